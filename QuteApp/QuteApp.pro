@@ -1,7 +1,7 @@
 # -------------------------------------------------
 # Project created by QtCreator 2010-10-16T20:41:09
 # -------------------------------------------------
-QT += xml
+QT += xml concurrent
 TEMPLATE = app
 TMPDIR = "build"
 
@@ -26,7 +26,9 @@ win32-g++:include (../qcs-win32.pro)
 rtmidi:DEFINES += QCS_RTMIDI
 INCLUDEPATH = ../src
 QCSPWD = "../src"
-SOURCES += "$${QCSPWD}/configlists.cpp" \
+SOURCES += "$${QCSPWD}/audiotaps.cpp" \
+    "$${QCSPWD}/completionindex.cpp" \
+    "$${QCSPWD}/configlists.cpp" \
     "$${QCSPWD}/console.cpp" \
     "$${QCSPWD}/csoundengine.cpp" \
     "$${QCSPWD}/csoundoptions.cpp" \
@@ -34,13 +36,17 @@ SOURCES += "$${QCSPWD}/configlists.cpp" \
     "$${QCSPWD}/dockhelp.cpp" \
     "$${QCSPWD}/basedocument.cpp" \
     "$${QCSPWD}/baseview.cpp" \
+    "$${QCSPWD}/documentmodel.cpp" \
     "$${QCSPWD}/documentview.cpp" \
+    "$${QCSPWD}/eventscheduler.cpp" \
     "$${QCSPWD}/findreplace.cpp" \
     "$${QCSPWD}/framewidget.cpp" \
     "$${QCSPWD}/highlighter.cpp" \ # "$${QCSPWD}/keyboardshortcuts.cpp" \
+    "$${QCSPWD}/liveevaluator.cpp" \
     "$${QCSPWD}/node.cpp" \
     "$${QCSPWD}/opentryparser.cpp" \
     "$${QCSPWD}/options.cpp" \
+    "$${QCSPWD}/outputlevels.cpp" \
     "$${QCSPWD}/qutebutton.cpp" \
     "$${QCSPWD}/qutecheckbox.cpp" \
     "$${QCSPWD}/qutecombobox.cpp" \
@@ -49,23 +55,30 @@ SOURCES += "$${QCSPWD}/configlists.cpp" \
     "$${QCSPWD}/qutegraph.cpp" \
     "$${QCSPWD}/quteknob.cpp" \
     "$${QCSPWD}/qutemeter.cpp" \
+    "$${QCSPWD}/qutemeterbank.cpp" \
     "$${QCSPWD}/qutescope.cpp" \
     "$${QCSPWD}/quteslider.cpp" \
     "$${QCSPWD}/qutespinbox.cpp" \
     "$${QCSPWD}/qutetext.cpp" \
     "$${QCSPWD}/qutewidget.cpp" \
+    "$${QCSPWD}/tablewatch.cpp" \
     "$${QCSPWD}/texteditor.cpp" \
+    "$${QCSPWD}/transportclock.cpp" \
     "$${QCSPWD}/widgetlayout.cpp" \
     "$${QCSPWD}/widgetpreset.cpp" \
     "$${QCSPWD}/scoreeditor.cpp" \
+    "$${QCSPWD}/scorestreamer.cpp" \
     "$${QCSPWD}/filebeditor.cpp" \
     "$${QCSPWD}/eventsheet.cpp" \
+    "$${QCSPWD}/eventsheetmodel.cpp" \
     "$${PWD}/main.cpp" \
 	"$${PWD}/quteapp.cpp" \
     "$${PWD}/simpledocument.cpp" \
     "$${PWD}/settingsdialog.cpp" \
     aboutwidget.cpp
-HEADERS += "$${QCSPWD}/configlists.h" \
+HEADERS += "$${QCSPWD}/audiotaps.h" \
+    "$${QCSPWD}/completionindex.h" \
+    "$${QCSPWD}/configlists.h" \
     "$${QCSPWD}/console.h" \
     "$${QCSPWD}/csoundengine.h" \
     "$${QCSPWD}/csoundoptions.h" \
@@ -73,13 +86,17 @@ HEADERS += "$${QCSPWD}/configlists.h" \
     "$${QCSPWD}/dockhelp.h" \
     "$${QCSPWD}/basedocument.h" \
     "$${QCSPWD}/baseview.h" \
+    "$${QCSPWD}/documentmodel.h" \
     "$${QCSPWD}/documentview.h" \
+    "$${QCSPWD}/eventscheduler.h" \
     "$${QCSPWD}/findreplace.h" \
     "$${QCSPWD}/framewidget.h" \
     "$${QCSPWD}/highlighter.h" \ # "$${QCSPWD}/keyboardshortcuts.h" \
+    "$${QCSPWD}/liveevaluator.h" \
     "$${QCSPWD}/node.h" \
     "$${QCSPWD}/opentryparser.h" \
     "$${QCSPWD}/options.h" \
+    "$${QCSPWD}/outputlevels.h" \
     "$${QCSPWD}/qutebutton.h" \
     "$${QCSPWD}/qutecheckbox.h" \
     "$${QCSPWD}/qutecombobox.h" \
@@ -88,17 +105,22 @@ HEADERS += "$${QCSPWD}/configlists.h" \
     "$${QCSPWD}/qutegraph.h" \
     "$${QCSPWD}/quteknob.h" \
     "$${QCSPWD}/qutemeter.h" \
+    "$${QCSPWD}/qutemeterbank.h" \
     "$${QCSPWD}/qutescope.h" \
     "$${QCSPWD}/quteslider.h" \
     "$${QCSPWD}/qutespinbox.h" \
     "$${QCSPWD}/qutetext.h" \
     "$${QCSPWD}/qutewidget.h" \
+    "$${QCSPWD}/tablewatch.h" \
     "$${QCSPWD}/texteditor.h" \
+    "$${QCSPWD}/transportclock.h" \
     "$${QCSPWD}/widgetlayout.h" \
     "$${QCSPWD}/widgetpreset.h" \
     "$${QCSPWD}/scoreeditor.h" \
+    "$${QCSPWD}/scorestreamer.h" \
     "$${QCSPWD}/filebeditor.h" \
     "$${QCSPWD}/eventsheet.h" \
+    "$${QCSPWD}/eventsheetmodel.h" \
 	"$${QCSPWD}/types.h" \
 	"$${PWD}/quteapp.h" \
     "$${PWD}/simpledocument.h" \
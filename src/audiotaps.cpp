@@ -0,0 +1,186 @@
+#include "audiotaps.h"
+
+#include <QDebug>
+
+AudioTap::AudioTap() :
+    m_isInput(false),
+    m_writePos(0),
+    m_channels(0),
+    m_subscribers(0),
+    m_released(-1),
+    m_source(nullptr),
+    m_retry(0)
+{
+}
+
+AudioTaps::AudioTaps() :
+    m_count(0),
+    m_subscribed(0),
+    m_passes(0),
+    m_csound(nullptr),
+    m_ksmps(0),
+    m_inputChannels(0),
+    m_scale(1.0)
+{
+}
+
+void AudioTaps::allocate(AudioTap &tap)
+{
+    int channels = tap.m_isInput ? qMax(m_inputChannels, 1) : 1;
+    tap.m_ring.assign((size_t) QCS_AUDIO_TAP_FRAMES * channels, 0.0);
+    tap.m_writePos.store(0, std::memory_order_relaxed);
+    tap.m_channels.store(0, std::memory_order_relaxed);
+    tap.m_source = nullptr;
+    tap.m_retry = 0;
+}
+
+void AudioTaps::reset(CSOUND *csound, int ksmps, int inputChannels, MYFLT zerodBFS)
+{
+    QMutexLocker locker(&m_mutex);
+    m_csound = csound;
+    m_ksmps = ksmps;
+    m_inputChannels = inputChannels;
+    m_scale = zerodBFS > 0 ? 1.0 / zerodBFS : 1.0;
+    // Unused taps at the end can go. Those in the middle are kept, readers
+    // hold pointers to the ones after them.
+    int count = m_count.load(std::memory_order_relaxed);
+    while (count > 0 && m_taps[count - 1].m_subscribers.load(std::memory_order_relaxed) == 0) {
+        count--;
+        m_taps[count].m_ring.clear();
+        m_taps[count].m_name.clear();
+    }
+    for (int i = 0; i < count; i++) {
+        allocate(m_taps[i]);
+        m_taps[i].m_released = -1;
+    }
+    m_count.store(count, std::memory_order_release);
+}
+
+void AudioTaps::stop()
+{
+    QMutexLocker locker(&m_mutex);
+    m_csound = nullptr;
+}
+
+bool AudioTaps::isFree(const AudioTap &tap) const
+{
+    if (tap.m_subscribers.load(std::memory_order_relaxed) > 0) {
+        return false;
+    }
+    // A pass running when the last subscriber left may still be copying
+    return m_csound == nullptr
+            || m_passes.load(std::memory_order_acquire) > tap.m_released;
+}
+
+AudioTap *AudioTaps::subscribe(const QString &name)
+{
+    QMutexLocker locker(&m_mutex);
+    int count = m_count.load(std::memory_order_relaxed);
+    for (int i = 0; i < count; i++) {
+        if (m_taps[i].m_name == name) {
+            m_taps[i].m_subscribers.fetch_add(1);
+            m_subscribed.fetch_add(1);
+            return &m_taps[i];
+        }
+    }
+    int index = 0;
+    while (index < count && !isFree(m_taps[index])) {
+        index++;
+    }
+    if (index == QCS_MAX_AUDIO_TAPS) {
+        qDebug() << "AudioTaps::subscribe no free tap for" << name;
+        return nullptr;
+    }
+    // The performance thread doesn't look at this slot until m_count is
+    // published or it has subscribers, so it can be set up without further
+    // care
+    AudioTap &tap = m_taps[index];
+    tap.m_name = name;
+    tap.m_latinName = name.toLatin1();
+    tap.m_isInput = name == "_In";
+    allocate(tap);
+    tap.m_subscribers.store(1, std::memory_order_release);
+    if (index == count) {
+        m_count.store(count + 1, std::memory_order_release);
+    }
+    m_subscribed.fetch_add(1);
+    return &tap;
+}
+
+void AudioTaps::unsubscribe(AudioTap *tap)
+{
+    if (tap == nullptr) {
+        return;
+    }
+    QMutexLocker locker(&m_mutex);
+    if (tap->m_subscribers.load() > 0) {
+        if (tap->m_subscribers.fetch_sub(1) == 1) {
+            tap->m_released = m_passes.load(std::memory_order_acquire);
+        }
+        m_subscribed.fetch_sub(1);
+    }
+}
+
+bool AudioTaps::resolve(AudioTap &tap)
+{
+    if (m_csound == nullptr) {
+        return false;
+    }
+    MYFLT *source = nullptr;
+    if (tap.m_isInput) {
+        source = csoundGetSpin(m_csound);
+    } else {
+        // The channel may only be created later by chnset, so look for it
+        // every few passes instead of creating it here
+        if (tap.m_retry-- > 0) {
+            return false;
+        }
+        tap.m_retry = 64;
+        int type = csoundGetChannelPtr(m_csound, &source, tap.m_latinName.constData(), 0);
+        if (type <= 0 || (type & CSOUND_CHANNEL_TYPE_MASK) != CSOUND_AUDIO_CHANNEL) {
+            return false;
+        }
+        if (csoundGetChannelPtr(m_csound, &source, tap.m_latinName.constData(),
+                                CSOUND_AUDIO_CHANNEL) != CSOUND_SUCCESS) {
+            return false;
+        }
+    }
+    if (source == nullptr) {
+        return false;
+    }
+    tap.m_source = source;
+    tap.m_channels.store((int) (tap.m_ring.size() / QCS_AUDIO_TAP_FRAMES),
+                         std::memory_order_release);
+    return true;
+}
+
+void AudioTaps::process()
+{
+    if (m_subscribed.load(std::memory_order_relaxed) == 0) {
+        m_passes.fetch_add(1, std::memory_order_release);
+        return;
+    }
+    const int count = m_count.load(std::memory_order_acquire);
+    for (int i = 0; i < count; i++) {
+        AudioTap &tap = m_taps[i];
+        if (tap.m_subscribers.load(std::memory_order_acquire) == 0) {
+            continue;
+        }
+        if (tap.m_source == nullptr && !resolve(tap)) {
+            continue;
+        }
+        const long numSamples = (long) m_ksmps * tap.m_channels.load(std::memory_order_relaxed);
+        const long size = (long) tap.m_ring.size();
+        const MYFLT *source = tap.m_source;
+        MYFLT *ring = tap.m_ring.data();
+        long pos = tap.m_writePos.load(std::memory_order_relaxed);
+        for (long n = 0; n < numSamples; n++) {
+            ring[pos] = source[n] * m_scale;
+            if (++pos == size) {
+                pos = 0;
+            }
+        }
+        tap.m_writePos.store(pos, std::memory_order_release);
+    }
+    m_passes.fetch_add(1, std::memory_order_release);
+}
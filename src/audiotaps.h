@@ -0,0 +1,80 @@
+#ifndef AUDIOTAPS_H
+#define AUDIOTAPS_H
+
+#include <atomic>
+#include <vector>
+
+#include <QMutex>
+#include <QString>
+
+#include "types.h"
+
+#define QCS_MAX_AUDIO_TAPS 16
+// Length of each tap's ring in frames
+#define QCS_AUDIO_TAP_FRAMES 8192
+
+// A copy of an audio signal other than the final mix, for scopes and
+// analysers. The source is the input buffer (name "_In") or an a-rate
+// channel written with chnset or declared with chn_a.
+// The performance thread is the only writer. Readers take writePos() and
+// read backwards from it; there are no locks, so a reader that falls a whole
+// ring behind sees newer samples, which is harmless for a display.
+class AudioTap
+{
+public:
+    AudioTap();
+    QString name() const { return m_name; }
+    int channels() const { return m_channels.load(std::memory_order_acquire); }  // 0 until the source is found
+    long size() const { return (long) m_ring.size(); }  // In samples
+    const MYFLT *data() const { return m_ring.data(); }
+    long writePos() const { return m_writePos.load(std::memory_order_acquire); }  // In samples, < size()
+
+private:
+    friend class AudioTaps;
+    QString m_name;
+    QByteArray m_latinName;
+    bool m_isInput;
+    std::vector<MYFLT> m_ring;
+    std::atomic<long> m_writePos;
+    std::atomic<int> m_channels;
+    std::atomic<int> m_subscribers;
+    qint64 m_released;  // Passes counted when the last subscriber left, under the mutex
+    // Only touched by the performance thread while running
+    MYFLT *m_source;
+    int m_retry;
+};
+
+// The set of taps for one engine. Taps are created the first time a name is
+// subscribed. A tap that has lost its subscribers is reused for another
+// name once the performance thread has finished a pass without it, so the
+// thread never sees one change under it. Nothing is copied for taps
+// without subscribers.
+class AudioTaps
+{
+public:
+    AudioTaps();
+
+    // Must be called before the performance thread starts
+    void reset(CSOUND *csound, int ksmps, int inputChannels, MYFLT zerodBFS);
+    void stop();  // After the performance thread has stopped
+    AudioTap *subscribe(const QString &name);  // nullptr if all taps are in use
+    void unsubscribe(AudioTap *tap);
+    void process();  // From csThread, once per control pass
+
+private:
+    bool resolve(AudioTap &tap);
+    bool isFree(const AudioTap &tap) const;
+    void allocate(AudioTap &tap);
+
+    AudioTap m_taps[QCS_MAX_AUDIO_TAPS];
+    std::atomic<int> m_count;  // Taps in use, published after they are set up
+    std::atomic<int> m_subscribed;  // Total subscribers, to skip everything when 0
+    std::atomic<qint64> m_passes;  // Control passes finished by process()
+    CSOUND *m_csound;
+    int m_ksmps;
+    int m_inputChannels;
+    MYFLT m_scale;
+    QMutex m_mutex;  // Serializes subscribe, unsubscribe and reset
+};
+
+#endif // AUDIOTAPS_H
@@ -27,6 +27,7 @@
 #include "csoundengine.h"
 #include "qutecsound.h"
 #include "qutebutton.h"
+#include "qutescope.h"
 #include "console.h"
 
 
@@ -58,6 +59,15 @@ BaseDocument::~BaseDocument()
 	disconnect(m_csEngine, 0,0,0);
 	//  disconnect(m_widgetLayout, 0,0,0);
     m_csEngine->stop();
+	// Scopes outlive the engine here, but their audio taps go with it
+	foreach (WidgetLayout *wl, m_widgetLayouts) {
+		foreach (QuteWidget *widget, wl->getWidgets()) {
+			QuteScope *scope = qobject_cast<QuteScope *>(widget);
+			if (scope != nullptr) {
+				scope->setUd(nullptr);
+			}
+		}
+	}
     delete m_csEngine;
 	while (!m_widgetLayouts.isEmpty()) {
 		WidgetLayout *wl = m_widgetLayouts.takeLast();
@@ -156,6 +166,8 @@ WidgetLayout* BaseDocument::newWidgetLayout()
 	WidgetLayout* wl = new WidgetLayout(0);
     wl->setWindowFlags(Qt::Window | wl->windowFlags());
 	connect(wl, SIGNAL(queueEventSignal(QString)),this,SLOT(queueEvent(QString)));
+	connect(wl, SIGNAL(queueScheduledEventSignal(ScheduledEvent)),
+			this, SLOT(queueEvent(ScheduledEvent)));
 	connect(wl, SIGNAL(registerButton(QuteButton*)),
 			this, SLOT(registerButton(QuteButton*)));
 	return wl;
@@ -331,9 +343,14 @@ void BaseDocument::stopRecording()
 	m_csEngine->stopRecording();
 }
 
-void BaseDocument::queueEvent(QString eventLine, int delay)
+void BaseDocument::queueEvent(QString eventLine, double delay)
+{
+	m_csEngine->queueEvent(eventLine, delay);
+}
+
+void BaseDocument::queueEvent(const ScheduledEvent &event, double delay)
 {
-	m_csEngine->queueEvent(eventLine, delay);  //TODO  implement passing of timestamp
+	m_csEngine->queueEvent(event, delay);
 }
 
 void BaseDocument::loadTextString(QString &text)
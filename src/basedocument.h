@@ -25,6 +25,7 @@
 
 #include "types.h"
 #include "csoundoptions.h"
+#include "eventscheduler.h"
 #include <QWidget>
 #include <QThread>
 
@@ -80,7 +81,8 @@ public slots:
 	void stopRecording();
 	//    void playParent(); // Triggered from button, ask parent for options
 	//    void renderParent();
-	void queueEvent(QString line, int delay = 0);
+	void queueEvent(QString line, double delay = 0);  // delay in seconds
+	void queueEvent(const ScheduledEvent &event, double delay = 0);
 	virtual void registerButton(QuteButton *button) = 0;
 protected:
 	virtual void init(QWidget *parent, OpEntryParser *opcodeTree) = 0;
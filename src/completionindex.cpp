@@ -0,0 +1,159 @@
+#include "completionindex.h"
+
+#include <algorithm>
+
+// Characters of name spanned by the letters of typed in order, -1 if they
+// are not all there. Both are lower case and start with the same letter.
+static int subsequenceSpread(const QString &name, const QString &typed)
+{
+    int j = 1;
+    for (int i = 1; i < name.size(); i++) {
+        if (j == typed.size()) {
+            return i;
+        }
+        if (name[i] == typed[j]) {
+            j++;
+        }
+    }
+    return j == typed.size() ? name.size() : -1;
+}
+
+static bool betterMatch(const CompletionIndex::Match &a, const CompletionIndex::Match &b)
+{
+    if (a.weight != b.weight) {
+        return a.weight > b.weight;
+    }
+    if (a.spread != b.spread) {
+        return a.spread < b.spread;
+    }
+    if (a.name.size() != b.name.size()) {
+        return a.name.size() < b.name.size();
+    }
+    if (a.name != b.name) {
+        return a.name < b.name;
+    }
+    return a.id < b.id;
+}
+
+void CompletionIndex::clear()
+{
+    m_entries.clear();
+}
+
+void CompletionIndex::reserve(int size)
+{
+    m_entries.reserve(size);
+}
+
+void CompletionIndex::add(const QString &name, int id, int weight)
+{
+    if (name.isEmpty()) {
+        return;
+    }
+    Entry entry;
+    entry.folded = name.toLower();
+    entry.name = name;
+    entry.id = id;
+    entry.weight = weight;
+    m_entries.append(entry);
+}
+
+void CompletionIndex::build()
+{
+    // Stable, so entries with the same name keep the order they were added in
+    std::stable_sort(m_entries.begin(), m_entries.end(),
+                     [](const Entry &a, const Entry &b) { return a.folded < b.folded; });
+}
+
+void CompletionIndex::addWeight(const QString &name, int delta)
+{
+    if (name.isEmpty()) {
+        return;
+    }
+    const QString folded = name.toLower();
+    const int first = lowerBound(folded);
+    for (int i = first; i < m_entries.size() && m_entries[i].folded == folded; i++) {
+        if (m_entries[i].name == name) {
+            m_entries[i].weight += delta;
+            if (m_entries[i].weight <= 0) {
+                m_entries.remove(i);
+            }
+            return;
+        }
+    }
+    if (delta > 0) {
+        Entry entry;
+        entry.folded = folded;
+        entry.name = name;
+        entry.id = 0;
+        entry.weight = delta;
+        m_entries.insert(first, entry);
+    }
+}
+
+int CompletionIndex::lowerBound(const QString &folded) const
+{
+    auto it = std::lower_bound(m_entries.constBegin(), m_entries.constEnd(), folded,
+                               [](const Entry &entry, const QString &key) {
+        return entry.folded < key;
+    });
+    return int(it - m_entries.constBegin());
+}
+
+int CompletionIndex::weightOf(const QString &name) const
+{
+    const QString folded = name.toLower();
+    for (int i = lowerBound(folded); i < m_entries.size() && m_entries[i].folded == folded; i++) {
+        if (m_entries[i].name == name) {
+            return m_entries[i].weight;
+        }
+    }
+    return 0;
+}
+
+QVector<CompletionIndex::Match> CompletionIndex::complete(const QString &typed,
+                                                          const CompletionIndex *usage,
+                                                          int maxFuzzy) const
+{
+    QVector<Match> matches;
+    QVector<Match> fuzzyMatches;
+    if (typed.isEmpty()) {
+        return matches;
+    }
+    const QString folded = typed.toLower();
+    // Prefix matches are a range inside the range of the first letter, so
+    // only walk the latter when fuzzy matches are wanted
+    int i = maxFuzzy > 0 ? lowerBound(QString(folded[0])) : lowerBound(folded);
+    for (; i < m_entries.size(); i++) {
+        const Entry &entry = m_entries[i];
+        if (entry.folded[0] != folded[0]) {
+            break;
+        }
+        int spread = 0;
+        if (!entry.folded.startsWith(folded)) {
+            if (maxFuzzy <= 0) {
+                break;
+            }
+            spread = subsequenceSpread(entry.folded, folded);
+            if (spread < 0) {
+                continue;
+            }
+        }
+        Match match;
+        match.name = entry.name;
+        match.id = entry.id;
+        match.weight = entry.weight + (usage != nullptr ? usage->weightOf(entry.name) : 0);
+        match.spread = spread;
+        if (spread == 0) {
+            matches.append(match);
+        } else {
+            fuzzyMatches.append(match);
+        }
+    }
+    std::sort(matches.begin(), matches.end(), betterMatch);
+    std::sort(fuzzyMatches.begin(), fuzzyMatches.end(), betterMatch);
+    for (int j = 0; j < fuzzyMatches.size() && j < maxFuzzy; j++) {
+        matches.append(fuzzyMatches[j]);
+    }
+    return matches;
+}
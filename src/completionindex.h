@@ -0,0 +1,54 @@
+#ifndef COMPLETIONINDEX_H
+#define COMPLETIONINDEX_H
+
+#include <QString>
+#include <QVector>
+
+// Names sorted without case, for autocompletion. The names starting with a
+// typed word are one range of the array, found by binary search. Fuzzy
+// matches (the typed letters in order, starting with the same letter) are
+// only looked for within the range of the first letter, so a search never
+// walks the whole index. Once built an index is only read, so it can be
+// shared between threads.
+class CompletionIndex
+{
+public:
+    struct Match {
+        QString name;
+        int id;       // As given to add()
+        int weight;   // Including usage
+        int spread;   // Characters spanned by the typed letters, 0 for prefix matches
+    };
+
+    void clear();
+    void reserve(int size);
+    // Higher weights are listed first. Call build() after the last add()
+    void add(const QString &name, int id, int weight = 0);
+    void build();
+    // Adds delta to the weight of name, inserting it if needed and removing
+    // it when the weight drops to 0, for indexes that count uses. Keeps the
+    // index sorted, so build() is not needed after it
+    void addWeight(const QString &name, int delta);
+    int size() const { return m_entries.size(); }
+    bool isEmpty() const { return m_entries.isEmpty(); }
+    int weightOf(const QString &name) const;  // 0 if name is not in the index
+
+    // Names starting with typed, then at most maxFuzzy fuzzy matches, best
+    // first in each group. If usage is given, the weight a name has there
+    // (e.g. how often the document uses it) is added to its own.
+    QVector<Match> complete(const QString &typed, const CompletionIndex *usage = nullptr,
+                            int maxFuzzy = 8) const;
+
+private:
+    struct Entry {
+        QString folded;  // Lower case, the sort key
+        QString name;
+        int id;
+        int weight;
+    };
+    int lowerBound(const QString &folded) const;
+
+    QVector<Entry> m_entries;
+};
+
+#endif // COMPLETIONINDEX_H
@@ -298,6 +298,7 @@ ConfigDialog::ConfigDialog(CsoundQt *parent, Options *options, ConfigLists *conf
 
     realtimeCheckBox->setChecked(m_options->realtimeFlag);
     sampleAccurateCheckBox->setChecked(m_options->sampleAccurateFlag);
+    streamScoreCheckBox->setChecked(m_options->streamScore);
 
     //limiter
     bool limiterAvailable = csoundGetVersion()>=6160;
@@ -582,6 +583,7 @@ void ConfigDialog::accept()
     m_options->numInputChannels = numInputChannelsSpinBox->value();
     m_options->realtimeFlag = realtimeCheckBox->isChecked();
     m_options->sampleAccurateFlag = sampleAccurateCheckBox->isChecked();
+    m_options->streamScore = streamScoreCheckBox->isChecked();
 
 
 	m_options->rtMidiModule = RtMidiModuleComboBox->currentText();
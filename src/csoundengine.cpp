@@ -24,6 +24,8 @@
 #include <QtConcurrent>
 #include <QThread>
 
+#include <cmath>
+
 #ifdef Q_OS_WIN
 #include <ole2.h> // for OleInitialize() FLTK bug workaround
 #endif
@@ -40,7 +42,8 @@
 // #define QDEBUG qDebug() << __FUNCTION__ << ":"
 
 CsoundEngine::CsoundEngine(ConfigLists *configlists) :
-    m_options(configlists)
+    m_options(configlists),
+    m_liveEvaluator(this)
 {
     QMutexLocker locker(&m_playMutex);
     ud = new CsoundUserData();
@@ -49,6 +52,9 @@ CsoundEngine::CsoundEngine(ConfigLists *configlists) :
     ud->perfThread = nullptr;
     ud->flags = QCS_NO_FLAGS;
     ud->mouseValues.resize(6); // For _MouseX _MouseY _MouseRelX _MouseRelY _MouseBut1 and _MouseBut2 channels
+    for (int i = 0; i < TransportClock::ChannelCount; i++) {
+        ud->transportChannels[i] = nullptr;
+    }
     ud->wl = nullptr;
     ud->midiBuffer = nullptr;
     ud->virtualMidiBuffer = nullptr;
@@ -63,9 +69,6 @@ CsoundEngine::CsoundEngine(ConfigLists *configlists) :
     ud->midiBuffer = csoundCreateCircularBuffer(ud->csound, 1024, sizeof(unsigned char));
     Q_ASSERT(ud->midiBuffer);
 #endif
-    eventQueue.resize(QCS_MAX_EVENTS);
-    eventTimeStamps.resize(QCS_MAX_EVENTS);
-    eventQueueSize = 0;
     m_refreshTime = QCS_QUEUETIMER_DEFAULT_TIME;  // TODO Eventually allow this to be changed
     ud->msgRefreshTime = m_refreshTime*1000;
     ud->runDispatcher = true;
@@ -151,6 +154,28 @@ void CsoundEngine::inputValueCallback (CSOUND *csound,
                 *value = (MYFLT) ud->mouseValues[5];
             }
         }
+        else if(!strncmp(channelName, "_Transport", 10)) {
+            int channel = TransportClock::channelForName(channelName);
+            if (channel >= 0) {
+                double values[TransportClock::ChannelCount];
+                ud->transport.channelValues(ud->transport.position(), values);
+                *value = (MYFLT) values[channel];
+            } else {
+                *value = (MYFLT) ud->wl->getValueForChannel(channelName);
+            }
+        }
+        else if(!strncmp(channelName, "_Out", 4)) {
+            OutputLevels::Kind kind;
+            int channel;
+            if (OutputLevels::parseChannelName(channelName, &kind, &channel)) {
+                if (!ud->outputLevels.isEnabled() || kind == OutputLevels::TruePeak) {
+                    ud->outputLevels.setEnabled(true, kind == OutputLevels::TruePeak);
+                }
+                *value = (MYFLT) ud->outputLevels.value(kind, channel);
+            } else {
+                *value = (MYFLT) ud->wl->getValueForChannel(channelName);
+            }
+        }
         else {
             // QString name(channelName);
             *value = (MYFLT) ud->wl->getValueForChannel(channelName);
@@ -315,6 +340,14 @@ int CsoundEngine::keyEventCallback(void *userData,
 void CsoundEngine::csThread(void *data)
 {
     CsoundUserData* udata = (CsoundUserData*)data;
+    udata->transport.setPosition(csoundGetCurrentTimeSamples(udata->csound));
+    double transportValues[TransportClock::ChannelCount];
+    udata->transport.channelValues(udata->transport.position(), transportValues);
+    for (int i = 0; i < TransportClock::ChannelCount; i++) {
+        if (udata->transportChannels[i] != nullptr) {
+            *udata->transportChannels[i] = (MYFLT) transportValues[i];
+        }
+    }
     if (!(udata->flags & QCS_NO_COPY_BUFFER)) {
         MYFLT *outputBuffer = csoundGetSpout(udata->csound);
         // outputBufferSize == ksmps
@@ -325,6 +358,9 @@ void CsoundEngine::csThread(void *data)
         //     udata->audioOutputBuffer.put(outputBuffer[i]/ udata->zerodBFS);
         // }
     }
+    udata->outputLevels.process(csoundGetSpout(udata->csound),
+                                udata->outputBufferSize, 1.0/udata->zerodBFS);
+    udata->audioTaps.process();
     //  udata->wl->getValues(&udata->channelNames,
     //                       &udata->values,
     //                       &udata->stringValues);
@@ -334,7 +370,7 @@ void CsoundEngine::csThread(void *data)
         readWidgetValues(udata);
     }
     if (!(udata->flags & QCS_NO_RT_EVENTS)) {
-        udata->csEngine->processEventQueue();
+        udata->scheduler.process(udata->csound, udata->transport, udata->outputBufferSize);
     }
 #ifdef QCS_PYTHONQT
     if (!(udata->flags & QCS_NO_PYTHON_CALLBACK)) {
@@ -413,6 +449,7 @@ void CsoundEngine::writeWidgetValues(CsoundUserData *ud)
 void CsoundEngine::setWidgetLayout(WidgetLayout *wl)
 {
     ud->wl = wl;
+    wl->setOutputLevels(&ud->outputLevels);
     //  connect(wl, SIGNAL(destroyed()), this, SLOT(widgetLayoutDestroyed()));
     // Key presses on widget layout and console are passed to the engine
 	connect(wl, SIGNAL(keyPressed(int)),
@@ -529,14 +566,23 @@ void CsoundEngine::registerGraph(QuteGraph *graph)
     graph->setUd(ud);
 }
 
-void CsoundEngine::evaluate(QString code)
+void CsoundEngine::evaluate(QString code, double quantum, QString name)
 {
     CSOUND *csound = getCsound();
-    if (csound) {
-        csoundCompileOrc(csound, code.toLatin1());
+    if (m_liveEvaluator.evaluate(code, quantum, name)) {
+        return;  // Reports when applied
+    }
+    if (csound) {  // Without a performance thread
+        int result = csoundCompileOrc(csound, code.toLatin1());
         queueMessage(tr("Csound code evaluated.\n"));
+        if (!name.isEmpty()) {
+            emit evaluated(name, result == CSOUND_SUCCESS);
+        }
     } else {
         queueMessage(tr("Csound is not running. Code not evaluated."));
+        if (!name.isEmpty()) {
+            emit evaluated(name, false);
+        }
     }
 }
 
@@ -571,33 +617,6 @@ int CsoundEngine::popKeyReleaseEvent()
     return value;
 }
 
-void CsoundEngine::processEventQueue()
-{
-    // This function should only be called when Csound is running
-    eventMutex.lock();
-    while (eventQueueSize > 0) {
-        eventQueueSize--;
-        m_playMutex.lock();
-#ifdef QCS_DESTROY_CSOUND
-        if (ud->perfThread) {
-            //ScoreEvent is not working
-            //      ud->perfThread->ScoreEvent(0, type, eventElements.size(), pFields);
-            //      qDebug()  << eventQueue[eventQueueSize];
-            ud->perfThread->InputMessage(eventQueue[eventQueueSize].toLatin1());
-        }
-        else {
-            QDEBUG << "WARNING: ud->perfThread is NULL";
-        }
-#else
-        if (ud->perfThread) {
-            ud->perfThread->InputMessage(eventQueue[eventQueueSize].toLatin1());
-        }
-#endif
-        m_playMutex.unlock();
-    }
-    eventMutex.unlock();
-}
-
 void CsoundEngine::passOutValue(QString channelName, double value)
 {
     ud->wl->newValue(QPair<QString, double>(channelName, value));
@@ -686,27 +705,66 @@ void CsoundEngine::stopRecording()
 #endif
 }
 
-void CsoundEngine::queueEvent(QString eventLine, int delay)
+void CsoundEngine::queueEvent(QString eventLine, double delay)
 {
-    // TODO: implement delayed events
-    (void) delay;
     //   qDebug("CsoundEngine::queueEvent %s", eventLine.toStdString().c_str());
+    queueEvent(ScheduledEvent::fromLine(eventLine), delay);
+}
+
+void CsoundEngine::queueEvent(const ScheduledEvent &event, double delay)
+{
+    const TransportClock &clock = ud->transport;
+    queueEventAt(event, clock.position() + llround(qMax(delay, 0.0) * clock.sampleRate()));
+}
+
+void CsoundEngine::queueEventAt(const ScheduledEvent &event, qint64 sample)
+{
     if (!isRunning()) {
         QMutexLocker lock(&m_messageMutex);
         messageQueue << tr("Csound is not running! Event ignored.\n");
         return;
     }
-    if (eventQueueSize < QCS_MAX_EVENTS) {
-        eventMutex.lock();
-        eventQueue[eventQueueSize] = eventLine;
-        eventQueueSize++;
-        eventMutex.unlock();
-    }
-    else {
+    if (!ud->scheduler.schedule(this, event, sample)) {
         qDebug("Warning: event queue full, event not processed");
     }
 }
 
+void CsoundEngine::queueEventAtBeat(QString eventLine, double beat)
+{
+    qint64 sample = ud->transport.sampleAt(beat);
+    if (sample < 0) {
+        QMutexLocker lock(&m_messageMutex);
+        messageQueue << tr("Transport stopped! Event ignored.\n");
+        return;
+    }
+    queueEventAt(ScheduledEvent::fromLine(eventLine), sample);
+}
+
+void CsoundEngine::startTransport()
+{
+    ud->transport.start();
+}
+
+void CsoundEngine::stopTransport()
+{
+    ud->transport.stop();
+}
+
+void CsoundEngine::locateTransport(double beat)
+{
+    ud->transport.locate(beat);
+}
+
+void CsoundEngine::setTransportTempo(double tempo, double beat)
+{
+    ud->transport.setTempo(tempo, beat);
+}
+
+void CsoundEngine::setTransportBeatsPerBar(int beats)
+{
+    ud->transport.setBeatsPerBar(beats);
+}
+
 int CsoundEngine::checkSyntax() {
     QDEBUG << "$$$ checkSyntax 0";
     QMutexLocker locker(&m_playMutex);
@@ -718,7 +776,6 @@ int CsoundEngine::checkSyntax() {
     ud->csound = csoundCreate((void *) ud);
     QDEBUG << "$$$ checkSyntax 2";
 
-    eventQueueSize = 0;
     ud->msgRefreshTime = m_refreshTime*1000;
     QDir::setCurrent(m_options.fileName1);
     for (int i = 0; i < consoles.size(); i++) {
@@ -772,8 +829,6 @@ int CsoundEngine::runCsound()
     // OleInitialize(NULL); // Do not initialize here but in CsoundQt onbject
     // OleInitialize(NULL);
 #endif
-    eventQueueSize = 0;
-    // Flush events gathered while idle.
     ud->audioOutputBuffer.allZero();
     ud->msgRefreshTime = m_refreshTime*1000;
     QDir::setCurrent(m_options.fileName1);
@@ -895,10 +950,26 @@ int CsoundEngine::runCsound()
         }
     }
 
+    ud->tableWatch.setCsound(ud->csound);
     ud->zerodBFS = csoundGet0dBFS(ud->csound);
     ud->sampleRate = csoundGetSr(ud->csound);
     ud->numChnls = csoundGetNchnls(ud->csound);
     ud->outputBufferSize = csoundGetKsmps(ud->csound);
+    ud->outputLevels.reset(ud->numChnls, ud->sampleRate, ud->outputBufferSize);
+    ud->audioTaps.reset(ud->csound, ud->outputBufferSize,
+                        csoundGetNchnlsInput(ud->csound), ud->zerodBFS);
+    ud->transport.reset(ud->sampleRate);
+    for (int i = 0; i < TransportClock::ChannelCount; i++) {
+        MYFLT *pvalue;
+        const char *name = TransportClock::channelName((TransportClock::Channel) i);
+        if (csoundGetChannelPtr(ud->csound, &pvalue, name,
+                                CSOUND_CONTROL_CHANNEL | CSOUND_INPUT_CHANNEL | CSOUND_OUTPUT_CHANNEL) == 0) {
+            ud->transportChannels[i] = pvalue;
+        } else {
+            ud->transportChannels[i] = nullptr;
+        }
+    }
+    ud->scheduler.reset();
     if (ud->enableWidgets) {
         setupChannels();
     }
@@ -909,6 +980,10 @@ int CsoundEngine::runCsound()
         ud->perfThread->SetProcessCallback(CsoundEngine::csThread, (void*)ud);
         ud->perfThread->Play();
 		m_paused = false;
+		m_liveEvaluator.start(ud->csound, &ud->transport);
+		if (!m_options.streamedScore.isEmpty()) {
+			m_scoreStreamer.start(m_options.streamedScore, ud->perfThread, &ud->transport);
+		}
     }
     ud->audioOutputBuffer.resize(ud->numChnls * 2048);
     return 0;
@@ -924,6 +999,8 @@ void CsoundEngine::stopCsound()
 
     CsoundPerformanceThread *pt = ud->perfThread;
 
+    m_scoreStreamer.stop();
+    m_liveEvaluator.stop();
     pt->Stop();
 	m_paused = false;
 
@@ -954,6 +1031,7 @@ void CsoundEngine::stopCsound()
         csoundMutex.lock();
         pt->SetProcessCallback(nullptr, nullptr);
         QThread::msleep(200);
+        releaseTables();
         QDEBUG << "Destroying csound...";
         // delete pt;
         csoundDestroy(ud->csound);
@@ -1002,6 +1080,8 @@ void CsoundEngine::cleanupCsound()
         return;
     }
     QMutexLocker locker(&csoundMutex);
+    releaseTables();
+    ud->audioTaps.stop();
     csoundSetIsGraphable(ud->csound, 0);
     csoundSetMakeGraphCallback(ud->csound, nullptr);
     csoundSetDrawGraphCallback(ud->csound, nullptr);
@@ -1030,6 +1110,12 @@ void CsoundEngine::cleanupCsound()
 #endif
 }
 
+void CsoundEngine::releaseTables()
+{
+    // Table memory is freed with the csound instance
+    ud->tableWatch.setCsound(nullptr);
+}
+
 void CsoundEngine::setupChannels()
 {
     ud->inputChannelNames.clear();
@@ -1046,6 +1132,22 @@ void CsoundEngine::setupChannels()
 
     MYFLT *pvalue;
     QVector<QuteWidget *> widgets = ud->wl->getWidgets();
+    // Output levels are only computed if a widget listens to them
+    bool levels = false;
+    bool truePeak = false;
+    foreach (QuteWidget *w, widgets) {
+        OutputLevels::Kind kind;
+        int channel;
+        foreach (QString name, QStringList() << w->getChannelName() << w->getChannel2Name()) {
+            QByteArray latin = name.toLatin1();
+            if (OutputLevels::parseChannelName(latin.constData(), &kind, &channel)
+                    || OutputLevels::parseKindName(latin.constData(), &kind)) {
+                levels = true;
+                truePeak = truePeak || kind == OutputLevels::TruePeak;
+            }
+        }
+    }
+    ud->outputLevels.setEnabled(levels, truePeak);
     // Set channels values for existing channels (i.e. those declared with chn_*
     // in the csound header
     for (int i = 0; i < numChannels; i++) {
@@ -38,6 +38,13 @@
 
 #include "types.h"
 #include "csoundoptions.h"
+#include "tablewatch.h"
+#include "outputlevels.h"
+#include "audiotaps.h"
+#include "eventscheduler.h"
+#include "transportclock.h"
+#include "scorestreamer.h"
+#include "liveevaluator.h"
 #ifdef QCS_PYTHONQT
 #include "pythonconsole.h"
 #endif
@@ -76,6 +83,12 @@ struct CsoundUserData {
 	bool runDispatcher;
 	QVector<double> mouseValues;
 	RingBuffer audioOutputBuffer;
+	TableWatch tableWatch; // Direct access to f-tables for display widgets
+	OutputLevels outputLevels; // For _OutPeakN, _OutRmsN and _OutTruePeakN channels
+	AudioTaps audioTaps; // Input and a-rate channels copied for scopes
+	TransportClock transport; // Engine position in samples, shared by everything that plays in time
+	MYFLT *transportChannels[TransportClock::ChannelCount]; // For chnget, written every pass
+	EventScheduler scheduler; // Live events from sheets, widgets, the console and Python
 	bool enableWidgets; // Whether widget values are processed in the callback
 
 	/* current configuration */
@@ -160,7 +173,6 @@ public:
 	int popKeyPressEvent();
 	int popKeyReleaseEvent();
 
-	void processEventQueue();
 	void passOutValue(QString channelName, double value);
 	void passOutString(QString channelName, QString value);
 	void flushQueues();
@@ -173,6 +185,7 @@ public:
 	// To pass to parent document for access from python scripting
 	CSOUND * getCsound();
     CsoundUserData *getUserData();
+	EventScheduler *getEventScheduler() { return &ud->scheduler; }
     void clearConsoles(void);
 #ifdef QCS_PYTHONQT
 	void registerProcessCallback(QString func, int skipPeriods);
@@ -209,7 +222,17 @@ public slots:
 	void pause();
 	int startRecording(int format, QString filename);
 	void stopRecording();
-	void queueEvent(QString eventLine, int delay = 0);
+	void queueEvent(QString eventLine, double delay = 0);  // delay in seconds
+	void queueEvent(const ScheduledEvent &event, double delay = 0);  // Already parsed
+	void queueEventAt(const ScheduledEvent &event, qint64 sample);  // Engine sample, see getTransport()
+	void queueEventAtBeat(QString eventLine, double beat);  // Ignored while the transport is stopped
+	// The transport is changed from the GUI thread only. Callers on other
+	// threads queue these
+	void startTransport();
+	void stopTransport();
+	void locateTransport(double beat);
+	void setTransportTempo(double tempo, double beat = -1);
+	void setTransportBeatsPerBar(int beats);
 	void keyPressForCsound(int key);  // For key press events from consoles and widget panel
 	void keyReleaseForCsound(int key);
 
@@ -219,9 +242,12 @@ public slots:
     void requestCsoundUserData(QuteWidget *widget);
 	void setFlags(PerfFlags flags) {ud->flags = flags;}
 
-	void evaluate(QString code);
+	// quantum in transport beats, see LiveEvaluator. A name reports what
+	// was replaced and its compile time
+	void evaluate(QString code, double quantum = 0, QString name = QString());
 
 public:
+	TransportClock &getTransport() { return ud->transport; }
     QVector<ConsoleWidget *> consoles;  // Consoles registered for message printing
     int runCsound();
 	void stopCsound();
@@ -230,6 +256,7 @@ public:
 
 private:
 	void setupChannels();
+	void releaseTables();
 	QList <int> getAnsiKeySequence(int key);
 
 	QFuture<void> m_msgUpdateThread;
@@ -238,6 +265,8 @@ private:
 	CsoundUserData *ud;
 
 	CsoundOptions m_options;
+	ScoreStreamer m_scoreStreamer;  // Feeds m_options.streamedScore while running
+	LiveEvaluator m_liveEvaluator;
 
 	int m_consoleBufferSize;
 	QMutex m_messageMutex; // Protection for message queue
@@ -250,12 +279,8 @@ private:
 	bool m_paused;
     // To prevent from starting a Csound instance while another is starting or closing
     QMutex m_playMutex;
-	QMutex eventMutex;
     QMutex csoundMutex;
-	QVector<QString> eventQueue;
 	int m_refreshTime; // time in milliseconds for widget value updates (both input and output)
-	QVector<unsigned long> eventTimeStamps;
-	int eventQueueSize;
 
 private slots:
 
@@ -264,6 +289,7 @@ signals:
 	void passMessages(QString msg);
 	void stopSignal(); // Sent when performance has stopped internally to inform others.playFromParent()
 	void breakpointReached();
+	void evaluated(QString name, bool success); // For named evaluations, once compiled or rejected
 };
 
 #endif // CSOUNDENGINE_H
@@ -46,6 +46,7 @@ CsoundOptions::CsoundOptions(ConfigLists *configlists) :
 	numThreads = 1;
     realtimeFlag = false;
     sampleAccurateFlag = false;
+	streamScore = false;
 	additionalFlags = "";
 	additionalFlagsActive = false;
 
@@ -43,6 +43,7 @@ public:
     QString docName;
 	QString fileName1;
 	QString fileName2;
+	QString streamedScore;  // Score taken out of fileName1 to be streamed, set by play()
 	bool rt; //FIXME make sure this is set!
 
 	bool enableFLTK;
@@ -53,6 +54,7 @@ public:
 	bool dither;
     bool sampleAccurateFlag;
     bool realtimeFlag;
+	bool streamScore;
 	bool newParser;
 	bool multicore;
 	int numThreads;
@@ -70,6 +70,7 @@ Curve::Curve(MYFLT *data, size_t size, const QString& caption,
 Curve::Curve(const Curve& curve)
 	: m_caption(curve.m_caption)
 {
+	m_size = 0;
 	mutex.lock();
 	set_size(curve.m_size);
 	copy(curve.m_size, curve.m_data);
@@ -87,6 +88,7 @@ Curve& Curve::operator=(const Curve& curve)
 	mutex.lock();
 	if (this != &curve) {
 		destroy();
+		m_size = 0;
 		set_size(curve.m_size);
 		copy(curve.m_size, curve.m_data);
 		m_caption = curve.m_caption;
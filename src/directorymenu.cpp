@@ -0,0 +1,149 @@
+#include "directorymenu.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QtConcurrent>
+
+// A listing older than this is scanned again after the menu is shown
+#define DIRECTORY_MENU_MAX_AGE_MS 30000
+
+DirectoryMenu::DirectoryMenu(QMenu *menu, QStringList filters, QObject *receiver,
+                             const char *member) :
+    QObject(menu),
+    m_menu(menu),
+    m_filters(filters),
+    m_receiver(receiver),
+    m_member(member),
+    m_maxDepth(0),
+    m_maxEntries(0),
+    m_scanTaken(true),
+    m_dirty(false)
+{
+    connect(m_menu, SIGNAL(aboutToShow()), this, SLOT(menuAboutToShow()));
+    connect(&m_watcher, SIGNAL(finished()), this, SLOT(scanFinished()));
+}
+
+DirectoryMenu::~DirectoryMenu()
+{
+    m_watcher.waitForFinished();
+}
+
+void DirectoryMenu::setDirectory(QString path, int maxDepth, int maxEntries, QStringList skip)
+{
+    m_path = path;
+    m_maxDepth = maxDepth;
+    m_maxEntries = maxEntries;
+    m_skip = skip;
+    m_watcher.waitForFinished();  // A scan of the old directory
+    m_scanTaken = true;
+    clear();
+    m_root.clear();
+    m_dirty = false;
+    if (!m_path.isEmpty()) {
+        rescan();
+    }
+}
+
+void DirectoryMenu::rescan()
+{
+    if (m_path.isEmpty() || m_watcher.isRunning()) {
+        return;
+    }
+    QString path = m_path;
+    QStringList filters = m_filters;
+    QStringList skip = m_skip;
+    int maxDepth = m_maxDepth;
+    int maxEntries = m_maxEntries;
+    m_scanTaken = false;
+    m_scanAge.start();
+    m_watcher.setFuture(QtConcurrent::run([=]() {
+        return scan(path, filters, skip, 0, maxDepth, maxEntries);
+    }));
+}
+
+void DirectoryMenu::scanFinished()
+{
+    if (m_scanTaken) {
+        return;
+    }
+    m_scanTaken = true;
+    m_root.reset(new Node(m_watcher.result()));
+    m_dirty = true;
+}
+
+DirectoryMenu::Node DirectoryMenu::scan(QString path, const QStringList &filters,
+                                        const QStringList &skip, int depth, int maxDepth,
+                                        int maxEntries)
+{
+    Node node;
+    node.path = path;
+    if (depth > maxDepth) {
+        return node;
+    }
+    QDir dir(path);
+    dir.setNameFilters(filters);
+    QStringList dirs = dir.entryList(QDir::AllDirs | QDir::NoDotAndDotDot, QDir::Name);
+    for (int i = 0; i < dirs.size() && i < maxEntries; i++) {
+        if (!skip.contains(dirs[i])) {
+            node.dirs.append(scan(dir.absoluteFilePath(dirs[i]), filters, skip,
+                                  depth + 1, maxDepth, maxEntries));
+        }
+    }
+    node.files = dir.entryList(QDir::Files, QDir::Name).mid(0, maxEntries);
+    return node;
+}
+
+void DirectoryMenu::menuAboutToShow()
+{
+    QMenu *menu = qobject_cast<QMenu *>(sender());
+    if (menu == m_menu) {
+        if (m_path.isEmpty()) {
+            return;
+        }
+        if (!m_scanTaken && (m_root.isNull() || m_watcher.isFinished())) {
+            // Opened before the first scan finished, or before its result
+            // was delivered
+            m_watcher.waitForFinished();
+            scanFinished();
+        }
+        if (m_dirty) {
+            clear();
+            m_shown = m_root;
+            m_dirty = false;
+            fill(m_menu, *m_shown);
+        } else if (m_scanAge.elapsed() > DIRECTORY_MENU_MAX_AGE_MS) {
+            rescan();
+        }
+    } else if (m_unfilled.contains(menu)) {
+        fill(menu, *m_unfilled.take(menu));
+    }
+}
+
+void DirectoryMenu::fill(QMenu *menu, const Node &node)
+{
+    emit aboutToFill(menu, node.path);
+    foreach (const Node &dir, node.dirs) {
+        QMenu *submenu = new QMenu(QFileInfo(dir.path).fileName(), menu);
+        menu->addMenu(submenu);
+        if (menu == m_menu) {
+            m_submenus.append(submenu);  // Deeper ones are deleted with these
+        }
+        m_unfilled.insert(submenu, &dir);
+        connect(submenu, SIGNAL(aboutToShow()), this, SLOT(menuAboutToShow()));
+    }
+    QDir dir(node.path);
+    foreach (const QString &file, node.files) {
+        QAction *action = menu->addAction(file, m_receiver, m_member.constData());
+        action->setData(dir.absoluteFilePath(file));
+    }
+    emit filled(menu, node.path);
+}
+
+void DirectoryMenu::clear()
+{
+    m_unfilled.clear();
+    m_menu->clear();
+    qDeleteAll(m_submenus);
+    m_submenus.clear();
+    m_shown.clear();
+}
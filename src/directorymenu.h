@@ -0,0 +1,70 @@
+#ifndef DIRECTORYMENU_H
+#define DIRECTORYMENU_H
+
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QMenu>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QVector>
+
+// Lists the files in a directory tree as a menu, for the examples,
+// favorites and scripts menus. The tree is scanned on a pool thread and
+// each submenu is only filled the first time it is shown, so building the
+// main window reads nothing from disk.
+class DirectoryMenu : public QObject
+{
+    Q_OBJECT
+public:
+    // File actions call member on receiver, with the file's path as data
+    DirectoryMenu(QMenu *menu, QStringList filters, QObject *receiver, const char *member);
+    ~DirectoryMenu();
+
+    // Lists path down to maxDepth levels, with at most maxEntries files and
+    // folders per folder. Folders named in skip are left out. An empty path
+    // leaves the menu empty for the owner to fill.
+    void setDirectory(QString path, int maxDepth, int maxEntries,
+                      QStringList skip = QStringList());
+    void rescan();  // The menu is refilled the next time it is shown
+
+signals:
+    // Around the entries added to menu (the top menu or a submenu) for path
+    void aboutToFill(QMenu *menu, QString path);
+    void filled(QMenu *menu, QString path);
+
+private slots:
+    void menuAboutToShow();
+    void scanFinished();
+
+private:
+    struct Node {
+        QString path;
+        QStringList files;
+        QVector<Node> dirs;
+    };
+    static Node scan(QString path, const QStringList &filters, const QStringList &skip,
+                     int depth, int maxDepth, int maxEntries);
+    void fill(QMenu *menu, const Node &node);
+    void clear();
+
+    QMenu *m_menu;
+    QStringList m_filters;
+    QObject *m_receiver;
+    QByteArray m_member;
+    QString m_path;
+    int m_maxDepth;
+    int m_maxEntries;
+    QStringList m_skip;
+
+    QFutureWatcher<Node> m_watcher;
+    bool m_scanTaken;  // The running scan's result was already used
+    QElapsedTimer m_scanAge;
+    QSharedPointer<const Node> m_root;   // Latest scan
+    QSharedPointer<const Node> m_shown;  // Tree the menu was filled from
+    bool m_dirty;  // m_root has not been shown yet
+    QHash<QMenu *, const Node *> m_unfilled;  // Submenus not shown yet
+    QList<QMenu *> m_submenus;  // Of the top menu
+};
+
+#endif // DIRECTORYMENU_H
@@ -0,0 +1,507 @@
+#include "documentmodel.h"
+
+#include <QTextBlock>
+#include <QTextDocument>
+#include <QtConcurrent>
+
+#include <algorithm>
+
+QStringList DocumentOutline::udoNames() const
+{
+    QStringList names;
+    foreach (const Udo &udo, udos) {
+        names << udo.opcodeName;
+    }
+    return names;
+}
+
+// Last span in spans starting at or before line, if it contains line
+template <typename T>
+static const DocumentOutline::Span *findSpan(const QVector<T> &spans, int line)
+{
+    auto it = std::upper_bound(spans.constBegin(), spans.constEnd(), line,
+                               [](int line, const T &span) { return line < span.line; });
+    if (it == spans.constBegin()) {
+        return nullptr;
+    }
+    --it;
+    if (it->endLine >= 0 && line > it->endLine) {
+        return nullptr;
+    }
+    return &*it;
+}
+
+const DocumentOutline::Span *DocumentOutline::spanAt(int line) const
+{
+    const Span *span = findSpan(instruments, line);
+    return span != nullptr ? span : findSpan(udos, line);
+}
+
+DocumentModel::DocumentModel(QTextDocument *document, QObject *parent) :
+    QObject(parent),
+    m_document(document),
+    m_lineCount(0),
+    m_running(false),
+    m_outline(new DocumentOutline)
+{
+    connect(m_document, SIGNAL(contentsChange(int,int,int)),
+            this, SLOT(contentsChange(int,int,int)));
+    reset();
+}
+
+DocumentModel::~DocumentModel()
+{
+    m_mutex.lock();
+    m_pending.clear();
+    m_mutex.unlock();
+    m_future.waitForFinished();
+}
+
+QSharedPointer<const DocumentOutline> DocumentModel::outline()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_outline;
+}
+
+QString DocumentModel::text(int firstLine, int lastLine)
+{
+    QStringList lines;
+    QTextBlock block = m_document->findBlockByNumber(firstLine - 1);
+    while (block.isValid() && (lastLine < 0 || block.blockNumber() < lastLine)) {
+        lines << block.text();
+        block = block.next();
+    }
+    return lines.join('\n');
+}
+
+QSet<QString> DocumentModel::wordsInLines(int firstLine, int lastLine) const
+{
+    QSet<QString> words;
+    const int last = qMin(lastLine, m_blockWords.size());
+    for (int i = qMax(firstLine, 1); i <= last; i++) {
+        foreach (const QString &word, m_blockWords[i - 1].words) {
+            words.insert(word);
+        }
+    }
+    return words;
+}
+
+QList<QTextBlock> DocumentModel::blocksUsing(const QSet<QString> &words) const
+{
+    QList<QTextBlock> blocks;
+    // Words no line uses need no search
+    QSet<QString> used;
+    foreach (const QString &word, words) {
+        if (m_words.weightOf(word) > 0) {
+            used.insert(word);
+        }
+    }
+    if (used.isEmpty()) {
+        return blocks;
+    }
+    for (int i = 0; i < m_blockWords.size(); i++) {
+        foreach (const QString &word, m_blockWords[i].words) {
+            if (used.contains(word)) {
+                blocks << m_document->findBlockByNumber(i);
+                break;
+            }
+        }
+    }
+    return blocks;
+}
+
+QSharedPointer<const DocumentOutline> DocumentModel::parse(const QString &text)
+{
+    QVector<Line> lines;
+    foreach (const QString &lineText, text.split('\n')) {
+        Line line;
+        line.text = lineText;
+        parseLine(line);
+        lines.append(line);
+    }
+    return buildOutline(lines);
+}
+
+void DocumentModel::reset()
+{
+    Edit edit;
+    edit.firstLine = 0;
+    edit.removedLines = m_lineCount;
+    for (QTextBlock block = m_document->begin(); block.isValid(); block = block.next()) {
+        edit.lines << block.text();
+    }
+    m_lineCount = m_document->blockCount();
+    indexWords(edit);
+    enqueue(edit);
+}
+
+void DocumentModel::contentsChange(int position, int /*charsRemoved*/, int charsAdded)
+{
+    // Positions are after the change, so the lines now in the changed range
+    // replace as many old lines as the block count did not grow by
+    const int blockCount = m_document->blockCount();
+    QTextBlock first = m_document->findBlock(position);
+    QTextBlock last = m_document->findBlock(position + charsAdded);
+    if (!last.isValid()) {
+        last = m_document->lastBlock();
+    }
+    if (!first.isValid()) {
+        reset();
+        return;
+    }
+    Edit edit;
+    edit.firstLine = first.blockNumber();
+    int lastLine = last.blockNumber();
+    edit.removedLines = lastLine - edit.firstLine + 1 - (blockCount - m_lineCount);
+    if (edit.removedLines < 0) {
+        reset();
+        return;
+    }
+    for (QTextBlock block = first; block.isValid() && block.blockNumber() <= lastLine;
+         block = block.next()) {
+        edit.lines << block.text();
+    }
+    m_lineCount = blockCount;
+    indexWords(edit);
+    enqueue(edit);
+}
+
+void DocumentModel::indexWords(const Edit &edit)
+{
+    // Same splice as applyEdit, on the GUI thread. Only the edited lines are
+    // split into words
+    int firstLine = qBound(0, edit.firstLine, m_blockWords.size());
+    int removedLines = qBound(0, edit.removedLines, m_blockWords.size() - firstLine);
+    int common = qMin(removedLines, edit.lines.size());
+    for (int i = 0; i < common; i++) {
+        BlockWords &block = m_blockWords[firstLine + i];
+        if (block.text == edit.lines[i]) {
+            continue;
+        }
+        foreach (const QString &word, block.words) {
+            m_words.addWeight(word, -1);
+        }
+        block.text = edit.lines[i];
+        block.words = lineWords(block.text);
+        foreach (const QString &word, block.words) {
+            m_words.addWeight(word, 1);
+        }
+    }
+    if (removedLines > common) {
+        for (int i = common; i < removedLines; i++) {
+            foreach (const QString &word, m_blockWords[firstLine + i].words) {
+                m_words.addWeight(word, -1);
+            }
+        }
+        m_blockWords.remove(firstLine + common, removedLines - common);
+    } else if (edit.lines.size() > common) {
+        m_blockWords.insert(firstLine + common, edit.lines.size() - common, BlockWords());
+        for (int i = common; i < edit.lines.size(); i++) {
+            BlockWords &block = m_blockWords[firstLine + i];
+            block.text = edit.lines[i];
+            block.words = lineWords(block.text);
+            foreach (const QString &word, block.words) {
+                m_words.addWeight(word, 1);
+            }
+        }
+    }
+}
+
+void DocumentModel::enqueue(const Edit &edit)
+{
+    QMutexLocker locker(&m_mutex);
+    m_pending.append(edit);
+    if (!m_running) {
+        m_running = true;
+        m_future = QtConcurrent::run(this, &DocumentModel::process);
+    }
+}
+
+void DocumentModel::process()
+{
+    forever {
+        QVector<Edit> edits;
+        m_mutex.lock();
+        if (m_pending.isEmpty()) {
+            m_running = false;
+            m_mutex.unlock();
+            return;
+        }
+        edits.swap(m_pending);
+        m_mutex.unlock();
+
+        bool changed = false;
+        foreach (const Edit &edit, edits) {
+            changed = applyEdit(edit) || changed;
+        }
+        if (changed) {
+            QSharedPointer<const DocumentOutline> outline = buildOutline(m_lines);
+            m_mutex.lock();
+            m_outline = outline;
+            m_mutex.unlock();
+            emit updated();
+        }
+    }
+}
+
+bool DocumentModel::applyEdit(const Edit &edit)
+{
+    int firstLine = qBound(0, edit.firstLine, m_lines.size());
+    int removedLines = qBound(0, edit.removedLines, m_lines.size() - firstLine);
+    int common = qMin(removedLines, edit.lines.size());
+    bool changed = removedLines != edit.lines.size();
+    // Lines that were rewritten in place, often only one
+    for (int i = 0; i < common; i++) {
+        Line &line = m_lines[firstLine + i];
+        if (line.text == edit.lines[i]) {
+            continue;  // Format only changes, e.g. from the highlighter
+        }
+        line.text = edit.lines[i];
+        parseLine(line);
+        changed = true;
+    }
+    if (removedLines > common) {
+        m_lines.remove(firstLine + common, removedLines - common);
+    } else if (edit.lines.size() > common) {
+        m_lines.insert(firstLine + common, edit.lines.size() - common, Line());
+        for (int i = common; i < edit.lines.size(); i++) {
+            Line &line = m_lines[firstLine + i];
+            line.text = edit.lines[i];
+            parseLine(line);
+        }
+    }
+    return changed;
+}
+
+static inline bool isWordDelimiter(QChar c)
+{
+    switch (c.unicode()) {
+    case '+': case '-': case '*': case '/': case '=': case '#': case '&': case ',':
+    case '"': case '\'': case '|': case '[': case ']': case '(': case ')': case '<':
+    case '>': case '.': case ';': case ':': case '^':
+        return true;
+    default:
+        return c.isSpace();
+    }
+}
+
+// Position of word in text as a whole word, or -1
+static int findWord(const QString &text, const QString &word)
+{
+    int pos = text.indexOf(word);
+    while (pos >= 0) {
+        int end = pos + word.size();
+        bool startOk = pos == 0 || !(text[pos - 1].isLetterOrNumber() || text[pos - 1] == '_');
+        bool endOk = end == text.size() || !(text[end].isLetterOrNumber() || text[end] == '_');
+        if (startOk && endOk) {
+            return pos;
+        }
+        pos = text.indexOf(word, pos + 1);
+    }
+    return -1;
+}
+
+static bool startsWithKeyword(const QString &text, const char *keyword, int length)
+{
+    return text.startsWith(QLatin1String(keyword))
+            && (text.size() == length || text[length].isSpace());
+}
+
+QStringList DocumentModel::lineWords(const QString &text)
+{
+    QStringList words;
+    int wordStart = -1;
+    for (int i = 0; i <= text.size(); i++) {
+        if (i == text.size() || isWordDelimiter(text[i])) {
+            if (wordStart >= 0) {
+                words << text.mid(wordStart, i - wordStart);
+                wordStart = -1;
+            }
+        } else if (wordStart < 0) {
+            wordStart = i;
+        }
+    }
+    words.removeDuplicates();
+    return words;
+}
+
+void DocumentModel::parseLine(Line &line)
+{
+    line.kind = PlainLine;
+    line.flags = 0;
+    line.arg.clear();
+    line.opcodeName.clear();
+
+    const QString &text = line.text;
+
+    int commentStart = text.indexOf("/*");
+    if (commentStart >= 0) {
+        line.flags |= HasComment;
+        if (text.indexOf("*/", commentStart) < 0) {
+            line.flags |= OpensComment;
+        }
+    }
+    if (text.indexOf("*/") >= 0) {
+        line.flags |= ClosesComment;
+    }
+
+    const QString trimmed = text.trimmed();
+    if (trimmed.isEmpty()) {
+        return;
+    }
+    if (trimmed[0] == '<') {
+        if (trimmed.startsWith("<CsInstruments>")) {
+            line.kind = OrchestraStartLine;
+        } else if (trimmed.startsWith("</CsInstruments>")) {
+            line.kind = OrchestraEndLine;
+        } else if (trimmed.startsWith("<CsScore>")) {
+            line.kind = ScoreStartLine;
+        }
+    } else if (trimmed.startsWith(";;")) {
+        line.kind = MarkerLine;
+        line.arg = trimmed.mid(2).trimmed();
+    } else if (trimmed[0] == ';' || trimmed.startsWith("//")) {
+        return;
+    } else if (startsWithKeyword(trimmed, "instr", 5)) {
+        line.kind = InstrLine;
+        line.arg = trimmed.mid(6).trimmed();
+    } else if (startsWithKeyword(trimmed, "opcode", 6)) {
+        int comma = trimmed.indexOf(',');
+        QString name = trimmed.mid(7, comma - 7).trimmed();
+        if (comma > 0 && !name.isEmpty()) {
+            line.kind = OpcodeLine;
+            line.arg = trimmed.mid(7);
+            line.opcodeName = name;
+        }
+    } else if (trimmed.startsWith("#define")) {
+        line.kind = DefineLine;
+        line.arg = trimmed.mid(8);
+    } else if (trimmed.startsWith("endin")) {
+        line.kind = EndinLine;
+    } else if (trimmed.startsWith("endop")) {
+        line.kind = EndopLine;
+    } else {
+        int pos = findWord(trimmed, QStringLiteral("ftgen"));
+        if (pos >= 0) {
+            // Only "ftgen ..." or "giTable ftgen ..."
+            int i = 0;
+            while (i < pos && (trimmed[i].isLetterOrNumber() || trimmed[i] == '_')) {
+                i++;
+            }
+            while (i < pos && trimmed[i].isSpace()) {
+                i++;
+            }
+            if (i == pos) {
+                line.kind = FtgenLine;
+                line.arg = trimmed;
+                return;
+            }
+        }
+        pos = findWord(trimmed, QStringLiteral("xin"));
+        if (pos >= 0) {
+            line.kind = XinLine;
+            line.arg = trimmed.left(pos).simplified();
+            return;
+        }
+        pos = findWord(trimmed, QStringLiteral("xout"));
+        if (pos >= 0 && pos + 4 < trimmed.size() && trimmed[pos + 4].isSpace()) {
+            line.kind = XoutLine;
+            line.arg = trimmed.mid(pos + 4).simplified();
+        }
+    }
+}
+
+QSharedPointer<const DocumentOutline> DocumentModel::buildOutline(const QVector<Line> &lines)
+{
+    // A walk over the parsed lines, no text is scanned here
+    QSharedPointer<DocumentOutline> outline(new DocumentOutline);
+    int i = 0;
+    const int count = lines.size();
+    for (int j = 0; j < count; j++) {
+        if (lines[j].kind == OrchestraStartLine) {
+            outline->orchestraLine = j + 1;
+            i = j + 1;
+            break;
+        }
+    }
+    // Files without tags (orc, udo, inc) are all orchestra
+    DocumentOutline::Span *instrument = nullptr;
+    DocumentOutline::Udo *udo = nullptr;
+    bool inComment = false;
+    for (; i < count; i++) {
+        const Line &line = lines[i];
+        if (inComment) {
+            inComment = !(line.flags & ClosesComment);
+            continue;
+        }
+        if (line.flags & HasComment) {
+            inComment = line.flags & OpensComment;
+            continue;
+        }
+        if (line.kind == OrchestraEndLine) {
+            outline->orchestraEndLine = i + 1;
+            break;
+        }
+        if (line.kind == MarkerLine) {
+            DocumentOutline::Entry marker = {line.arg, i + 1};
+            if (udo != nullptr) {
+                udo->markers.append(marker);
+            } else if (instrument != nullptr) {
+                instrument->markers.append(marker);
+            } else {
+                outline->markers.append(marker);
+            }
+        } else if (udo != nullptr) {
+            if (line.kind == EndopLine) {
+                udo->endLine = i + 1;
+                udo = nullptr;
+            } else if (line.kind == XinLine && udo->xinLine < 0) {
+                udo->inArgs = line.arg;
+                udo->xinLine = i + 1;
+            } else if (line.kind == XoutLine && udo->xoutLine < 0) {
+                udo->outArgs = line.arg;
+                udo->xoutLine = i + 1;
+            }
+        } else if (instrument != nullptr) {
+            if (line.kind == EndinLine) {
+                instrument->endLine = i + 1;
+                instrument = nullptr;
+            }
+        } else if (line.kind == InstrLine) {
+            DocumentOutline::Span span;
+            span.name = line.arg;
+            span.line = i + 1;
+            span.endLine = -1;
+            outline->instruments.append(span);
+            instrument = &outline->instruments.last();
+        } else if (line.kind == OpcodeLine) {
+            DocumentOutline::Udo newUdo;
+            newUdo.name = line.arg;
+            newUdo.opcodeName = line.opcodeName;
+            newUdo.line = i + 1;
+            newUdo.endLine = -1;
+            newUdo.xinLine = -1;
+            newUdo.xoutLine = -1;
+            outline->udos.append(newUdo);
+            udo = &outline->udos.last();
+        } else if (line.kind == DefineLine || line.kind == FtgenLine) {
+            DocumentOutline::Entry entry = {line.arg, i + 1};
+            if (line.kind == DefineLine) {
+                outline->macros.append(entry);
+            } else {
+                outline->ftables.append(entry);
+            }
+        }
+    }
+    for (; i < count; i++) {
+        if (lines[i].kind == ScoreStartLine) {
+            outline->scoreLine = i + 1;
+            break;
+        }
+    }
+    for (int j = 0; j < outline->udos.size(); j++) {
+        outline->udoIndex.add(outline->udos[j].opcodeName, j);
+    }
+    outline->udoIndex.build();
+    return outline;
+}
@@ -0,0 +1,152 @@
+#ifndef DOCUMENTMODEL_H
+#define DOCUMENTMODEL_H
+
+#include <QObject>
+#include <QFuture>
+#include <QMutex>
+#include <QSet>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QVector>
+
+#include "completionindex.h"
+
+class QTextBlock;
+class QTextDocument;
+
+// The structure of a csd or orc at one point in time, as seen by the
+// inspector, UDO highlighting, completion and the code graph.
+// Line numbers start at 1 as in the editor.
+struct DocumentOutline
+{
+    struct Entry {
+        QString text;
+        int line;
+    };
+    struct Span {
+        QString name;  // Text after instr or opcode
+        int line;
+        int endLine;   // -1 if not closed
+        QVector<Entry> markers;  // ;; comments inside the span
+    };
+    struct Udo : Span {
+        QString opcodeName;
+        QString inArgs;   // Variables read with xin
+        QString outArgs;  // Values written with xout
+        int xinLine;
+        int xoutLine;
+    };
+
+    DocumentOutline() : orchestraLine(-1), orchestraEndLine(-1), scoreLine(-1) {}
+    QStringList udoNames() const;
+    // The instrument or UDO containing line, or nullptr. Spans that are not
+    // closed run to the end of the text
+    const Span *spanAt(int line) const;
+
+    int orchestraLine;     // Line of <CsInstruments>, -1 if the text has no tags
+    int orchestraEndLine;  // Line of </CsInstruments>
+    int scoreLine;         // Line of <CsScore>
+    QVector<Span> instruments;
+    QVector<Udo> udos;
+    QVector<Entry> macros;
+    QVector<Entry> ftables;
+    QVector<Entry> markers;  // ;; comments outside instruments and UDOs
+    CompletionIndex udoIndex;   // UDO opcode names, ids are indexes in udos
+};
+
+// Keeps a DocumentOutline up to date for a QTextDocument. Edits are taken
+// from contentsChange as the text of the lines they touched, and parsed on
+// a pool thread, so the GUI thread never scans the whole text. updated()
+// is emitted after a new outline has been published.
+// The identifiers in the text are indexed on the GUI thread as each edit
+// arrives, so completion sees a new variable as soon as it is typed.
+class DocumentModel : public QObject
+{
+    Q_OBJECT
+public:
+    DocumentModel(QTextDocument *document, QObject *parent = nullptr);
+    ~DocumentModel();
+
+    QSharedPointer<const DocumentOutline> outline();  // Never null
+    // Every identifier in the text, weighted by the number of lines using
+    // it. Up to date with the document, GUI thread only
+    const CompletionIndex &words() const { return m_words; }
+    // Identifiers in lines first to last, each once, GUI thread only
+    QSet<QString> wordsInLines(int firstLine, int lastLine) const;
+    // Blocks that use any of words, GUI thread only
+    QList<QTextBlock> blocksUsing(const QSet<QString> &words) const;
+    // Text of the lines first to last from the document, to the end if
+    // last is -1
+    QString text(int firstLine, int lastLine);
+    // Parses text synchronously, for text that is not in an editor
+    static QSharedPointer<const DocumentOutline> parse(const QString &text);
+
+signals:
+    void updated();
+
+private slots:
+    void contentsChange(int position, int charsRemoved, int charsAdded);
+
+private:
+    enum LineKind : quint8 {
+        PlainLine,
+        OrchestraStartLine,
+        OrchestraEndLine,
+        ScoreStartLine,
+        InstrLine,
+        EndinLine,
+        OpcodeLine,
+        EndopLine,
+        DefineLine,
+        FtgenLine,
+        MarkerLine,
+        XinLine,
+        XoutLine
+    };
+    enum LineFlags : quint8 {
+        OpensComment = 0x1,   // Has /* not closed on the same line
+        HasComment = 0x2,     // Has /*
+        ClosesComment = 0x4   // Has */
+    };
+    struct Line {
+        QString text;
+        QString arg;  // Name, definition or arguments, depending on kind
+        QString opcodeName;
+        quint8 kind;
+        quint8 flags;
+    };
+    struct Edit {
+        int firstLine;
+        int removedLines;
+        QStringList lines;
+    };
+    struct BlockWords {
+        QString text;
+        QStringList words;  // Each once
+    };
+
+    void reset();
+    void indexWords(const Edit &edit);
+    void enqueue(const Edit &edit);
+    void process();  // Runs on the pool
+    bool applyEdit(const Edit &edit);
+    static QStringList lineWords(const QString &text);
+    static void parseLine(Line &line);
+    static QSharedPointer<const DocumentOutline> buildOutline(const QVector<Line> &lines);
+
+    QTextDocument *m_document;
+    int m_lineCount;  // Block count after the last edit seen, GUI thread only
+    QVector<BlockWords> m_blockWords;  // One per block, GUI thread only
+    CompletionIndex m_words;
+
+    QMutex m_mutex;  // Protects the members below
+    QVector<Edit> m_pending;
+    bool m_running;
+    QFuture<void> m_future;
+    QSharedPointer<const DocumentOutline> m_outline;
+
+    // Owned by the worker while it runs
+    QVector<Line> m_lines;
+};
+
+#endif // DOCUMENTMODEL_H
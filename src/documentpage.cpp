@@ -25,6 +25,7 @@
 
 
 #include "documentpage.h"
+#include "documentmodel.h"
 #include "documentview.h"
 #include "csoundengine.h"
 #include "liveeventframe.h"
@@ -54,8 +55,8 @@ DocumentPage::DocumentPage(QWidget *parent, OpEntryParser *opcodeTree,
 	m_view->showLineArea(true);
 	m_midiLearn = midiLearn;
     m_colorTheme = "";
-    regexUdo.setPattern("\\n\\s*\\bopcode\\s+(\\w+)\\s*,\\s*[a-zA-Z0\\[\\]]+\\s*,\\s*[a-zA-Z0\\[\\]]+");
     m_parseUdosNeeded = true;
+    connect(m_view->getDocumentModel(), SIGNAL(updated()), this, SLOT(outlineUpdated()));
 	foreach(WidgetLayout* wl, m_widgetLayouts) {
 		connect(wl, SIGNAL(changed()), this, SLOT(setModified()));
         connect(wl, SIGNAL(widgetSelectedSignal(QuteWidget*)),
@@ -72,6 +73,10 @@ DocumentPage::~DocumentPage()
 	//  qDebug();
 	disconnect(m_console, 0,0,0);
 	disconnect(m_view, 0,0,0);
+	// The sheets outlive the page, but the scheduler goes with the engine
+	for (int i = 0; i < m_liveFrames.size(); i++) {
+		m_liveFrames[i]->getSheet()->setEventScheduler(nullptr, nullptr);
+	}
 	//  deleteAllLiveEvents(); // FIXME This is also crashing...
 }
 
@@ -202,7 +207,7 @@ int DocumentPage::setTextString(QString &text)
 		QString liveText = panelElement.text();
 		//    qDebug() << liveText;
 		QString panelName = panelElement.attribute("name","");
-		double tempo = panelElement.attribute("tempo","60.0").toDouble();
+		double tempo = panelElement.attribute("tempo","0.0").toDouble();
 		double loop = panelElement.attribute("loop","8.0").toDouble();
 		int posx = panelElement.attribute("x","-1").toDouble();
 		int posy = panelElement.attribute("y","-1").toDouble();
@@ -340,13 +345,14 @@ QString DocumentPage::getDotText()
 		qDebug() << "No dot for sco files";
 		return QString();
 	}
-	QString orcText = getFullText();
-	if (!fileName.endsWith("orc")) { //asume csd
-        if (orcText.contains("<CsInstruments>")) {
-            auto start = orcText.indexOf("<CsInstruments>");
-            orcText = orcText.mid(start + 15,
-                                  orcText.indexOf("</CsInstruments>") - start - 15);
-		}
+	QString orcText;
+	DocumentModel *model = m_view->getDocumentModel();
+	auto outline = model->outline();
+	if (!fileName.endsWith("orc") && outline->orchestraLine > 0) { //asume csd
+		int lastLine = outline->orchestraEndLine > 0 ? outline->orchestraEndLine - 1 : -1;
+		orcText = model->text(outline->orchestraLine + 1, lastLine);
+	} else {
+		orcText = getFullText();
 	}
 	DotGenerator dot(fileName, orcText, m_opcodeTree);
 	return dot.getDotText();
@@ -609,8 +615,12 @@ EventSheet* DocumentPage::getSheet(int sheetIndex)
 
 EventSheet* DocumentPage::getSheet(QString sheetName)
 {
-    (void) sheetName;
-    return nullptr;
+	for (int i = 0; i < m_liveFrames.size(); i++) {
+		if (m_liveFrames[i]->getName() == sheetName) {
+			return m_liveFrames[i]->getSheet();
+		}
+	}
+	return nullptr;
 }
 
 int DocumentPage::lineCount(bool countExtras)
@@ -668,17 +678,6 @@ QString DocumentPage::getFilePath()
 	return fileName.left(fileName.lastIndexOf("/"));
 }
 
-QStringList DocumentPage::getScheduledEvents(unsigned long ksmps)
-{
-	QStringList events;
-	// Called once after every Csound control pass
-	for (int i = 0; i < m_liveFrames.size(); i++) {
-		m_liveFrames[i]->getEvents(ksmps, &events);
-	}
-	//  m_ksmpscount = ksmpscount;
-	return events;
-}
-
 void DocumentPage::setModified(bool mod)
 {
 	// This slot is triggered by the document children whenever they are modified
@@ -700,9 +699,9 @@ void DocumentPage::setModified(bool mod)
 	}
 }
 
-void DocumentPage::sendCodeToEngine(QString code)
+void DocumentPage::sendCodeToEngine(QString code, double quantum)
 {
-	m_csEngine->evaluate(code);
+	m_csEngine->evaluate(code, quantum);
 }
 
 bool DocumentPage::isModified()
@@ -1271,6 +1270,8 @@ void DocumentPage::init(QWidget *parent, OpEntryParser *opcodeTree)
 			m_view, SLOT(markErrorLines(QList<QPair<int, QString> >)));
 	connect(m_csEngine, SIGNAL(stopSignal()),
 			this, SLOT(perfEnded()));
+	connect(m_csEngine, SIGNAL(evaluated(QString,bool)),
+			this, SLOT(spanEvaluated(QString,bool)));
 
 	//  detachWidgets();
 	saveOldFormat = false; // don't save Mac widgets by default
@@ -1306,8 +1307,109 @@ int DocumentPage::play(CsoundOptions *options)
 	}
 	else {
 		m_view->unmarkErrorLines();  // Clear error lines when running
-		return BaseDocument::play(options);
+		int ret = BaseDocument::play(options);
+		m_runningSpans.clear();
+		m_pendingSpans.clear();
+		if (ret == 0) {
+			foreach (const OrchestraSpan &span, orchestraSpans(getBasicText())) {
+				m_runningSpans.insert(span.key, span.text);
+			}
+		}
+		return ret;
+	}
+}
+
+int DocumentPage::hotUpdate()
+{
+	if (!m_csEngine->isRunning() || fileName.endsWith(".py")) {
+		m_csEngine->queueMessage(tr("Csound is not running. Nothing to update.\n"));
+		return -1;
+	}
+	QVector<OrchestraSpan> spans = orchestraSpans(getBasicText());
+	QSet<QString> keys;
+	QStringList changedUdos;
+	QVector<bool> changed(spans.size(), false);
+	for (int i = 0; i < spans.size(); i++) {
+		keys.insert(spans[i].key);
+		changed[i] = m_runningSpans.value(spans[i].key) != spans[i].text;
+		if (changed[i] && !spans[i].opcodeName.isEmpty()) {
+			changedUdos << QRegExp::escape(spans[i].opcodeName);
+		}
+	}
+	// Instruments and UDOs keep the UDOs they were compiled with, so
+	// everything that calls a changed UDO, directly or not, is compiled again
+	while (!changedUdos.isEmpty()) {
+		QRegExp uses("\\b(" + changedUdos.join("|") + ")\\b");
+		changedUdos.clear();
+		for (int i = 0; i < spans.size(); i++) {
+			if (!changed[i] && uses.indexIn(spans[i].text) >= 0) {
+				changed[i] = true;
+				if (!spans[i].opcodeName.isEmpty()) {
+					changedUdos << QRegExp::escape(spans[i].opcodeName);
+				}
+			}
+		}
+	}
+	int count = 0;
+	for (int i = 0; i < spans.size(); i++) {
+		if (changed[i]) {
+			m_pendingSpans[spans[i].key].append(spans[i].text);
+			m_csEngine->evaluate(spans[i].text, 0, spans[i].key);
+			count++;
+		}
 	}
+	foreach (const QString &key, m_runningSpans.keys()) {
+		if (!keys.contains(key)) {
+			m_csEngine->queueMessage(tr("%1 was removed from the text, it is still in the engine.\n").arg(key));
+		}
+	}
+	if (count == 0) {
+		m_csEngine->queueMessage(tr("No changed instruments to update.\n"));
+	}
+	return count;
+}
+
+void DocumentPage::spanEvaluated(QString key, bool success)
+{
+	QStringList &pending = m_pendingSpans[key];
+	if (pending.isEmpty()) {  // Sent before the last play()
+		m_pendingSpans.remove(key);
+		return;
+	}
+	QString text = pending.takeFirst();
+	if (pending.isEmpty()) {
+		m_pendingSpans.remove(key);
+	}
+	// A span that failed keeps its old text, so the next update tries it again
+	if (success) {
+		m_runningSpans.insert(key, text);
+	}
+}
+
+QVector<DocumentPage::OrchestraSpan> DocumentPage::orchestraSpans(const QString &text)
+{
+	QSharedPointer<const DocumentOutline> outline = DocumentModel::parse(text);
+	QStringList lines = text.split('\n');
+	QVector<OrchestraSpan> spans;
+	foreach (const DocumentOutline::Udo &udo, outline->udos) {
+		if (udo.endLine > 0) {
+			OrchestraSpan span;
+			span.key = "opcode " + udo.name.simplified();
+			span.opcodeName = udo.opcodeName;
+			span.text = QStringList(lines.mid(udo.line - 1, udo.endLine - udo.line + 1)).join("\n") + "\n";
+			spans.append(span);
+		}
+	}
+	foreach (const DocumentOutline::Span &instrument, outline->instruments) {
+		if (instrument.endLine > 0) {
+			OrchestraSpan span;
+			span.key = "instr " + instrument.name.simplified();
+			span.text = QStringList(lines.mid(instrument.line - 1,
+											  instrument.endLine - instrument.line + 1)).join("\n") + "\n";
+			spans.append(span);
+		}
+	}
+	return spans;
 }
 
 void DocumentPage::stop()
@@ -1613,6 +1715,8 @@ LiveEventFrame * DocumentPage::createLiveEventPanel(QString text)
 	connect(e, SIGNAL(setLoopLengthFromPanel(LiveEventFrame *, double)),
 			this, SLOT(setPanelLoopLength(LiveEventFrame *,double)));
 	connect(e->getSheet(), SIGNAL(sendEvent(QString)),this,SLOT(queueEvent(QString)));
+	connect(e->getSheet(), SIGNAL(runPythonCode(QString)),this,SLOT(runSheetScript(QString)));
+	e->getSheet()->setEventScheduler(m_csEngine->getEventScheduler(), &m_csEngine->getTransport());
 	connect(e->getSheet(), SIGNAL(modified()),this,SLOT(setModified()));
 	return e;
 }
@@ -1639,6 +1743,12 @@ void DocumentPage::deleteLiveEventPanel(LiveEventFrame *frame)
 void DocumentPage::textChanged()
 {
     // setModified(true);
+    // The inspector and UDOs are updated when the document model has
+    // parsed the change, see outlineUpdated()
+}
+
+void DocumentPage::outlineUpdated()
+{
     m_parseUdosNeeded = true;
     // This signal triggers an inspector update
 	emit currentTextUpdated();
@@ -1703,6 +1813,17 @@ void DocumentPage::evaluatePython(QString code)
 	emit evaluatePythonSignal(code);
 }
 
+void DocumentPage::runSheetScript(QString code)
+{
+	// The script finds the sheet that runs it as sheet
+	for (int i = 0; i < m_liveFrames.size(); i++) {
+		if (m_liveFrames[i]->getSheet() == sender()) {
+			emit runPythonSignal(QString("sheet = q.getSheet(-1, %1)\n").arg(i) + code);
+			return;
+		}
+	}
+}
+
 
 void DocumentPage::setPanelLoopEnabled(LiveEventFrame *panel, bool enabled)
 {
@@ -1739,19 +1860,15 @@ void DocumentPage::setParsedUDOs(QStringList udos) {
 void DocumentPage::parseUdos(bool force) {
     if(!m_parseUdosNeeded && !force)
         return;
-    auto text = this->getBasicText();
-    QRegularExpressionMatchIterator i = regexUdo.globalMatch(text);
-    int numUdos = m_parsedUdos.size();
-    m_parsedUdos.clear();
-    while(i.hasNext()) {
-        QRegularExpressionMatch match = i.next();
-        QString udoName = match.captured(1);
-        m_parsedUdos.append(udoName);
-    }
+    QSet<QString> oldUdos = m_parsedUdos.toSet();
+    m_parsedUdos = m_view->getDocumentModel()->outline()->udoNames();
+    QSet<QString> newUdos = m_parsedUdos.toSet();
     auto highlighter = m_view->getHighlighter();
     highlighter->setUDOs(m_parsedUdos);
-    if(numUdos != m_parsedUdos.size()) {
-        highlighter->rehighlight();
+    // Only lines using a UDO that was added or removed change colour
+    QSet<QString> changed = (newUdos - oldUdos) | (oldUdos - newUdos);
+    if (!changed.isEmpty()) {
+        highlighter->rehighlightBlocks(m_view->getDocumentModel()->blocksUsing(changed));
     }
     m_parseUdosNeeded = false;
 }
@@ -117,7 +117,6 @@ public:
 	int widgetCount();
 	QString embeddedFiles();
 	QString getFilePath();
-	QStringList getScheduledEvents(unsigned long ksmpscount);
 	bool isModified();
 	bool isRunning();
 	bool isRecording();
@@ -191,6 +190,9 @@ public:
 
 public slots:
 	virtual int play(CsoundOptions *options);
+	// Recompiles the instruments and UDOs edited since play() into the
+	// running engine. Returns how many were sent, -1 if not running
+	int hotUpdate();
 	void stop();
 	int record(int format);
 	void perfEnded();
@@ -206,7 +208,7 @@ public slots:
 	void setMacOption(QString option, QString newValue);
     void setModified(bool mod = true);
 	// For Csound Engine
-	void sendCodeToEngine(QString code);
+	void sendCodeToEngine(QString code, double quantum = 0);
 	//Passed directly to widget layout
 	void setWidgetEditMode(bool active);
 	void duplicateWidgets();
@@ -267,10 +269,19 @@ private:
     QString m_colorTheme;
     QStringList m_parsedUdos;
     bool m_parseUdosNeeded;
-    QRegularExpression regexUdo;
+	struct OrchestraSpan {
+		QString key;         // "instr name" or "opcode name"
+		QString opcodeName;  // For UDOs
+		QString text;
+	};
+	// Closed UDOs then instruments, in text order
+	static QVector<OrchestraSpan> orchestraSpans(const QString &text);
+	QHash<QString, QString> m_runningSpans;  // Text of each span as the engine has it
+	QHash<QString, QStringList> m_pendingSpans;  // Texts sent for evaluation, oldest first
 
 private slots:
 	void textChanged();
+	void outlineUpdated();
 	void liveEventControlClosed();
 	void renamePanel(LiveEventFrame *panel,QString newName);
 	void setPanelLoopRange(LiveEventFrame *panel, double start, double end);
@@ -278,6 +289,8 @@ private slots:
 	void setPanelTempo(LiveEventFrame *panel, double tempo);
 	void setPanelLoopEnabled(LiveEventFrame *panel, bool enabled);
 	void evaluatePython(QString code);
+	void runSheetScript(QString code);
+	void spanEvaluated(QString key, bool success);
 signals:
 	void currentTextUpdated();  // To let inspector know it must update
 	void setCurrentAudioFile(QString name);
@@ -288,6 +301,7 @@ signals:
 	void setHelpSignal(); // Propagated from view
 	void setWidgetClipboardSignal(QString text);
 	void evaluatePythonSignal(QString code);
+	void runPythonSignal(QString code);  // Always Python, unlike evaluatePythonSignal
 	void closeExtraPanelsSignal();
 };
 
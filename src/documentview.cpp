@@ -28,6 +28,7 @@
 
 #include "highlighter.h"
 #include "texteditor.h"
+#include "documentmodel.h"
 
 
 static const QStringList tagWords = {"CsInstruments", "CsScore", "CsoundSynthesizer", "CsOptions"};
@@ -70,6 +71,14 @@ DocumentView::DocumentView(QWidget * parent, OpEntryParser *opcodeTree) :
 	internalChange = false;
 
     //  m_highlighter = new Highlighter();
+    m_documentModel = new DocumentModel(m_mainEditor->document(), this);
+    m_contextFirstLine = 0;
+    m_contextLastLine = 0;
+    m_contextInSpan = false;
+    m_localVariablesDirty = false;
+    m_currentContext = NO_CONTEXT;
+    // New outlines can move the span under the cursor
+    connect(m_documentModel, SIGNAL(updated()), this, SLOT(updateContext()));
     connect(m_mainEditor, SIGNAL(textChanged()),
             this, SLOT(textChanged()));
     connect(m_mainEditor, SIGNAL(cursorPositionChanged()),
@@ -163,100 +172,64 @@ void DocumentView::print(QPrinter *printer)
 
 void DocumentView::updateContext()
 {
-    // this code is too expensive to be run at EACH keystroke. We need to think of something better
-    // Until then I am disabling it (EM, Nov. 21)
-    return;
-	QStringList contextStart;
-	contextStart << "<CsInstruments>" << "<CsScore" << "<CsOptions>";
-	QTextCursor cursor = m_mainEditor->textCursor();
-	cursor.select(QTextCursor::LineUnderCursor);
-	QString line = cursor.selection().toPlainText().simplified();
-	while (!cursor.atStart()) {
-		foreach(QString startText, contextStart) {
-			if (line.startsWith(startText)) {
-				m_currentContext = contextStart.indexOf(startText) + 1;
-				break;
-			}
-		}
-		cursor.movePosition(QTextCursor::Up);
-		cursor.select(QTextCursor::BlockUnderCursor);
-		line = cursor.selection().toPlainText();
-		cursor.movePosition(QTextCursor::StartOfBlock);
-	}
-	if (m_currentContext == DocumentView::ORC_CONTEXT) { // Instrument section
-		QString endText = "</CsInstruments>";
-		QTextCursor linecursor = cursor;
-		linecursor.select(QTextCursor::LineUnderCursor);
-		line = linecursor.selection().toPlainText();
-		linecursor.movePosition(QTextCursor::EndOfLine);
-		while (!linecursor.atEnd() && !line.contains(endText)) {
-			cursor.movePosition(QTextCursor::NextBlock, QTextCursor::KeepAnchor);
-			cursor.movePosition(QTextCursor::EndOfLine, QTextCursor::KeepAnchor);
-			linecursor = cursor;
-			linecursor.select(QTextCursor::LineUnderCursor);
-			line = linecursor.selection().toPlainText();
-			linecursor.movePosition(QTextCursor::EndOfLine);
-		}
-		QString orc = cursor.selection().toPlainText();
-        updateOrcContext(orc);
-	}
+    // Runs on every cursor move, so it only compares the cursor line with
+    // the span found last time. The local variables are collected later,
+    // when completion asks for them
+    QSharedPointer<const DocumentOutline> outline = m_documentModel->outline();
+    int line = m_mainEditor->textCursor().blockNumber() + 1;
+    if (outline == m_contextOutline && line >= m_contextFirstLine
+            && (m_contextLastLine < 0 || line <= m_contextLastLine)) {
+        return;
+    }
+    m_contextOutline = outline;
+    const DocumentOutline::Span *span = outline->spanAt(line);
+    if (span != nullptr) {
+        m_contextFirstLine = span->line;
+        m_contextLastLine = span->endLine;
+        m_currentContext = ORC_CONTEXT;
+    } else {
+        // Outside instruments only this line is known to be in the same context
+        m_contextFirstLine = line;
+        m_contextLastLine = line;
+        if (outline->scoreLine > 0 && line >= outline->scoreLine) {
+            m_currentContext = SCO_CONTEXT;
+        } else if (outline->orchestraLine < 0 || (line > outline->orchestraLine
+                   && (outline->orchestraEndLine < 0 || line < outline->orchestraEndLine))) {
+            m_currentContext = ORC_CONTEXT;
+        } else {
+            m_currentContext = NO_CONTEXT;
+        }
+    }
+    m_contextInSpan = span != nullptr;
+    m_localVariablesDirty = true;
 }
 
-void DocumentView::updateOrcContext(QString orc)
+void DocumentView::updateLocalVariables()
 {
-    // This is disabled at the moment since updateContext is itself disabled
-    (void) orc;
-	// TODO: add string as context
-	QStringList innerContextStart;
-	innerContextStart << "instr" << "opcode";
-	QTextCursor cursor = m_mainEditor->textCursor();
-	cursor.select(QTextCursor::LineUnderCursor);
-	QString line = cursor.selection().toPlainText().trimmed();
-    while (!cursor.atStart()) {
-		foreach(QString startText, innerContextStart) {
-			if (line.startsWith(startText)) {
-				break;
-			}
-		}
-		cursor.movePosition(QTextCursor::Up);
-		cursor.select(QTextCursor::BlockUnderCursor);
-		line = cursor.selection().toPlainText().trimmed();
-		cursor.movePosition(QTextCursor::StartOfBlock);
-	}
-	cursor.movePosition(QTextCursor::NextBlock);
-	QString endText = "endin";
-	QTextCursor linecursor = cursor;
-	linecursor.select(QTextCursor::LineUnderCursor);
-	line = linecursor.selection().toPlainText().trimmed();
-	linecursor.movePosition(QTextCursor::EndOfLine);
-	while (!linecursor.atEnd() && !line.startsWith(endText)) {
-		cursor.movePosition(QTextCursor::NextBlock, QTextCursor::KeepAnchor);
-		cursor.movePosition(QTextCursor::EndOfLine, QTextCursor::KeepAnchor);
-		linecursor = cursor;
-		linecursor.select(QTextCursor::LineUnderCursor);
-		line = linecursor.selection().toPlainText().trimmed();
-		linecursor.movePosition(QTextCursor::EndOfLine);
-	}
-	QString instr = cursor.selection().toPlainText();
-    auto lines = instr.splitRef("\n", SKIP_EMPTY_PARTS);
-
-    auto rxWordSplit = QRegularExpression("[\\s,+-/\\*\\.\\^\\(\\)\\[\\]$]");
-	m_localVariables.clear();
-    QSet<QString> seen;
-    for(auto line: lines) {
-        line = line.trimmed();
-        if (line.isEmpty() || line.startsWith(";")) {
-			continue;
-		}
-        auto words = line.toString().split(rxWordSplit, SKIP_EMPTY_PARTS);
-        for(auto word: words) {
-            if(!seen.contains(word) && !m_opcodeTree->isOpcode(word)) {
-                seen.insert(word);
+    // Variables of the instrument or UDO under the cursor, from the words
+    // the document model keeps for each line
+    m_localVariables.clear();
+    m_localVariablesDirty = false;
+    if (!m_contextInSpan) {
+        return;
+    }
+    int lastLine = m_contextLastLine < 0 ? m_mainEditor->document()->blockCount() : m_contextLastLine;
+    QSet<QString> words = m_documentModel->wordsInLines(m_contextFirstLine, lastLine);
+    foreach (const QString &word, words) {
+        if (word.size() < 2 || !(word[1].isLetterOrNumber() || word[1] == '_')) {
+            continue;
+        }
+        switch (word[0].toLatin1()) {
+        case 'i': case 'k': case 'a': case 'S': case 'f': case 'w':
+            if (!m_opcodeTree->isOpcode(word)) {
+                m_localVariables << word;
             }
-		}
-	}
-    //m_localVariables = QStringList(seen.begin(), seen.end());
-    m_localVariables = seen.values();
+            break;
+        default:
+            break;
+        }
+    }
+    m_localVariables.sort();
 }
 
 void DocumentView::nextParameter()
@@ -840,23 +813,6 @@ void DocumentView::createParenthesisSelection(int pos, bool paired)
 	editor->setExtraSelections(selections);
 }
 
-const QStringList DocumentView::getAllWords() {
-    // All words are parsed at max. each 4 seconds
-    const int minMsecsFromLastParsing = 4000;
-    auto now = QTime::currentTime();
-    int msecs = m_lastWordsUpdate.msecsTo(now);
-    if(m_allWords.isEmpty() || msecs > minMsecsFromLastParsing) {
-        QDEBUG << "Updating all words, time since last update: " << msecs << "msecs";
-        TextEditor *editor = m_mainEditor;
-        QString wholeText = editor->toPlainText();
-        auto allWords = wholeText.split(QRegularExpression("[" + QRegularExpression::escape("+-*/=#&,\"\'|[]()<>.;:^") + "\\s]"), SKIP_EMPTY_PARTS);
-        allWords.removeDuplicates();
-        m_lastWordsUpdate = now;
-        m_allWords = allWords;
-    }
-    return m_allWords;
-}
-
 void DocumentView::autoCompleteAtCursor() {
     TextEditor *editor = m_mainEditor;
 
@@ -918,19 +874,23 @@ void DocumentView::autoCompleteAtCursor() {
     }
     else if (cursor.position() > cursor.anchor() && word.size() > 2 && !word.startsWith("\"")) { // Only at the end of the word
         syntaxMenu->clear();
+        // Variables of the current instrument come first
+        if (m_localVariablesDirty) {
+            updateLocalVariables();
+        }
         foreach(QString var, m_localVariables) {
-            if (var.endsWith(',')) {
-                var.chop(1);
-            }
             if (var.startsWith(word) && word != var) {
                 QAction *a = syntaxMenu->addAction(var, this,
                                                    SLOT(insertAutoCompleteText())); // was: insertParameterText that does not exist any more
                 a->setData(var);
                 showSyntaxMenu = true;
+                menuWordsSeen.insert(var);
             }
         }
         // opcodes and parameters
-        auto syntax = m_opcodeTree->getPossibleSyntax(word);
+        QSharedPointer<const DocumentOutline> outline = m_documentModel->outline();
+        const CompletionIndex &words = m_documentModel->words();
+        auto syntax = m_opcodeTree->getPossibleSyntax(word, outline.data(), &words);
         bool allEqual = true;
         for(int i = 0; i < syntax.size(); i++) {
             if (syntax[i].opcodeName != word) {
@@ -994,18 +954,17 @@ void DocumentView::autoCompleteAtCursor() {
             }
             syntaxMenu->addSeparator();
         }
-        // check for autcompletion from ALL words in text editor
-        auto allWords = getAllWords();
-        QStringList menuWords;
-        for(auto theWord: allWords) {
-            if (word != theWord &&
-                    theWord.toLower().startsWith(wordlow) &&
-                    !menuWordsSeen.contains(theWord) &&
-                    QRegularExpression("\\b[akigp]").match(word).hasMatch()) {
-                auto a = syntaxMenu->addAction(theWord, this, SLOT(insertAutoCompleteText()));
-                a->setData(theWord);
-                showSyntaxMenu = true;
-                menuWordsSeen.insert(theWord);
+        // check for autcompletion from ALL words in text editor, the most
+        // used first. Words are only offered as prefix matches
+        if (QRegularExpression("\\b[akigp]").match(word).hasMatch()) {
+            foreach (const CompletionIndex::Match &match, words.complete(word, nullptr, 0)) {
+                const QString &theWord = match.name;
+                if (word != theWord && !menuWordsSeen.contains(theWord)) {
+                    auto a = syntaxMenu->addAction(theWord, this, SLOT(insertAutoCompleteText()));
+                    a->setData(theWord);
+                    showSyntaxMenu = true;
+                    menuWordsSeen.insert(theWord);
+                }
             }
         }
         for(auto tag: tagWords) {
@@ -32,6 +32,9 @@
 #include <QKeyEvent> // For syntax menu class
 #include <QPair>
 
+class DocumentModel;
+struct DocumentOutline;
+
 class MySyntaxMenu: public QMenu
 {
 	Q_OBJECT
@@ -101,7 +104,7 @@ public:
     Highlighter* getHighlighter() { return &m_highlighter; }
     void gotoLineDialog();
     void markCurrentPosition();
-    const QStringList getAllWords();
+    DocumentModel *getDocumentModel() { return m_documentModel; }
 
 
 public slots:
@@ -119,7 +122,6 @@ public slots:
     void findString(QString query = QString());
 	void evaluate();
 	void updateContext();
-	void updateOrcContext(QString orc);
 	void nextParameter();
 	void prevParameter();
 	void showHoverText();
@@ -165,6 +167,7 @@ protected:
 private:
 	QString changeToChnget(QString text);
 	QString changeToInvalue(QString text);
+    void updateLocalVariables();
 
 	MySyntaxMenu *syntaxMenu;
 
@@ -185,10 +188,15 @@ private:
 	bool lastCaseSensitive; // These last three are for search and replace
 	QString lastSearch;
 	QString lastReplace;
-	QStringList m_localVariables;
+	QStringList m_localVariables;  // Of the instrument or UDO under the cursor
 	QStringList m_globalVariables;
-    QTime m_lastWordsUpdate;
-    QStringList m_allWords;
+    DocumentModel *m_documentModel;
+    // Span of the context last found by updateContext, lines are 1-based
+    QSharedPointer<const DocumentOutline> m_contextOutline;
+    int m_contextFirstLine;
+    int m_contextLastLine;  // -1 if the instrument is not closed
+    bool m_contextInSpan;
+    bool m_localVariablesDirty;
     int m_lastCursorPosition;
     QStringList m_longOptions = {
         "syntax-check-only", "control-rate=", "messagelevel=",
@@ -0,0 +1,369 @@
+#include "eventscheduler.h"
+#include "transportclock.h"
+
+#include <QRegExp>
+#include <QStringList>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+
+static const qint64 NEVER = std::numeric_limits<qint64>::max();
+
+ScheduledEvent ScheduledEvent::fromLine(const QString &line)
+{
+	ScheduledEvent event;
+	QString text = line.trimmed();
+	if (!text.isEmpty()) {
+		event.type = text[0].toLatin1();
+	}
+	bool binary = (event.type == 'i' || event.type == 'f') && !text.contains('\n');
+	if (binary) {
+		QStringList fields = text.mid(1).split(QRegExp("\\s+"), SKIP_EMPTY_PARTS);
+		binary = fields.size() >= 2 && fields.size() <= QCS_MAX_EVENT_PFIELDS;
+		for (int i = 0; binary && i < fields.size(); i++) {
+			double value = fields[i].toDouble(&binary);
+			event.pfields.append(value);
+		}
+	}
+	if (!binary) {
+		event.pfields.clear();
+		event.line = text.toLatin1();
+	}
+	return event;
+}
+
+EventTemplate EventTemplate::fromLine(const QString &line)
+{
+	EventTemplate eventTemplate;
+	eventTemplate.text = line;
+	QString text = line.trimmed();
+	if (text.isEmpty() || !text.contains('$') || text.contains('\n')) {
+		eventTemplate.event = ScheduledEvent::fromLine(text);
+		return eventTemplate;
+	}
+	// Split as ScheduledEvent::fromLine does, so slots are p-field indexes
+	QStringList fields = text.mid(1).split(QRegExp("\\s+"), SKIP_EMPTY_PARTS);
+	static const QRegExp slot("\\$[A-Za-z_][A-Za-z0-9_:.]*");
+	for (int i = 0; i < fields.size(); i++) {
+		if (slot.exactMatch(fields[i])) {
+			eventTemplate.slotFields.append(i);
+			eventTemplate.channels.append(fields[i].mid(1));
+			fields[i] = "0";
+		}
+	}
+	eventTemplate.event = ScheduledEvent::fromLine(text.left(1) + " " + fields.join(" "));
+	if (!eventTemplate.event.line.isEmpty() && !eventTemplate.slotFields.isEmpty()) {
+		fields.prepend(text.left(1));
+		eventTemplate.fields = fields;
+	}
+	return eventTemplate;
+}
+
+ScheduledEvent EventTemplate::fill(const QVector<double> &values) const
+{
+	if (slotFields.isEmpty()) {
+		return event;
+	}
+	if (event.line.isEmpty()) {
+		ScheduledEvent filled = event;
+		for (int i = 0; i < slotFields.size(); i++) {
+			filled.pfields[slotFields[i]] = values.value(i);
+		}
+		return filled;
+	}
+	QStringList filled = fields;
+	for (int i = 0; i < slotFields.size(); i++) {
+		filled[slotFields[i] + 1] = QString::number(values.value(i), 'g', 12);
+	}
+	return ScheduledEvent::fromLine(filled.join(" "));
+}
+
+EventScheduler::EventScheduler()
+{
+}
+
+void EventScheduler::setLoop(const void *owner, QSharedPointer<const LiveLoop> loop)
+{
+	// The old loop is released here, so the performance thread never frees memory
+	QMutexLocker locker(&m_mutex);
+	prune();
+	Source &source = m_sources[sourceIndex(owner)];
+	if (source.loop.isNull()) {
+		source.anchor = -1;
+	}
+	source.loop = loop;
+	source.next = -1;
+}
+
+void EventScheduler::removeLoop(const void *owner)
+{
+	QMutexLocker locker(&m_mutex);
+	for (int i = 0; i < m_sources.size(); i++) {
+		if (m_sources[i].owner == owner) {
+			if (m_sources[i].read == m_sources[i].queue.size()) {
+				m_sources.remove(i);
+			}
+			else {
+				// Its queue still plays out. The owner may be deleted
+				// meanwhile, so the source is left without one until
+				// prune() finds it drained
+				m_sources[i].loop.clear();
+				m_sources[i].owner = nullptr;
+			}
+			return;
+		}
+	}
+}
+
+bool EventScheduler::schedule(const void *owner, const ScheduledEvent &event, qint64 time)
+{
+	QMutexLocker locker(&m_mutex);
+	prune();
+	Source &source = m_sources[sourceIndex(owner)];
+	source.queue.remove(0, source.read);
+	source.read = 0;
+	if (source.queue.size() >= QCS_MAX_QUEUED_EVENTS) {
+		return false;
+	}
+	QueuedEvent queued;
+	queued.time = time;
+	queued.event = event;
+	// After the events queued for the same time, so they keep their order
+	QVector<QueuedEvent>::iterator it =
+			std::upper_bound(source.queue.begin(), source.queue.end(), time,
+							 [](qint64 t, const QueuedEvent &e) { return t < e.time; });
+	source.queue.insert(it, queued);
+	return true;
+}
+
+void EventScheduler::reset()
+{
+	QMutexLocker locker(&m_mutex);
+	for (int i = 0; i < m_sources.size(); i++) {
+		m_sources[i].anchor = -1;
+		m_sources[i].queue.clear();
+		m_sources[i].read = 0;
+	}
+	prune();
+}
+
+void EventScheduler::process(CSOUND *csound, const TransportClock &clock, int ksmps)
+{
+	// Missing a pass while the GUI changes a source only delays its due
+	// events to the next one
+	if (!m_mutex.tryLock()) {
+		return;
+	}
+	const qint64 now = clock.position();
+	const qint64 end = now + ksmps;  // Events due before the end of the next pass
+	const double sr = clock.sampleRate();
+	m_heap.clear();
+	for (int i = 0; i < m_sources.size(); i++) {
+		Source &source = m_sources[i];
+		prepare(source, clock, ksmps);
+		Due due;
+		due.time = qMin(loopTime(source, clock), queueTime(source));
+		due.source = i;
+		if (due.time < end) {
+			m_heap.push_back(due);
+		}
+	}
+	std::make_heap(m_heap.begin(), m_heap.end(), later);
+	while (!m_heap.empty()) {
+		std::pop_heap(m_heap.begin(), m_heap.end(), later);
+		Due &due = m_heap.back();
+		Source &source = m_sources[due.source];
+		const double start = due.time > now ? (due.time - now) / sr : 0.0;
+		if (queueTime(source) <= due.time) {
+			send(csound, source.queue.at(source.read).event, start);
+			source.read++;
+		}
+		else {
+			const LiveLoop *loop = source.loop.data();
+			const LiveLoop::Event &event = loop->events.at(source.next);
+			if (source.cycle >= event.firstCycle) {
+				sendLoopEvent(csound, source, clock, start);
+			}
+			if (++source.next == loop->events.size()) {
+				source.next = 0;
+				source.cycle++;
+			}
+		}
+		due.time = qMin(loopTime(source, clock), queueTime(source));
+		if (due.time < end) {
+			std::push_heap(m_heap.begin(), m_heap.end(), later);
+		}
+		else {
+			m_heap.pop_back();
+		}
+	}
+	m_mutex.unlock();
+}
+
+int EventScheduler::sourceIndex(const void *owner)
+{
+	for (int i = 0; i < m_sources.size(); i++) {
+		if (m_sources[i].owner == owner) {
+			return i;
+		}
+	}
+	Source source;
+	source.owner = owner;
+	source.anchor = -1;
+	source.anchorBeat = 0.0;
+	source.cycle = 0;
+	source.next = 0;
+	source.playing = false;
+	source.beatLength = 0.0;
+	source.read = 0;
+	source.generation = 0;
+	m_sources.append(source);
+	m_heap.reserve(m_sources.size());
+	return m_sources.size() - 1;
+}
+
+void EventScheduler::prune()
+{
+	for (int i = m_sources.size() - 1; i >= 0; i--) {
+		if (m_sources[i].owner == nullptr && m_sources[i].read == m_sources[i].queue.size()) {
+			m_sources.remove(i);
+		}
+	}
+}
+
+void EventScheduler::prepare(Source &source, const TransportClock &clock, int ksmps)
+{
+	const LiveLoop *loop = source.loop.data();
+	source.playing = loop != nullptr && !loop->events.isEmpty() && loop->length > 0;
+	if (!source.playing) {
+		return;
+	}
+	const qint64 now = clock.position();
+	const double tempo = loop->followsTransport() ? clock.tempoAt(clock.beatAt(now)) : loop->tempo;
+	source.beatLength = clock.samplesPerBeat(tempo);
+	if (loop->length * source.beatLength < ksmps) {
+		source.playing = false;  // Shorter than a control pass
+		return;
+	}
+	if (source.anchor < 0 || source.generation != clock.generation()) {
+		// Started, stopped or moved, so the loop starts again with the transport
+		source.generation = clock.generation();
+		source.anchor = clock.nextBeat(now);
+		source.cycle = 0;
+		source.next = 0;
+		if (source.anchor < 0) {
+			source.playing = false;  // Stopped
+			return;
+		}
+		source.anchorBeat = floor(clock.beatAt(source.anchor) + 0.5);
+	}
+	else if (source.next < 0) {
+		seek(source, clock, now);
+	}
+}
+
+qint64 EventScheduler::loopTime(const Source &source, const TransportClock &clock)
+{
+	if (!source.playing) {
+		return NEVER;
+	}
+	const LiveLoop *loop = source.loop.data();
+	const LiveLoop::Event &event = loop->events.at(source.next);
+	// From the cycle count, so cycles never drift from each other
+	const double beat = source.cycle * loop->length + event.beat;
+	if (!loop->followsTransport()) {
+		return source.anchor + llround(beat * source.beatLength);
+	}
+	// Placed by the tempo map, so tempo changes reach the loop at once
+	const qint64 time = clock.sampleAt(source.anchorBeat + beat);
+	return time >= 0 ? time : NEVER;  // Stopped during the pass
+}
+
+qint64 EventScheduler::queueTime(const Source &source)
+{
+	return source.read < source.queue.size() ? source.queue.at(source.read).time : NEVER;
+}
+
+bool EventScheduler::later(const Due &a, const Due &b)
+{
+	// Makes the heap a min-heap of times, ties by source index
+	return a.time != b.time ? a.time > b.time : a.source > b.source;
+}
+
+void EventScheduler::seek(Source &source, const TransportClock &clock, qint64 now)
+{
+	const LiveLoop *loop = source.loop.data();
+	double beats = loop->followsTransport() ? clock.beatAt(now) - source.anchorBeat
+											: (now - source.anchor) / source.beatLength;
+	if (beats < 0) {
+		source.cycle = 0;
+		source.next = 0;
+		return;
+	}
+	source.cycle = (qint64) floor(beats / loop->length);
+	double beat = beats - source.cycle * loop->length;
+	QVector<LiveLoop::Event>::const_iterator it =
+			std::lower_bound(loop->events.constBegin(), loop->events.constEnd(), beat,
+							 [](const LiveLoop::Event &event, double b) { return event.beat < b; });
+	source.next = int(it - loop->events.constBegin());
+	if (source.next == loop->events.size()) {
+		source.next = 0;
+		source.cycle++;
+	}
+}
+
+void EventScheduler::send(CSOUND *csound, const ScheduledEvent &event, double start)
+{
+	if (!event.line.isEmpty()) {
+		csoundInputMessage(csound, event.line.constData());
+	}
+	else if (event.head.isEmpty()) {
+		MYFLT pfields[QCS_MAX_EVENT_PFIELDS];
+		const int count = event.pfields.size();
+		for (int i = 0; i < count; i++) {
+			pfields[i] = event.pfields.at(i);
+		}
+		if (count > 1) {
+			pfields[1] += start;
+		}
+		csoundScoreEvent(csound, event.type, pfields, count);
+	}
+	else {
+		char line[QCS_MAX_EVENT_LINE + 32];
+		snprintf(line, sizeof(line), "%s %.8f %s", event.head.constData(), start,
+				 event.tail.constData());
+		csoundInputMessage(csound, line);
+	}
+}
+
+void EventScheduler::sendLoopEvent(CSOUND *csound, const Source &source,
+								   const TransportClock &clock, double start)
+{
+	const LiveLoop *loop = source.loop.data();
+	const LiveLoop::Event &event = loop->events.at(source.next);
+	if (event.duration < 0) {
+		send(csound, event, start);
+		return;
+	}
+	// p3 at the tempo where the note starts
+	const double beat = source.anchorBeat + source.cycle * loop->length + event.beat;
+	const double duration = event.duration * 60.0 / clock.tempoAt(beat);
+	if (event.head.isEmpty()) {
+		MYFLT pfields[QCS_MAX_EVENT_PFIELDS];
+		const int count = event.pfields.size();
+		for (int i = 0; i < count; i++) {
+			pfields[i] = event.pfields.at(i);
+		}
+		pfields[1] += start;
+		pfields[2] = duration;
+		csoundScoreEvent(csound, event.type, pfields, count);
+	}
+	else {
+		char line[QCS_MAX_EVENT_LINE + 64];
+		snprintf(line, sizeof(line), "%s %.8f %.8f %s", event.head.constData(), start,
+				 duration, event.tail.constData());
+		csoundInputMessage(csound, line);
+	}
+}
@@ -0,0 +1,149 @@
+#ifndef EVENTSCHEDULER_H
+#define EVENTSCHEDULER_H
+
+#include <QByteArray>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <vector>
+
+#include "types.h"
+
+class TransportClock;
+
+// Events with more p-fields, or with strings or expressions in them, are
+// sent as text lines of at most QCS_MAX_EVENT_LINE characters
+#define QCS_MAX_EVENT_PFIELDS 64
+#define QCS_MAX_EVENT_LINE 1024
+// Events waiting in the queue of each source
+#define QCS_MAX_QUEUED_EVENTS 4096
+
+// A score event ready to be sent from the performance thread.
+struct ScheduledEvent
+{
+	ScheduledEvent() : type('i') {}
+	// Numeric i and f lines become binary events, anything else is sent
+	// as it is written
+	static ScheduledEvent fromLine(const QString &line);
+
+	char type;
+	QVector<MYFLT> pfields;  // From p1. p2 is added to the offset the event is sent at
+	QByteArray head;  // For text events, the line before p2
+	QByteArray tail;  // and after it. Empty head for binary events
+	QByteArray line;  // Text sent unchanged, p2 and all
+};
+
+// An event line parsed once for buttons and scripts that send it again
+// and again. P-fields written as $channel are slots, filled with a value
+// each time the event is sent, so a numeric template is sent binary
+// without parsing any text.
+struct EventTemplate
+{
+	static EventTemplate fromLine(const QString &line);
+	// The event with its slots set to values, in order. Missing values are 0
+	ScheduledEvent fill(const QVector<double> &values) const;
+
+	QString text;  // The line as written
+	ScheduledEvent event;  // Slots are 0 in the p-fields
+	QVector<int> slotFields;  // Index in the p-fields of each slot
+	QStringList channels;  // The channel named by each slot
+	QStringList fields;  // For text events with slots, the line after the type
+};
+
+// The rows of an event sheet loop, compiled once for the engine. Times are
+// in beats from the start of a cycle. A loop with a tempo of its own has p3
+// scaled to seconds already; one that follows the transport keeps p3 in
+// beats and scales it by the transport tempo where the event starts.
+struct LiveLoop
+{
+	struct Event : ScheduledEvent {
+		Event() : beat(0.0), firstCycle(0), duration(-1.0) {}
+		double beat;     // 0 <= beat < length
+		int firstCycle;  // Events starting past the loop length wait this many cycles
+		// p3 in beats, or -1 if it is sent as it is. In pfields[2] for
+		// binary events, and left out of tail for text events
+		double duration;
+	};
+
+	LiveLoop() : tempo(0.0), length(0.0) {}
+
+	bool followsTransport() const { return tempo <= 0; }
+
+	double tempo;   // bpm, 0 to follow the tempo map of the transport
+	double length;  // Beats
+	QVector<Event> events;  // By beat
+};
+
+// Sends live events to Csound from the performance thread. Each source
+// (an event sheet, or the engine for lines from buttons, the console and
+// Python) has a loop and a queue of events sorted by time. At every
+// control pass the sources are merged by time through a heap holding the
+// next event of each, so events go out in time order, ties in source
+// order, without allocating. Events are sent during the pass before they
+// are due with p2 set to their offset inside it, so they are placed to
+// the sample (with --sample-accurate), and the n-th cycle of a loop
+// starts n lengths after the first rather than after n timer periods.
+class EventScheduler
+{
+public:
+	EventScheduler();
+	// GUI thread. A loop that replaces the one of the same owner keeps its
+	// phase; a new loop starts on the next beat of the transport clock.
+	// Loops play at the tempo of the transport, following its changes,
+	// unless they have a tempo of their own. They start again on a
+	// transport beat when the transport is started or located, and are
+	// silent while it is stopped
+	void setLoop(const void *owner, QSharedPointer<const LiveLoop> loop);
+	void removeLoop(const void *owner);
+	// Sends event at sample time of the transport clock, in the next pass
+	// if it is already due. False if the queue of owner is full
+	bool schedule(const void *owner, const ScheduledEvent &event, qint64 time);
+	// Call before performance starts. Queued events are dropped and loops
+	// restart on the first beat
+	void reset();
+	void process(CSOUND *csound, const TransportClock &clock, int ksmps);  // Called from csThread
+
+private:
+	struct QueuedEvent {
+		qint64 time;
+		ScheduledEvent event;
+	};
+	struct Source {
+		const void *owner;  // nullptr once removed, while its queue drains
+		QSharedPointer<const LiveLoop> loop;
+		qint64 anchor;  // Sample where cycle 0 starts, -1 to start on the next beat
+		double anchorBeat;  // Transport beat at anchor
+		quint32 generation;  // Of the transport when anchored
+		qint64 cycle;
+		int next;       // Next event of the loop, -1 to find it from the clock
+		bool playing;   // Set for the current pass
+		double beatLength;  // In samples, at the current tempo for loops following the transport
+		// By time. Events before read have been sent, they are freed by
+		// the next call to schedule() so the performance thread never does
+		QVector<QueuedEvent> queue;
+		int read;
+	};
+	struct Due {
+		qint64 time;
+		int source;
+	};
+	int sourceIndex(const void *owner);  // Adds a source if needed, mutex held
+	void prune();  // Removes the sources left by removeLoop() once drained, mutex held
+	void prepare(Source &source, const TransportClock &clock, int ksmps);
+	static qint64 loopTime(const Source &source, const TransportClock &clock);
+	static qint64 queueTime(const Source &source);
+	static bool later(const Due &a, const Due &b);
+	static void seek(Source &source, const TransportClock &clock, qint64 now);
+	static void send(CSOUND *csound, const ScheduledEvent &event, double start);
+	static void sendLoopEvent(CSOUND *csound, const Source &source,
+							  const TransportClock &clock, double start);
+
+	QMutex m_mutex;  // Only tried from the performance thread
+	QVector<Source> m_sources;
+	std::vector<Due> m_heap;  // Room for every source is reserved on the GUI thread
+};
+
+#endif // EVENTSCHEDULER_H
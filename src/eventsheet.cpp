@@ -21,6 +21,9 @@
 */
 
 #include "eventsheet.h"
+#include "eventsheetmodel.h"
+#include "eventscheduler.h"
+#include "transportclock.h"
 #include "liveeventframe.h"
 
 #include <QMenu>
@@ -37,6 +40,8 @@
 #include <QFile>
 #include <QMessageBox>
 
+#include <algorithm>
+#include <cmath>
 // For rand() function
 #include <cstdlib>
 // Only for debug
@@ -131,13 +136,13 @@ protected:
 	}
 };
 
-EventSheet::EventSheet(QWidget *parent) : QTableWidget(parent)
+EventSheet::EventSheet(QWidget *parent) : QTableView(parent)
 {
 	//  qDebug() << "EventSheet::EventSheet";
-	this->setRowCount(10);
-	this->setColumnCount(6);
-	columnNames << tr("Event") << "p1 (instr)" << "p2 (start)" << "p3 (dur)" << "p4" << "p5";
-	this->setHorizontalHeaderLabels(columnNames);
+	m_model = new EventSheetModel(this);
+	m_model->insertColumns(0, 6);
+	m_model->setRowCount(10);
+	this->setModel(m_model);
 	this->setColumnWidth(0, 50);
 	this->setColumnWidth(1, 70);
 	this->setColumnWidth(2, 70);
@@ -149,33 +154,38 @@ EventSheet::EventSheet(QWidget *parent) : QTableWidget(parent)
 	m_stopScript = false;
 	m_looping = false;
 	createActions();
-	connect(this, SIGNAL(itemSelectionChanged()), this, SLOT(newSelection()));
 	// a bit of a hack to ensure that manual changes to the sheet are stored in the
 	// undo history. This seems better than calling markHistory() when a cell
 	// changes because large operations like add or subractract will produce
 	// many steps in the history
 //	connect(this, SIGNAL(cellDoubleClicked(int, int)), this, SLOT(cellDoubleClickedSlot(int, int)));
-	connect(this, SIGNAL(cellChanged (int, int)), this, SLOT(cellChangedSlot(int, int)));
+	connect(m_model, SIGNAL(cellEdited(int,int)), this, SLOT(cellChangedSlot(int,int)));
+	connect(this->selectionModel(), SIGNAL(selectionChanged(QItemSelection,QItemSelection)),
+			this, SLOT(newSelection()));
+	this->setDragDropOverwriteMode(true);
 
-	loopTimer.setSingleShot(true);
-	connect(&loopTimer, SIGNAL(timeout()), this, SLOT(sendEvents()));
+	m_scheduler = 0;
+	m_clock = 0;
+	m_tempo = 0.0;
+	m_loopStart = m_loopEnd = -1;
 
 	builtinScripts << ":/python/sort_by_start.py" << ":/python/produce_score.py"<< ":/python/fill_text.py";
 	converterScripts << ":/python/Conversion/cps2mid.py" << ":/python/Conversion/mid2cps.py" << ":/python/Conversion/cps2pch.py"
 					 << ":/python/Conversion/pch2cps.py" ;
 	testScripts <<  ":/python/Tests/python_test.py" << ":/python/Tests/tk_test.py";
-
-	noHistoryChange = 0;
 }
 
 EventSheet::~EventSheet()
 {
+	if (m_scheduler != 0) {
+		m_scheduler->removeLoop(this);
+	}
 }
 
 QString EventSheet::getPlainText(bool scaleTempo)
 {
 	QString t = "";
-	for (int i = 0; i < this->rowCount(); i++) {
+	for (int i = 0; i < m_model->rowCount(); i++) {
 		t += getLine(i, scaleTempo) + "\n";  // Don't scale by default
 	}
 	t.chop(1);
@@ -185,35 +195,28 @@ QString EventSheet::getPlainText(bool scaleTempo)
 
 QString EventSheet::getSelection(bool cut)
 {
-	QModelIndexList list = this->selectedIndexes();
 	QList<int> selectedRows;
 	QList<int> selectedColumns;
-	for (int i = 0; i < list.size(); i++) { // Get list of selected rows
-		if (!selectedRows.contains(list[i].row()) ) {
-			selectedRows.append(list[i].row());
-		}
-		if (!selectedColumns.contains(list[i].column()) ) {
-			selectedColumns.append(list[i].column());
-		}
-	}
+	selectedRowsAndColumns(&selectedRows, &selectedColumns);
 	QString text = "";
+	if (cut) {
+		recordSelection();
+		m_model->beginUpdate();
+	}
 	for (int i = 0; i < selectedRows.size(); i++) {
 		QString line = "";
 		for (int j = 0; j < selectedColumns.size(); j++) {
-			QTableWidgetItem * item = this->item(selectedRows[i], selectedColumns[j]);
-			if (item != 0) { // Item is not empty
-				line += item->data(Qt::DisplayRole).toString();
-				QString space = item->data(Qt::UserRole).toString();
-				if (!space.isEmpty())
-					line += space;
-				else
-					line += " ";
+			int row = selectedRows[i], column = selectedColumns[j];
+			if (m_model->kind(row, column) != EventSheetModel::EmptyCell) {
+				line += m_model->text(row, column) + m_model->separator(row, column);
 				if (cut)
-					delete item;
+					m_model->clearCell(row, column);
 			}
 		}
 		text += line + "\n";
 	}
+	if (cut)
+		m_model->endUpdate();
 	text.chop(1); // remove last line break
 	return text;
 }
@@ -221,99 +224,72 @@ QString EventSheet::getSelection(bool cut)
 QString EventSheet::getLine(int number, bool scaleTempo, bool storeNumber, bool preprocess, double startOffset)
 {
 	QString line = "";
-	bool instrEvent = false;
-	bool comment = false;
-	for (int i = 0; i < this->columnCount(); i++) {
-		QTableWidgetItem * item = this->item(number, i);
-		if (item != 0) { // Item is not empty
-			if (i == 0 && (item->data(Qt::DisplayRole).toString() == "i") ) {
-				instrEvent = true;  // Check if event is intrument note to allow scale by tempo
-			}
-			if (instrEvent && i == 1 && storeNumber) { // append current instrument number to active note list
-				bool ok = false;
-				double instrNum = item->data(Qt::DisplayRole).toDouble(&ok);
-				if (ok && !activeInstruments.contains(instrNum))
-					activeInstruments.append(instrNum);
-			}
-			if (preprocess && item->data(Qt::DisplayRole).toString() == ".") { // Carry value from above
-				QString cellText = ".";
-				int row = number;
-				while (row >= 0 && cellText == "." && cellText != "") {
-					item = this->item(row, i);
-					if (item != 0 ) {
-						cellText = item->data(Qt::DisplayRole).toString();
-					}
-					else {
-						cellText = "";
-					}
-					row--;
-				}
-			}
-			if (scaleTempo && instrEvent && (i == 2 || i == 3) ) { // Scale tempo only for pfields p2 and p3
-				bool ok = false;
-				double value = item->data(Qt::DisplayRole).toDouble(&ok);
-				if (ok) {
-					if (i == 2) { // Add start offset to p2 before scaling
-						value += startOffset;
-					}
-					value = value * (60.0/m_tempo);
-					line += QString::number(value, 'f', 8);;
-				}
-				else {
-					line += item->data(Qt::DisplayRole).toString();
-				}
-			}
-			else {  // All other p-fields that don't require tempo scaling
-				QString cellText = item->data(Qt::DisplayRole).toString();
-				if (comment) {
-					bool dataRemaining = false;  // Check if remaining cells have data
-					for (int j = i + 1; j < this->columnCount(); j++) {
-						QTableWidgetItem * checkItem = this->item(number, j);
-						if (checkItem != 0 && checkItem->data(Qt::DisplayRole).toString() != "") {
-							dataRemaining = true;
-							break;
-						}
-					}
-					if (dataRemaining || cellText != "")
-						line += ";" + cellText;
-				}
-				else if (cellText.startsWith(';')) {
-					comment = true; // is a comment from now on
-					line += cellText;
-				}
-				else {
-					line += cellText;
-				}
-			}
-			// Then add white space separation
-			QString space = item->data(Qt::UserRole).toString();
-			if (!space.isEmpty()) { // Separataion is stored in UserRole of items
-				line += space;
+	// Everything from the first cell starting with ; is a comment, so later
+	// cells get the ; back that splitting the comment into cells took away
+	int comment = m_model->commentColumn(number);
+	int last = m_model->lastColumn(number);
+	const double tempo = scaleTempo ? currentTempo() : QCS_DEFAULT_TEMPO;
+	bool instrEvent = last >= 0 && m_model->kind(number, 0) == EventSheetModel::TextCell
+			&& m_model->text(number, 0) == "i";  // Only instrument notes are scaled by tempo
+	for (int i = 0; i <= last; i++) {
+		EventSheetModel::CellKind kind = m_model->kind(number, i);
+		if (kind == EventSheetModel::EmptyCell) {
+			continue;
+		}
+		int row = number;
+		if (preprocess && kind == EventSheetModel::CarryCell) { // Carry value from above
+			int source = m_model->carrySource(number, i);
+			if (source >= 0) {
+				row = source;
+				kind = m_model->kind(row, i);
 			}
-			else {
-				line += " ";
+		}
+		if (instrEvent && i == 1 && storeNumber && kind == EventSheetModel::NumberCell) {
+			// append current instrument number to active note list
+			double instrNum = m_model->number(row, i);
+			if (!activeInstruments.contains(instrNum))
+				activeInstruments.append(instrNum);
+		}
+		if (comment >= 0 && i > comment) {
+			line += ";" + m_model->text(row, i);
+		}
+		else if (scaleTempo && instrEvent && (i == 2 || i == 3)
+				 && kind == EventSheetModel::NumberCell) { // Scale tempo only for pfields p2 and p3
+			double value = m_model->number(row, i);
+			if (i == 2) { // Add start offset to p2 before scaling
+				value += startOffset;
 			}
+			value = value * (60.0/tempo);
+			line += QString::number(value, 'f', 8);
 		}
-		else if (comment) { // empty cell part of a comment
-			// Do nothing
+		else {
+			line += m_model->text(row, i);
 		}
+		line += m_model->separator(number, i);
 	}
 	return line;
 }
 
 QList< QList<QVariant> > EventSheet::getData()
 {
-	// TODO this can be made a lot more efficient
 	QList< QList<QVariant> > data;
-	for (int i = 0; i < this->rowCount(); i++) {
+	const int rows = m_model->rowCount();
+	const int columns = m_model->columnCount();
+	data.reserve(rows);
+	for (int i = 0; i < rows; i++) {
 		QList<QVariant> row;
-		for (int j = 0; j < this->columnCount(); j++) {
-			QTableWidgetItem * item = this->item(i, j);
-			if (item != 0) { // Item is not empty
-				row.append(item->data(Qt::DisplayRole));
-			}
-			else {
+		row.reserve(columns);
+		for (int j = 0; j < columns; j++) {
+			switch (m_model->kind(i, j)) {
+			case EventSheetModel::EmptyCell:
 				row.append(QVariant());
+				break;
+			case EventSheetModel::NumberCell:
+				row.append(m_model->number(i, j));
+				break;
+			default:
+				row.append(m_model->text(i, j));
+				break;
 			}
 		}
 		data << row;
@@ -323,74 +299,85 @@ QList< QList<QVariant> > EventSheet::getData()
 
 void EventSheet::setFromText(QString text, int rowOffset, int columnOffset, int numRows, int numColumns, bool noHistoryMark)
 {
-	// Separataion is stored in UserRole of items
 	// remember to treat comments and formulas properly
 	QStringList lines = text.split("\n");
 	int nRows = 0; // Number of actual rows to process
 	// numRows = 0 : don't remove rows, only add if necessary. numRows = -1 limit rows to the ones in text
 	nRows = numRows <= 0 ? lines.size() : numRows;
-	if (this->rowCount() < nRows + rowOffset || numRows == -1) {
-		this->setRowCount(nRows + rowOffset);
+	if (m_model->rowCount() < nRows + rowOffset || numRows == -1) {
+		m_model->setRowCount(nRows + rowOffset);
 	}
+	QVector<QList<QPair<QString, QString> > > rows(nRows);
+	int lastColumn = -1;
 	for (int i = 0; i < nRows; i++) {
-		//    if (nRows != 0 && i >= nRows) {  // Only paste up to a certain number of rows if not 0
-		//      break;
-		//    }
 		QString line = "";
 		if (i < lines.size()) {
 			line = lines[i].trimmed(); //Remove whitespace from start and end
 		}
-		this->blockSignals(true); // To avoid triggering changed signal which goes to undo for each cell
-		QList<QPair<QString, QString> > fields = parseLine(line);
+		rows[i] = parseLine(line);
+		int nColumns = numColumns == 0 ? rows[i].size() : numColumns;
+		nColumns = (numColumns == -1 && nColumns <  m_model->columnCount()) ?  m_model->columnCount() : nColumns;
+		lastColumn = qMax(lastColumn, nColumns + columnOffset - 1);
+	}
+	while (m_model->columnCount() <= lastColumn) {
+		appendColumn();
+	}
+	m_model->recordCells(rowOffset, columnOffset, rowOffset + nRows - 1, lastColumn);
+	// Cells are announced to the view once, at the end
+	m_model->beginUpdate();
+	for (int i = 0; i < nRows; i++) {
+		const QList<QPair<QString, QString> > &fields = rows[i];
 		int nColumns = numColumns == 0 ? fields.size() : numColumns;
-		nColumns = (numColumns == -1 && nColumns <  this->columnCount()) ?  this->columnCount() : nColumns;
-		while (this->columnCount() < nColumns + columnOffset) {
-			appendColumn();
-		}
-		int j;
-		for (j = 0; j < nColumns; j++) {
-			QTableWidgetItem * item = this->item(i + rowOffset, j + columnOffset);
-			if (item == 0) {
-				item = new QTableWidgetItem();
-				noHistoryChange = (noHistoryMark ? 1: 0);
-				this->setItem(i + rowOffset, j + columnOffset, item);
-			}
+		nColumns = (numColumns == -1 && nColumns <  m_model->columnCount()) ?  m_model->columnCount() : nColumns;
+		for (int j = 0; j < nColumns; j++) {
 			if (j < fields.size()) {
-				noHistoryChange = (noHistoryMark ? 1: 0);
-				item->setData(Qt::DisplayRole, fields[j].first);
-				noHistoryChange = (noHistoryMark ? 1: 0);
-				item->setData(Qt::UserRole, fields[j].second);
+				m_model->setText(i + rowOffset, j + columnOffset, fields[j].first);
+				m_model->setSeparator(i + rowOffset, j + columnOffset, fields[j].second);
 			}
 			else {
-				noHistoryChange = (noHistoryMark ? 1: 0);
-				item->setData(Qt::DisplayRole, "");
-				noHistoryChange = (noHistoryMark ? 1: 0);
-				item->setData(Qt::UserRole, "");
+				m_model->clearCell(i + rowOffset, j + columnOffset);
 			}
 		}
-		while (j < numColumns && j + columnOffset < this->columnCount()) {
-			this->removeCellWidget(i + rowOffset, j + columnOffset);
-			j++;
-		}
 	}
-	// column names mus be reset here as the names have been cleared
-	this->setHorizontalHeaderLabels(columnNames);
-	this->blockSignals(false);
+	m_model->endUpdate();
 	if (!noHistoryMark) {
-		emit ( cellChanged(rowOffset, columnOffset) );
+		cellChangedSlot(rowOffset, columnOffset);
 	}
-	if (this->rowCount() == 0)
-		this->setRowCount(1);
+	if (m_model->rowCount() == 0)
+		m_model->setRowCount(1);
 }
 
 void EventSheet::setCell(int row, int column, QVariant value)
 {
-	QTableWidgetItem * item = this->item(row, column);
-	if (item == 0) {
-		item = new QTableWidgetItem();
-		this->setItem(row, column, item);
+	if (row < 0 || row >= m_model->rowCount() || column < 0 || column >= m_model->columnCount()) {
+		return;
+	}
+	if (value.type() == QVariant::Double || value.type() == QVariant::Int) {
+		m_model->setNumber(row, column, value.toDouble());
+	}
+	else {
+		m_model->setText(row, column, value.toString());
 	}
-	item->setData(Qt::DisplayRole, value);
+}
+
+QVector<double> EventSheet::columnNumbers(int column, int first, int count)
+{
+	if (column < 0 || column >= m_model->columnCount() || first < 0 || first > m_model->rowCount()) {
+		return QVector<double>();
+	}
+	if (count < 0 || first + count > m_model->rowCount()) {
+		count = m_model->rowCount() - first;
+	}
+	return m_model->numbers(column, first, count);
+}
+
+void EventSheet::setColumnNumbers(int column, const QVector<double> &values, int first)
+{
+	if (column < 0 || column >= m_model->columnCount() || first < 0 || first >= m_model->rowCount()) {
+		return;
+	}
+	m_model->setNumbers(column, first, values);
+	changed();
 }
 
 void EventSheet::setDebug(bool debug)
@@ -398,16 +385,37 @@ void EventSheet::setDebug(bool debug)
 	m_debug = debug;
 }
 
+void EventSheet::clear()
+{
+	m_model->clearCells();
+}
+
+void EventSheet::setRowCount(int rows)
+{
+	m_model->setRowCount(rows);
+}
+
+void EventSheet::setColumnCount(int columns)
+{
+	while (m_model->columnCount() < columns) {
+		appendColumn();
+	}
+	if (m_model->columnCount() > columns) {
+		m_model->removeColumns(columns, m_model->columnCount() - columns);
+	}
+}
+
 QPair<int, int> EventSheet::getSelectedRowsRange()
 {
-	QModelIndexList selection = this->selectedIndexes();
-	int min = 9999, max = -1;
+	// The ranges, not selectedIndexes(), which lists every cell of a select all
+	QItemSelection selection = this->selectionModel()->selection();
+	int min = m_model->rowCount(), max = -1;
 	for (int i = 0; i < selection.size(); i++) {
-		if (selection[i].row() > max) {
-			max = selection[i].row();
+		if (selection[i].bottom() > max) {
+			max = selection[i].bottom();
 		}
-		if (selection[i].row() < min) {
-			min = selection[i].row();
+		if (selection[i].top() < min) {
+			min = selection[i].top();
 		}
 	}
 	qDebug() << "EventSheet::getSelectedRowsRange " << min << " "<< max;
@@ -418,29 +426,41 @@ void EventSheet::setTempo(double value)
 {
 	//  qDebug() << "EventSheet::setTempo " << value;
 	m_tempo = value;
+	updateLoop();
 }
 
 void EventSheet::setLoopLength(double value)
 {
 	//  qDebug() << "EventSheet::setLoopLength " << value;
 	m_loopLength = value;
+	updateLoop();
 }
 
-void EventSheet::sendEvents()
+void EventSheet::setEventScheduler(EventScheduler *scheduler, const TransportClock *clock)
 {
-	QModelIndexList list;
-	QPair<int, int> rowsRange;
-	if (m_looping && sender() != sendEventsAct) {
-		double time = 1000.0 * m_loopLength * 60.0 /m_tempo;
-		loopTimer.start(time);
-		qDebug() << " EventSheet::sendEvents() " << time;
-		rowsRange.first = m_loopStart;
-		rowsRange.second = m_loopEnd;
+	if (m_scheduler != 0) {
+		m_scheduler->removeLoop(this);
 	}
-	else {
-		rowsRange = getSelectedRowsRange();
+	m_scheduler = scheduler;
+	m_clock = clock;
+	updateLoop();
+}
+
+double EventSheet::currentTempo()
+{
+	if (m_tempo > 0) {
+		return m_tempo;
 	}
-	for (int i = rowsRange.first; i <= rowsRange.second; i++) {
+	if (m_clock == 0) {
+		return QCS_DEFAULT_TEMPO;
+	}
+	return m_clock->tempoAt(m_clock->beatAt(m_clock->position()));
+}
+
+void EventSheet::sendEvents()
+{
+	QPair<int, int> rowsRange = getSelectedRowsRange();
+	for (int i = rowsRange.first; i <= rowsRange.second && i < m_model->rowCount(); i++) {
 		//    double number = 0.0;
 		emit sendEvent(getLine(i, true, true, true));  // With tempo scaling
 	}
@@ -448,7 +468,7 @@ void EventSheet::sendEvents()
 
 void EventSheet::sendAllEvents()
 {
-	for (int i = 0; i < this->rowCount(); i++) {
+	for (int i = 0; i < m_model->rowCount(); i++) {
 		//    qDebug() << "EventSheet::sendAllEvents() " << i;
 		emit sendEvent(getLine(i, true, true, true));  // With tempo scaling
 	}
@@ -456,22 +476,15 @@ void EventSheet::sendAllEvents()
 
 void EventSheet::sendEventsOffset()
 {
-	QModelIndexList list;
 	QList<int> selectedRows;
-	list = this->selectedIndexes();
-	for (int i = 0; i < list.size(); i++) {
-		if (!selectedRows.contains(list[i].row()) ) {
-			selectedRows.append(list[i].row());
-		}
-	}
+	selectedRowsAndColumns(&selectedRows, 0);
 	double minTime = 999999999999999.0;
 	bool hasMin = false;
 	for (int i = 0; i < selectedRows.size(); i++) {
-		QTableWidgetItem * item = this->item(selectedRows[i], 2);
-		if (item != 0 && item->data(Qt::DisplayRole).canConvert(QVariant::Double)) {
-			bool ok = false;
-			double n = item->data(Qt::DisplayRole).toDouble(&ok);
-			if (ok && n < minTime) {
+		if (m_model->columnCount() > 2
+				&& m_model->kind(selectedRows[i], 2) == EventSheetModel::NumberCell) {
+			double n = m_model->number(selectedRows[i], 2);
+			if (n < minTime) {
 				minTime = n;
 				hasMin = true;
 			}
@@ -499,8 +512,7 @@ void EventSheet::setLoopActive(bool loop)
 	if (loop) {
 		if (!m_looping) {
 			m_looping = true;
-			markLoop(m_loopStart, m_loopEnd);
-			sendEvents();
+			markLoop(m_loopStart, m_loopEnd);  // Also hands the loop to the engine
 		}
 	}
 	else {
@@ -509,31 +521,133 @@ void EventSheet::setLoopActive(bool loop)
 	}
 }
 
-void EventSheet::markLoop(double start, double end)
+void EventSheet::updateLoop()
 {
-	// TODO move looping to eventframe class
-	m_loopStart = (int) start;
-	m_loopEnd = (int) end;
-	for (int i = 0; i < rowCount(); i++) {
-		for (int j = 0; j < 4; j++) {
-			QTableWidgetItem * item = this->item(i, j);
-			if (item == 0) {
-				item = new QTableWidgetItem();
-				this->setItem(i, j, item );
+	if (m_scheduler == 0) {
+		return;
+	}
+	if (m_looping) {
+		m_scheduler->setLoop(this, compileLoop());
+	}
+	else {
+		m_scheduler->removeLoop(this);
+	}
+}
+
+QSharedPointer<const LiveLoop> EventSheet::compileLoop()
+{
+	QSharedPointer<LiveLoop> loop(new LiveLoop);
+	loop->tempo = m_tempo;
+	loop->length = m_loopLength;
+	for (int row = qMax(m_loopStart, 0); row <= m_loopEnd && row < m_model->rowCount(); row++) {
+		LiveLoop::Event event;
+		if (compileEvent(row, &event)) {
+			if (loop->length > 0) {
+				event.firstCycle = (int) floor(event.beat / loop->length);
+				event.beat -= event.firstCycle * loop->length;
 			}
-			if (i < m_loopStart || i > m_loopEnd) {
-				item->setBackground(QBrush());
+			loop->events.append(event);
+		}
+	}
+	std::stable_sort(loop->events.begin(), loop->events.end(),
+					 [](const LiveLoop::Event &a, const LiveLoop::Event &b) { return a.beat < b.beat; });
+	return loop;
+}
+
+bool EventSheet::compileEvent(int row, LiveLoop::Event *event)
+{
+	int last = m_model->lastColumn(row);
+	int comment = m_model->commentColumn(row);
+	if (comment >= 0) {
+		last = comment - 1;
+	}
+	if (last < 2 || m_model->kind(row, 0) != EventSheetModel::TextCell
+			|| m_model->text(row, 0).size() != 1
+			|| m_model->kind(row, 1) == EventSheetModel::EmptyCell) {
+		return false;  // Needs an event type, p1 and p2
+	}
+	event->type = m_model->text(row, 0)[0].toLatin1();
+	event->firstCycle = 0;
+	event->duration = -1.0;
+	bool instrEvent = event->type == 'i';
+	// Loops that follow the transport keep p3 in beats until they are sent.
+	// Other events have start times in seconds, placed at the tempo in
+	// effect now
+	const bool follow = m_tempo <= 0;
+	const double tempo = currentTempo();
+	bool binary = last <= QCS_MAX_EVENT_PFIELDS;
+	QStringList fields;  // Text of the p-fields other than p2
+	for (int i = 1; i <= last; i++) {
+		int source = row;
+		EventSheetModel::CellKind kind = m_model->kind(row, i);
+		if (kind == EventSheetModel::CarryCell) {
+			source = m_model->carrySource(row, i);
+			if (source >= 0) {
+				kind = m_model->kind(source, i);
+			}
+			else if (i <= 2) {
+				return false;  // No instrument or start to carry
 			}
 			else {
-				if (m_looping) {
-					item->setBackground(QBrush(Qt::green));
-				}
-				else {
-					item->setBackground(QBrush(QColor(200,255,200)));
-				}
+				// Nothing above to carry, the "." is sent as written, as in getLine()
+				source = row;
+				kind = EventSheetModel::TextCell;
+			}
+		}
+		if (i == 2) {
+			if (kind != EventSheetModel::NumberCell) {
+				return false;  // Can't place it in time
+			}
+			double start = qMax(m_model->number(source, i), 0.0);
+			// Only instrument notes are in beats, as in getLine()
+			event->beat = instrEvent ? start : start * tempo / 60.0;
+			event->pfields.append(0.0);
+			continue;
+		}
+		if (kind == EventSheetModel::EmptyCell) {
+			continue;
+		}
+		if (kind == EventSheetModel::NumberCell) {
+			double value = m_model->number(source, i);
+			if (instrEvent && i == 3 && follow) {
+				event->duration = value;  // Sent after p2, see EventScheduler
+			}
+			else if (instrEvent && i == 3) {
+				value *= 60.0 / tempo;
+				fields << QString::number(value, 'f', 8);
+			}
+			else {
+				fields << m_model->text(source, i);
+			}
+			if (instrEvent && i == 1 && !activeInstruments.contains(value)) {
+				activeInstruments.append(value);
 			}
+			event->pfields.append(value);
+		}
+		else {
+			fields << m_model->text(source, i);
+			binary = false;
 		}
 	}
+	if (!binary) {
+		event->pfields.clear();
+		event->head = (QString(event->type) + " " + fields.takeFirst()).toLatin1();
+		event->tail = fields.join(" ").toLatin1();
+		if (event->head.size() + event->tail.size() > QCS_MAX_EVENT_LINE) {
+			qDebug() << "EventSheet::compileEvent line too long for loop, row" << row;
+			return false;
+		}
+	}
+	return true;
+}
+
+void EventSheet::markLoop(double start, double end)
+{
+	// TODO move looping to eventframe class
+	m_loopStart = (int) start;
+	m_loopEnd = (int) end;
+	m_model->setLoopRange(m_loopStart, m_loopEnd, m_looping);
+	updateLoop();
 }
 
 void EventSheet::setLoopRange()
@@ -547,7 +661,6 @@ void EventSheet::setLoopRange()
 
 void EventSheet::stopAllEvents()
 {
-	loopTimer.stop();
 	m_looping = false;
 	markLoop();
 	while (!activeInstruments.isEmpty()) {
@@ -560,20 +673,24 @@ void EventSheet::stopAllEvents()
 
 void EventSheet::del()
 {
-	QModelIndexList list = this->selectedIndexes();
-	for (int i = 0; i < list.size(); i++) {
-		QTableWidgetItem * item = this->item(list[i].row(), list[i].column());
-		if (item != 0) { // Item is not empty
-			delete item;
+	QItemSelection selection = this->selectionModel()->selection();
+	recordSelection();
+	m_model->beginUpdate();
+	for (int i = 0; i < selection.size(); i++) {
+		for (int row = selection[i].top(); row <= selection[i].bottom(); row++) {
+			for (int column = selection[i].left(); column <= selection[i].right(); column++) {
+				m_model->clearCell(row, column);
+			}
 		}
 	}
-	markHistory();
+	m_model->endUpdate();
+	changed();
 }
 
 void EventSheet::cut()
 {
 	copy(true);
-	markHistory();
+	changed();
 }
 
 void EventSheet::copy(bool cut)
@@ -584,86 +701,46 @@ void EventSheet::copy(bool cut)
 void EventSheet::paste()
 {
 	//  qDebug() << "EventSheet::paste() text = " << qApp->clipboard()->text();
-	QModelIndexList list = this->selectedIndexes();
 	QList<int> selectedRows;
 	QList<int> selectedColumns;
-	int rowCount, columnCount;
-	int lowestRow = 0x0fffffff, lowestColumn = 0x0fffffff;
-	for (int i = 0; i < list.size(); i++) { // Get list of selected rows
-		if (!selectedRows.contains(list[i].row()) ) {
-			selectedRows.append(list[i].row());
-			if (list[i].row() < lowestRow) {
-				lowestRow = list[i].row();
-			}
-		}
-		if (!selectedColumns.contains(list[i].column()) ) {
-			selectedColumns.append(list[i].column());
-			if (list[i].column() < lowestColumn) {
-				lowestColumn = list[i].column();
-			}
-		}
-	}
-	if (lowestRow == 0x0fffffff) { // If there is no selection
-		lowestRow = 0;
-	}
-	if (lowestColumn == 0x0fffffff) { // If there is no selection
-		lowestColumn = 0;
-	}
-	rowCount = selectedRows.size();
-	columnCount = selectedColumns.size();
+	selectedRowsAndColumns(&selectedRows, &selectedColumns);
+	int rowCount = selectedRows.size();
+	int columnCount = selectedColumns.size();
+	int lowestRow = rowCount > 0 ? selectedRows.first() : 0;  // 0 if there is no selection
+	int lowestColumn = columnCount > 0 ? selectedColumns.first() : 0;
 	if (rowCount <= 1 && columnCount <= 1) {
 		rowCount = columnCount = 0;
 	}
 	// TODO comments that should be pasted on multiple cells are not.
 	setFromText(qApp->clipboard()->text(), lowestRow, lowestColumn, rowCount, columnCount, true);
-	markHistory();
+	changed();
 }
 
 void EventSheet::undo()
 {
-	qDebug() << "EventSheet::undo() " << historyIndex;
-	if (historyIndex > 0) {
-		historyIndex--;
-		setFromText(history[historyIndex], 0,0,rowCount(),columnCount(),true);
+	m_model->commitStep();  // Changes not marked yet are undone first
+	if (m_model->undo()) {
+		updateLoop();
+		emit modified();
 	}
 }
 
 void EventSheet::redo()
 {
-	qDebug() << "EventSheet::redo() " << historyIndex << history.size();
-	if (historyIndex < history.size() - 1) {
-		historyIndex++;
-		setFromText(history[historyIndex], 0,0,rowCount(),columnCount(),true);
+	if (m_model->redo()) {
+		updateLoop();
+		emit modified();
 	}
 }
 
 void EventSheet::markHistory()
 {
-	QString text = getPlainText();
-	if (history.isEmpty()) {
-		history << "";
-		historyIndex = 0;
-	}
-	if (history[historyIndex] != text) {
-		if (! history[historyIndex].isEmpty())
-			historyIndex++;
-		//    if (historyIndex >= QCS_MAX_UNDO) {
-		//      history.pop_front();
-		//      historyIndex--;
-		//    }
-		if (history.size() != historyIndex + 1)
-			history.resize(historyIndex + 1);
-		history[historyIndex] = text;
-		//    qDebug() << "EventSheet::markHistory "<< historyIndex << " ....."  << text;
-	}
+	m_model->commitStep();
 }
 
 void EventSheet::clearHistory()
 {
-	QString text = getPlainText();
-	//  qDebug() << "EventSheet::clearHistory() " << text;
-	history.clear();
-	historyIndex = 0;
+	m_model->clearUndo();
 }
 
 void EventSheet::setScriptDirectory(QString dir)
@@ -725,40 +802,23 @@ void EventSheet::randomize()
 
 void EventSheet::reverse()
 {
-	QModelIndexList list = this->selectedIndexes();
-	if (list.size() < 2)
-		return;
-	QList<int> selectedColumns;
-	for (int i = 0; i < list.size(); i++) {
-		if (!selectedColumns.contains(list[i].column()) ) {
-			selectedColumns.append(list[i].column());
-		}
-	}
-	int numRows = list.size() / selectedColumns.size();
-	if (numRows < 2)
-		return;
-
-	QVector<QVariant> elements;
-	elements.resize(numRows);
-	for (int i = 0; i < selectedColumns.size(); i++) {
-		for (int j = 0; j < numRows; j++) {
-			QTableWidgetItem * item = this->item(list[(i*numRows) + j].row(), list[(i*numRows) + j].column());
-			if (item != 0) {
-				elements[numRows - j - 1] = item->data(Qt::DisplayRole);
-			}
-			else {
-				elements[numRows - j - 1] = QVariant();
-			}
-		}
-		for (int j = 0; j < numRows; j++) {
-			QTableWidgetItem * item = this->item(list[(i*numRows) + j].row(), list[(i*numRows) + j].column());
-			if (item == 0) {
-				item = new QTableWidgetItem();
-				this->setItem(list[(i*numRows) + j].row(), list[(i*numRows) + j].column(), item );
+	QItemSelection selection = this->selectionModel()->selection();
+	m_model->beginUpdate();
+	for (int i = 0; i < selection.size(); i++) { // Reverse each column of each range
+		for (int column = selection[i].left(); column <= selection[i].right(); column++) {
+			int top = selection[i].top();
+			int bottom = selection[i].bottom();
+			while (top < bottom) {
+				EventSheetModel::Cell cell = m_model->cell(top, column);
+				m_model->setCell(top, column, m_model->cell(bottom, column));
+				m_model->setCell(bottom, column, cell);
+				top++;
+				bottom--;
 			}
-			item->setData(Qt::DisplayRole, elements[j] );
 		}
 	}
+	m_model->endUpdate();
+	changed();
 }
 
 void EventSheet::shuffle()
@@ -811,66 +871,29 @@ void EventSheet::runScript()
 
 QString EventSheet::generateDataText(QString outFileName)
 {
-	QModelIndexList list = this->selectedIndexes();
+	QItemSelection selection = this->selectionModel()->selection();
 	int minRow = 999999, minCol = 999999, maxRow = -1, maxCol = -1;
-	for (int i = 0; i < list.size(); i++) { // First traverse to find size
-		if (list[i].row() > maxRow) {
-			maxRow = list[i].row();
-		}
-		if (list[i].row() < minRow) {
-			minRow = list[i].row();
-		}
-		if (list[i].column() > maxCol) {
-			maxCol = list[i].column();
-		}
-		if (list[i].column() < minCol) {
-			minCol = list[i].column();
-		}
+	for (int i = 0; i < selection.size(); i++) { // First traverse to find size
+		maxRow = qMax(maxRow, selection[i].bottom());
+		minRow = qMin(minRow, selection[i].top());
+		maxCol = qMax(maxCol, selection[i].right());
+		minCol = qMin(minCol, selection[i].left());
 	}
-	//  QString data = "[ ";
-	//  for (int i = minRow; i <= maxRow; i++) {
-	//    data += "[ ";
-	//    for (int j = minCol; j <= maxCol; j++) {
-	//      QTableWidgetItem * item = this->item(i, j);
-	//      if ( item == 0) {
-	//        data += "''";
-	//      }
-	//      else {
-	//        bool ok;
-	//        item->data(Qt::DisplayRole).toString().toDouble(&ok);
-	//        if (ok) {
-	//          data += item->data(Qt::DisplayRole).toString();
-	//        }
-	//        else {
-	//          data += "'" + item->data(Qt::DisplayRole).toString() + "'";
-	//        }
-	//      }
-	//      data += ", ";
-	//    }
-	//    data.chop(2);
-	//    data += " ],\n";
-	//  }
-	//  data.chop(2);
-	//  data += " ]";
 
 	QString data_all = "[ ";
-	for (int i = 0; i < this->rowCount(); i++) {
+	for (int i = 0; i < m_model->rowCount(); i++) {
 		data_all += "[ ";
-		for (int j = 0; j < this->columnCount() ; j++) {
-			QTableWidgetItem * item = this->item(i, j);
-			if ( item == 0) {
+		for (int j = 0; j < m_model->columnCount() ; j++) {
+			switch (m_model->kind(i, j)) {
+			case EventSheetModel::EmptyCell:
 				data_all += "''";
-			}
-			else {
-				bool ok;
-				item->data(Qt::DisplayRole).toString().toDouble(&ok);
-				//        qDebug() << item->data(Qt::DisplayRole).typeName() << item;
-				if (ok) {
-					data_all += item->data(Qt::DisplayRole).toString();
-				}
-				else {
-					data_all += "'" + item->data(Qt::DisplayRole).toString() + "'";
-				}
+				break;
+			case EventSheetModel::NumberCell:
+				data_all += m_model->text(i, j);
+				break;
+			default:
+				data_all += "'" + m_model->text(i, j) + "'";
+				break;
 			}
 			data_all += ", ";
 		}
@@ -885,10 +908,9 @@ QString EventSheet::generateDataText(QString outFileName)
 	text += "col = " + QString::number(minCol) + "\n";
 	text += "num_rows = " + QString::number(maxRow - minRow + 1) + "\n";
 	text += "num_cols = " + QString::number(maxCol - minCol + 1) + "\n";
-	text += "total_rows = " + QString::number(this->rowCount()) + "\n";
-	text += "total_cols = " + QString::number(this->columnCount ()) + "\n";
+	text += "total_rows = " + QString::number(m_model->rowCount()) + "\n";
+	text += "total_cols = " + QString::number(m_model->columnCount ()) + "\n";
 
-	//  text += "data = " + data + "\n";
 	text += "data_all = " + data_all + "\n";
 	text += "out_filename = '" + outFileName + "'\n";
 	return text;
@@ -897,6 +919,20 @@ QString EventSheet::generateDataText(QString outFileName)
 void EventSheet::runScript(QString name)
 {
 	//  qDebug() << "EventSheet::runScript " << name;
+	QFile source(name);
+	if (!source.open(QIODevice::ReadOnly | QIODevice::Text)) {
+		return;
+	}
+	QString code = QString::fromUtf8(source.readAll());
+	source.close();
+#ifdef QCS_PYTHONQT
+	static const QRegExp inProcess("^\\s*#\\s*qcs:\\s*in-process\\s*$");
+	if (code.split('\n').indexOf(inProcess) >= 0) {
+		// Runs in the application, reading and writing columns in place
+		emit runPythonCode(code);
+		return;
+	}
+#endif
 
 	QString outFileName = "qutesheet_out_data.txt";
 	QDir oldDir = QDir::current();
@@ -918,11 +954,8 @@ void EventSheet::runScript(QString name)
 
 	QFile script(tempDir.absolutePath() + QDir::separator() + name.mid(name.lastIndexOf("/") + 1));
 	script.open(QFile::WriteOnly | QIODevice::Text);
-	QFile file2(name);
-	file2.open(QIODevice::ReadOnly);
 	QTextStream scriptStream(&script);
-	scriptStream << file2.readAll();
-	file2.close();
+	scriptStream << code;
 	script.close();
 
 	QFile dataFile(tempDir.absolutePath() + QDir::separator() + "qutesheet_data.py");
@@ -999,16 +1032,14 @@ void EventSheet::insertRowHere()
 
 void EventSheet::appendColumn()
 {
-	this->insertColumn(this->columnCount());
-	columnNames << QString("p%1").arg(this->columnCount() - 1);
-	this->setHorizontalHeaderLabels(columnNames);
-	this->setColumnWidth(this->columnCount() - 1, 50);
+	m_model->insertColumns(m_model->columnCount(), 1);
+	this->setColumnWidth(m_model->columnCount() - 1, 50);
 }
 
 void EventSheet::appendRow()
 {
 	//  qDebug() << "EventSheet::appendRow()";
-	this->insertRow(this->rowCount());
+	m_model->insertRows(m_model->rowCount(), 1);
 }
 
 void EventSheet::appendColumns()
@@ -1038,23 +1069,21 @@ void EventSheet::appendRows()
 void EventSheet::deleteColumn()
 {
 	// TODO: remove multiple columns
-	this->removeColumn(this->columnCount() - 1);
-	columnNames.takeLast();
+	m_model->removeColumns(m_model->columnCount() - 1, 1);
 }
 
 void EventSheet::deleteRows()
 {
-	// TODO: remove multiple rows
-	QModelIndexList list = this->selectedIndexes();
 	QList<int> selectedRows;
-	for (int i = 0; i < list.size(); i++) {
-		if (!selectedRows.contains(list[i].row()) ) {
-			selectedRows.append(list[i].row());
+	selectedRowsAndColumns(&selectedRows, 0);
+	int i = selectedRows.size() - 1;
+	while (i >= 0) { // From the bottom, a run of adjacent rows at a time
+		int first = i;
+		while (first > 0 && selectedRows[first - 1] == selectedRows[first] - 1) {
+			first--;
 		}
-	}
-	qSort(selectedRows);
-	for (int i = selectedRows.size() - 1; i >=0; i--) {
-		this->removeRow(selectedRows[i]);
+		m_model->removeRows(selectedRows[first], i - first + 1);
+		i = first - 1;
 	}
 }
 
@@ -1168,94 +1197,49 @@ void EventSheet::keyPressEvent (QKeyEvent * event) {
 	else {
 		//    qDebug() << "EventSheet::keyPressEvent  " << event->key();
 		//    event->ignore();
-		QTableWidget::keyPressEvent(event);  // Propagate any other events
+		QTableView::keyPressEvent(event);  // Propagate any other events
 	}
 }
 
 void EventSheet::add(double value)
 {
-	QModelIndexList list = this->selectedIndexes();
-	for (int i = 0; i < list.size(); i++) {
-		QTableWidgetItem * item = this->item(list[i].row(), list[i].column());
-		if (item != 0 && item->data(Qt::DisplayRole).canConvert(QVariant::Double)) {
-			bool ok = false;
-			double n = item->data(Qt::DisplayRole).toDouble(&ok);
-			if (ok) {
-				noHistoryChange = 1;
-				item->setData(Qt::DisplayRole,
-							  QVariant(n + value));
-			}
-		}
-	}
-	noHistoryChange = 0;
-	markHistory();
+	transformSelection(EventSheetModel::Add, value);
 }
 
 void EventSheet::multiply(double value)
 {
-	QModelIndexList list = this->selectedIndexes();
-	for (int i = 0; i < list.size(); i++) {
-		QTableWidgetItem * item = this->item(list[i].row(), list[i].column());
-		if (item != 0 && item->data(Qt::DisplayRole).canConvert(QVariant::Double)) {
-			bool ok = false;
-			double n = item->data(Qt::DisplayRole).toDouble(&ok);
-			if (ok) {
-				noHistoryChange = 1;
-				item->setData(Qt::DisplayRole,
-							  QVariant(n * value));
-			}
-		}
-	}
-	noHistoryChange = 0;
-	markHistory();
+	transformSelection(EventSheetModel::Multiply, value);
 }
 
 void EventSheet::divide(double value)
 {
-	QModelIndexList list = this->selectedIndexes();
-	for (int i = 0; i < list.size(); i++) {
-		QTableWidgetItem * item = this->item(list[i].row(), list[i].column());
-		if (item != 0 && item->data(Qt::DisplayRole).canConvert(QVariant::Double)) {
-			bool ok = false;
-			double n = item->data(Qt::DisplayRole).toDouble(&ok);
-			if (ok) {
-				noHistoryChange = 1;
-				item->setData(Qt::DisplayRole,
-							  QVariant(n / value));
-			}
-		}
-	}
-	noHistoryChange = 0;
-	markHistory();
+	transformSelection(EventSheetModel::Divide, value);
 }
 
 void EventSheet::randomize(double min, double max, int mode)
 {
 	// Mode 0 =
 	// Mode 1 = integers only
-	QModelIndexList list = this->selectedIndexes();
+	QItemSelection selection = this->selectionModel()->selection();
 	QTime midnight(0, 0, 0);
 	qsrand(midnight.secsTo(QTime::currentTime()));
-	for (int i = 0; i < list.size(); i++) {
-		QTableWidgetItem * item = this->item(list[i].row(), list[i].column());
-		if (item == 0) {
-			item = new QTableWidgetItem();
-			noHistoryChange = 1;
-			this->setItem(list[i].row(), list[i].column(), item);
-		}
-		double value = 0.0;
-		if (mode == 0) {
-			value = min + ((double) qrand() / (double) RAND_MAX) * (max - min);
-		}
-		else /*if (mode == 1)*/ {  // Integers only
-			value = min + (qrand() % (int) (max - min + 1)); // Include max value as a possibility
+	m_model->beginUpdate();
+	for (int r = 0; r < selection.size(); r++) {
+		QVector<double> values(selection[r].height());
+		for (int column = selection[r].left(); column <= selection[r].right(); column++) {
+			for (int i = 0; i < values.size(); i++) {
+				if (mode == 0) {
+					values[i] = min + ((double) qrand() / (double) RAND_MAX) * (max - min);
+				}
+				else /*if (mode == 1)*/ {  // Integers only
+					values[i] = min + (qrand() % (int) (max - min + 1)); // Include max value as a possibility
+				}
+			}
+			m_model->setNumbers(column, selection[r].top(), values);
 		}
-		noHistoryChange = 1;
-		item->setData(Qt::DisplayRole,
-					  QVariant(value));
 	}
-	noHistoryChange = 0;
-	markHistory();
+	m_model->endUpdate();
+	changed();
 }
 
 void EventSheet::shuffle(int iterations)
@@ -1265,95 +1249,78 @@ void EventSheet::shuffle(int iterations)
 	QModelIndexList list = this->selectedIndexes();
 	if (list.size() < 3)
 		return;
-	for (int i = 0; i < iterations; i++) { // First traverse to copy values
+	recordSelection();
+	m_model->beginUpdate();
+	for (int i = 0; i < iterations; i++) {
 		int num1 = qrand() % list.size();
-		QTableWidgetItem * item1 = this->item(list[num1].row(), list[num1].column());
 		int num2 = qrand() % list.size();
 		while (num2 == num1) {
 			num2 = qrand() % list.size();
 		}
-		QTableWidgetItem * item2 = this->item(list[num2].row(), list[num2].column());
-		QVariant value1 = QVariant();
-		if (item1 != 0) {
-			value1 = item1->data(Qt::DisplayRole);
-		}
-		else {
-			item1 = new QTableWidgetItem();
-			noHistoryChange = 1;
-			this->setItem(list[i].row(), list[i].column(), item1);
-		}
-		if (item2 == 0) {
-			item2 = new QTableWidgetItem();
-			noHistoryChange = 1;
-			this->setItem(list[i].row(), list[i].column(), item2);
-		}
-		noHistoryChange = 1;
-		item1->setData(Qt::DisplayRole,item2->data(Qt::DisplayRole));
-		noHistoryChange = 1;
-		item2->setData(Qt::DisplayRole,value1);
+		EventSheetModel::Cell cell1 = m_model->cell(list[num1].row(), list[num1].column());
+		EventSheetModel::Cell cell2 = m_model->cell(list[num2].row(), list[num2].column());
+		// Only the values move, each cell keeps its separator
+		qSwap(cell1.separator, cell2.separator);
+		m_model->setCell(list[num1].row(), list[num1].column(), cell2);
+		m_model->setCell(list[num2].row(), list[num2].column(), cell1);
 	}
-	noHistoryChange = 0;
-	markHistory();
+	m_model->endUpdate();
+	changed();
 }
 
 void EventSheet::rotate(int amount)
 {
 	QModelIndexList list = this->selectedIndexes();
-	QList<QVariant> oldValues;
+	QVector<EventSheetModel::Cell> oldValues;
+	oldValues.reserve(list.size());
 	for (int i = 0; i < list.size(); i++) { // First traverse to copy values
-		QTableWidgetItem * item = this->item(list[i].row(), list[i].column());
-		if (item != 0) {
-			oldValues.append(item->data(Qt::DisplayRole));
-		}
-		else {
-			oldValues.append(QVariant());
-		}
+		oldValues.append(m_model->cell(list[i].row(), list[i].column()));
 	}
+	recordSelection();
+	m_model->beginUpdate();
 	for (int i = 0; i < list.size(); i++) { // Then put in rotated values
-		QTableWidgetItem * item = this->item(list[i].row(), list[i].column());
-		if (item == 0) {
-			item = new QTableWidgetItem();
-			noHistoryChange = 1;
-			this->setItem(list[i].row(), list[i].column(), item);
-		}
 		int index = (i - amount + list.size())%list.size();
-		noHistoryChange = 1;
-		item->setData(Qt::DisplayRole,oldValues[index]);
+		EventSheetModel::Cell cell = oldValues[index];
+		cell.separator = oldValues[i].separator;
+		m_model->setCell(list[i].row(), list[i].column(), cell);
 	}
-	noHistoryChange = 0;
-	markHistory();
+	m_model->endUpdate();
+	changed();
 }
 
 void EventSheet::fill(double start, double end, double slope)
 {
-	QModelIndexList list = this->selectedIndexes();
-	double inc = (end - start) / (list.size() - 1.0);
-	double value = start;
-	//  double listSize = (double) list.size();
-	for (int i = 0; i < list.size(); i++) {
-		QTableWidgetItem * item = this->item(list[i].row(), list[i].column());
-		if (item == 0) {
-			item = new QTableWidgetItem();
-			noHistoryChange = 1;
-			this->setItem(list[i].row(), list[i].column(), item);
-		}
-		noHistoryChange = 1;
-		item->setData(Qt::DisplayRole,
-					  QVariant(value));
-		if (slope == 1.0) {
-			value += inc;
-		}
-		else if (slope < 1.0 && slope >= 0.0) {
-			value = start;
-			value += (end-start) * (exp(((i + 1.0) / (list.size() - 1.0)) * log(slope))-1.0) / (slope-1.0);
-		}
-		else if (slope > 1.0) {
-			value = start;
-			value += (end-start) * (exp(((i + 1.0) / (list.size() - 1.0)) * log(slope))-1.0) / (slope-1.0);
+	// Cells are counted by row inside each selection range, as
+	// selectedIndexes() lists them, and each column is filled in one go
+	QItemSelection selection = this->selectionModel()->selection();
+	int count = 0;
+	for (int r = 0; r < selection.size(); r++) {
+		count += selection[r].width() * selection[r].height();
+	}
+	double inc = (end - start) / (count - 1.0);
+	int first = 0;  // Number of the top left cell of the range
+	m_model->beginUpdate();
+	for (int r = 0; r < selection.size(); r++) {
+		const int width = selection[r].width();
+		QVector<double> values(selection[r].height());
+		for (int column = selection[r].left(); column <= selection[r].right(); column++) {
+			int cell = first + column - selection[r].left();
+			for (int i = 0; i < values.size(); i++, cell += width) {
+				double value = start;
+				if (cell > 0 && slope == 1.0) {
+					value += cell * inc;
+				}
+				else if (cell > 0 && slope >= 0.0) {
+					value += (end-start) * (exp((cell / (count - 1.0)) * log(slope))-1.0) / (slope-1.0);
+				}
+				values[i] = value;
+			}
+			m_model->setNumbers(column, selection[r].top(), values);
 		}
+		first += width * values.size();
 	}
-	noHistoryChange = 0;
-	markHistory();
+	m_model->endUpdate();
+	changed();
 }
 
 void EventSheet::createActions()
@@ -1616,10 +1583,64 @@ QList<QPair<QString, QString> > EventSheet::parseLine(QString line)
 	return list;
 }
 
+void EventSheet::recordSelection()
+{
+	QItemSelection selection = this->selectionModel()->selection();
+	for (int i = 0; i < selection.size(); i++) {
+		m_model->recordCells(selection[i].top(), selection[i].left(),
+							 selection[i].bottom(), selection[i].right());
+	}
+}
+
+void EventSheet::transformSelection(EventSheetModel::Operation op, double value)
+{
+	QItemSelection selection = this->selectionModel()->selection();
+	m_model->beginUpdate();
+	for (int i = 0; i < selection.size(); i++) {
+		for (int column = selection[i].left(); column <= selection[i].right(); column++) {
+			m_model->transformNumbers(column, selection[i].top(), selection[i].bottom(), op, value);
+		}
+	}
+	m_model->endUpdate();
+	changed();
+}
+
+void EventSheet::selectedRowsAndColumns(QList<int> *rows, QList<int> *columns)
+{
+	// Sorted and each once. Built from the selection ranges, so a select all
+	// costs one entry per row and column rather than one per cell
+	QItemSelection selection = this->selectionModel()->selection();
+	QSet<int> rowSet, columnSet;
+	for (int i = 0; i < selection.size(); i++) {
+		for (int row = selection[i].top(); rows != 0 && row <= selection[i].bottom(); row++) {
+			rowSet.insert(row);
+		}
+		for (int column = selection[i].left(); columns != 0 && column <= selection[i].right(); column++) {
+			columnSet.insert(column);
+		}
+	}
+	if (rows != 0) {
+		*rows = rowSet.toList();
+		qSort(*rows);
+	}
+	if (columns != 0) {
+		*columns = columnSet.toList();
+		qSort(*columns);
+	}
+}
+
+void EventSheet::changed()
+{
+	markHistory();
+	updateLoop();
+	emit modified();
+}
+
 void EventSheet::newSelection()
 {
-	QModelIndexList list = this->selectedIndexes();
-	if (list.size() > 1) {
+	QItemSelection selection = this->selectionModel()->selection();
+	if (selection.size() > 1 || (selection.size() == 1
+								 && (selection[0].height() > 1 || selection[0].width() > 1))) {
 		this->setDragDropMode(QAbstractItemView::DragDrop); // Allow dragging items
 	}
 	else {
@@ -1627,6 +1648,57 @@ void EventSheet::newSelection()
 	}
 }
 
+void EventSheet::dropEvent(QDropEvent *event)
+{
+	QModelIndex target = indexAt(event->pos());
+	if (event->source() != this || !target.isValid() || !currentIndex().isValid()
+			|| (event->dropAction() != Qt::CopyAction && event->dropAction() != Qt::MoveAction)) {
+		event->ignore();
+		return;
+	}
+	// The selected cells keep their places around the one the drag began on
+	const int rowOffset = target.row() - currentIndex().row();
+	const int columnOffset = target.column() - currentIndex().column();
+	const bool move = event->dropAction() == Qt::MoveAction;
+	QItemSelection selection = this->selectionModel()->selection();
+	QList<QPair<QModelIndex, EventSheetModel::Cell> > cells;
+	for (int i = 0; i < selection.size(); i++) {
+		for (int row = selection[i].top(); row <= selection[i].bottom(); row++) {
+			for (int column = selection[i].left(); column <= selection[i].right(); column++) {
+				cells.append(qMakePair(m_model->index(row, column), m_model->cell(row, column)));
+			}
+		}
+	}
+	if (move) {
+		recordSelection();
+	}
+	for (int i = 0; i < selection.size(); i++) {
+		m_model->recordCells(selection[i].top() + rowOffset, selection[i].left() + columnOffset,
+							 selection[i].bottom() + rowOffset, selection[i].right() + columnOffset);
+	}
+	m_model->beginUpdate();
+	if (move) {
+		for (int i = 0; i < cells.size(); i++) {
+			m_model->clearCell(cells[i].first.row(), cells[i].first.column());
+		}
+	}
+	QItemSelection moved;
+	for (int i = 0; i < cells.size(); i++) {
+		int row = cells[i].first.row() + rowOffset;
+		int column = cells[i].first.column() + columnOffset;
+		if (row >= 0 && row < m_model->rowCount() && column >= 0 && column < m_model->columnCount()) {
+			m_model->setCell(row, column, cells[i].second);
+			moved.select(m_model->index(row, column), m_model->index(row, column));
+		}
+	}
+	m_model->endUpdate();
+	this->selectionModel()->select(moved, QItemSelectionModel::ClearAndSelect);
+	changed();
+	event->accept();
+	// Already moved, so the view must not clear the source cells
+	event->setDropAction(Qt::CopyAction);
+}
+
 void EventSheet::cellDoubleClickedSlot(int /*row*/, int /*column*/)
 {
 	markHistory();
@@ -1634,26 +1706,16 @@ void EventSheet::cellDoubleClickedSlot(int /*row*/, int /*column*/)
 
 void EventSheet::cellChangedSlot(int row, int column)
 {
-    if (this->item(row, column) != 0 && this->item(row, column)->data(Qt::DisplayRole).toString() != 0) {
-		while (column > 0) {
+	// A value typed after empty cells moves left to follow the last one
+	if (row < m_model->rowCount() && column < m_model->columnCount()
+			&& m_model->kind(row, column) != EventSheetModel::EmptyCell) {
+		while (column > 0 && m_model->kind(row, column - 1) == EventSheetModel::EmptyCell) {
+			m_model->setCell(row, column - 1, m_model->cell(row, column));
+			m_model->clearCell(row, column);
 			column--;
-			QTableWidgetItem * item = this->item(row, column);
-			//      qDebug() << "EventSheet::cellChangedSlot " << column;
-            if (item == 0 || item->data(Qt::DisplayRole).toString() == "") {
-				this->setItem(row, column, this->takeItem(row, column + 1));
-			}
-			else {
-				break;
-			}
 		}
 	}
-	if (noHistoryChange == 0) {
-		markHistory();
-	}
-	else {
-		noHistoryChange = 0;
-	}
-	emit modified();
+	changed();
 }
 
 void EventSheet::stopScript()
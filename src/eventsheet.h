@@ -23,12 +23,14 @@
 #ifndef EVENTSHEET_H
 #define EVENTSHEET_H
 
-#include <QTableWidget>
-#include <QStandardItemModel>
+#include <QTableView>
 #include <QAction>
-#include <QTimer>
+#include <QSharedPointer>
 
-class EventSheet : public QTableWidget
+#include "eventscheduler.h"
+#include "eventsheetmodel.h"
+
+class EventSheet : public QTableView
 {
 	Q_OBJECT
 public:
@@ -47,11 +49,23 @@ public:
 	void setFromText(QString text, int rowOffset = 0, int columnOffset = 0,
 					 int numRows = 0, int numColumns = 0, bool noHistoryMark = false);
 	void setCell(int row, int column, QVariant text);
+	// Numbers of a column for scripts run in the application, NaN for
+	// other cells. Writing NaN leaves a cell as it is. count -1 reads to
+	// the last row
+	QVector<double> columnNumbers(int column, int first = 0, int count = -1);
+	void setColumnNumbers(int column, const QVector<double> &values, int first = 0);
 	void setDebug(bool debug);
+	void clear();
+	void setRowCount(int rows);
+	void setColumnCount(int columns);
 	QPair<int, int> getSelectedRowsRange();
+	EventSheetModel *sheetModel() { return m_model; }
+	// Loops are played by the engine through scheduler, which may be null,
+	// against clock
+	void setEventScheduler(EventScheduler *scheduler, const TransportClock *clock);
 
 public slots:
-	void setTempo(double value);
+	void setTempo(double value);  // 0 follows the transport
 	void setLoopLength(double value);
 	void sendEvents();
 	void sendAllEvents();
@@ -95,11 +109,21 @@ public slots:
 protected:
 	void contextMenuEvent(QContextMenuEvent * event);
 	virtual void keyPressEvent(QKeyEvent * event);
+	virtual void dropEvent(QDropEvent *event);
 
 private:
 	void createActions();
 	QList<QPair<QString, QString> > parseLine(QString line);
+	void selectedRowsAndColumns(QList<int> *rows, QList<int> *columns);
+	void transformSelection(EventSheetModel::Operation op, double value);
+	void recordSelection();  // For undo, before changing the selected cells one by one
+	void changed();  // Marks history and the sheet as modified
+	void updateLoop();  // Hands the loop to the scheduler, or removes it
+	QSharedPointer<const LiveLoop> compileLoop();
+	bool compileEvent(int row, LiveLoop::Event *event);
+	double currentTempo();  // The tempo of the sheet, or of the transport it follows
 	bool m_stopScript;  // Order stopping python script
+	EventSheetModel *m_model;
 
 	// Operations
 	void add(double value);
@@ -116,7 +140,7 @@ private:
 	//    void rename(QString name);
 
 	// Attributes to be saved
-	double m_tempo;
+	double m_tempo;  // 0 to follow the transport
 	QString m_name;
 
 	// Actions
@@ -150,20 +174,16 @@ private:
 	QAction *deleteColumnAct;
 	QAction *deleteRowAct;
 
-	QStringList columnNames;
-
 	QList<double> activeInstruments;
 	bool m_looping; // Whether currently looping
 	bool m_debug; // Debug mode
 	double m_loopLength;
-	int noHistoryChange; // Last change in cells was made by undo
 
 	//Undo / Redo
-	int historyIndex;
-	QVector<QString> history;
 
 	// Looping
-	QTimer loopTimer;
+	EventScheduler *m_scheduler;
+	const TransportClock *m_clock;
 	int m_loopStart, m_loopEnd; // Start and end rows for looping (both inclusive)
 	//    QModelIndexList  loopList;
 
@@ -174,15 +194,18 @@ private:
 	QStringList testScripts;
 
 private slots:
-    void newSelection();
 	void cellDoubleClickedSlot(int row, int column);
 	void cellChangedSlot(int row, int column);
+	void newSelection();
 	void stopScript();
 
 	void runScript();
 
 signals:
 	void sendEvent(QString event);
+	// Scripts marked with a "# qcs: in-process" line, run in the
+	// application's interpreter to use the columns directly
+	void runPythonCode(QString code);
 	void setLoopRangeFromSheet(double start, double end);
 	void setLoopEnabledFromSheet(bool enabled);
 	//    void cellDoubleClicked();
@@ -0,0 +1,769 @@
+#include "eventsheetmodel.h"
+#include "types.h"
+
+#include <QBrush>
+#include <QColor>
+#include <QMimeData>
+#include <QtNumeric>
+
+#include <climits>
+#include <cmath>
+
+static void shiftRows(QHash<int, QString> &hash, int row, int count, bool insert)
+{
+	if (hash.isEmpty()) {
+		return;
+	}
+	QHash<int, QString> shifted;
+	shifted.reserve(hash.size());
+	for (QHash<int, QString>::const_iterator it = hash.constBegin(); it != hash.constEnd(); ++it) {
+		int key = it.key();
+		if (key >= row) {
+			if (insert) {
+				key += count;
+			}
+			else if (key < row + count) {
+				continue;
+			}
+			else {
+				key -= count;
+			}
+		}
+		shifted.insert(key, it.value());
+	}
+	hash.swap(shifted);
+}
+
+EventSheetModel::EventSheetModel(QObject *parent) :
+	QAbstractTableModel(parent),
+	m_rows(0),
+	m_updating(0),
+	m_loopFirst(-1),
+	m_loopLast(-1),
+	m_loopActive(false),
+	m_recording(true),
+	m_stepIndex(0),
+	m_undoSize(0)
+{
+}
+
+int EventSheetModel::rowCount(const QModelIndex &parent) const
+{
+	return parent.isValid() ? 0 : m_rows;
+}
+
+int EventSheetModel::columnCount(const QModelIndex &parent) const
+{
+	return parent.isValid() ? 0 : m_columns.size();
+}
+
+QVariant EventSheetModel::data(const QModelIndex &index, int role) const
+{
+	if (!index.isValid()) {
+		return QVariant();
+	}
+	if (role == Qt::DisplayRole || role == Qt::EditRole) {
+		if (kind(index.row(), index.column()) == EmptyCell) {
+			return QVariant();
+		}
+		return text(index.row(), index.column());
+	}
+	if (role == Qt::BackgroundRole && index.column() < 4
+			&& index.row() >= m_loopFirst && index.row() <= m_loopLast) {
+		return m_loopActive ? QBrush(Qt::green) : QBrush(QColor(200,255,200));
+	}
+	return QVariant();
+}
+
+bool EventSheetModel::setData(const QModelIndex &index, const QVariant &value, int role)
+{
+	if (!index.isValid() || role != Qt::EditRole) {
+		return false;
+	}
+	setText(index.row(), index.column(), value.toString());
+	emit cellEdited(index.row(), index.column());
+	return true;
+}
+
+Qt::ItemFlags EventSheetModel::flags(const QModelIndex &index) const
+{
+	if (!index.isValid()) {
+		return Qt::NoItemFlags;
+	}
+	return Qt::ItemIsSelectable | Qt::ItemIsEditable | Qt::ItemIsEnabled
+			| Qt::ItemIsDragEnabled | Qt::ItemIsDropEnabled;
+}
+
+QStringList EventSheetModel::mimeTypes() const
+{
+	return QStringList() << "text/plain";
+}
+
+QMimeData *EventSheetModel::mimeData(const QModelIndexList &indexes) const
+{
+	if (indexes.isEmpty()) {
+		return 0;
+	}
+	int top = INT_MAX, left = INT_MAX, bottom = -1, right = -1;
+	for (int i = 0; i < indexes.size(); i++) {
+		top = qMin(top, indexes[i].row());
+		bottom = qMax(bottom, indexes[i].row());
+		left = qMin(left, indexes[i].column());
+		right = qMax(right, indexes[i].column());
+	}
+	QString text;
+	for (int row = top; row <= bottom; row++) {
+		for (int column = left; column <= right; column++) {
+			if (kind(row, column) != EmptyCell) {
+				text += this->text(row, column) + separator(row, column);
+			}
+		}
+		text += "\n";
+	}
+	text.chop(1);
+	QMimeData *data = new QMimeData;
+	data->setText(text);
+	return data;
+}
+
+Qt::DropActions EventSheetModel::supportedDropActions() const
+{
+	return Qt::CopyAction | Qt::MoveAction;
+}
+
+QVariant EventSheetModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+	if (orientation == Qt::Horizontal && role == Qt::DisplayRole) {
+		switch (section) {
+		case 0:
+			return tr("Event");
+		case 1:
+			return QString("p1 (instr)");
+		case 2:
+			return QString("p2 (start)");
+		case 3:
+			return QString("p3 (dur)");
+		default:
+			return QString("p%1").arg(section);
+		}
+	}
+	return QAbstractTableModel::headerData(section, orientation, role);
+}
+
+bool EventSheetModel::insertRows(int row, int count, const QModelIndex &parent)
+{
+	if (parent.isValid() || row < 0 || row > m_rows || count <= 0) {
+		return false;
+	}
+	recordStructure(Patch::InsertRows, row, count);
+	beginInsertRows(QModelIndex(), row, row + count - 1);
+	for (int i = 0; i < m_columns.size(); i++) {
+		Column &c = m_columns[i];
+		c.kinds.insert(row, count, EmptyCell);
+		c.values.insert(row, count, 0.0);
+		shiftRows(c.texts, row, count, true);
+		shiftRows(c.separators, row, count, true);
+		c.carryRow = -1;
+	}
+	m_rows += count;
+	endInsertRows();
+	return true;
+}
+
+bool EventSheetModel::removeRows(int row, int count, const QModelIndex &parent)
+{
+	if (parent.isValid() || row < 0 || count <= 0 || row + count > m_rows) {
+		return false;
+	}
+	recordStructure(Patch::RemoveRows, row, count);
+	beginRemoveRows(QModelIndex(), row, row + count - 1);
+	for (int i = 0; i < m_columns.size(); i++) {
+		Column &c = m_columns[i];
+		c.kinds.remove(row, count);
+		c.values.remove(row, count);
+		shiftRows(c.texts, row, count, false);
+		shiftRows(c.separators, row, count, false);
+		c.carryRow = -1;
+	}
+	m_rows -= count;
+	endRemoveRows();
+	return true;
+}
+
+bool EventSheetModel::insertColumns(int column, int count, const QModelIndex &parent)
+{
+	if (parent.isValid() || column < 0 || column > m_columns.size() || count <= 0) {
+		return false;
+	}
+	recordStructure(Patch::InsertColumns, column, count);
+	beginInsertColumns(QModelIndex(), column, column + count - 1);
+	m_columns.insert(column, count, emptyColumn());
+	endInsertColumns();
+	return true;
+}
+
+bool EventSheetModel::removeColumns(int column, int count, const QModelIndex &parent)
+{
+	if (parent.isValid() || column < 0 || count <= 0 || column + count > m_columns.size()) {
+		return false;
+	}
+	recordStructure(Patch::RemoveColumns, column, count);
+	beginRemoveColumns(QModelIndex(), column, column + count - 1);
+	m_columns.remove(column, count);
+	endRemoveColumns();
+	return true;
+}
+
+void EventSheetModel::setRowCount(int rows)
+{
+	if (rows > m_rows) {
+		insertRows(m_rows, rows - m_rows);
+	}
+	else if (rows < m_rows) {
+		removeRows(rows, m_rows - rows);
+	}
+}
+
+void EventSheetModel::clearCells()
+{
+	record(0, 0, m_rows - 1, m_columns.size() - 1);
+	beginResetModel();
+	for (int i = 0; i < m_columns.size(); i++) {
+		m_columns[i] = emptyColumn();
+	}
+	endResetModel();
+}
+
+QString EventSheetModel::text(int row, int column) const
+{
+	const Column &c = m_columns[column];
+	switch (c.kinds[row]) {
+	case NumberCell: {
+		QHash<int, QString>::const_iterator it = c.texts.constFind(row);
+		return it != c.texts.constEnd() ? it.value() : formatNumber(c.values[row]);
+	}
+	case TextCell:
+		return c.texts.value(row);
+	case CarryCell:
+		return QString(".");
+	default:
+		return QString();
+	}
+}
+
+QString EventSheetModel::separator(int row, int column) const
+{
+	QHash<int, QString>::const_iterator it = m_columns[column].separators.constFind(row);
+	return it != m_columns[column].separators.constEnd() ? it.value() : QString(" ");
+}
+
+EventSheetModel::Cell EventSheetModel::cell(int row, int column) const
+{
+	const Column &c = m_columns[column];
+	Cell cell;
+	cell.kind = CellKind(c.kinds[row]);
+	cell.value = c.values[row];
+	cell.text = c.texts.value(row);
+	cell.separator = c.separators.value(row);
+	return cell;
+}
+
+int EventSheetModel::commentColumn(int row) const
+{
+	for (int i = 0; i < m_columns.size(); i++) {
+		const Column &c = m_columns[i];
+		if (c.kinds[row] == TextCell && c.texts.value(row).startsWith(';')) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+int EventSheetModel::lastColumn(int row) const
+{
+	for (int i = m_columns.size() - 1; i >= 0; i--) {
+		if (m_columns[i].kinds[row] != EmptyCell) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+int EventSheetModel::carrySource(int row, int column) const
+{
+	const Column &c = m_columns[column];
+	int source = row;
+	while (source >= 0 && c.kinds[source] == CarryCell) {
+		if (source == c.carryRow) {
+			source = c.carrySource;
+			break;
+		}
+		source--;
+	}
+	if (source >= 0 && c.kinds[source] == EmptyCell) {
+		source = -1;
+	}
+	c.carryRow = row;
+	c.carrySource = source;
+	return source;
+}
+
+void EventSheetModel::setText(int row, int column, const QString &text)
+{
+	record(row, column, row, column);
+	Column &c = m_columns[column];
+	if (text.isEmpty()) {
+		c.kinds[row] = EmptyCell;
+		c.texts.remove(row);
+	}
+	else if (text == ".") {
+		c.kinds[row] = CarryCell;
+		c.texts.remove(row);
+	}
+	else {
+		bool ok = false;
+		double value = text.toDouble(&ok);
+		if (ok && std::isfinite(value)) {
+			c.kinds[row] = NumberCell;
+			c.values[row] = value;
+			if (text == formatNumber(value)) {
+				c.texts.remove(row);
+			}
+			else {
+				c.texts.insert(row, text);  // Keep the spelling, e.g. 440.00
+			}
+		}
+		else {
+			c.kinds[row] = TextCell;
+			c.texts.insert(row, text);
+		}
+	}
+	cellChanged(row, column);
+}
+
+void EventSheetModel::setSeparator(int row, int column, const QString &separator)
+{
+	record(row, column, row, column);
+	if (separator.isEmpty() || separator == " ") {
+		m_columns[column].separators.remove(row);
+	}
+	else {
+		m_columns[column].separators.insert(row, separator);
+	}
+}
+
+void EventSheetModel::setNumber(int row, int column, double value)
+{
+	record(row, column, row, column);
+	Column &c = m_columns[column];
+	c.kinds[row] = NumberCell;
+	c.values[row] = value;
+	c.texts.remove(row);
+	cellChanged(row, column);
+}
+
+void EventSheetModel::setCell(int row, int column, const Cell &cell)
+{
+	record(row, column, row, column);
+	Column &c = m_columns[column];
+	c.kinds[row] = cell.kind;
+	c.values[row] = cell.value;
+	if (cell.text.isEmpty()) {
+		c.texts.remove(row);
+	}
+	else {
+		c.texts.insert(row, cell.text);
+	}
+	setSeparator(row, column, cell.separator);
+	cellChanged(row, column);
+}
+
+void EventSheetModel::clearCell(int row, int column)
+{
+	record(row, column, row, column);
+	Column &c = m_columns[column];
+	c.kinds[row] = EmptyCell;
+	c.values[row] = 0.0;
+	c.texts.remove(row);
+	c.separators.remove(row);
+	cellChanged(row, column);
+}
+
+QVector<double> EventSheetModel::numbers(int column, int first, int count) const
+{
+	const Column &c = m_columns[column];
+	QVector<double> values(count);
+	const quint8 *kinds = c.kinds.constData() + first;
+	const double *source = c.values.constData() + first;
+	double *out = values.data();
+	for (int i = 0; i < count; i++) {
+		out[i] = kinds[i] == NumberCell ? source[i] : qQNaN();
+	}
+	return values;
+}
+
+void EventSheetModel::setNumbers(int column, int first, const QVector<double> &values)
+{
+	Column &c = m_columns[column];
+	const int count = qMin(values.size(), m_rows - first);
+	if (count <= 0) {
+		return;
+	}
+	record(first, column, first + count - 1, column);
+	quint8 *kinds = c.kinds.data() + first;
+	double *target = c.values.data() + first;
+	const double *in = values.constData();
+	for (int i = 0; i < count; i++) {
+		if (!qIsNaN(in[i])) {
+			kinds[i] = NumberCell;
+			target[i] = in[i];
+		}
+	}
+	dropTexts(c, first, first + count - 1, in);
+	cellsChanged(first, column, first + count - 1, column);
+}
+
+void EventSheetModel::transformNumbers(int column, int first, int last, Operation op, double value)
+{
+	record(first, column, last, column);
+	Column &c = m_columns[column];
+	const quint8 *kinds = c.kinds.constData();
+	double *values = c.values.data();
+	switch (op) {
+	case Add:
+		for (int i = first; i <= last; i++) {
+			if (kinds[i] == NumberCell) {
+				values[i] += value;
+			}
+		}
+		break;
+	case Multiply:
+		for (int i = first; i <= last; i++) {
+			if (kinds[i] == NumberCell) {
+				values[i] *= value;
+			}
+		}
+		break;
+	case Divide:
+		for (int i = first; i <= last; i++) {
+			if (kinds[i] == NumberCell) {
+				values[i] /= value;
+			}
+		}
+		break;
+	}
+	dropTexts(c, first, last, nullptr);
+	cellsChanged(first, column, last, column);
+}
+
+void EventSheetModel::beginUpdate()
+{
+	if (m_updating++ == 0) {
+		m_dirtyTop = m_dirtyLeft = INT_MAX;
+		m_dirtyBottom = m_dirtyRight = -1;
+	}
+}
+
+void EventSheetModel::endUpdate()
+{
+	if (--m_updating == 0 && m_dirtyBottom >= 0) {
+		// Rows or columns may have been removed since the cell was changed
+		int bottom = qMin(m_dirtyBottom, m_rows - 1);
+		int right = qMin(m_dirtyRight, m_columns.size() - 1);
+		if (m_dirtyTop <= bottom && m_dirtyLeft <= right) {
+			emit dataChanged(index(m_dirtyTop, m_dirtyLeft), index(bottom, right));
+		}
+	}
+}
+
+void EventSheetModel::recordCells(int top, int left, int bottom, int right)
+{
+	record(qMax(top, 0), qMax(left, 0), qMin(bottom, m_rows - 1), qMin(right, m_columns.size() - 1));
+}
+
+bool EventSheetModel::commitStep()
+{
+	if (m_pending.isEmpty()) {
+		return false;
+	}
+	closePatches();
+	Step step;
+	step.patches = m_pending;
+	step.size = 0;
+	for (int i = 0; i < m_pending.size(); i++) {
+		step.size += patchSize(m_pending[i]);
+	}
+	m_pending.clear();
+	m_pendingRects.clear();
+	m_pendingCells.clear();
+	while (m_steps.size() > m_stepIndex) {
+		m_undoSize -= m_steps.last().size;
+		m_steps.removeLast();
+	}
+	m_steps.append(step);
+	m_stepIndex++;
+	m_undoSize += step.size;
+	// The last step is kept whatever its size
+	while (m_steps.size() > 1
+		   && (m_undoSize > QCS_MAX_SHEET_UNDO_SIZE || m_steps.size() > QCS_MAX_UNDO)) {
+		m_undoSize -= m_steps.first().size;
+		m_steps.removeFirst();
+		m_stepIndex--;
+	}
+	return true;
+}
+
+bool EventSheetModel::undo()
+{
+	if (m_stepIndex == 0) {
+		return false;
+	}
+	const Step &step = m_steps.at(--m_stepIndex);
+	m_recording = false;
+	beginUpdate();
+	for (int i = step.patches.size() - 1; i >= 0; i--) {
+		const Patch &p = step.patches.at(i);
+		switch (p.kind) {
+		case Patch::Cells:
+			writeCells(p.top, p.left, p.rows, p.columns, p.before);
+			break;
+		case Patch::InsertRows:
+			removeRows(p.top, p.rows);
+			break;
+		case Patch::RemoveRows:
+			insertRows(p.top, p.rows);
+			writeCells(p.top, p.left, p.rows, p.columns, p.before);
+			break;
+		case Patch::InsertColumns:
+			removeColumns(p.left, p.columns);
+			break;
+		case Patch::RemoveColumns:
+			insertColumns(p.left, p.columns);
+			writeCells(p.top, p.left, p.rows, p.columns, p.before);
+			break;
+		}
+	}
+	endUpdate();
+	m_recording = true;
+	return true;
+}
+
+bool EventSheetModel::redo()
+{
+	if (m_stepIndex == m_steps.size()) {
+		return false;
+	}
+	const Step &step = m_steps.at(m_stepIndex++);
+	m_recording = false;
+	beginUpdate();
+	for (int i = 0; i < step.patches.size(); i++) {
+		const Patch &p = step.patches.at(i);
+		switch (p.kind) {
+		case Patch::Cells:
+			writeCells(p.top, p.left, p.rows, p.columns, p.after);
+			break;
+		case Patch::InsertRows:
+			insertRows(p.top, p.rows);
+			break;
+		case Patch::RemoveRows:
+			removeRows(p.top, p.rows);
+			break;
+		case Patch::InsertColumns:
+			insertColumns(p.left, p.columns);
+			break;
+		case Patch::RemoveColumns:
+			removeColumns(p.left, p.columns);
+			break;
+		}
+	}
+	endUpdate();
+	m_recording = true;
+	return true;
+}
+
+void EventSheetModel::clearUndo()
+{
+	m_pending.clear();
+	m_pendingRects.clear();
+	m_pendingCells.clear();
+	m_steps.clear();
+	m_stepIndex = 0;
+	m_undoSize = 0;
+}
+
+void EventSheetModel::setLoopRange(int first, int last, bool active)
+{
+	int top = qMin(first, m_loopFirst);
+	int bottom = qMax(last, m_loopLast);
+	m_loopFirst = first;
+	m_loopLast = last;
+	m_loopActive = active;
+	top = qMax(top, 0);
+	bottom = qMin(bottom, m_rows - 1);
+	if (top <= bottom && !m_columns.isEmpty()) {
+		emit dataChanged(index(top, 0), index(bottom, qMin(3, m_columns.size() - 1)),
+						 QVector<int>() << Qt::BackgroundRole);
+	}
+}
+
+QString EventSheetModel::formatNumber(double value)
+{
+	return QString::number(value, 'g', 15);
+}
+
+void EventSheetModel::record(int top, int left, int bottom, int right)
+{
+	if (!m_recording || bottom < top || right < left) {
+		return;
+	}
+	const bool single = top == bottom && left == right;
+	const quint64 key = (quint64(top) << 32) | quint32(left);
+	if (single && m_pendingCells.contains(key)) {
+		return;
+	}
+	for (int i = m_pendingRects.size() - 1; i >= 0; i--) {
+		const Patch &p = m_pending.at(m_pendingRects[i]);
+		if (top >= p.top && bottom < p.top + p.rows && left >= p.left && right < p.left + p.columns) {
+			return;  // Its old contents are already kept
+		}
+	}
+	Patch patch;
+	patch.kind = Patch::Cells;
+	patch.top = top;
+	patch.left = left;
+	patch.rows = bottom - top + 1;
+	patch.columns = right - left + 1;
+	patch.before = cells(top, left, patch.rows, patch.columns);
+	patch.open = true;
+	if (single) {
+		m_pendingCells.insert(key);
+	}
+	else {
+		m_pendingRects.append(m_pending.size());
+	}
+	m_pending.append(patch);
+}
+
+void EventSheetModel::recordStructure(Patch::Kind kind, int position, int count)
+{
+	if (!m_recording) {
+		return;
+	}
+	// Cells recorded so far are closed at their current place, as the
+	// change moves them
+	closePatches();
+	m_pendingRects.clear();
+	m_pendingCells.clear();
+	Patch patch;
+	patch.kind = kind;
+	patch.open = false;
+	if (kind == Patch::InsertRows || kind == Patch::RemoveRows) {
+		patch.top = position;
+		patch.rows = count;
+		patch.left = 0;
+		patch.columns = m_columns.size();
+	}
+	else {
+		patch.top = 0;
+		patch.rows = m_rows;
+		patch.left = position;
+		patch.columns = count;
+	}
+	if (kind == Patch::RemoveRows || kind == Patch::RemoveColumns) {
+		patch.before = cells(patch.top, patch.left, patch.rows, patch.columns);
+	}
+	m_pending.append(patch);
+}
+
+void EventSheetModel::closePatches()
+{
+	for (int i = 0; i < m_pending.size(); i++) {
+		Patch &p = m_pending[i];
+		if (p.open) {
+			p.after = cells(p.top, p.left, p.rows, p.columns);
+			p.open = false;
+		}
+	}
+}
+
+QVector<EventSheetModel::Cell> EventSheetModel::cells(int top, int left, int rows, int columns) const
+{
+	QVector<Cell> cells;
+	cells.reserve(rows * columns);
+	for (int row = top; row < top + rows; row++) {
+		for (int column = left; column < left + columns; column++) {
+			cells.append(cell(row, column));
+		}
+	}
+	return cells;
+}
+
+void EventSheetModel::writeCells(int top, int left, int rows, int columns, const QVector<Cell> &cells)
+{
+	int i = 0;
+	for (int row = top; row < top + rows; row++) {
+		for (int column = left; column < left + columns; column++) {
+			setCell(row, column, cells.at(i++));
+		}
+	}
+}
+
+qint64 EventSheetModel::patchSize(const Patch &patch)
+{
+	qint64 size = sizeof(Patch) + (patch.before.size() + patch.after.size()) * sizeof(Cell);
+	for (int i = 0; i < patch.before.size(); i++) {
+		size += (patch.before[i].text.size() + patch.before[i].separator.size()) * sizeof(QChar);
+	}
+	for (int i = 0; i < patch.after.size(); i++) {
+		size += (patch.after[i].text.size() + patch.after[i].separator.size()) * sizeof(QChar);
+	}
+	return size;
+}
+
+EventSheetModel::Column EventSheetModel::emptyColumn() const
+{
+	Column c;
+	c.kinds.fill(EmptyCell, m_rows);
+	c.values.fill(0.0, m_rows);
+	c.carryRow = -1;
+	c.carrySource = -1;
+	return c;
+}
+
+void EventSheetModel::dropTexts(Column &c, int first, int last, const double *values)
+{
+	// Numbers that changed lose their own spelling. The side table is
+	// usually small, so walk it instead of the rows
+	QHash<int, QString>::iterator it = c.texts.begin();
+	while (it != c.texts.end()) {
+		int row = it.key();
+		if (row >= first && row <= last && c.kinds[row] == NumberCell
+				&& (values == nullptr || !qIsNaN(values[row - first]))) {
+			it = c.texts.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+}
+
+void EventSheetModel::cellChanged(int row, int column)
+{
+	cellsChanged(row, column, row, column);
+}
+
+void EventSheetModel::cellsChanged(int top, int left, int bottom, int right)
+{
+	for (int i = left; i <= right; i++) {
+		m_columns[i].carryRow = -1;
+	}
+	if (m_updating > 0) {
+		m_dirtyTop = qMin(m_dirtyTop, top);
+		m_dirtyBottom = qMax(m_dirtyBottom, bottom);
+		m_dirtyLeft = qMin(m_dirtyLeft, left);
+		m_dirtyRight = qMax(m_dirtyRight, right);
+	}
+	else {
+		emit dataChanged(index(top, left), index(bottom, right));
+	}
+}
@@ -0,0 +1,172 @@
+#ifndef EVENTSHEETMODEL_H
+#define EVENTSHEETMODEL_H
+
+#include <QAbstractTableModel>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+
+// Memory kept for undo by each sheet, besides the QCS_MAX_UNDO steps limit
+#define QCS_MAX_SHEET_UNDO_SIZE (16 * 1024 * 1024)
+
+// The cells of an event sheet, stored by column. Numbers are kept as
+// doubles; event letters, strings, formulas and comments go to a side
+// table of the column, as do separators other than a single space. A row
+// costs a few bytes per p-field, so sheets with hundreds of thousands of
+// events load, scroll and send without an object per cell.
+class EventSheetModel : public QAbstractTableModel
+{
+	Q_OBJECT
+public:
+	enum CellKind {
+		EmptyCell,
+		NumberCell,
+		TextCell,   // Anything that does not read as a number
+		CarryCell   // "." repeats the value above
+	};
+	enum Operation {
+		Add,
+		Multiply,
+		Divide
+	};
+	struct Cell {
+		Cell() : kind(EmptyCell), value(0.0) {}
+		CellKind kind;
+		double value;
+		QString text;       // Empty for numbers written as formatNumber() writes them
+		QString separator;  // Empty for a single space
+	};
+
+	EventSheetModel(QObject *parent = 0);
+
+	int rowCount(const QModelIndex &parent = QModelIndex()) const;
+	int columnCount(const QModelIndex &parent = QModelIndex()) const;
+	QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+	bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole);
+	Qt::ItemFlags flags(const QModelIndex &index) const;
+	QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+	// Dragged cells are plain text as copy() writes it. Drops inside the
+	// sheet are placed by EventSheet::dropEvent()
+	QStringList mimeTypes() const;
+	QMimeData *mimeData(const QModelIndexList &indexes) const;
+	Qt::DropActions supportedDropActions() const;
+	bool insertRows(int row, int count, const QModelIndex &parent = QModelIndex());
+	bool removeRows(int row, int count, const QModelIndex &parent = QModelIndex());
+	bool insertColumns(int column, int count, const QModelIndex &parent = QModelIndex());
+	bool removeColumns(int column, int count, const QModelIndex &parent = QModelIndex());
+
+	void setRowCount(int rows);
+	void clearCells();  // Keeps the size of the sheet
+
+	CellKind kind(int row, int column) const { return CellKind(m_columns[column].kinds[row]); }
+	double number(int row, int column) const { return m_columns[column].values[row]; }
+	QString text(int row, int column) const;
+	QString separator(int row, int column) const;
+	Cell cell(int row, int column) const;
+	// First column of the comment in row, -1 if it has none
+	int commentColumn(int row) const;
+	// Last column of row that is not empty, -1 for empty rows
+	int lastColumn(int row) const;
+	// Row whose value a "." at row repeats, -1 if there is none above it.
+	// Sending rows in order resolves each carry in constant time
+	int carrySource(int row, int column) const;
+
+	void setText(int row, int column, const QString &text);
+	void setSeparator(int row, int column, const QString &separator);
+	void setNumber(int row, int column, double value);
+	void setCell(int row, int column, const Cell &cell);
+	void clearCell(int row, int column);
+
+	// Bulk access to the numbers of a column, a loop over its buffer.
+	// Cells that are not numbers read as NaN
+	QVector<double> numbers(int column, int first, int count) const;
+	// Values from row first on, NaN leaves a cell as it is
+	void setNumbers(int column, int first, const QVector<double> &values);
+	// Applies op with value to the numbers of rows first to last
+	void transformNumbers(int column, int first, int last, Operation op, double value);
+
+	// Changes made between these are announced with one dataChanged()
+	void beginUpdate();
+	void endUpdate();
+
+	// Undo. Each change keeps the old contents of the cells it touches, and
+	// inserted or removed rows and columns, until commitStep() closes them
+	// into a step together with the new contents. Undoing a step only
+	// writes back those cells. Edits about to touch many cells one by one
+	// should announce their rectangle with recordCells() first
+	void recordCells(int top, int left, int bottom, int right);
+	bool commitStep();  // False if nothing changed since the last step
+	bool undo();
+	bool redo();
+	void clearUndo();  // Pending changes are dropped too
+
+	// Rows first to last are painted as the loop, brighter when active
+	void setLoopRange(int first, int last, bool active);
+
+	static QString formatNumber(double value);
+
+signals:
+	void cellEdited(int row, int column);  // By the user, through setData()
+
+private:
+	struct Column {
+		QVector<quint8> kinds;
+		QVector<double> values;
+		QHash<int, QString> texts;       // Text cells and numbers with their own spelling
+		QHash<int, QString> separators;  // Separators other than a single space
+		mutable int carryRow;     // Last carry resolved, -1 if none
+		mutable int carrySource;
+	};
+	struct Patch {
+		enum Kind {
+			Cells,
+			InsertRows,
+			RemoveRows,
+			InsertColumns,
+			RemoveColumns
+		};
+		Kind kind;
+		// The rectangle of cells. Inserted or removed rows are rows from
+		// top over all columns, and columns are columns from left
+		int top, left, rows, columns;
+		QVector<Cell> before;  // Row by row, empty for insertions
+		QVector<Cell> after;   // Only for Cells, filled when the patch is closed
+		bool open;
+	};
+	struct Step {
+		QVector<Patch> patches;
+		qint64 size;
+	};
+	void record(int top, int left, int bottom, int right);
+	void recordStructure(Patch::Kind kind, int position, int count);
+	void closePatches();
+	QVector<Cell> cells(int top, int left, int rows, int columns) const;
+	void writeCells(int top, int left, int rows, int columns, const QVector<Cell> &cells);
+	static qint64 patchSize(const Patch &patch);
+
+	Column emptyColumn() const;
+	static void dropTexts(Column &c, int first, int last, const double *values);
+	void cellChanged(int row, int column);
+	void cellsChanged(int top, int left, int bottom, int right);
+
+	QVector<Column> m_columns;
+	int m_rows;
+
+	int m_updating;
+	int m_dirtyTop, m_dirtyLeft, m_dirtyBottom, m_dirtyRight;
+
+	int m_loopFirst, m_loopLast;
+	bool m_loopActive;
+
+	bool m_recording;  // False while undoing and redoing
+	QVector<Patch> m_pending;
+	// Recorded since the last row or column change: patches of more than
+	// one cell and single cells, to record each cell once per step
+	QVector<int> m_pendingRects;
+	QSet<quint64> m_pendingCells;
+	QVector<Step> m_steps;
+	int m_stepIndex;  // Steps applied
+	qint64 m_undoSize;
+};
+
+#endif // EVENTSHEETMODEL_H
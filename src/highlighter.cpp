@@ -23,13 +23,15 @@
 #include "highlighter.h"
 
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QRegularExpression>
 
+#include <algorithm>
+
 
 TextBlockData::TextBlockData()
 {
 	// Nothing to do
-    section = UnknownSection;
 }
 
 QVector<ParenthesisInfo *> TextBlockData::parentheses()
@@ -341,14 +343,14 @@ QTextCharFormat Highlighter::getFormat(QString tag) {
 Highlighter::Highlighter(QTextDocument *parent)
 	: QSyntaxHighlighter(parent)
 {
-    commentStartExpression.setPattern("/\\*");
-    commentEndExpression.setPattern("\\*/");
-
     //  b64encStartExpression = QRegExp("<CsFileB .*>");
 	//  b64encEndExpression = QRegExp("<CsFileB>");
 	colorVariables = true;
 	m_mode = 0; // default to Csound mode
     m_scoreSyntaxHighlighting = true;
+    m_rehighlightTimer.setInterval(0);
+    connect(&m_rehighlightTimer, &QTimer::timeout, this, &Highlighter::rehighlightPending);
+    m_state = UnknownSection;
 
     tagPatterns << "<CsoundSynthesizer>" << "</CsoundSynthesizer>"
 				<< "<CsInstruments>" << "</CsInstruments>"
@@ -405,23 +407,16 @@ Highlighter::Highlighter(QTextDocument *parent)
                   << "--nchnls=" << "--nchnls_i=" << "--sinesize" << "--daemon"
                   << "--port=" << "--use-system-sr" << "--ksmps=" << "-+jack_client="
                   << "--limiter" << "--udp-echo" << "--opcode-dir="
+                  << "--midi-key-cps=" << "--midi-velocity="
                   ;
+    // Options are matched as prefixes, longest first
+    std::sort(csoundOptions.begin(), csoundOptions.end(),
+              [](const QString &a, const QString &b) { return a.size() > b.size(); });
 
-    csoundOptionsRx = QRegularExpression(
-                        "-(-(env|nodisplays|nosound|control-rate|messagelevel="
-                        "|dither|sched|omacro:|smacro:|verbose|sample-accurate|"
-                        "realtime|nchnls|nchnls_i|sinesize=|daemon|port=|use-system-sr|"
-                        "ksmps|midi-key-cps=|midi-velocity=)|"
-                        "\\+(rtaudio=|rtmidi=|jack_client=))");
-    /*
-    csoundOptionsRx = QRegExp("--(env|nodisplays|nosound|control-rate|messagelevel=|"
-                              "dither|sched|omacro:|smacro:|verbose|sample-accurate|"
-                              "realtime|nchnls|nchnls_i|sinesize=|daemon|port=|"
-                              "use-system-sr|ksmps|midi-key-cps=|midi-velocity=)");
-    */
-    csoundOptionsRx2 = QRegularExpression("-+(rtaudio=|rtmidi=|jack_client=)");
-
-    functionRegex = QRegExp("\\b\\w+(\\:a|\\:k|\\:i)?(?=\\()");
+    foreach (const QString &tag, tagPatterns) {
+        int start = tag.startsWith("</") ? 2 : 1;
+        m_csdTags.insert(tag.mid(start, tag.size() - start - 1));
+    }
 
     // For Python
     pythonKeywords << "and" << "or" << "not" << "is"
@@ -473,8 +468,7 @@ Highlighter::Highlighter(QTextDocument *parent)
 
 	javascriptKeywords << "function" << "var" << "if" << "===" << "console.log"  << "console.warn";
 
-    rxScoreLetter.setPattern("^\\s*(i|f|e|d|s)");
-    rxQuotation.setPattern("\"[^\"]*\"");
+    rebuildWordKinds();
 
     // this->setTheme("classic");
 }
@@ -489,8 +483,7 @@ void Highlighter::setOpcodeNameList(QStringList list)
 	m_opcodeList = list;
     //QSet<QString>(list.begin(), list.end()); // does not work with older Qt versions
     m_opcodesSet = list.toSet();
-	//   setFirstRules();
-	setLastRules();
+    rebuildWordKinds();
 }
 
 void Highlighter::setMode(int mode)
@@ -502,9 +495,6 @@ void Highlighter::setMode(int mode)
 void Highlighter::setColorVariables(bool color)
 {
 	colorVariables = color;
-
-	highlightingRules.clear();
-	setLastRules();
 }
 
 void Highlighter::highlightBlock(const QString &text)
@@ -543,19 +533,6 @@ void Highlighter::highlightBlock(const QString &text)
     }
     setCurrentBlockUserData(data);
 
-    if(m_theme != "none") {
-        // find previous valid block
-        auto block = currentBlock().previous();
-        while (block.isValid()) {
-            auto userData = static_cast<TextBlockData*>(block.userData());
-            if(userData != nullptr) {
-                data->section = userData->section;
-                break;
-            }
-            block = block.previous();
-        }
-    }
-
 	switch (m_mode) {
 	case 0:  // Csound mode
 		highlightCsoundBlock(text);
@@ -583,287 +560,559 @@ void Highlighter::highlightBlock(const QString &text)
 }
 
 
-void Highlighter::highlightScore(const QString &text, int start, int end) {
-    // things to highlight:
-    // 1) score command (i, f, e, etc)
-    // 2) strings
-    // 3) macros: $foo
-    // qDebug() << "highlighting score text: " << text << "\n";
-    // return;
-    // QRegularExpression rx;
-    // rx.setPattern("^\\s*(i|f|e|d|s)");
-    QRegularExpressionMatch match;
-    match = rxScoreLetter.match(text, start);
-    if(match.hasMatch()) {
-        setFormat(match.capturedStart(1), 1, scoreLetterFormat);
+// Character classes for the Csound tokenizer. Everything outside ASCII is
+// classified with QChar, which only matters for identifiers.
+enum CharClass {
+    CC_Other = 0,
+    CC_Space,
+    CC_Word,      // [A-Za-z0-9_]
+    CC_Quote,
+    CC_Semicolon,
+    CC_Slash,
+    CC_Operator,  // & | = ! > and backslash
+    CC_Less,
+    CC_Macro,     // $ and #
+    CC_Brace      // {
+};
+
+struct CharClassTable {
+    unsigned char classes[128];
+    CharClassTable() {
+        for (int i = 0; i < 128; i++) {
+            classes[i] = CC_Other;
+        }
+        classes[int(' ')] = classes[int('\t')] = classes[int('\r')] = classes[int('\n')] = CC_Space;
+        for (int i = 'a'; i <= 'z'; i++) {
+            classes[i] = CC_Word;
+        }
+        for (int i = 'A'; i <= 'Z'; i++) {
+            classes[i] = CC_Word;
+        }
+        for (int i = '0'; i <= '9'; i++) {
+            classes[i] = CC_Word;
+        }
+        classes[int('_')] = CC_Word;
+        classes[int('"')] = CC_Quote;
+        classes[int(';')] = CC_Semicolon;
+        classes[int('/')] = CC_Slash;
+        classes[int('&')] = classes[int('|')] = classes[int('=')] = CC_Operator;
+        classes[int('!')] = classes[int('>')] = classes[int('\\')] = CC_Operator;
+        classes[int('<')] = CC_Less;
+        classes[int('$')] = classes[int('#')] = CC_Macro;
+        classes[int('{')] = CC_Brace;
     }
-    int pos = start;
-    while(pos < end) {
-        match = rxQuotation.match(text, pos);
-        if(!match.hasMatch())
-            break;
-        setFormat(match.capturedStart(), match.capturedLength(), quotationFormat);
-        pos = match.capturedEnd() + 1;
+};
+
+static const CharClassTable charClassTable;
+
+static inline CharClass charClass(QChar c)
+{
+    ushort u = c.unicode();
+    if (u < 128) {
+        return (CharClass) charClassTable.classes[u];
     }
-    /*
-    pos = start;
-    rx.setPattern("\\$[a-zA-Z_]\\w+");
-    while(pos < end) {
-        match = rx.match(text, pos);
-        if(!match.hasMatch())
-            break;
-        setFormat(match.capturedStart(), match.capturedLength(), macroDefineFormat);
-        pos = match.capturedEnd() + 1;
+    if (c.isLetterOrNumber()) {
+        return CC_Word;
     }
-    */
+    return c.isSpace() ? CC_Space : CC_Other;
 }
 
-
-void Highlighter::highlightCsoundBlock(const QString &line)
+static inline bool isWordChar(QChar c)
 {
-    // TODO: rewrite this using QRegularExpression
-    QRegularExpression rx;
-    QRegularExpressionMatch rxmatch;
+    return charClass(c) == CC_Word;
+}
 
-	// text is processed one line at a time
-    if(m_theme == "none")
-        return;
+static inline int skipSpaces(const QString &text, int pos)
+{
+    while (pos < text.size() && charClass(text[pos]) == CC_Space) {
+        pos++;
+    }
+    return pos;
+}
 
-    int commentIndex = line.indexOf(';'); // try both comment markings
-	if (commentIndex < 0) {
-        commentIndex = line.indexOf("//");
-	}
+// Returns the end of the word starting at pos. Colons are part of a word
+// (functional syntax, e.g. oscili:a) but not at its end, so labels stay
+// separate from their colon.
+static int scanWord(const QString &text, int pos, bool allowColon)
+{
+    int end = pos;
+    while (end < text.size() && (isWordChar(text[end]) || (allowColon && text[end] == ':'))) {
+        end++;
+    }
+    while (end > pos + 1 && text[end - 1] == ':') {
+        end--;
+    }
+    return end;
+}
 
-    if(commentIndex >= 0) {
-        if(line[commentIndex] == ';' && line.size() > commentIndex+1 && line[commentIndex+1] == ';') {
-            setFormat(commentIndex, line.size() - commentIndex, importantCommentFormat);
-            return;
-        } else {
-            setFormat(commentIndex, line.size() - commentIndex, singleLineCommentFormat);
+// Returns the position after the closing quote, or -1 if the string is not
+// closed on this line
+static int scanString(const QString &text, int pos)
+{
+    for (int i = pos + 1; i < text.size(); i++) {
+        if (text[i] == '\\') {
+            i++;
+        } else if (text[i] == '"') {
+            return i + 1;
         }
-    } else {
-        commentIndex = line.size() + 1;
     }
-    // auto text = line.mid(0, commentIndex);
-
-    int index = 0;
-    int length = 0;
-
-    auto blockdata = static_cast<TextBlockData*>(currentBlockUserData());
-
-    rx.setPattern("^\\s*<\\/?(CsInstruments|CsOptions|CsoundSynthesizer|CsScore|CsFileB|CsLicense|html).*>");
-    rxmatch = rx.match(line);
-    if(rxmatch.hasMatch()) {
-        if(rxmatch.captured(1) == "CsInstruments") {
-            blockdata->section = OrchestraSection;
-        } else if(rxmatch.captured(1) == "CsScore") {
-            blockdata->section = ScoreSection;
-        } else if(rxmatch.captured(1) == "CsOptions") {
-            blockdata->section = OptionsSection;
-        } else {
-            blockdata->section = UnknownSection;
-        }
-        setFormat(rxmatch.capturedStart(), rxmatch.capturedLength(), csdtagFormat);
-        return;
+    return -1;
+}
+
+// True if only blanks or a comment follow pos
+static bool restIsBlank(const QString &text, int pos)
+{
+    pos = skipSpaces(text, pos);
+    if (pos >= text.size() || text[pos] == ';') {
+        return true;
     }
+    return text[pos] == '/' && pos + 1 < text.size() && text[pos + 1] == '/';
+}
 
-    if(blockdata->section == ScoreSection) {
-        if(m_scoreSyntaxHighlighting) {
-            highlightScore(line, 0, commentIndex);
-        }
-        return;
+void Highlighter::rebuildWordKinds()
+{
+    // Inserted from lowest to highest priority, later lists override
+    m_wordKinds.clear();
+    foreach (const QString &word, m_opcodeList) {
+        m_wordKinds.insert(word, OpcodeWord);
     }
-    else if(blockdata->section == OptionsSection) {
-        index = 0;
-        while((rxmatch = csoundOptionsRx.match(line, index)).hasMatch()) {
-            length = rxmatch.capturedLength();
-            setFormat(rxmatch.capturedStart(), length, csoundOptionFormat);
-            index += length;
-        }
-        return;
+    foreach (const QString &word, deprecatedOpcodes) {
+        m_wordKinds.insert(word, DeprecatedWord);
     }
-    else if(blockdata->section == UnknownSection) {
-        return;
+    foreach (const QString &word, ioPatterns) {
+        m_wordKinds.insert(word, IoWord);
+    }
+    foreach (const QString &word, keywordLiterals) {
+        m_wordKinds.insert(word, KeywordWord);
+    }
+    foreach (const QString &word, headerPatterns) {
+        m_wordKinds.insert(word, HeaderWord);
     }
+    foreach (const QString &word, instPatterns) {
+        m_wordKinds.insert(word, InstWord);
+    }
+}
 
-    auto text = QStringRef(&line, 0, commentIndex);
+bool Highlighter::highlightSectionTag(const QString &text)
+{
+    int pos = skipSpaces(text, 0);
+    if (pos >= text.size() || text[pos] != '<') {
+        return false;
+    }
+    int start = pos + 1;
+    bool closing = start < text.size() && text[start] == '/';
+    if (closing) {
+        start++;
+    }
+    int end = scanWord(text, start, false);
+    int tagEnd = text.lastIndexOf('>');
+    if (end == start || tagEnd < end) {
+        return false;
+    }
+    const QString name = QString::fromRawData(text.constData() + start, end - start);
+    CsdSection section;
+    if (name == QLatin1String("CsInstruments")) {
+        section = OrchestraSection;
+    } else if (name == QLatin1String("CsScore")) {
+        section = ScoreSection;
+    } else if (name == QLatin1String("CsOptions")) {
+        section = OptionsSection;
+    } else if (name == QLatin1String("CsoundSynthesizer") || name == QLatin1String("CsFileB")
+               || name == QLatin1String("CsLicense") || name == QLatin1String("html")) {
+        section = UnknownSection;
+    } else {
+        return false;
+    }
+    // Text after a closing tag does not belong to that section anymore.
+    // Comments, strings and instruments left open end here too.
+    m_state = closing ? UnknownSection : section;
+    setFormat(0, tagEnd + 1, csdtagFormat);
+    return true;
+}
 
-    // define
-    rx.setPattern("^\\s*#define\\s+[_\\w\\ \\t]*#.*#");
-    rxmatch = rx.match(text);
-    if(rxmatch.hasMatch()) {
-        setFormat(rxmatch.capturedStart(), rxmatch.capturedLength(), macroDefineFormat);
-        return;
+void Highlighter::highlightLineComment(const QString &text, int pos)
+{
+    if (pos + 1 < text.size() && text[pos] == ';' && text[pos + 1] == ';') {
+        setFormat(pos, text.size() - pos, importantCommentFormat);
+    } else {
+        setFormat(pos, text.size() - pos, singleLineCommentFormat);
     }
+}
 
-    rx.setPattern("^\\s*\\b(instr|opcode)\\s+(\\w+)\\b");
-    rxmatch = rx.match(text);
-    if(rxmatch.hasMatch()) {
-        auto group = rxmatch.captured(2);
-        setFormat(rxmatch.capturedStart(1), rxmatch.capturedLength(1), instFormat);
-        setFormat(rxmatch.capturedStart(2), rxmatch.capturedLength(2), nameFormat);
-        return;
+// Formats a /* */ comment or a {{ }} string starting at start, looking for
+// its end from searchFrom. Returns the position after it, or -1 if it
+// continues on the next line, which is recorded in the block state.
+int Highlighter::highlightMultiLine(const QString &text, int start, int searchFrom, BlockState flag)
+{
+    const bool comment = flag == InMultiLineComment;
+    int end = text.indexOf(QLatin1String(comment ? "*/" : "}}"), searchFrom);
+    const QTextCharFormat &format = comment ? multiLineCommentFormat : quotationFormat;
+    if (end < 0) {
+        setFormat(start, text.size() - start, format);
+        m_state |= flag;
+        return -1;
     }
+    setFormat(start, end + 2 - start, format);
+    m_state &= ~flag;
+    return end + 2;
+}
 
-    rx.setPattern(R"(&&|==|\|\||<|>|<=|>=|!=|\\)");
-    index = 0;
-    while((rxmatch=rx.match(text, index)).hasMatch()) {
-        length = rxmatch.capturedLength();
-        setFormat(rxmatch.capturedStart(), length, operatorFormat);
-        index = rxmatch.capturedEnd()+1;
+// Continues a comment or string left open by the previous block. Returns
+// where tokenizing should start, or -1 if the whole line is inside it.
+int Highlighter::continueMultiLine(const QString &text)
+{
+    if (m_state & InMultiLineComment) {
+        return highlightMultiLine(text, 0, 0, InMultiLineComment);
+    } else if (m_state & InMultiLineString) {
+        return highlightMultiLine(text, 0, 0, InMultiLineString);
     }
+    return 0;
+}
 
-    /*
-    index = 0;
-    while ((index = functionRegex.indexIn(text, index)) != -1 && index < commentIndex) {
-        length = functionRegex.matchedLength();
-        setFormat(index, length, opcodeFormat);
-        index += length;
+void Highlighter::highlightWord(const QString &text, int start, int end)
+{
+    const int length = end - start;
+    const QChar *data = text.constData() + start;
+    const QString word = QString::fromRawData(data, length);
+    if (data[0] == 'p' && length > 1) {
+        int i = 1;
+        while (i < length && data[i].isDigit()) {
+            i++;
+        }
+        if (i == length) {
+            setFormat(start, length, pfieldFormat);
+            return;
+        }
     }
-    */
-    QRegularExpression expressionRx("\\b[\\w:]+\\b");
-    QRegularExpression pfieldRx("\\bp[\\d]+\\b");
-    index = 0;
-    while((rxmatch = expressionRx.match(text, index)).hasMatch()) {
-        int wordStart = rxmatch.capturedStart();
-        int wordEnd = rxmatch.capturedEnd();
-        index = wordEnd;
-
-        if(wordStart > 0) {
-            auto prev = text.at(wordStart - 1);
-            if(prev == '$' || prev == '#') {
-                // check if macro name - replacement for regexp solution
-                setFormat(wordStart-1, wordEnd - wordStart + 1, macroDefineFormat);
-                index = wordEnd;
-                continue;
-			}
+    WordKind kind = m_wordKinds.value(word, NoWord);
+    switch (kind) {
+    case InstWord:
+        setFormat(start, length, instFormat);
+        return;
+    case HeaderWord:
+        setFormat(start, length, headerFormat);
+        return;
+    case KeywordWord:
+        setFormat(start, length, keywordFormat);
+        return;
+    case IoWord:
+        setFormat(start, length, ioFormat);
+        return;
+    default:
+        break;
+    }
+    int colon = word.indexOf(':');
+    if (colon >= 0) {
+        // functional style opcode:k(...)
+        if (word.indexOf(':', colon + 1) >= 0) {
+            setFormat(start, length, errorFormat);
+        } else if (isOpcode(QString::fromRawData(data, colon))) {
+            setFormat(start, length, opcodeFormat);
         }
-		wordEnd = (wordEnd > 0 ? wordEnd : text.size());
-        QString word = rxmatch.captured();
-        if(pfieldRx.match(word).hasMatch()) {
-			setFormat(wordStart, wordEnd - wordStart, pfieldFormat);
-		}
-        else if(instPatterns.contains(word)) {
-			setFormat(wordStart, wordEnd - wordStart, instFormat);
-            break; // was: return. For any case, to go through lines after while loop
-		}
-        else if(tagPatterns.contains("<" + word + ">") && wordStart > 0) {
-            setFormat(wordStart - (text[wordStart - 1] == '/'? 2: 1),
-                      wordEnd - wordStart + (text[wordStart - 1] == '/'? 3: 2),
-                      csdtagFormat);
-		}
-        else if(headerPatterns.contains(word)) {
-            setFormat(wordStart, wordEnd - wordStart, headerFormat);
-		}
-        else if(keywordLiterals.contains(word)) {
-            setFormat(wordStart, wordEnd - wordStart, keywordFormat);
-		}
-        else if(ioPatterns.contains(word)) {
-            setFormat(wordStart, wordEnd - wordStart, ioFormat);
+        return;
+    }
+    if (m_udosSet.contains(word)) {
+        setFormat(start, length, udoFormat);
+    } else if (kind == DeprecatedWord) {
+        setFormat(start, length, deprecatedFormat);
+    } else if (kind == OpcodeWord) {
+        setFormat(start, length, opcodeFormat);
+    } else if (colorVariables) {
+        const QTextCharFormat *format = nullptr;
+        bool global = data[0] == 'g' && length > 1;
+        switch ((global ? data[1] : data[0]).unicode()) {
+        case 'a':
+            format = global ? &garateFormat : &arateFormat;
+            break;
+        case 'k':
+            format = global ? &gkrateFormat : &krateFormat;
+            break;
+        case 'i':
+            format = global ? &girateFormat : &irateFormat;
+            break;
+        case 'S':
+            format = global ? &gstringVarFormat : &stringVarFormat;
+            break;
+        case 'f':
+            format = global ? &gfsigFormat : &fsigFormat;
+            break;
         }
-        else if(word[word.size()-1] != ':' && word.contains(":")) {
-            // functional style opcode:k(...)
-            auto parts = word.split(":");
-			if (parts.size() == 2) {
-                if (isOpcode(parts[0])) {
-					setFormat(wordStart, wordEnd - wordStart, opcodeFormat);
-				}
-			}
-            else {
-                setFormat(wordStart, wordEnd - wordStart, errorFormat);
-            }
-		}
-        else if(m_parsedUDOs.contains(word)) {
-            setFormat(wordStart, wordEnd - wordStart, udoFormat);
+        if (format != nullptr) {
+            setFormat(start, length, *format);
         }
-        else if(deprecatedOpcodes.contains(word)) {
-            setFormat(wordStart, wordEnd - wordStart, deprecatedFormat);
+    }
+}
+
+void Highlighter::highlightOrchestra(const QString &text)
+{
+    const int size = text.size();
+    int pos = continueMultiLine(text);
+    if (pos < 0) {
+        return;
+    }
+    bool firstToken = true;
+    int names = 0;  // Words to show as names after instr (-1 for all) or opcode
+    while (pos < size) {
+        const QChar c = text[pos];
+        const QChar next = pos + 1 < size ? text[pos + 1] : QChar();
+        CharClass cls = charClass(c);
+        if (cls == CC_Space) {
+            pos++;
+            continue;
         }
-        else if(isOpcode(word)) {
-			setFormat(wordStart, wordEnd - wordStart, opcodeFormat);
-		}
-        else if(colorVariables) {
-            if(word.startsWith('a')) {
-                setFormat(wordStart, wordEnd - wordStart, arateFormat);
+        bool first = firstToken;
+        firstToken = false;
+        switch (cls) {
+        case CC_Semicolon:
+            highlightLineComment(text, pos);
+            return;
+        case CC_Slash:
+            if (next == '/') {
+                highlightLineComment(text, pos);
+                return;
+            } else if (next == '*') {
+                pos = highlightMultiLine(text, pos, pos + 2, InMultiLineComment);
+                if (pos < 0) {
+                    return;
+                }
+            } else {
+                pos++;
             }
-            else if(word.startsWith('k')) {
-                setFormat(wordStart, wordEnd - wordStart, krateFormat);
+            break;
+        case CC_Quote: {
+            int end = scanString(text, pos);
+            if (end < 0) {
+                pos++;
+            } else {
+                setFormat(pos, end - pos, quotationFormat);
+                pos = end;
             }
-            else if(word.startsWith('i')) {
-                setFormat(wordStart, wordEnd - wordStart, irateFormat);
+            break;
+        }
+        case CC_Brace:
+            if (next == '{') {
+                pos = highlightMultiLine(text, pos, pos + 2, InMultiLineString);
+                if (pos < 0) {
+                    return;
+                }
+            } else {
+                pos++;
             }
-            else if(word.startsWith("ga")) {
-                setFormat(wordStart, wordEnd - wordStart, garateFormat);
+            break;
+        case CC_Macro: {
+            int end = scanWord(text, pos + 1, true);
+            if (end == pos + 1) {
+                pos++;
+                break;
             }
-            else if(word.startsWith("gk")) {
-                setFormat(wordStart, wordEnd - wordStart, gkrateFormat);
+            if (first && c == '#' && QStringRef(&text, pos + 1, end - pos - 1) == QLatin1String("define")) {
+                // #define NAME(args) # body #
+                int nameStart = skipSpaces(text, end);
+                int bodyStart = nameStart;
+                while (bodyStart < size && text[bodyStart] != '#' && charClass(text[bodyStart]) != CC_Quote
+                       && charClass(text[bodyStart]) != CC_Semicolon) {
+                    bodyStart++;
+                }
+                int bodyEnd = text.lastIndexOf('#');
+                if (nameStart > end && bodyStart < size && text[bodyStart] == '#' && bodyEnd > bodyStart) {
+                    setFormat(0, bodyEnd + 1, macroDefineFormat);
+                    pos = bodyEnd + 1;
+                    break;
+                }
             }
-            else if(word.startsWith("gi")) {
-                setFormat(wordStart, wordEnd - wordStart, girateFormat);
+            setFormat(pos, end - pos, macroDefineFormat);
+            pos = end;
+            break;
+        }
+        case CC_Word: {
+            int end = scanWord(text, pos, true);
+            if (first && end < size && text[end] == ':' && !c.isDigit()
+                    && text.indexOf(':', pos) == end && restIsBlank(text, end + 1)) {
+                setFormat(pos, end - pos, labelFormat);
+                pos = end + 1;
+                break;
             }
-            else if(word.startsWith("S")) {
-                setFormat(wordStart, wordEnd - wordStart, stringVarFormat);
+            const QStringRef word(&text, pos, end - pos);
+            if (first && (word == QLatin1String("instr") || word == QLatin1String("opcode"))) {
+                setFormat(pos, end - pos, instFormat);
+                bool instr = word == QLatin1String("instr");
+                names = instr ? -1 : 1;
+                m_state = (m_state & ~(InInstrument | InOpcode)) | (instr ? InInstrument : InOpcode);
+            } else if (first && (word == QLatin1String("endin") || word == QLatin1String("endop"))) {
+                setFormat(pos, end - pos, instFormat);
+                m_state &= ~(InInstrument | InOpcode);
+            } else if (names != 0) {
+                setFormat(pos, end - pos, nameFormat);
+                if (names > 0) {
+                    names--;
+                }
+            } else {
+                highlightWord(text, pos, end);
             }
-            else if(word.startsWith("gS")) {
-                setFormat(wordStart, wordEnd - wordStart, gstringVarFormat);
+            pos = end;
+            break;
+        }
+        case CC_Less: {
+            // CSD tags other than the section tags, e.g. <CsVersion>
+            int start = next == '/' ? pos + 2 : pos + 1;
+            int end = scanWord(text, start, false);
+            if (end > start && end < size && text[end] == '>'
+                    && m_csdTags.contains(QString::fromRawData(text.constData() + start, end - start))) {
+                setFormat(pos, end + 1 - pos, csdtagFormat);
+                pos = end + 1;
+                break;
             }
-            else if(word.startsWith("f")) {
-                setFormat(wordStart, wordEnd - wordStart, fsigFormat);
+        }
+            // Fall through
+        case CC_Operator: {
+            int length = 0;
+            if (c == '<' || c == '>') {
+                length = next == '=' ? 2 : 1;
+            } else if (c == '\\') {
+                length = 1;
+            } else if ((c == '&' && next == '&') || (c == '|' && next == '|')
+                       || ((c == '=' || c == '!') && next == '=')) {
+                length = 2;
             }
-            else if(word.startsWith("gf")) {
-                setFormat(wordStart, wordEnd - wordStart, gfsigFormat);
+            if (length > 0) {
+                setFormat(pos, length, operatorFormat);
+                pos += length;
+            } else {
+                pos++;
             }
+            break;
+        }
+        default:
+            pos++;
+            break;
         }
-
     }
+}
 
-    // string
-    rx.setPattern("\"[^\"]*\"");
-    index = 0;
-    while ((rxmatch = rx.match(text, index)).hasMatch()) {
-        setFormat(rxmatch.capturedStart(), rxmatch.capturedLength(), quotationFormat);
-        index = rxmatch.capturedEnd();
+void Highlighter::highlightScore(const QString &text)
+{
+    const int size = text.size();
+    int pos = continueMultiLine(text);
+    if (pos < 0) {
+        return;
     }
-
-    //last rules
-    for(auto rule: lastHighlightingRules) {
-        index = 0;
-        while((rxmatch = rule.pattern.match(text, index)).hasMatch()) {
-            int group = rule.group;
-            qDebug() << "last rule matched: " << rule.pattern.pattern();
-            setFormat(rxmatch.capturedLength(group), rxmatch.capturedStart(group), rule.format);
-            index = rxmatch.capturedEnd();
+    pos = skipSpaces(text, pos);
+    if (m_scoreSyntaxHighlighting && pos < size) {
+        switch (text[pos].unicode()) {
+        case 'i': case 'f': case 'e': case 'd': case 's':
+            setFormat(pos, 1, scoreLetterFormat);
+            pos++;
+            break;
         }
     }
+    while (pos < size) {
+        const QChar c = text[pos];
+        if (c == ';' || (c == '/' && pos + 1 < size && text[pos + 1] == '/')) {
+            highlightLineComment(text, pos);
+            return;
+        }
+        if (c == '/' && pos + 1 < size && text[pos + 1] == '*') {
+            pos = highlightMultiLine(text, pos, pos + 2, InMultiLineComment);
+            if (pos < 0) {
+                return;
+            }
+            continue;
+        }
+        if (c == '"' && m_scoreSyntaxHighlighting) {
+            int end = scanString(text, pos);
+            if (end > 0) {
+                setFormat(pos, end - pos, quotationFormat);
+                pos = end;
+                continue;
+            }
+        }
+        pos++;
+    }
+}
 
-    setCurrentBlockState(0);
-
-	int startIndex = 0;
-    if(previousBlockState() != 1) {
-        rxmatch = commentStartExpression.match(text, 0);
-        startIndex = rxmatch.hasMatch() ? rxmatch.capturedStart() : -1;
+void Highlighter::highlightOptions(const QString &text)
+{
+    const int size = text.size();
+    int pos = 0;
+    while (pos < size) {
+        pos = skipSpaces(text, pos);
+        if (pos >= size) {
+            break;
+        }
+        const QChar c = text[pos];
+        if (c == ';' || (c == '/' && pos + 1 < size && text[pos + 1] == '/')) {
+            highlightLineComment(text, pos);
+            return;
+        }
+        int end = pos;
+        while (end < size && charClass(text[end]) != CC_Space) {
+            end++;
+        }
+        if (c == '-') {
+            // csoundOptions is sorted longest first, so --nchnls_i wins over --nchnls
+            const QStringRef token(&text, pos, end - pos);
+            foreach (const QString &option, csoundOptions) {
+                if (token.startsWith(option)) {
+                    setFormat(pos, option.size(), csoundOptionFormat);
+                    break;
+                }
+            }
+        }
+        pos = end;
     }
+}
 
-    QRegularExpressionMatch endMatch;
+void Highlighter::highlightCsoundBlock(const QString &text)
+{
+    // Text is tokenized in a single pass per line, formats are applied as
+    // each token is recognized. Everything carried from line to line is in
+    // the block state, so when an edit leaves a block's state unchanged Qt
+    // stops rehighlighting there.
+    int previous = previousBlockState();
+    if (previous < 0) {
+        // First block. Orc, sco and inc files have no section tags.
+        switch (m_mode) {
+        case 3:
+        case 5:
+            previous = OrchestraSection;
+            break;
+        case 4:
+            previous = ScoreSection;
+            break;
+        default:
+            previous = UnknownSection;
+            break;
+        }
+    }
+    m_state = previous;
+    if (!highlightSectionTag(text)) {
+        highlightSection(text);
+    }
+    setCurrentBlockState(m_state);
+}
 
-    while (startIndex >= 0 && startIndex < commentIndex) {
-        endMatch = commentEndExpression.match(text, startIndex);
-        int endIndex = endMatch.hasMatch() ? endMatch.capturedStart() : -1;
-        if (format(startIndex) == quotationFormat) {
-            rxmatch = commentStartExpression.match(text, startIndex+1);
-            startIndex = rxmatch.hasMatch() ? rxmatch.capturedStart() : -1;
-            continue;
-		}
-		int commentLength;
-		if (endIndex == -1) {
-            setCurrentBlockState(1);
-			commentLength = text.length() - startIndex;
-		} else {
-            commentLength = endIndex - startIndex + endMatch.capturedLength();
-		}
-		setFormat(startIndex, commentLength, multiLineCommentFormat);
-        rxmatch = commentStartExpression.match(text, startIndex + commentLength);
-        startIndex = rxmatch.hasMatch() ? rxmatch.capturedStart() : -1;
+void Highlighter::highlightSection(const QString &text)
+{
+    switch (sectionOf(m_state)) {
+    case OrchestraSection:
+        highlightOrchestra(text);
+        break;
+    case ScoreSection:
+        highlightScore(text);
+        break;
+    case OptionsSection:
+        highlightOptions(text);
+        break;
+    default: {
+        int commentIndex = text.indexOf(';');
+        if (commentIndex < 0) {
+            commentIndex = text.indexOf(QLatin1String("//"));
+        }
+        if (commentIndex >= 0) {
+            highlightLineComment(text, commentIndex);
+        }
+        break;
+    }
     }
 }
 
@@ -1010,58 +1259,48 @@ void Highlighter::highlightHtmlBlock(const QString &text)
 	}
 }
 
-// void Highlighter::setFirstRules()
-// {
-//   highlightingRules.clear();
-// }
-
-void Highlighter::setLastRules()
-{
-	HighlightingRule rule;
-
-    // labels
-    rule = {QRegularExpression("^\\s*([a-zA-Z]\\w*):\\s*$"), labelFormat, 1};
-    lastHighlightingRules.append(rule);
-
-    // strings
-    // lastHighlightingRules.append({QRegularExpression("\"[^\"]*\""), quotationFormat, 0});
-
-    // NB: multiline strings should be implemented like multi-line comments
-    // NB2: qt does syntax highlighting on a line-per-line basis
-    // multi line strings
-    // rule = {QRegularExpression("\\{\\{.*"), quotationFormat, 0};
-    // lastHighlightingRules.append(rule);
-
-    // end multi line strings
-    // rule = {QRegularExpression(".*\\}\\}"), quotationFormat, 0};
-    // lastHighlightingRules.append(rule);
-}
-
 bool Highlighter::isOpcode(QString name) {
     // Returns true if name is a known opcode
     return m_opcodesSet.contains(name);
 }
 
-int Highlighter::findOpcode(QString opcodeName, int start, int end)
+void Highlighter::rehighlightBlocks(const QList<QTextBlock> &blocks)
 {
-	//   fprintf(stderr, "%i - %i\n", start, end);
-	Q_ASSERT(m_opcodeList.size() > 0);
-	if (end == -1) {
-		end = m_opcodeList.size() -1;
-	}
-	int pos = ((end - start)/2) + start;
-	if (opcodeName == m_opcodeList[pos])
-		return pos;
-    else if(start == end)
-		return -1;
-    else if(opcodeName < m_opcodeList[pos])
-		return findOpcode(opcodeName, start, pos);
-    else if(opcodeName > m_opcodeList[pos])
-		return findOpcode(opcodeName, pos + 1, end);
-	return -1;
+    // Numbers are read now, as edits since the last call may have moved them
+    QSet<int> queued;
+    foreach (const QTextBlock &block, m_pendingBlocks) {
+        if (block.isValid()) {
+            queued.insert(block.blockNumber());
+        }
+    }
+    foreach (const QTextBlock &block, blocks) {
+        if (block.isValid() && !queued.contains(block.blockNumber())) {
+            queued.insert(block.blockNumber());
+            m_pendingBlocks.append(block);
+        }
+    }
+    if (!m_pendingBlocks.isEmpty() && !m_rehighlightTimer.isActive()) {
+        m_rehighlightTimer.start();
+    }
+}
+
+void Highlighter::rehighlightPending()
+{
+    // A slice of at most a few ms per pass of the event loop
+    QElapsedTimer timer;
+    timer.start();
+    while (!m_pendingBlocks.isEmpty() && timer.elapsed() < 4) {
+        QTextBlock block = m_pendingBlocks.takeFirst();
+        if (block.isValid() && block.document() == document()) {
+            rehighlightBlock(block);
+        }
+    }
+    if (m_pendingBlocks.isEmpty()) {
+        m_rehighlightTimer.stop();
+    }
 }
 
 void Highlighter::setUDOs(QStringList udos)
 {
-       m_parsedUDOs = udos;
+       m_udosSet = udos.toSet();
 }
@@ -31,6 +31,7 @@
 #include <QRegularExpression>
 
 #include <QTextDocument>
+#include <QTimer>
 
 enum CsdSection { UnknownSection, OptionsSection, OrchestraSection, ScoreSection };
 
@@ -47,7 +48,6 @@ public:
 
 	QVector<ParenthesisInfo *> parentheses();
 	void insert(ParenthesisInfo *info);
-    CsdSection section;
     void clearParenthesis() { m_parentheses.clear(); }
 
 private:
@@ -87,6 +87,22 @@ public:
 	{ return m_formats[construct]; }
 
     void setUDOs(QStringList udos);
+    // Rehighlights blocks a few at a time from the event loop, so large
+    // sets do not block the GUI
+    void rehighlightBlocks(const QList<QTextBlock> &blocks);
+
+    // Block state of Csound text: the section in the low bits and flags
+    // for what is still open at the end of the block
+    enum BlockState {
+        SectionMask = 0x3,
+        InMultiLineComment = 0x4,
+        InMultiLineString = 0x8,
+        InInstrument = 0x10,
+        InOpcode = 0x20
+    };
+    static CsdSection sectionOf(int blockState) {
+        return blockState < 0 ? UnknownSection : CsdSection(blockState & SectionMask);
+    }
 
 protected:
 	enum State {
@@ -102,26 +118,22 @@ protected:
 	void highlightPythonBlock(const QString &text);
 	void highlightXmlBlock(const QString &text);
 	void highlightHtmlBlock(const QString &text);
-    void highlightScore(const QString &text, int start, int end);
-	int findOpcode(QString opcodeName, int start = 0, int end = -1);
+    bool highlightSectionTag(const QString &text);
+    void highlightSection(const QString &text);
+    void highlightOrchestra(const QString &text);
+    void highlightScore(const QString &text);
+    void highlightOptions(const QString &text);
+    void highlightWord(const QString &text, int start, int end);
+    void highlightLineComment(const QString &text, int pos);
+    int highlightMultiLine(const QString &text, int start, int searchFrom, BlockState flag);
+    int continueMultiLine(const QString &text);
     bool isOpcode(QString name);
 
 private:
-	struct HighlightingRule
-	{
-        QRegularExpression pattern;
-		QTextCharFormat format;
-        int group;
-	};
-	QVector<HighlightingRule> highlightingRules;
-	QVector<HighlightingRule> lastHighlightingRules;
+    // Classes of the words looked up in m_wordKinds, UDOs are kept apart
+    // because they change while editing
+    enum WordKind { NoWord, InstWord, HeaderWord, KeywordWord, IoWord, DeprecatedWord, OpcodeWord };
 
-    QRegularExpression commentStartExpression;
-    QRegularExpression commentEndExpression;
-    QRegExp functionRegex;
-
-    QRegularExpression rxScoreLetter;
-    QRegularExpression rxQuotation;
     //    QRegExp b64encStartExpression;
 	//    QRegExp b64encEndExpression;
 
@@ -156,10 +168,11 @@ private:
 
     QStringList pythonKeywords;  //Python
 	QTextCharFormat keywordFormat;
-    QRegularExpression csoundOptionsRx, csoundOptionsRx2;
 
-	//     void setFirstRules();
-	void setLastRules();
+    void rebuildWordKinds();
+    QHash<QString, WordKind> m_wordKinds;
+    QSet<QString> m_csdTags;  // Tag names without brackets
+    int m_state;  // State of the block being highlighted
 
 	QStringList m_opcodeList;
     QSet<QString> m_opcodesSet;
@@ -176,7 +189,11 @@ private:
 	QTextCharFormat jsKeywordFormat, htmlTagFormat;
 	QTextCharFormat m_formats[LastConstruct + 1];
 
-    QStringList m_parsedUDOs;
+    QSet<QString> m_udosSet;
+
+    void rehighlightPending();
+    QList<QTextBlock> m_pendingBlocks;
+    QTimer m_rehighlightTimer;
 };
 
 #endif
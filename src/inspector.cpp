@@ -22,7 +22,6 @@
 
 #include "inspector.h"
 #include "types.h"
-#include <chrono>
 #include <QtGui>
 
 Inspector::Inspector(QWidget *parent)
@@ -40,24 +39,7 @@ Inspector::Inspector(QWidget *parent)
 			this, SLOT(itemChanged(QTreeWidgetItem*, QTreeWidgetItem*)));
 	//  connect(m_treeWidget, SIGNAL(itemDoubleClicked(QTreeWidgetItem*,int)),
 	//          this, SLOT(itemActivated(QTreeWidgetItem*,int)));
-	treeItem1 = new TreeItem(m_treeWidget, QStringList(tr("Opcodes")));
-	treeItem2 = new TreeItem(m_treeWidget, QStringList(tr("Macros")));
-	treeItem3 = new TreeItem(m_treeWidget, QStringList(tr("Instruments")));
-	treeItem4 = new TreeItem(m_treeWidget, QStringList(tr("F-tables")));
-	treeItem5 = new TreeItem(m_treeWidget, QStringList(tr("Score")));
-
-    m_treeWidget->expandItem(treeItem1);    // opcodes
-    m_treeWidget->collapseItem(treeItem2);  // macros
-    m_treeWidget->expandItem(treeItem3);    // instruments
-    m_treeWidget->collapseItem(treeItem4);  // ftables
-    m_treeWidget->collapseItem(treeItem5);    // score
-    rxOpcode.setPattern("\\bopcode\\s+(\\w+),");
-    xinRx.setPattern("\\bxin\\b");
-    // xinRx.setPattern("[akiS]\\w+[,\\w\\d\\s_]+\\bxin\\s*$");
-    xoutRx.setPattern("\\bxout\\s+\\b");
-    // ftableRx1.setPattern("^f\\s*\\d");
-    ftableRx2.setPattern("^[\\w]*[\\s]*ftgen");
-
+	createCsoundTree();
     inspectLabels = false;
 
 
@@ -71,213 +53,150 @@ Inspector::~Inspector()
 
 void Inspector::parseText(const QString &text)
 {
-    udosMap.clear();
-    // udosVector.clear();
-    inspectorMutex.lock();
-
-    auto t1 = std::chrono::high_resolution_clock::now();
-
-    bool insideSco = false;
-    bool insideOrc = false;
-	bool treeItem1Expanded = true;
-	bool treeItem2Expanded = true;
-	bool treeItem3Expanded = true;
-	bool treeItem4Expanded = true;
-	bool treeItem5Expanded = true;
-	if  (treeItem1 != 0) {
-		treeItem1Expanded = treeItem1->isExpanded();
-		treeItem2Expanded = treeItem2->isExpanded();
-		treeItem3Expanded = treeItem3->isExpanded();
-		treeItem4Expanded = (treeItem4 != 0 ? treeItem4->isExpanded() : false);
-		treeItem5Expanded = (treeItem5 != 0 ? treeItem5->isExpanded() : false);
-	}
-	QHash<QString, bool> instrumentExpanded;  // Remember if instrument is expanded in menu
-	for (int i = 0; i < treeItem3->childCount(); i++) {
-		QTreeWidgetItem * instr = treeItem3->child(i);
-		Q_ASSERT(instr->columnCount() > 0);
-		instrumentExpanded[instr->text(0)] = instr->isExpanded();
-	}
-
-	m_treeWidget->clear();
-	treeItem1 = new TreeItem(m_treeWidget, QStringList(tr("Opcodes")));
-	treeItem1->setLine(-1);
-    treeItem2 = new TreeItem(m_treeWidget, QStringList(tr("Macros")));
-	treeItem2->setLine(-1);
-	treeItem3 = new TreeItem(m_treeWidget, QStringList(tr("Instruments")));
-	treeItem3->setLine(-1);
-    treeItem4 = new TreeItem(m_treeWidget, QStringList(tr("F-tables")));
-	treeItem4->setLine(-1);
-	treeItem5 = new TreeItem(m_treeWidget, QStringList(tr("Score")));
-	treeItem5->setLine(-1);  // This might be overridden below
-    TreeItem *currentInstrument = nullptr;
-    TreeItem *currentItem = treeItem3;
-    Opcode *currentOpcode = nullptr;
-	int commentIndex = 0;
-    bool partOfComment = false;
-    int i = 0;
-    auto lines = text.splitRef('\n');
-    QRegularExpressionMatch match;
-    QRegularExpression orcStartRx("^\\s*<CsInstruments>");
+    setOutline(DocumentModel::parse(text));
+}
 
-    for(; i<lines.size(); i++) {
-        if(orcStartRx.match(lines[i]).hasMatch()) {
-            i++;
-            treeItem3->setLine(i);
-            break;
-        }
+// Makes the children of parent match nodes. Items are matched by their text,
+// in order, so an item that is still there keeps its expanded state and
+// selection; only its line is updated. New items are inserted and items
+// that are gone are deleted.
+void Inspector::syncChildren(QTreeWidgetItem *parent, const QVector<InspectorNode> &nodes)
+{
+    QHash<QString, QList<TreeItem *> > existing;
+    for (int i = 0; i < parent->childCount(); i++) {
+        TreeItem *item = static_cast<TreeItem *>(parent->child(i));
+        existing[item->text(0)].append(item);
     }
-
-    // Parsing orchestra
-    for (; i< lines.size(); i++) {
-        auto line = lines[i];
-        if (partOfComment) {
-            if (line.indexOf("*/") != -1)
-                partOfComment = false;
-            continue;
-        }
-        if (!partOfComment && (commentIndex=line.indexOf("/*")) != -1) {
-            partOfComment = line.indexOf("*/", commentIndex) == -1;
-            continue;
-        }
-        line = line.trimmed();
-        if (line.isEmpty())
-            continue;
-        if (line[0] == "<") {
-            if (line.startsWith("</CsInstruments>"))
-                break;
-            QDEBUG << "Malformed orchestra, tag" << line << "is invalid";
-            continue;
-        }
-        if (line.startsWith(';') || line.startsWith("//"))
-            continue;
-        else if (line.startsWith(";; ")) {
-            auto itemname = line.mid(2).trimmed().toString();
-            TreeItem *newItem = new TreeItem(currentItem, QStringList(itemname));
-            newItem->setLine(i + 1);
-        }
-        else if(currentOpcode == nullptr && currentInstrument == nullptr) {
-            // we are at instr 0
-            if (line.startsWith("instr ")) {
-                auto instrline = line.mid(6).trimmed().toString();
-                auto newItem = new TreeItem(treeItem3, QStringList(instrline));
-                newItem->setLine(i + 1);
-                currentInstrument = newItem;
-                currentItem = newItem;
-            }
-            else if((match=rxOpcode.match(line)).hasMatch()) {
-                auto opcodeName = match.captured(1);
-                auto itemtext = line.mid(7).toString();
-                QStringList columnslist(itemtext);
-                if (treeItem1->childCount() == 0) { // set line for element to the first one found
-                    treeItem1->setLine(i + 1);
-                }
-                TreeItem *newItem = new TreeItem(treeItem1, columnslist);
-                newItem->setLine(i + 1);
-                currentItem = newItem;
-                currentOpcode = new Opcode(opcodeName);
-                udosMap.insert(currentOpcode->opcodeName, *currentOpcode);
-            }
-            else if (line.startsWith("#define")) {
-                QString item = line.mid(8).toString();
-                if (treeItem2->childCount() == 0) { // set line for element to the first one found
-                    treeItem2->setLine(i + 1);
-                }
-                TreeItem *newItem = new TreeItem(treeItem2, QStringList(item));
-                newItem->setLine(i + 1);
-            }
-            else if(ftableRx2.match(line).hasMatch()) {
-                QStringList columnslist(line.toString());
-                if (treeItem4->childCount() == 0) { // set line for element to the first one found
-                    treeItem4->setLine(i + 1);
-                }
-                TreeItem *newItem = new TreeItem(treeItem4, columnslist);
-                newItem->setLine(i + 1);
-            }
+    // Items are matched by text, in order, and the rest deleted first so
+    // that the ones kept are already in place unless they really moved
+    QVector<TreeItem *> matched(nodes.size(), nullptr);
+    QSet<QTreeWidgetItem *> kept;
+    for (int i = 0; i < nodes.size(); i++) {
+        auto it = existing.find(nodes[i].text);
+        if (it != existing.end() && !it.value().isEmpty()) {
+            matched[i] = it.value().takeFirst();
+            kept.insert(matched[i]);
         }
-        else if(currentOpcode != nullptr) {
-            if (line.startsWith("endop")) {
-                if(currentOpcode != nullptr) {
-                    // udosMap.insert(currentOpcode->opcodeName, *currentOpcode);
-                    // udosVector << currentOpcode;
-                    currentOpcode = nullptr;
-                    currentItem = treeItem3;
-                }
-                else {
-                    qDebug() << "endop found outside opcode definition, line" << (i+1);
-                }
-            }
-            else if(currentOpcode->inArgs.isEmpty() && (match=xinRx.match(line)).hasMatch()) {
-                currentOpcode->inArgs = line.mid(0, match.capturedStart()).toString().simplified();
-                // QStringList columnslist(line.toString().simplified());
-                QStringList columnslist(currentOpcode->inArgs + " xin");
-                TreeItem *newItem = new TreeItem(currentItem, columnslist);
-                newItem->setLine(i + 1);
-            }
-            else if(currentOpcode->outArgs.isEmpty() && (match=xoutRx.match(line)).hasMatch()) {
-                currentOpcode->outArgs = line.mid(match.capturedEnd()).toString().simplified();
-                // auto itemtext = line.toString().simplified();
-                // QStringList columnslist(itemtext);
-                QStringList columnslist("xout " + currentOpcode->outArgs);
-                TreeItem *newItem = new TreeItem(currentItem, columnslist);
-                newItem->setLine(i + 1);
-            }
+    }
+    for (int i = parent->childCount() - 1; i >= 0; i--) {
+        if (!kept.contains(parent->child(i))) {
+            delete parent->takeChild(i);
         }
-        else if (line.startsWith("endin")) {
-            // everything between instruments is placed in the main instrument menu
-            currentInstrument = nullptr;
-            currentItem = treeItem3;
+    }
+    for (int i = 0; i < nodes.size(); i++) {
+        const InspectorNode &node = nodes[i];
+        TreeItem *item = matched[i];
+        if (item == nullptr) {
+            item = new TreeItem(static_cast<QTreeWidgetItem *>(nullptr), QStringList(node.text));
+            parent->insertChild(i, item);
+        } else if (parent->child(i) != item) {
+            bool expanded = item->isExpanded();
+            parent->takeChild(parent->indexOfChild(item));
+            parent->insertChild(i, item);
+            item->setExpanded(expanded);
         }
+        item->setLine(node.line);
+        syncChildren(item, node.children);
+    }
+}
+
+void Inspector::setOutline(QSharedPointer<const DocumentOutline> outline)
+{
+    if (outline == m_outline && m_csoundTree) {
+        return;
+    }
+    inspectorMutex.lock();
+    m_outline = outline;
+    // Signals are blocked so that removing the current item does not
+    // make the editor jump to another one
+    m_treeWidget->blockSignals(true);
+    if (!m_csoundTree) {
+        // Coming back from a Python document
+        m_treeWidget->clear();
+        createCsoundTree();
+    }
 
-        /*
-        else if((currentOpcode != nullptr) && currentOpcode->inArgs.isEmpty() && (match=xinRx.match(line)).hasMatch()) {
-            currentOpcode->inArgs = line.mid(0, match.capturedStart()).toString().simplified();
-            QStringList columnslist(line.toString().simplified());
-            TreeItem *newItem = new TreeItem(currentItem, columnslist);
-            newItem->setLine(i + 1);
+    QVector<InspectorNode> opcodes;
+    udosMap.clear();
+    foreach (const DocumentOutline::Udo &udo, outline->udos) {
+        InspectorNode node(udo.name, udo.line);
+        if (udo.xinLine >= 0) {
+            node.children.append(InspectorNode(udo.inArgs + " xin", udo.xinLine));
+        }
+        if (udo.xoutLine >= 0) {
+            node.children.append(InspectorNode("xout " + udo.outArgs, udo.xoutLine));
         }
-        else if(currentOpcode != nullptr && currentOpcode->outArgs.isEmpty() && (match=xoutRx.match(line)).hasMatch()) {
-            currentOpcode->outArgs = line.mid(match.capturedEnd()).toString().simplified();
-            auto itemtext = line.toString().simplified();
-            QStringList columnslist(itemtext);
-            TreeItem *newItem = new TreeItem(currentItem, columnslist);
-            newItem->setLine(i + 1);
+        foreach (const DocumentOutline::Entry &marker, udo.markers) {
+            node.children.append(InspectorNode(marker.text, marker.line));
         }
-        */
+        opcodes.append(node);
+        udosMap.insert(udo.opcodeName, Opcode(udo.opcodeName, udo.outArgs, udo.inArgs));
     }
-
-    for(; i< lines.size(); i++) {
-        auto line = lines[i].trimmed();
-        if (line.startsWith("<CsScore>")) {
-            treeItem5->setLine(i + 1);
-            currentItem = treeItem5;
-            insideSco = true;
-            break;
+    QVector<InspectorNode> macros;
+    foreach (const DocumentOutline::Entry &macro, outline->macros) {
+        macros.append(InspectorNode(macro.text, macro.line));
+    }
+    QVector<InspectorNode> instruments;
+    foreach (const DocumentOutline::Span &instrument, outline->instruments) {
+        InspectorNode node(instrument.name, instrument.line);
+        foreach (const DocumentOutline::Entry &marker, instrument.markers) {
+            node.children.append(InspectorNode(marker.text, marker.line));
         }
+        instruments.append(node);
+    }
+    foreach (const DocumentOutline::Entry &marker, outline->markers) {
+        instruments.append(InspectorNode(marker.text, marker.line));
+    }
+    QVector<InspectorNode> ftables;
+    foreach (const DocumentOutline::Entry &ftable, outline->ftables) {
+        ftables.append(InspectorNode(ftable.text, ftable.line));
     }
 
-	treeItem1->setExpanded(treeItem1Expanded);
-	treeItem2->setExpanded(treeItem2Expanded);
-	treeItem3->setExpanded(treeItem3Expanded);
-	treeItem4->setExpanded(treeItem4Expanded);
-	treeItem5->setExpanded(treeItem5Expanded);
+    // Categories point at their first element
+    treeItem1->setLine(opcodes.isEmpty() ? -1 : opcodes.first().line);
+    treeItem2->setLine(macros.isEmpty() ? -1 : macros.first().line);
+    treeItem3->setLine(outline->orchestraLine);
+    treeItem4->setLine(ftables.isEmpty() ? -1 : ftables.first().line);
+    treeItem5->setLine(outline->scoreLine);
+    syncChildren(treeItem1, opcodes);
+    syncChildren(treeItem2, macros);
+    syncChildren(treeItem3, instruments);
+    syncChildren(treeItem4, ftables);
 
-    for (int i = 0; i < treeItem3->childCount(); i++) {
-		QTreeWidgetItem * instr = treeItem3->child(i);
-		if (instrumentExpanded.contains(instr->text(0))) {
-			instr->setExpanded(instrumentExpanded[instr->text(0)]);
-		}
-	}
-    std::chrono::duration<double, std::milli> ms_double = std::chrono::high_resolution_clock::now() - t1;
-    qDebug() << "Inspector::parseText: "<< ms_double.count() << "ms\n";
+    m_treeWidget->blockSignals(false);
     inspectorMutex.unlock();
+}
 
+void Inspector::createCsoundTree()
+{
+	treeItem1 = new TreeItem(m_treeWidget, QStringList(tr("Opcodes")));
+	treeItem1->setLine(-1);
+	treeItem2 = new TreeItem(m_treeWidget, QStringList(tr("Macros")));
+	treeItem2->setLine(-1);
+	treeItem3 = new TreeItem(m_treeWidget, QStringList(tr("Instruments")));
+	treeItem3->setLine(-1);
+	treeItem4 = new TreeItem(m_treeWidget, QStringList(tr("F-tables")));
+	treeItem4->setLine(-1);
+	treeItem5 = new TreeItem(m_treeWidget, QStringList(tr("Score")));
+	treeItem5->setLine(-1);
+
+    m_treeWidget->expandItem(treeItem1);    // opcodes
+    m_treeWidget->collapseItem(treeItem2);  // macros
+    m_treeWidget->expandItem(treeItem3);    // instruments
+    m_treeWidget->collapseItem(treeItem4);  // ftables
+    m_treeWidget->collapseItem(treeItem5);    // score
+    m_csoundTree = true;
 }
 
 void Inspector::parsePythonText(const QString &text)
 {
 	//  qDebug() << "Inspector:parseText";
 	inspectorMutex.lock();
+	m_treeWidget->blockSignals(true);
 	m_treeWidget->clear();
+	m_treeWidget->blockSignals(false);
+	m_csoundTree = false;
+	m_outline.clear();
 	treeItem1 = 0;
 	treeItem1 = new TreeItem(m_treeWidget, QStringList(tr("Imports")));
 	treeItem1->setLine(-1);
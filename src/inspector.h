@@ -27,6 +27,7 @@
 #include <QTreeWidget>
 #include <QMutex>
 #include "types.h"
+#include "documentmodel.h"
 
 class TreeItem : public QTreeWidgetItem
 {
@@ -47,6 +48,17 @@ private:
 };
 
 
+// What one tree item should show, built from an outline and compared with
+// the items already in the tree
+struct InspectorNode
+{
+    InspectorNode() : line(-1) {}
+    InspectorNode(const QString &text, int line) : text(text), line(line) {}
+    QString text;
+    int line;
+    QVector<InspectorNode> children;
+};
+
 class Inspector : public QDockWidget
 {
 	Q_OBJECT
@@ -54,6 +66,7 @@ public:
 	Inspector(QWidget *parent);
 	~Inspector();
 	void parseText(const QString &text);
+    void setOutline(QSharedPointer<const DocumentOutline> outline);
 	void parsePythonText(const QString &text);
     QStringList getParsedUDOs() { return m_opcodes; }
     QVector<Opcode*> getUdosVector() { return udosVector; }
@@ -65,6 +78,9 @@ protected:
 	virtual void closeEvent(QCloseEvent * event);
 
 private:
+    void createCsoundTree();
+    void syncChildren(QTreeWidgetItem *parent, const QVector<InspectorNode> &nodes);
+
 	QTreeWidget *m_treeWidget;
 	TreeItem *treeItem1;
 	TreeItem *treeItem2;
@@ -76,15 +92,11 @@ private:
     // QVector<QString> m_opcodes;
     QStringList m_opcodes;
     QRegExp opcodeRegexp;
-    QRegularExpression rxOpcode;
     bool inspectLabels;
     QHash<QString, Opcode>udosMap;
     QVector<Opcode *>udosVector;
-
-    QRegularExpression xinRx;
-    QRegularExpression xoutRx;
-    QRegularExpression ftableRx1;
-    QRegularExpression ftableRx2;
+    QSharedPointer<const DocumentOutline> m_outline;  // Shown in the tree
+    bool m_csoundTree;  // False while showing a Python outline
 
 
 private slots:
@@ -2,6 +2,7 @@
 #include "ui_livecodeeditor.h"
 
 #include "documentview.h"
+#include "liveevaluator.h"
 
 LiveCodeEditor::LiveCodeEditor(QWidget *parent, OpEntryParser *m_opcodeTree) :
     QWidget(parent),
@@ -17,6 +18,7 @@ LiveCodeEditor::LiveCodeEditor(QWidget *parent, OpEntryParser *m_opcodeTree) :
 	connect(ui->modeComboBox, SIGNAL(currentIndexChanged(int)),
 			this, SLOT(modeChanged(int)));
 	connect(m_docView, SIGNAL(evaluate(QString)), this, SLOT(evaluateSlot(QString)));
+	connect(ui->tempoSpinBox, SIGNAL(valueChanged(double)), this, SIGNAL(tempoChanged(double)));
 }
 
 LiveCodeEditor::~LiveCodeEditor()
@@ -29,6 +31,30 @@ DocumentView *LiveCodeEditor::getDocumentView()
 	return m_docView;
 }
 
+double LiveCodeEditor::quantum()
+{
+	switch (ui->quantizeComboBox->currentIndex()) {
+	case 1:
+		return 1.0;
+	case 2:
+		return QCS_QUANTUM_BAR;
+	default:
+		return 0.0;
+	}
+}
+
+double LiveCodeEditor::tempo()
+{
+	return ui->tempoSpinBox->value();
+}
+
+void LiveCodeEditor::setTempo(double tempo)
+{
+	ui->tempoSpinBox->blockSignals(true);
+	ui->tempoSpinBox->setValue(tempo);
+	ui->tempoSpinBox->blockSignals(false);
+}
+
 void LiveCodeEditor::setCsdMode(bool csdMode)
 {
 	if (csdMode) {
@@ -42,10 +68,12 @@ void LiveCodeEditor::modeChanged(int index)
 {
 	if (index == 0) {
 		m_docView->setFileType(EDIT_CSOUND_MODE);
+		ui->quantizeComboBox->setEnabled(true);
 //		m_docView->setBackgroundColor(QColor(240, 230, 230));
 		emit enableCsdMode(true);
 	} else {
 		m_docView->setFileType(EDIT_PYTHON_MODE);
+		ui->quantizeComboBox->setEnabled(false);
 //		m_docView->setBackgroundColor(QColor(230, 240, 230));
 		emit enableCsdMode(false);
 	}
@@ -18,6 +18,9 @@ public:
 	~LiveCodeEditor();
 
 	DocumentView *getDocumentView();
+	double quantum();  // Transport beats evaluated code is aligned to, 0 for none
+	double tempo();
+	void setTempo(double tempo);  // Without emitting tempoChanged()
 
 public slots:
 	void setCsdMode(bool csdMode);
@@ -31,6 +34,7 @@ private:
 signals:
 	void evaluate(QString code);
 	void enableCsdMode(bool enable);
+	void tempoChanged(double tempo);  // Transport tempo set from the editor
 };
 
 #endif // LIVECODEEDITOR_H
@@ -0,0 +1,147 @@
+#include "liveevaluator.h"
+#include "csoundengine.h"
+#include "transportclock.h"
+
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QThread>
+#include <QtConcurrent>
+
+LiveEvaluator::LiveEvaluator(CsoundEngine *engine) :
+	m_engine(engine),
+	m_csound(nullptr),
+	m_clock(nullptr),
+	m_running(false),
+	m_stop(false)
+{
+}
+
+LiveEvaluator::~LiveEvaluator()
+{
+	stop();
+}
+
+void LiveEvaluator::start(CSOUND *csound, const TransportClock *clock)
+{
+	stop();
+	QMutexLocker locker(&m_mutex);
+	m_csound = csound;
+	m_clock = clock;
+	m_stop = false;
+}
+
+void LiveEvaluator::stop()
+{
+	m_mutex.lock();
+	m_stop = true;
+	m_queue.clear();
+	m_mutex.unlock();
+	m_future.waitForFinished();
+	QMutexLocker locker(&m_mutex);
+	m_csound = nullptr;
+	m_clock = nullptr;
+}
+
+bool LiveEvaluator::evaluate(const QString &code, double quantum, const QString &name)
+{
+	QMutexLocker locker(&m_mutex);
+	if (m_csound == nullptr || m_stop) {
+		return false;
+	}
+	Evaluation evaluation;
+	evaluation.code = code.toLatin1();
+	evaluation.name = name;
+	evaluation.quantum = quantum;
+	evaluation.queued = m_clock->position();
+	m_queue.append(evaluation);
+	if (!m_running) {
+		m_running = true;
+		m_future = QtConcurrent::run(this, &LiveEvaluator::run);
+	}
+	return true;
+}
+
+void LiveEvaluator::run()
+{
+	forever {
+		m_mutex.lock();
+		if (m_queue.isEmpty() || m_stop) {
+			m_running = false;
+			m_mutex.unlock();
+			return;
+		}
+		Evaluation evaluation = m_queue.takeFirst();
+		m_mutex.unlock();
+		apply(evaluation);
+	}
+}
+
+void LiveEvaluator::apply(const Evaluation &evaluation)
+{
+	QElapsedTimer timer;
+	timer.start();
+	TREE *tree = csoundParseOrc(m_csound, evaluation.code.constData());
+	if (tree == nullptr) {
+		if (evaluation.name.isEmpty()) {
+			m_engine->queueMessage(QObject::tr("Csound code has errors. Code not evaluated.\n"));
+		}
+		else {
+			m_engine->queueMessage(QObject::tr("%1 has errors. Not replaced.\n").arg(evaluation.name));
+			emit m_engine->evaluated(evaluation.name, false);
+		}
+		return;
+	}
+	qint64 elapsed = timer.nsecsElapsed();
+	const double quantum = evaluation.quantum == QCS_QUANTUM_BAR ? m_clock->beatsPerBar()
+																 : evaluation.quantum;
+	qint64 boundary = quantum > 0 ? m_clock->nextBeat(evaluation.queued, quantum) : -1;
+	if (boundary >= 0) {
+		const qint64 ksmps = csoundGetKsmps(m_csound);
+		if (boundary - ksmps < m_clock->position()) {
+			// Compiling took too long for this one
+			boundary = m_clock->nextBeat(m_clock->position() + ksmps, quantum);
+		}
+		// The merge happens at the start of the pass after the one running
+		// when it is queued
+		if (boundary >= 0 && !waitFor(boundary - ksmps)) {
+			csoundDeleteTree(m_csound, tree);
+			if (!evaluation.name.isEmpty()) {
+				emit m_engine->evaluated(evaluation.name, false);
+			}
+			return;
+		}
+	}
+	timer.restart();
+	int result = csoundCompileTreeAsync(m_csound, tree);
+	elapsed += timer.nsecsElapsed();  // Parsing and compiling, not waiting
+	csoundDeleteTree(m_csound, tree);
+	if (evaluation.name.isEmpty()) {
+		if (result != CSOUND_SUCCESS) {
+			m_engine->queueMessage(QObject::tr("Csound code has errors. Code not evaluated.\n"));
+		}
+		else {
+			m_engine->queueMessage(QObject::tr("Csound code evaluated.\n"));
+		}
+	}
+	else if (result != CSOUND_SUCCESS) {
+		m_engine->queueMessage(QObject::tr("%1 failed to compile. Not replaced.\n").arg(evaluation.name));
+		emit m_engine->evaluated(evaluation.name, false);
+	}
+	else {
+		m_engine->queueMessage(QObject::tr("%1 replaced, compiled in %2 ms.\n")
+							   .arg(evaluation.name).arg(elapsed / 1e6, 0, 'f', 2));
+		emit m_engine->evaluated(evaluation.name, true);
+	}
+}
+
+bool LiveEvaluator::waitFor(qint64 sample)
+{
+	while (!m_stop) {
+		const qint64 left = sample - m_clock->position();
+		if (left <= 0) {
+			return true;
+		}
+		QThread::msleep(qBound(1, int(left * 1000 / m_clock->sampleRate()) / 2, 20));
+	}
+	return false;
+}
@@ -0,0 +1,62 @@
+#ifndef LIVEEVALUATOR_H
+#define LIVEEVALUATOR_H
+
+#include <QByteArray>
+#include <QFuture>
+#include <QList>
+#include <QMutex>
+#include <QString>
+
+#include <atomic>
+
+#include "types.h"
+
+class CsoundEngine;
+class TransportClock;
+
+// Quantum of code applied on the next bar of the transport
+#define QCS_QUANTUM_BAR -1
+
+// Orchestra code evaluated on a running engine. The code is parsed and
+// compiled on a pool thread, away from the performance thread, and the
+// compiled instruments are handed to Csound to be merged at the start of
+// a control pass (csoundCompileTreeAsync). With a quantum, that pass is
+// the one that reaches the next multiple of quantum beats of the
+// transport clock, so new instruments come in on the beat or bar and a
+// slow compile delays them to the following boundary instead of causing
+// a dropout. Evaluations are applied in the order they were queued.
+class LiveEvaluator
+{
+public:
+	LiveEvaluator(CsoundEngine *engine);
+	~LiveEvaluator();
+	void start(CSOUND *csound, const TransportClock *clock);  // After performance starts
+	void stop();  // Drops pending evaluations and waits for the pool thread
+	// GUI thread. quantum in transport beats, or QCS_QUANTUM_BAR. 0, or a
+	// stopped transport, applies it as soon as it is compiled. With a name,
+	// what it replaced and how long compiling took are reported under it.
+	// False if not started
+	bool evaluate(const QString &code, double quantum, const QString &name = QString());
+
+private:
+	struct Evaluation {
+		QByteArray code;
+		QString name;
+		double quantum;
+		qint64 queued;  // Transport sample when evaluated
+	};
+	void run();
+	void apply(const Evaluation &evaluation);
+	bool waitFor(qint64 sample);  // False if stopped
+
+	CsoundEngine *m_engine;  // For messages
+	CSOUND *m_csound;
+	const TransportClock *m_clock;
+	QMutex m_mutex;
+	QList<Evaluation> m_queue;  // protected by m_mutex
+	bool m_running;  // Pool thread taking from the queue, protected by m_mutex
+	std::atomic<bool> m_stop;
+	QFuture<void> m_future;
+};
+
+#endif // LIVEEVALUATOR_H
@@ -45,7 +45,7 @@ LiveEventFrame::LiveEventFrame(QString csdName, QWidget *parent, Qt::WindowFlags
 	//  setWindowFlags(windowFlags() | Qt::WindowStaysOnTopHint);
 	m_sheet = new EventSheet(this);
 	//  m_sheet->show();
-	m_sheet->setTempo(60.0);
+	m_sheet->setTempo(0.0);  // Follow the transport
 	m_sheet->setLoopLength(8.0);
 	m_sheet->hide();
 	connect(m_sheet,SIGNAL(modified()), this, SLOT(setModified()));
@@ -245,11 +245,6 @@ QString LiveEventFrame::getPlainText()
 	return panel;
 }
 
-void LiveEventFrame::getEvents(unsigned long /*ksmps*/, QStringList */*eventText*/)
-{
-	// TODO: implement
-}
-
 bool LiveEventFrame::isModified()
 {
 	return m_modified;
@@ -53,7 +53,6 @@ public:
 	QString getPlainText();
 	bool getVisibleEnabled() { return m_visibleEnabled; }
 
-	void getEvents(unsigned long ksmps, QStringList *eventText);
 	bool isModified();
 	//    void forceDestroy();
 
@@ -23,7 +23,12 @@
 #include <QApplication>
 #include <QSplashScreen>
 #include "qutecsound.h"
+#include "highlighter.h"
+#include "opentryparser.h"
+#include "startuptrace.h"
 #include <QLocalSocket>
+#include <QDirIterator>
+#include <QElapsedTimer>
 
 #ifdef WIN32
 #include <tchar.h>
@@ -52,9 +57,66 @@ BOOL IsWow64() {
 }
 #endif
 
+// Times a full rehighlight of each file. Directories are searched for the
+// largest csd files they contain.
+static int benchmarkHighlighter(const QStringList &paths)
+{
+    const int maxFilesPerDir = 5;
+    const int runs = 5;
+    QTextStream out(stdout);
+    QStringList fileNames;
+    foreach (QString path, paths) {
+        if (!QFileInfo(path).isDir()) {
+            fileNames.append(path);
+            continue;
+        }
+        QList<QFileInfo> found;
+        QDirIterator it(path, QStringList("*.csd"), QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            it.next();
+            found.append(it.fileInfo());
+        }
+        std::sort(found.begin(), found.end(), [](const QFileInfo &a, const QFileInfo &b) {
+            return a.size() > b.size();
+        });
+        for (int i = 0; i < found.size() && i < maxFilesPerDir; i++) {
+            fileNames.append(found[i].filePath());
+        }
+    }
+    OpEntryParser opcodeTree(":/opcodes.xml");
+    QStringList opcodeNames = opcodeTree.opcodeNameList();
+    foreach (QString fileName, fileNames) {
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            out << "Could not open " << fileName << endl;
+            continue;
+        }
+        QTextDocument document;
+        document.setPlainText(QString::fromUtf8(file.readAll()));
+        Highlighter highlighter;
+        highlighter.setTheme("light");
+        highlighter.setOpcodeNameList(opcodeNames);
+        highlighter.setDocument(&document);
+        QElapsedTimer timer;
+        qint64 best = -1;
+        for (int run = 0; run < runs; run++) {
+            timer.start();
+            highlighter.rehighlight();
+            qint64 elapsed = timer.nsecsElapsed();
+            if (best < 0 || elapsed < best) {
+                best = elapsed;
+            }
+        }
+        out << QString("%1: %2 lines, %3 ms")
+               .arg(fileName).arg(document.blockCount()).arg(best / 1.0e6, 0, 'f', 2) << endl;
+    }
+    return 0;
+}
+
 int main(int argc, char *argv[])
 {
     int result = 0;
+    StartupTrace::start();
 
     // Set a global template for ALL qDebug messages.
 	qSetMessagePattern("[%{if-debug}D%{endif}%{if-info}I%{endif}%{if-warning}W%{endif}%{if-critical}C%{endif}%{if-fatal}F%{endif}][%{file}:%{line} %{function}] %{message}");
@@ -85,6 +147,11 @@ int main(int argc, char *argv[])
             out << "\n\n";
             out << "Options:" << endl;
             out << "   --play        Autoplay the last file passed via command line" << endl;
+            out << "   --startup-trace" << endl;
+            out << "                 Print how long each phase of startup takes" << endl;
+            out << "   --bench-highlight <files or dirs>" << endl;
+            out << "                 Time syntax highlighting of the given files, or of the" << endl;
+            out << "                 largest csd files in the given directories, and quit" << endl;
             out << "   --help        This message" << endl;
             out << endl;
             exit(0);
@@ -92,8 +159,16 @@ int main(int argc, char *argv[])
         if(arg == "--play") {
             autoplay = true;
         }
+        if(arg == "--startup-trace") {
+            StartupTrace::setEnabled(true);
+        }
+        if(arg == "--bench-highlight") {
+            return benchmarkHighlighter(args.mid(i + 1));
+        }
     }
 
+    StartupTrace::mark("application");
+
     foreach (QString arg, args) {
         if (!arg.startsWith("-")) {// avoid OS X arguments
             fileNames.append(arg);
@@ -154,6 +229,8 @@ int main(int argc, char *argv[])
     splash->finish(csoundQt);
     delete splash;
     csoundQt->show();
+    // Posted paint events are handled before timers
+    QTimer::singleShot(0, []() { StartupTrace::mark("first paint"); });
     if(autoplay && !fileNames.isEmpty())
         csoundQt->play();
 
@@ -21,25 +21,42 @@
 */
 
 #include "opentryparser.h"
+#include "documentmodel.h"
 #include "types.h"
 #include "algorithm"
 
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
 #include <QFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+// Bump when the layout of the opcode cache changes
+#define OPCODE_CACHE_MAGIC 0x51434f50  // "QCOP"
+#define OPCODE_CACHE_VERSION 1
 
 void OpEntryParser::parseOpcodesXml(QString opcodeFile) {
-    QDomDocument m_doc("opcodes");
     QFile file(opcodeFile);
     if (!file.open(QIODevice::ReadOnly)) {
         qDebug() << "OpEntryParser::OpEntryParser could not find opcode file:" << opcodeFile;
         return;
     }
-    if (!m_doc.setContent(&file)) {
+    QByteArray xml = file.readAll();
+    file.close();
+    excludedOpcodes << "|" << "||" << "^" << "+" << "*" << "-" << "/";
+    // The xml only needs parsing when it is not the one cached last time
+    QByteArray hash = QCryptographicHash::hash(xml, QCryptographicHash::Sha1);
+    QString cachePath = opcodeCachePath(opcodeFile);
+    if (loadOpcodeCache(cachePath, hash)) {
+        return;
+    }
+    int firstCategory = opcodeCategoryList.size();
+    QDomDocument m_doc("opcodes");
+    if (!m_doc.setContent(xml)) {
         qDebug() << "OpEntryParser::OpEntryParser set content";
-        file.close();
         return;
     }
-    file.close();
-    excludedOpcodes << "|" << "||" << "^" << "+" << "*" << "-" << "/";
     QDomElement docElem = m_doc.documentElement();
     QList<Opcode> opcodesInCategoryList;
 
@@ -96,12 +113,107 @@ void OpEntryParser::parseOpcodesXml(QString opcodeFile) {
         opcodeCategoryList.append(newCategory);
         cat = cat.nextSiblingElement("category");
     }
+    saveOpcodeCache(cachePath, hash, firstCategory);
+}
+
+QString OpEntryParser::opcodeCachePath(QString opcodeFile)
+{
+    QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if (dir.isEmpty()) {
+        return QString();
+    }
+    // One cache per xml file, named after its path
+    QByteArray key = QCryptographicHash::hash(opcodeFile.toUtf8(), QCryptographicHash::Sha1);
+    return dir + "/opcodes-" + QString::fromLatin1(key.toHex().left(16)) + ".cache";
+}
+
+bool OpEntryParser::loadOpcodeCache(QString cachePath, const QByteArray &hash)
+{
+    if (cachePath.isEmpty()) {
+        return false;
+    }
+    QFile file(cachePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    // Read straight from the mapped file, nothing is copied but the strings
+    uchar *mapped = file.map(0, file.size());
+    if (mapped == nullptr) {
+        return false;
+    }
+    QByteArray data = QByteArray::fromRawData(reinterpret_cast<const char *>(mapped), int(file.size()));
+    QDataStream in(data);
+    in.setVersion(QDataStream::Qt_5_0);
+    quint32 magic, version;
+    QByteArray cachedHash;
+    in >> magic >> version >> cachedHash;
+    if (magic != OPCODE_CACHE_MAGIC || version != OPCODE_CACHE_VERSION || cachedHash != hash) {
+        return false;
+    }
+    // Read everything before adding anything, so a damaged file adds nothing
+    QStringList categories;
+    QVector<QList<Opcode> > opcodes;
+    quint32 categoryCount;
+    in >> categoryCount;
+    for (quint32 i = 0; i < categoryCount && in.status() == QDataStream::Ok; i++) {
+        QString catName;
+        quint32 opcodeCount;
+        in >> catName >> opcodeCount;
+        QList<Opcode> opcodesInCategoryList;
+        for (quint32 j = 0; j < opcodeCount && in.status() == QDataStream::Ok; j++) {
+            Opcode op;
+            in >> op.opcodeName >> op.outArgs >> op.inArgs >> op.desc;
+            op.isFlag = 0;
+            opcodesInCategoryList << op;
+        }
+        categories << catName;
+        opcodes << opcodesInCategoryList;
+    }
+    if (in.status() != QDataStream::Ok) {
+        qDebug() << "OpEntryParser: ignoring damaged opcode cache" << cachePath;
+        return false;
+    }
+    for (int i = 0; i < categories.size(); i++) {
+        foreach (const Opcode &op, opcodes[i]) {
+            addOpcode(op);
+        }
+        opcodeListCategory.append(opcodes[i]);
+        categoryList.append(categories[i]);
+        opcodeCategoryList.append(QPair<QString, QList<Opcode> >(categories[i], opcodes[i]));
+    }
+    return true;
+}
+
+void OpEntryParser::saveOpcodeCache(QString cachePath, const QByteArray &hash, int firstCategory)
+{
+    if (cachePath.isEmpty() || !QDir().mkpath(QFileInfo(cachePath).absolutePath())) {
+        return;
+    }
+    QSaveFile file(cachePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return;
+    }
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << quint32(OPCODE_CACHE_MAGIC) << quint32(OPCODE_CACHE_VERSION) << hash;
+    out << quint32(opcodeCategoryList.size() - firstCategory);
+    for (int i = firstCategory; i < opcodeCategoryList.size(); i++) {
+        const QList<Opcode> &opcodes = opcodeCategoryList[i].second;
+        out << opcodeCategoryList[i].first << quint32(opcodes.size());
+        foreach (const Opcode &op, opcodes) {
+            out << op.opcodeName << op.outArgs << op.inArgs << op.desc;
+        }
+    }
+    if (!file.commit()) {
+        qDebug() << "OpEntryParser: could not write opcode cache" << cachePath;
+    }
 }
 
 OpEntryParser::OpEntryParser(QString opcodeFile)
 	: m_opcodeFile(opcodeFile)
 {
     m_udosMap = nullptr;
+    m_opcodeIndexDirty = true;
     parseOpcodesXml(opcodeFile);
 	addExtraOpcodes();
 }
@@ -124,6 +236,7 @@ void OpEntryParser::sortOpcodes()
 {
     std::sort(opcodeList.begin(), opcodeList.end(),
               [](const Opcode &a, const Opcode &b) -> bool { return a.opcodeName < b.opcodeName; });
+    m_opcodeIndexDirty = true;
 }
 
 QStringList OpEntryParser::opcodeNameList()
@@ -139,6 +252,7 @@ void OpEntryParser::addOpcode(Opcode opcode)
 {
     opcodeList.append(opcode);
     opcodeMap.insert(opcode.opcodeName, opcode);
+    m_opcodeIndexDirty = true;
 }
 
 void OpEntryParser::addFlag(QString flag, QString desc) {
@@ -146,6 +260,23 @@ void OpEntryParser::addFlag(QString flag, QString desc) {
     opcode.desc = desc;
     opcode.isFlag = 1;
     opcodeList.append(opcode);
+    flagNames.insert(flag);
+    m_opcodeIndexDirty = true;
+}
+
+const CompletionIndex &OpEntryParser::opcodeIndex()
+{
+    // Built on first use, after risset's opcodes have been added
+    if (m_opcodeIndexDirty) {
+        m_opcodeIndex.clear();
+        m_opcodeIndex.reserve(opcodeList.size());
+        for (int i = 0; i < opcodeList.size(); i++) {
+            m_opcodeIndex.add(opcodeList[i].opcodeName, i);
+        }
+        m_opcodeIndex.build();
+        m_opcodeIndexDirty = false;
+    }
+    return m_opcodeIndex;
 }
 
 
@@ -190,19 +321,25 @@ QString OpEntryParser::getSyntax(QString opcodeName)
     return "";
 }
 
-QVector<Opcode> OpEntryParser::getPossibleSyntax(QString word)
+QVector<Opcode> OpEntryParser::getPossibleSyntax(QString word, const DocumentOutline *outline,
+                                                 const CompletionIndex *usage)
 {
     QVector<Opcode> out;
-	for (int i = 0; i < opcodeList.size(); i++) {
-		if (opcodeList[i].opcodeName.startsWith(word)) {
-			out << opcodeList[i];
-		}
-	}
-    auto it = m_udosMap->constBegin();
-    while(it != m_udosMap->constEnd()) {
-        if(it->opcodeName.startsWith(word))
-            out << it.value();
-        it++;
+    foreach (const CompletionIndex::Match &match, opcodeIndex().complete(word, usage)) {
+        out << opcodeList[match.id];
+    }
+    if (outline != nullptr) {
+        foreach (const CompletionIndex::Match &match, outline->udoIndex.complete(word, usage)) {
+            const DocumentOutline::Udo &udo = outline->udos[match.id];
+            out << Opcode(udo.opcodeName, udo.outArgs, udo.inArgs);
+        }
+    } else if (m_udosMap != nullptr) {
+        auto it = m_udosMap->constBegin();
+        while(it != m_udosMap->constEnd()) {
+            if(it->opcodeName.startsWith(word))
+                out << it.value();
+            it++;
+        }
     }
     return out;
 }
@@ -236,11 +373,9 @@ QList<Opcode> OpEntryParser::getOpcodeList(int index)
 
 bool OpEntryParser::isOpcode(QString opcodeName)
 {
-    for (int i = 0; i< opcodeList.size();i++)  {
-		if (opcodeName == opcodeList[i].opcodeName) {
-            return true;
-        }
-	}
+    if (opcodeMap.contains(opcodeName) || flagNames.contains(opcodeName)) {
+        return true;
+    }
     if(this->m_udosMap->contains(opcodeName))
         return true;
     return false;
@@ -28,6 +28,9 @@
 #include <QtXml>
 #include "node.h"
 #include "types.h" // For Opcode class
+#include "completionindex.h"
+
+struct DocumentOutline;
 
 class OpEntryParser
 {
@@ -41,7 +44,10 @@ public:
 	void addExtraOpcodes();
 	QStringList opcodeNameList();
 	QString getSyntax(QString opcodeName);
-	QVector<Opcode> getPossibleSyntax(QString word);
+	// Opcodes and UDOs matching word, best first. With an outline its UDOs are
+	// included, and names that have a weight in usage are ranked higher
+	QVector<Opcode> getPossibleSyntax(QString word, const DocumentOutline *outline = nullptr,
+	                                  const CompletionIndex *usage = nullptr);
 	QList< QPair<QString, QList<Opcode> > > getOpcodesByCategory();
 	int getCategoryCount();
 	QString getCategory(int index);
@@ -57,6 +63,7 @@ private:
 	QString m_opcodeFile;
 	QList<Opcode> opcodeList;
     QHash<QString, Opcode> opcodeMap;
+    QSet<QString> flagNames;  // Flags are in opcodeList but not in opcodeMap
 	QList< QPair<QString, QList<Opcode> > > opcodeCategoryList;
 	QVector<QList<Opcode> > opcodeListCategory;
 	QStringList categoryList;
@@ -64,6 +71,15 @@ private:
 
 	void addOpcode(Opcode opcode);
     void addFlag(QString flag, QString description);
+    // Opcodes parsed from an xml file are cached in binary form, keyed by
+    // the hash of the xml, so later runs skip the DOM parse
+    static QString opcodeCachePath(QString opcodeFile);
+    bool loadOpcodeCache(QString cachePath, const QByteArray &hash);
+    void saveOpcodeCache(QString cachePath, const QByteArray &hash, int firstCategory);
+    const CompletionIndex &opcodeIndex();
+
+    CompletionIndex m_opcodeIndex;  // Over opcodeList, ids are indexes in it
+    bool m_opcodeIndexDirty;
 
     QHash<QString, Opcode>*m_udosMap;
 
@@ -0,0 +1,179 @@
+#include "outputlevels.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+OutputLevels::OutputLevels() :
+	m_numChnls(0),
+	m_enabled(false),
+	m_truePeakEnabled(false),
+	m_peakRelease(1.0),
+	m_rmsCoeff(1.0),
+	m_historyPos(0)
+{
+	for (int kind = 0; kind < 3; kind++) {
+		for (int i = 0; i < QCS_MAX_LEVEL_CHANNELS; i++) {
+			m_slots[kind][i].store(0.0f);
+		}
+	}
+	// Windowed sinc for the three intermediate phases of a 4x oversampler.
+	// Phase 0 is the sample itself.
+	const int half = QCS_TRUEPEAK_TAPS / 2;
+	for (int phase = 1; phase < 4; phase++) {
+		for (int k = 0; k < QCS_TRUEPEAK_TAPS; k++) {
+			double t = k - (half - 1) - phase / 4.0;
+			double sinc = M_PI * t == 0 ? 1.0 : sin(M_PI * t) / (M_PI * t);
+			double window = 0.5 + 0.5 * cos(M_PI * t / half);
+			m_truePeakCoeffs[phase - 1][k] = (float) (sinc * window);
+		}
+	}
+	reset(0, 44100, 64);
+}
+
+void OutputLevels::reset(int numChnls, double sr, int ksmps)
+{
+	m_numChnls = qMin(numChnls, QCS_MAX_LEVEL_CHANNELS);
+	m_frameSize = numChnls;
+	m_enabled = false;
+	m_truePeakEnabled = false;
+	double passesPerSecond = ksmps > 0 && sr > 0 ? sr / ksmps : 1.0;
+	// Peaks fall 20 dB in 1.7 seconds (IEC PPM type I), RMS integrates over 300 ms
+	m_peakRelease = pow(10.0, -20.0 / 20.0 / (1.7 * passesPerSecond));
+	m_rmsCoeff = 1.0 - exp(-1.0 / (0.3 * passesPerSecond));
+	memset(m_peakState, 0, sizeof(m_peakState));
+	memset(m_meanSquare, 0, sizeof(m_meanSquare));
+	memset(m_truePeakState, 0, sizeof(m_truePeakState));
+	memset(m_history, 0, sizeof(m_history));
+	m_historyPos = 0;
+	for (int kind = 0; kind < 3; kind++) {
+		for (int i = 0; i < QCS_MAX_LEVEL_CHANNELS; i++) {
+			m_slots[kind][i].store(0.0f, std::memory_order_relaxed);
+		}
+	}
+}
+
+void OutputLevels::setEnabled(bool levels, bool truePeak)
+{
+	m_enabled = levels || truePeak;
+	m_truePeakEnabled = truePeak;
+}
+
+void OutputLevels::process(const MYFLT *spout, int ksmps, MYFLT scale)
+{
+	if (!m_enabled || spout == nullptr || ksmps <= 0) {
+		return;
+	}
+	const int numChnls = m_numChnls;
+	const int frameSize = m_frameSize;
+	double blockPeak[QCS_MAX_LEVEL_CHANNELS];
+	double blockSum[QCS_MAX_LEVEL_CHANNELS];
+	for (int chan = 0; chan < numChnls; chan++) {
+		blockPeak[chan] = 0.0;
+		blockSum[chan] = 0.0;
+	}
+	// Spout is interleaved, so the inner loop runs over contiguous samples
+	// and independent accumulators, which the compiler can vectorize.
+	for (int i = 0; i < ksmps; i++) {
+		const MYFLT *frame = spout + i * frameSize;
+		for (int chan = 0; chan < numChnls; chan++) {
+			double x = frame[chan];
+			double a = fabs(x);
+			blockPeak[chan] = a > blockPeak[chan] ? a : blockPeak[chan];
+			blockSum[chan] += x * x;
+		}
+	}
+	for (int chan = 0; chan < numChnls; chan++) {
+		double peak = m_peakState[chan] * m_peakRelease;
+		m_peakState[chan] = blockPeak[chan] > peak ? blockPeak[chan] : peak;
+		m_meanSquare[chan] += m_rmsCoeff * (blockSum[chan] / ksmps - m_meanSquare[chan]);
+		m_slots[Peak][chan].store((float) (m_peakState[chan] * scale), std::memory_order_relaxed);
+		m_slots[Rms][chan].store((float) (sqrt(m_meanSquare[chan]) * scale), std::memory_order_relaxed);
+	}
+	if (!m_truePeakEnabled) {
+		return;
+	}
+	int pos = m_historyPos;
+	for (int i = 0; i < ksmps; i++) {
+		const MYFLT *frame = spout + i * frameSize;
+		for (int chan = 0; chan < numChnls; chan++) {
+			float *history = m_history[chan];
+			float x = (float) frame[chan];
+			history[pos] = x;
+			history[pos + QCS_TRUEPEAK_TAPS] = x;
+			const float *window = history + pos + 1;  // Oldest to newest
+			double peak = m_truePeakState[chan];
+			for (int phase = 0; phase < 3; phase++) {
+				const float *coeffs = m_truePeakCoeffs[phase];
+				float sum = 0.0f;
+				for (int k = 0; k < QCS_TRUEPEAK_TAPS; k++) {
+					sum += window[k] * coeffs[k];
+				}
+				double a = fabs(sum);
+				peak = a > peak ? a : peak;
+			}
+			double a = fabs(x);
+			m_truePeakState[chan] = a > peak ? a : peak;
+		}
+		pos = (pos + 1) % QCS_TRUEPEAK_TAPS;
+	}
+	m_historyPos = pos;
+	for (int chan = 0; chan < numChnls; chan++) {
+		m_slots[TruePeak][chan].store((float) (m_truePeakState[chan] * scale), std::memory_order_relaxed);
+		m_truePeakState[chan] *= m_peakRelease;
+	}
+}
+
+double OutputLevels::value(Kind kind, int channel) const
+{
+	if (channel < 0 || channel >= m_numChnls) {
+		return 0.0;
+	}
+	return m_slots[kind][channel].load(std::memory_order_relaxed);
+}
+
+// Returns the part of name after the kind prefix, or nullptr if name is not
+// one of the reserved output level names
+static const char *parseKindPrefix(const char *name, OutputLevels::Kind *kind)
+{
+	if (strncmp(name, "_Out", 4) != 0) {
+		return nullptr;
+	}
+	const char *suffix = name + 4;
+	if (!strncmp(suffix, "TruePeak", 8)) {
+		*kind = OutputLevels::TruePeak;
+		return suffix + 8;
+	} else if (!strncmp(suffix, "Peak", 4)) {
+		*kind = OutputLevels::Peak;
+		return suffix + 4;
+	} else if (!strncmp(suffix, "Rms", 3)) {
+		*kind = OutputLevels::Rms;
+		return suffix + 3;
+	}
+	return nullptr;
+}
+
+bool OutputLevels::parseChannelName(const char *name, Kind *kind, int *channel)
+{
+	const char *suffix = parseKindPrefix(name, kind);
+	if (suffix == nullptr || *suffix < '1' || *suffix > '9') {
+		return false;
+	}
+	char *end;
+	long number = strtol(suffix, &end, 10);
+	if (*end != '\0' || number > QCS_MAX_LEVEL_CHANNELS) {
+		return false;
+	}
+	*channel = (int) number - 1;
+	return true;
+}
+
+bool OutputLevels::parseKindName(const char *name, Kind *kind)
+{
+	const char *suffix = parseKindPrefix(name, kind);
+	return suffix != nullptr && *suffix == '\0';
+}
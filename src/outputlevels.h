@@ -0,0 +1,56 @@
+#ifndef OUTPUTLEVELS_H
+#define OUTPUTLEVELS_H
+
+#include <atomic>
+
+#include "types.h"
+
+#define QCS_MAX_LEVEL_CHANNELS 256
+// Taps per phase of the 4x oversampling filter used for true peak
+#define QCS_TRUEPEAK_TAPS 12
+
+// Peak, RMS and true peak of every output channel, computed by the engine
+// after each control pass from csoundGetSpout. The GUI and the orchestra read
+// them through the reserved channels _OutPeakN, _OutRmsN and _OutTruePeakN
+// (N starting from 1), so meters need no rms/peak/outvalue code.
+// Values are linear and relative to 0dbfs.
+class OutputLevels
+{
+public:
+	enum Kind {
+		Peak = 0,
+		Rms,
+		TruePeak
+	};
+
+	OutputLevels();
+	void reset(int numChnls, double sr, int ksmps);  // Call before performance starts
+	void setEnabled(bool levels, bool truePeak);
+	bool isEnabled() const { return m_enabled; }
+	void process(const MYFLT *spout, int ksmps, MYFLT scale);  // Called from csThread
+	double value(Kind kind, int channel) const;  // channel starts from 0
+	static bool parseChannelName(const char *name, Kind *kind, int *channel);
+	// Name without channel number (_OutPeak, _OutRms, _OutTruePeak), used by meter banks
+	static bool parseKindName(const char *name, Kind *kind);
+
+private:
+	int m_numChnls;  // Metered, at most QCS_MAX_LEVEL_CHANNELS
+	int m_frameSize;  // nchnls, the stride through spout
+	std::atomic<bool> m_enabled;
+	std::atomic<bool> m_truePeakEnabled;
+	double m_peakRelease;  // Peak fall per control pass
+	double m_rmsCoeff;  // Averaging coefficient per control pass
+	float m_truePeakCoeffs[3][QCS_TRUEPEAK_TAPS];
+
+	// Only touched by the performance thread
+	double m_peakState[QCS_MAX_LEVEL_CHANNELS];
+	double m_meanSquare[QCS_MAX_LEVEL_CHANNELS];
+	double m_truePeakState[QCS_MAX_LEVEL_CHANNELS];
+	// History is stored twice so a whole window is always contiguous
+	float m_history[QCS_MAX_LEVEL_CHANNELS][QCS_TRUEPEAK_TAPS * 2];
+	int m_historyPos;
+
+	std::atomic<float> m_slots[3][QCS_MAX_LEVEL_CHANNELS];
+};
+
+#endif // OUTPUTLEVELS_H
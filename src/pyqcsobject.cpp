@@ -28,6 +28,7 @@
 
 #include <QMessageBox>
 #include <QDir>
+#include <QThread>
 #include "csound.h"
 
 PyQcsObject::PyQcsObject():QObject(NULL)
@@ -464,31 +465,81 @@ QuteSheet* PyQcsObject::getSheet(int index, QString sheetName)
 
 void PyQcsObject::schedule(QVariant time, QVariant event)
 {
-	qDebug() << "PyQcsObject::schedule" << event;
-	if (time.canConvert<double>())  { // a single event
-		QString eventLine = "i ";
-		if (event.canConvert<QVariantList>()) {
-			QVariantList fields = event.value<QVariantList>();
-			for (int f = 0; f < fields.size(); f++) {
-				if (strcmp(fields[f].typeName(), "double") || strcmp(fields[f].typeName(),"int")) {
-					eventLine.append(fields[f].toString() + " ");
-				}
-				else {
-					eventLine.append("\"" + fields[f].toString() + "\"");
-				}
-			}
+	// time in seconds from now, event a score line or a list of p-fields
+	// from p1. Lists of times take a list of events
+	if (time.type() == QVariant::List) {
+		QVariantList times = time.toList();
+		QVariantList events = event.toList();
+		for (int i = 0; i < times.size() && i < events.size(); i++) {
+			schedule(times[i], events[i]);
 		}
-		qDebug() << "PyQcsObject::schedule: " << eventLine;
+		return;
+	}
+	if (!time.canConvert<double>()) {
+		return;
+	}
+	m_qcs->sendEvent(eventLine(event), time.toDouble());
+}
+
+void PyQcsObject::scheduleBeat(QVariant beat, QVariant event)
+{
+	if (beat.type() == QVariant::List) {
+		QVariantList beats = beat.toList();
+		QVariantList events = event.toList();
+		for (int i = 0; i < beats.size() && i < events.size(); i++) {
+			scheduleBeat(beats[i], events[i]);
+		}
+		return;
+	}
+	CsoundEngine *e = m_qcs->getEngine();
+	if (!beat.canConvert<double>() || e == NULL) {
+		return;
 	}
-	else if (time.canConvert<QVariantList>()) { // list of events
+	QMetaObject::invokeMethod(e, "queueEventAtBeat", transportConnection(e),
+							  Q_ARG(QString, eventLine(event)), Q_ARG(double, beat.toDouble()));
+}
 
+Qt::ConnectionType PyQcsObject::transportConnection(QObject *engine)
+{
+	// Process callbacks run on the performance thread, and the transport
+	// only takes changes from the GUI thread
+	return QThread::currentThread() == engine->thread() ? Qt::DirectConnection
+														: Qt::QueuedConnection;
+}
+
+QString PyQcsObject::eventLine(const QVariant &event)
+{
+	if (event.type() != QVariant::List) {
+		return event.toString();
 	}
+	QString line = "i";
+	QVariantList fields = event.toList();
+	for (int f = 0; f < fields.size(); f++) {
+		if (fields[f].type() == QVariant::String) {
+			line.append(" \"" + fields[f].toString() + "\"");
+		}
+		else {
+			line.append(" " + fields[f].toString());
+		}
+	}
+	return line;
 }
 
 void PyQcsObject::sendEvent(QString events)
 {
 	//  qDebug() << "PyQcsObject::sendEvent" << events;
-	m_qcs->sendEvent(events);
+	if (events.contains('\n')) {
+		m_qcs->sendEvent(events);
+		return;
+	}
+	QHash<QString, EventTemplate>::const_iterator it = m_eventCache.constFind(events);
+	if (it == m_eventCache.constEnd()) {
+		if (m_eventCache.size() >= QCS_MAX_CACHED_EVENTS) {
+			m_eventCache.clear();
+		}
+		it = m_eventCache.insert(events, EventTemplate::fromLine(events));
+	}
+	m_qcs->sendEvent(-1, it.value());
 	//  if (events.type() == QVariant::String )  { // a single event in a string
 	//    m_qcs->sendEvent(events.toString());
 	//    qDebug() << "PyQcsObject::sendEvent sent: " << events.toString();
@@ -503,6 +554,96 @@ void PyQcsObject::sendEvent(int index, QString events)
 	m_qcs->sendEvent(index, events);
 }
 
+int PyQcsObject::registerEvent(QString eventLine)
+{
+	m_eventTemplates.append(EventTemplate::fromLine(eventLine));
+	return m_eventTemplates.size() - 1;
+}
+
+void PyQcsObject::fireEvent(int id, QVariantList values, double delay)
+{
+	if (id < 0 || id >= m_eventTemplates.size()) {
+		qDebug() << "PyQcsObject::fireEvent no event registered with id" << id;
+		return;
+	}
+	m_qcs->sendEvent(-1, m_eventTemplates[id], values, delay);
+}
+
+void PyQcsObject::startTransport()
+{
+	CsoundEngine *e = m_qcs->getEngine();
+	if (e != NULL) {
+		QMetaObject::invokeMethod(e, "startTransport", transportConnection(e));
+	}
+}
+
+void PyQcsObject::stopTransport()
+{
+	CsoundEngine *e = m_qcs->getEngine();
+	if (e != NULL) {
+		QMetaObject::invokeMethod(e, "stopTransport", transportConnection(e));
+	}
+}
+
+void PyQcsObject::locate(double beat)
+{
+	CsoundEngine *e = m_qcs->getEngine();
+	if (e != NULL) {
+		QMetaObject::invokeMethod(e, "locateTransport", transportConnection(e),
+								  Q_ARG(double, beat));
+	}
+}
+
+void PyQcsObject::setTempo(double tempo, double beat)
+{
+	CsoundEngine *e = m_qcs->getEngine();
+	if (e != NULL) {
+		QMetaObject::invokeMethod(e, "setTransportTempo", transportConnection(e),
+								  Q_ARG(double, tempo), Q_ARG(double, beat));
+	}
+}
+
+double PyQcsObject::getTempo()
+{
+	CsoundEngine *e = m_qcs->getEngine();
+	if (e == NULL) {
+		return -1.0;
+	}
+	const TransportClock &clock = e->getTransport();
+	return clock.tempoAt(clock.beatAt(clock.position()));
+}
+
+void PyQcsObject::setBeatsPerBar(int beats)
+{
+	CsoundEngine *e = m_qcs->getEngine();
+	if (e != NULL) {
+		QMetaObject::invokeMethod(e, "setTransportBeatsPerBar", transportConnection(e),
+								  Q_ARG(int, beats));
+	}
+}
+
+double PyQcsObject::getBeat()
+{
+	CsoundEngine *e = m_qcs->getEngine();
+	if (e == NULL) {
+		return -1.0;
+	}
+	const TransportClock &clock = e->getTransport();
+	return clock.beatAt(clock.position());
+}
+
+double PyQcsObject::getBar()
+{
+	CsoundEngine *e = m_qcs->getEngine();
+	if (e == NULL) {
+		return -1.0;
+	}
+	double values[TransportClock::ChannelCount];
+	const TransportClock &clock = e->getTransport();
+	clock.channelValues(clock.position(), values);
+	return values[TransportClock::BarChannel];
+}
+
 CSOUND* PyQcsObject::getCurrentCsound()
 {
 	CSOUND *cs = NULL;
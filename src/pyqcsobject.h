@@ -34,7 +34,11 @@
 
 #include <csound.hpp>
 
+#include "eventscheduler.h"
+
 #define PYQCSVERSION "1.0"
+// Lines sendEvent() keeps parsed
+#define QCS_MAX_CACHED_EVENTS 256
 
 class CsoundQt;
 class QuteSheet;
@@ -135,9 +139,26 @@ public slots:
 	QuteSheet* getSheet(int index, QString sheetName);
 
 	//Scheduler
-	void schedule(QVariant time, QVariant event);  // TODO implement receiving lists
+	void schedule(QVariant time, QVariant event);
 	void sendEvent(int index, QString events);
 	void sendEvent(QString events);
+	// Parses eventLine once and returns an id for fireEvent(). Fields
+	// written as $channel are slots
+	int registerEvent(QString eventLine);
+	// Slots take values in order, the rest take their channel values
+	void fireEvent(int id, QVariantList values = QVariantList(), double delay = 0);
+	// Like schedule(), with times in beats of the transport
+	void scheduleBeat(QVariant beat, QVariant event);
+
+	// Transport of the current document
+	void startTransport();
+	void stopTransport();
+	void locate(double beat);
+	void setTempo(double tempo, double beat = -1);  // From the current beat if beat is negative
+	double getTempo();
+	void setBeatsPerBar(int beats);
+	double getBeat();
+	double getBar();  // From 1
 
 	// To/From Csound
 	CSOUND* getCurrentCsound();
@@ -163,8 +184,13 @@ public slots:
 	void registerProcessCallback(QString func, int skipPeriods = 0, int index = -1);
 
 private:
+	static QString eventLine(const QVariant &event);  // From a score line or a list of p-fields
+	static Qt::ConnectionType transportConnection(QObject *engine);
+
 	CsoundQt *m_qcs;
 	MYFLT **m_tablePtr;
+	QVector<EventTemplate> m_eventTemplates;  // Registered, by id
+	QHash<QString, EventTemplate> m_eventCache;  // Lines sent with sendEvent()
 };
 
 #endif // PYQCSOBJECT_H
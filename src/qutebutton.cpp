@@ -27,6 +27,7 @@ QuteButton::QuteButton(QWidget *parent) : QuteWidget(parent)
     m_widget = new QPushButton(this);
     m_widget->setContextMenuPolicy(Qt::NoContextMenu);
     m_currentValue = 0;
+	m_indefinite = false;
     // Necessary to pass mouse tracking to widget panel for _MouseX channels
     m_widget->setMouseTracking(true);
 	setMouseTracking(true);
@@ -538,34 +539,20 @@ void QuteButton::performAction() {
     //bool useMomentaryMidiButton = property("QCS_momentaryMidiButton").toBool();
 
 	if (type.contains("event") && !eventLine.isEmpty()) {
-		if ( hasIndefiniteDuration() ) {		
+		updateEventTemplates(eventLine);
+		if ( m_indefinite ) {
             if ( m_currentValue == 0 ) { // turn off
-                QStringList lineElements = eventLine.split(QRegExp("\\s"),SKIP_EMPTY_PARTS);
-				if (lineElements.size() > 0 && lineElements[0] == "i") {
-					lineElements.removeAt(0); // Remove first element if it is "i"
-				}
-				else if (lineElements.size() > 0 && lineElements[0][0] == 'i') {
-					lineElements[0] = lineElements[0].mid(1); // Remove "i" character
-				}
-				if ( lineElements[0].startsWith("\"") || lineElements[0].startsWith("\'")  ) {
-					//qDebug()<<"Stopping named instrument: " << lineElements[0];
-					lineElements[0].insert(1,"-");
-				}
-				else {
-					lineElements[0].prepend("-");
-				}
-				lineElements.prepend("i");
 				setValue(0);
 				m_isPlaying = false;
-				emit(queueEventSignal(lineElements.join(" ")));
+				emit(queueTemplateSignal(m_offEvent));
 			} else {
 				setValue( property("QCS_pressedValue").toDouble()  ); // was 1
 				m_isPlaying = true;
-				emit(queueEventSignal(eventLine));
+				emit(queueTemplateSignal(m_onEvent));
 			}
 		} else { // if not negative p3 then just fire the event
 			if (!isLatch && m_currentValue>0) { //do not fire the event if latched && m_value==0 && is positive p3
-				emit(queueEventSignal(eventLine));
+				emit(queueTemplateSignal(m_onEvent));
 			}
 		}
     }
@@ -628,6 +615,35 @@ bool QuteButton::hasIndefiniteDuration()
 	return false;
 }
 
+void QuteButton::updateEventTemplates(const QString &eventLine)
+{
+	if (eventLine == m_onEvent.text) {
+		return;
+	}
+	m_onEvent = EventTemplate::fromLine(eventLine);
+	m_indefinite = hasIndefiniteDuration();
+	QStringList lineElements = eventLine.split(QRegExp("\\s"),SKIP_EMPTY_PARTS);
+	if (lineElements.size() > 0 && lineElements[0] == "i") {
+		lineElements.removeAt(0); // Remove first element if it is "i"
+	}
+	else if (lineElements.size() > 0 && lineElements[0][0] == 'i') {
+		lineElements[0] = lineElements[0].mid(1); // Remove "i" character
+	}
+	if (lineElements.isEmpty()) {
+		m_offEvent = EventTemplate();
+		return;
+	}
+	if ( lineElements[0].startsWith("\"") || lineElements[0].startsWith("\'")  ) {
+		//qDebug()<<"Stopping named instrument: " << lineElements[0];
+		lineElements[0].insert(1,"-");
+	}
+	else {
+		lineElements[0].prepend("-");
+	}
+	lineElements.prepend("i");
+	m_offEvent = EventTemplate::fromLine(lineElements.join(" "));
+}
+
 void QuteButton::buttonPressed()
 {
 #ifdef  USE_WIDGET_MUTEX
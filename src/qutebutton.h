@@ -78,9 +78,14 @@ private:
     QIcon onIcon;
 
 	bool m_isPlaying;
+	// Parsed from QCS_eventLine when it changes, not on every press
+	EventTemplate m_onEvent;
+	EventTemplate m_offEvent;  // Turns off a note held by a latched button
+	bool m_indefinite;
 
     void performAction();
 	bool hasIndefiniteDuration();
+	void updateEventTemplates(const QString &eventLine);
 
 private slots:
 	void buttonPressed();
@@ -89,6 +94,7 @@ private slots:
 
 signals:
 	void queueEventSignal(QString eventLine);
+	void queueTemplateSignal(const EventTemplate &eventTemplate);
 	void play();
 	void pause();
 	void stop();
@@ -42,6 +42,9 @@
 #include "livecodeeditor.h"
 #include "csoundhtmlview.h"
 #include "risset.h"
+#include "directorymenu.h"
+#include "startuptrace.h"
+#include "scorestreamer.h"
 #include <thread>
 
 
@@ -242,6 +245,7 @@ CsoundQt::CsoundQt(QStringList fileNames)
     createStatusBar();
     createToolBars();
     readSettings();
+    StartupTrace::mark("settings");
     createMenus(); // creating menu must be after readSettings. probably create Status- and toolbars, too?
     this->setToolbarIconSize(m_options->toolbarIconSize);
 
@@ -310,6 +314,7 @@ CsoundQt::CsoundQt(QStringList fileNames)
     fillFileMenu();     // Must be placed after readSettings to include recent Files
     fillFavoriteMenu(); // Must be placed after readSettings to know directory
     fillScriptsMenu();  // Must be placed after readSettings to know directory
+    StartupTrace::mark("menus");
     risset = new Risset(m_options->pythonExecutable);
     /*
 #if defined(Q_OS_LINUX)
@@ -331,9 +336,11 @@ CsoundQt::CsoundQt(QStringList fileNames)
         qDebug() << "Risset's opcodes.xml not found: " << rissetOpcodesXml;
     }
     m_opcodeTree->setUdos(m_inspector->getUdosMap());
+    StartupTrace::mark("opcode database");
     LiveCodeEditor *liveeditor = new LiveCodeEditor(m_scratchPad, m_opcodeTree);
     liveeditor->setSizePolicy(QSizePolicy::Expanding,QSizePolicy::Expanding);
     connect(liveeditor, SIGNAL(evaluate(QString)), this, SLOT(evaluate(QString)));
+    connect(liveeditor, SIGNAL(tempoChanged(double)), this, SLOT(setTransportTempo(double)));
     connect(liveeditor, SIGNAL(enableCsdMode(bool)),
             scratchPadCsdModeAct, SLOT(setChecked(bool)));
     //	connect(scratchPadCsdModeAct, SIGNAL(toggled(bool)),
@@ -492,6 +499,7 @@ CsoundQt::CsoundQt(QStringList fileNames)
     // Make sure that we do have an open file
     if(documentPages.size() < 1)
         newFile();
+    StartupTrace::mark("document restore");
 
 /*
 #ifdef Q_OS_LINUX
@@ -1010,7 +1018,8 @@ void CsoundQt::evaluate(QString code)
 
 void CsoundQt::evaluateCsound(QString code)
 {
-    documentPages[curPage]->sendCodeToEngine(code);
+    LiveCodeEditor *liveEditor = static_cast<LiveCodeEditor *>(m_scratchPad->widget());
+    documentPages[curPage]->sendCodeToEngine(code, liveEditor->quantum());
 }
 
 void CsoundQt::breakpointReached()
@@ -1050,6 +1059,7 @@ void CsoundQt::evaluateString(QString evalCode)
             }
         }
         if (testTree) { // when the code is csound code, but with errors, it will be sent to python interpreter too
+            csoundDeleteTree(csound, testTree);
             evaluateCsound(evalCode);
             return;
         }
@@ -2009,7 +2019,13 @@ void CsoundQt::play(bool realtime, int index)
     QString runFileName1, runFileName2;
     QTemporaryFile csdFile, csdFile2; // TODO add support for orc/sco pairs
     runFileName1 = fileName;
-    if(fileName.startsWith(":/", Qt::CaseInsensitive) || !m_options->saveChanges) {
+    // A streamed score is played from the editor text, so it needs the temporary file
+    bool streamScore = m_options->streamScore && realtime
+            && fileName.endsWith(".csd",Qt::CaseInsensitive)
+            && !fileName.startsWith(":/examples/", Qt::CaseInsensitive)
+            && !(page->usesFltk() && m_options->terminalFLTK);
+    m_options->streamedScore.clear();
+    if(fileName.startsWith(":/", Qt::CaseInsensitive) || !m_options->saveChanges || streamScore) {
         QDEBUG << "***** Using temporary file for filename" << fileName;
         QString tmpFileName = QDir::tempPath();
         if (!tmpFileName.endsWith("/") && !tmpFileName.endsWith("\\")) {
@@ -2027,7 +2043,15 @@ void CsoundQt::play(bool realtime, int index)
             // If example, just copy, since readonly anyway, otherwise get contents from editor.
             // Necessary since examples may contain <CsFileB> section with data.
             if (!fileName.startsWith(":/examples/", Qt::CaseInsensitive)) {
-                csdFile.write(page->getBasicText().toLatin1());
+                QString text = page->getBasicText();
+                QString reason;
+                if (streamScore
+                        && !ScoreStreamer::extractScore(&text, &m_options->streamedScore, &reason)
+                        && !reason.isEmpty()) {
+                    page->getEngine()->queueMessage(
+                                tr("Score not streamed, %1. Compiling it instead.\n").arg(reason));
+                }
+                csdFile.write(text.toLatin1());
             } else {
                 auto fullText = page->getView()->getFullText();
                 if(!fullText.contains("<CsFileB")) {
@@ -2086,6 +2110,9 @@ void CsoundQt::play(bool realtime, int index)
 		// No problem:
 		// set playing icon on tab
         documentTabs->setTabIcon(index, QIcon(QString(":/themes/%1/media-play.png").arg(m_options->theme )));
+        // The transport starts at the tempo shown in the scratch pad
+        LiveCodeEditor *liveEditor = static_cast<LiveCodeEditor *>(m_scratchPad->widget());
+        page->getEngine()->getTransport().setTempo(liveEditor->tempo(), 0);
 
 		// enable widgets
         if(m_options->checkSyntaxOnly) {
@@ -2213,6 +2240,20 @@ void CsoundQt::pause(int index)
     }
 }
 
+void CsoundQt::hotUpdate()
+{
+    if (curPage >= 0 && curPage < documentPages.size()) {
+        documentPages[curPage]->hotUpdate();
+    }
+}
+
+void CsoundQt::setTransportTempo(double tempo)
+{
+    if (curPage >= 0 && curPage < documentPages.size()) {
+        documentPages[curPage]->getEngine()->getTransport().setTempo(tempo);
+    }
+}
+
 void CsoundQt::stop(int index)
 {
     // Must guarantee that csound has stopped when it returns
@@ -2331,6 +2372,21 @@ void CsoundQt::sendEvent(int index, QString eventLine, double delay)
     }
 }
 
+void CsoundQt::sendEvent(int index, const EventTemplate &eventTemplate,
+                         const QVariantList &values, double delay)
+{
+    int docIndex = index == -1 ? curCsdPage : index;
+    if (docIndex < 0 || docIndex >= documentPages.size()) {
+        return;
+    }
+    QVector<double> filled(eventTemplate.channels.size());
+    for (int i = 0; i < filled.size(); i++) {
+        filled[i] = i < values.size() ? values[i].toDouble()
+                                      : documentPages[docIndex]->getChannelValue(eventTemplate.channels[i]);
+    }
+    documentPages[docIndex]->queueEvent(eventTemplate.fill(filled), delay);
+}
+
 void CsoundQt::render()
 {
     if (m_options->fileAskFilename) {
@@ -3343,7 +3399,7 @@ void CsoundQt::updateInspector()
         return; // Retrigger timer, but do no update
     }
     if (!documentPages[curPage]->getFileName().endsWith(".py")) {
-        m_inspector->parseText(documentPages[curPage]->getBasicText());
+        m_inspector->setOutline(documentPages[curPage]->getView()->getDocumentModel()->outline());
     }
     else {
         m_inspector->parsePythonText(documentPages[curPage]->getBasicText());
@@ -3393,6 +3449,7 @@ void CsoundQt::setDefaultKeyboardShortcuts()
     runAct->setShortcut(tr("CTRL+R"));
     runTermAct->setShortcut(QKeySequence(Qt::CTRL+Qt::SHIFT+Qt::Key_T));
     pauseAct->setShortcut(tr("Ctrl+Shift+M"));
+    hotUpdateAct->setShortcut(tr("Ctrl+Shift+U"));
 
     stopAct->setShortcut(tr("Ctrl+."));
     stopAllAct->setShortcut(QKeySequence(Qt::CTRL+Qt::SHIFT+Qt::Key_Period));
@@ -3832,6 +3889,12 @@ void CsoundQt::createActions()
     pauseAct->setShortcutContext(Qt::ApplicationShortcut);
     connect(pauseAct, SIGNAL(triggered()), this, SLOT(pause()));
 
+    hotUpdateAct = new QAction(tr("Hot Update"), this);
+    hotUpdateAct->setStatusTip(tr("Recompile the instruments changed since Run into the running engine"));
+    hotUpdateAct->setIconText(tr("Update"));
+    hotUpdateAct->setShortcutContext(Qt::ApplicationShortcut);
+    connect(hotUpdateAct, SIGNAL(triggered()), this, SLOT(hotUpdate()));
+
     stopAllAct = new QAction(QIcon(prefix + "media-stop.png"), tr("Stop All"), this);
     stopAllAct->setStatusTip(tr("Stop all running documents"));
     stopAllAct->setIconText(tr("Stop All"));
@@ -4342,6 +4405,7 @@ void CsoundQt::setKeyboardShortcutsList()
     m_keyActions.append(runTermAct);
     m_keyActions.append(stopAct);
     m_keyActions.append(pauseAct);
+    m_keyActions.append(hotUpdateAct);
     m_keyActions.append(stopAllAct);
     m_keyActions.append(recAct);
     m_keyActions.append(renderAct);
@@ -4472,6 +4536,8 @@ void CsoundQt::connectActions()
             this, SLOT(setCurrentAudioFile(QString)));
     connect(doc, SIGNAL(evaluatePythonSignal(QString)),
             this, SLOT(evaluateString(QString)));
+    connect(doc, SIGNAL(runPythonSignal(QString)),
+            this, SLOT(evaluatePython(QString)));
 
     disconnect(showWidgetsAct, 0,0,0);
     if (m_options->widgetsIndependent) {
@@ -4612,6 +4678,7 @@ void CsoundQt::createMenus()
     controlMenu->addAction(runAct);
     controlMenu->addAction(runTermAct);
     controlMenu->addAction(pauseAct);
+    controlMenu->addAction(hotUpdateAct);
     controlMenu->addAction(renderAct);
     controlMenu->addAction(recAct);
     controlMenu->addAction(stopAct);
@@ -4670,9 +4737,19 @@ void CsoundQt::createMenus()
 
 
     favoriteMenu = menuBar()->addMenu(tr("Favorites"));
+    QStringList favoriteFilters;
+    favoriteFilters << "*.csd" << "*.orc" << "*.sco" << "*.udo" << "*.inc" << "*.py";
+    m_favoriteDirMenu = new DirectoryMenu(favoriteMenu, favoriteFilters, this, SLOT(openFromAction()));
 #ifdef QCS_PYTHONQT
     scriptsMenu = menuBar()->addMenu(tr("Scripts"));
     scriptsMenu->hide();
+    m_scriptsDirMenu = new DirectoryMenu(scriptsMenu, QStringList("*.py"),
+                                         this, SLOT(runScriptFromAction()));
+    connect(m_scriptsDirMenu, SIGNAL(filled(QMenu*,QString)),
+            this, SLOT(scriptsMenuFilled(QMenu*,QString)));
+    m_editScriptsMenu = new QMenu("Edit", this);
+    m_editScriptsDirMenu = new DirectoryMenu(m_editScriptsMenu, QStringList("*.py"),
+                                             this, SLOT(openFromAction()));
 #endif
 
     menuBar()->addSeparator();
@@ -4715,59 +4792,38 @@ void CsoundQt::fillExampleMenu()
     }
 
     QMenu *examplesMenu = menuBar()->addMenu(tr("Examples"));
+    openExamplesFolderAct = new QAction(tr("Open Examples Folder"), this);
+    openExamplesFolderAct->setStatusTip(tr("Save the document under a new name"));
+    openExamplesFolderAct->setShortcutContext(Qt::ApplicationShortcut);
+    connect(openExamplesFolderAct, SIGNAL(triggered()), this, SLOT(openExamplesFolder()));
 
-    QDir dir(examplePath);
-    if (dir.count() > 0) {
-        fillExampleSubmenu(dir.absolutePath(), examplesMenu, 0);
-    }
-
-    if (!examplePath.isEmpty()) {
-        examplesMenu->addSeparator();
-        openExamplesFolderAct = new QAction(tr("Open Examples Folder"), this);
-        openExamplesFolderAct->setStatusTip(tr("Save the document under a new name"));
-        openExamplesFolderAct->setShortcutContext(Qt::ApplicationShortcut);
-        connect(openExamplesFolderAct, SIGNAL(triggered()), this, SLOT(openExamplesFolder()));
-        examplesMenu->addAction(openExamplesFolderAct);
-    }
-
-
+    // Filled in when first shown
+    QStringList filters;
+    filters << "*.csd" << "*.pdf" << "*.html";
+    DirectoryMenu *dirMenu = new DirectoryMenu(examplesMenu, filters, this, SLOT(openExample()));
+    connect(dirMenu, SIGNAL(aboutToFill(QMenu*,QString)),
+            this, SLOT(examplesMenuAboutToFill(QMenu*,QString)));
+    connect(dirMenu, SIGNAL(filled(QMenu*,QString)),
+            this, SLOT(examplesMenuFilled(QMenu*,QString)));
+    dirMenu->setDirectory(QDir(examplePath).absolutePath(), m_options->menuDepth, 256,
+                          QStringList("SourceMaterials"));
 }
 
-void CsoundQt::fillExampleSubmenu(QDir dir, QMenu *m, int depth)
+void CsoundQt::examplesMenuAboutToFill(QMenu *menu, QString path)
 {
-    QString test = dir.dirName();
-    //qDebug() << "dirName: " << test;
-    if (depth > m_options->menuDepth) {
-        return;
-    }
-
     // add extra entry for FLOSS manual
-    if (dir.dirName().startsWith("FLOSS")) {
-        m->addAction(tr("Read FLOSS Manual Online"),this, SLOT(openFLOSSManual()));
-        m->addSeparator();
+    if (QDir(path).dirName().startsWith("FLOSS")) {
+        menu->addAction(tr("Read FLOSS Manual Online"),this, SLOT(openFLOSSManual()));
+        menu->addSeparator();
     }
+}
 
-    QStringList filters;
-    filters << "*.csd" << "*.pdf" << "*.html";
-    dir.setNameFilters(filters);
-    QStringList files = dir.entryList(QDir::Files,QDir::Name);
-    QStringList dirs = dir.entryList(QDir::AllDirs,QDir::Name);
-    for (int i = 0; i < dirs.size() && i < 256; i++) {
-        QDir newDir(dir.absolutePath() + "/" + dirs[i]);
-        newDir.setNameFilters(filters);
-        QStringList newFiles = dir.entryList(QDir::Files,QDir::Name);
-        QStringList newDirs = dir.entryList(QDir::AllDirs,QDir::Name);
-        if (newFiles.size() > 0 ||  newDirs.size() > 0) {
-            if (dirs[i] != "." && dirs[i] != ".." && dirs[i]!="SourceMaterials") {
-                QMenu *menu = m->addMenu(dirs[i]);
-                fillExampleSubmenu(newDir.absolutePath(), menu, depth + 1);
-            }
-        }
-    }
-    for (int i = 0; i < files.size() &&  i < 256; i++) {
-        QAction *newAction = m->addAction(files[i],
-                                          this, SLOT(openExample()));
-        newAction->setData(dir.absoluteFilePath(files[i]));
+void CsoundQt::examplesMenuFilled(QMenu *menu, QString path)
+{
+    Q_UNUSED(path);
+    if (menu->parent() == menuBar()) {
+        menu->addSeparator();
+        menu->addAction(openExamplesFolderAct);
     }
 }
 
@@ -4828,114 +4884,40 @@ void CsoundQt::fillFileMenu()
 
 void CsoundQt::fillFavoriteMenu()
 {
-    favoriteMenu->clear();
+    // Listed in the background, the menu is filled when first shown
     if (!m_options->favoriteDir.isEmpty()) {
         QDir dir(m_options->favoriteDir);
-        fillFavoriteSubMenu(dir.absolutePath(), favoriteMenu, 0);
+        m_favoriteDirMenu->setDirectory(dir.absolutePath(), m_options->menuDepth, 64);
     }
     else {
+        m_favoriteDirMenu->setDirectory(QString(), 0, 0);
         favoriteMenu->addAction(tr("Set the Favourites folder in the Configuration Window"),
                                 this, SLOT(configure()));
     }
 }
 
-void CsoundQt::fillFavoriteSubMenu(QDir dir, QMenu *m, int depth)
-{
-    QStringList filters;
-    filters << "*.csd" << "*.orc" << "*.sco" << "*.udo" << "*.inc" << "*.py";
-    dir.setNameFilters(filters);
-    QStringList files = dir.entryList(QDir::Files,QDir::Name);
-    QStringList dirs = dir.entryList(QDir::AllDirs,QDir::Name);
-    if (depth > m_options->menuDepth)
-        return;
-    for (int i = 0; i < dirs.size() && i < 64; i++) {
-        QDir newDir(dir.absolutePath() + "/" + dirs[i]);
-        newDir.setNameFilters(filters);
-        QStringList newFiles = dir.entryList(QDir::Files,QDir::Name);
-        QStringList newDirs = dir.entryList(QDir::AllDirs,QDir::Name);
-        if (newFiles.size() > 0 ||  newDirs.size() > 0) {
-            if (dirs[i] != "." && dirs[i] != "..") {
-                QMenu *menu = m->addMenu(dirs[i]);
-                fillFavoriteSubMenu(newDir.absolutePath(), menu, depth + 1);
-            }
-        }
-    }
-    for (int i = 0; i < files.size() &&  i < 64; i++) {
-        QAction *newAction = m->addAction(files[i],
-                                          this, SLOT(openFromAction()));
-        newAction->setData(dir.absoluteFilePath(files[i]));
-    }
-}
-
 void CsoundQt::fillScriptsMenu()
 {
 #ifdef QCS_PYTHONQT
-    scriptsMenu->clear();
     QString dirName = m_options->pythonDir.isEmpty() ? DEFAULT_SCRIPT_DIR : m_options->pythonDir;
     QDir dir(dirName);
-    if (dir.count() > 0) {
-        fillScriptsSubMenu(dir.absolutePath(), scriptsMenu, 0);
-        scriptsMenu->addSeparator();
-        QMenu *editMenu = scriptsMenu->addMenu("Edit");
-        fillEditScriptsSubMenu(dir.absolutePath(), editMenu, 0);
-    }
+    QString path = dir.exists() ? dir.absolutePath() : QString();
+    m_scriptsDirMenu->setDirectory(path, m_options->menuDepth, 64);
+    m_editScriptsDirMenu->setDirectory(path, m_options->menuDepth, 64);
 #endif
 }
 
-void CsoundQt::fillScriptsSubMenu(QDir dir, QMenu *m, int depth)
+void CsoundQt::scriptsMenuFilled(QMenu *menu, QString path)
 {
-    QStringList filters;
-    filters << "*.py";
-    dir.setNameFilters(filters);
-    QStringList files = dir.entryList(QDir::Files,QDir::Name);
-    QStringList dirs = dir.entryList(QDir::AllDirs,QDir::Name);
-    if (depth > m_options->menuDepth)
-        return;
-    for (int i = 0; i < dirs.size() && i < 64; i++) {
-        QDir newDir(dir.absolutePath() + "/" + dirs[i]);
-        newDir.setNameFilters(filters);
-        QStringList newFiles = dir.entryList(QDir::Files,QDir::Name);
-        QStringList newDirs = dir.entryList(QDir::AllDirs,QDir::Name);
-        if (newFiles.size() > 0 ||  newDirs.size() > 0) {
-            if (dirs[i] != "." && dirs[i] != "..") {
-                QMenu *menu = m->addMenu(dirs[i]);
-                fillScriptsSubMenu(newDir.absolutePath(), menu, depth + 1);
-            }
-        }
-    }
-    for (int i = 0; i < files.size() &&  i < 64; i++) {
-        QAction *newAction = m->addAction(files[i],
-                                          this, SLOT(runScriptFromAction()));
-        newAction->setData(dir.absoluteFilePath(files[i]));
-    }
-}
-
-void CsoundQt::fillEditScriptsSubMenu(QDir dir, QMenu *m, int depth)
-{
-    QStringList filters;
-    filters << "*.py";
-    dir.setNameFilters(filters);
-    QStringList files = dir.entryList(QDir::Files,QDir::Name);
-    QStringList dirs = dir.entryList(QDir::AllDirs,QDir::Name);
-    if (depth > m_options->menuDepth)
-        return;
-    for (int i = 0; i < dirs.size() && i < 64; i++) {
-        QDir newDir(dir.absolutePath() + "/" + dirs[i]);
-        newDir.setNameFilters(filters);
-        QStringList newFiles = dir.entryList(QDir::Files,QDir::Name);
-        QStringList newDirs = dir.entryList(QDir::AllDirs,QDir::Name);
-        if (newFiles.size() > 0 ||  newDirs.size() > 0) {
-            if (dirs[i] != "." && dirs[i] != "..") {
-                QMenu *menu = m->addMenu(dirs[i]);
-                fillEditScriptsSubMenu(newDir.absolutePath(), menu, depth + 1);
-            }
-        }
-    }
-    for (int i = 0; i < files.size() &&  i < 64; i++) {
-        QAction *newAction = m->addAction(files[i],
-                                          this, SLOT(openFromAction()));
-        newAction->setData(dir.absoluteFilePath(files[i]));
+    Q_UNUSED(path);
+#ifdef QCS_PYTHONQT
+    if (menu == scriptsMenu) {
+        scriptsMenu->addSeparator();
+        scriptsMenu->addMenu(m_editScriptsMenu);
     }
+#else
+    Q_UNUSED(menu);
+#endif
 }
 
 //#include "flowlayout.h"
@@ -5219,6 +5201,7 @@ void CsoundQt::readSettings()
 
     m_options->realtimeFlag = settings.value("realtimeFlag", false).toBool();
     m_options->sampleAccurateFlag = settings.value("sampleAccurateFlag", false).toBool();
+    m_options->streamScore = settings.value("streamScore", false).toBool();
     if (settingsVersion < 1)
         m_options->additionalFlags.remove("-d");  // remove old -d preference, as it is fixed now.
     m_options->additionalFlagsActive = settings.value("additionalFlagsActive", false).toBool();
@@ -5458,6 +5441,7 @@ void CsoundQt::writeSettings(QStringList openFiles, int lastIndex)
         settings.setValue("dither", m_options->dither);
         settings.setValue("realtimeFlag", m_options->realtimeFlag);
         settings.setValue("sampleAccurateFlag", m_options->sampleAccurateFlag);
+        settings.setValue("streamScore", m_options->streamScore);
         settings.setValue("newParser", m_options->newParser);
         settings.setValue("multicore", m_options->multicore);
         settings.setValue("numThreads", m_options->numThreads);
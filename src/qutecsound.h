@@ -56,6 +56,7 @@ class PythonConsole;
 #endif
 class DockConsole;
 class DebugPanel;
+class DirectoryMenu;
 class OpEntryParser;
 class Options;
 class ConfigLists;
@@ -66,6 +67,7 @@ class GraphicWindow;
 class KeyboardShortcuts;
 class EventDispatcher;
 class EventSheet;
+struct EventTemplate;
 class CsoundEngine;
 class MidiHandler;
 class MidiLearnDialog;
@@ -117,6 +119,10 @@ public:
 	double getChannelValue(QString channel, int index = -1);
 	void setChannelString(QString channel, QString value, int index = -1);
 	QString getChannelString(QString channel, int index = -1);
+	// Fills the slots of eventTemplate from values, in order, and the rest
+	// from the channels of the document. -1 is the last csd document
+	void sendEvent(int index, const EventTemplate &eventTemplate,
+				   const QVariantList &values = QVariantList(), double delay = 0);
 	void setWidgetProperty(QString widgetid, QString property, QVariant value, int index= -1);
 	QVariant getWidgetProperty(QString widgetid, QString property, int index= -1);
 	QString createNewLabel(int x = -1, int y = -1, QString channel = QString(), int index = -1);
@@ -161,6 +167,8 @@ public slots:
 	void play(bool realtime = true, int index = -1);
 	void runInTerm(bool realtime = true);
 	void pause(int index = -1);
+	void hotUpdate();
+	void setTransportTempo(double tempo);  // Of the current document, from now on
 	void stop(int index = -1);
 	void stopAll();
 	void stopAllOthers();
@@ -193,6 +201,9 @@ protected:
 	virtual void closeEvent(QCloseEvent *event);
 	//    virtual void keyPressEvent(QKeyEvent *event);
 private slots:
+	void examplesMenuAboutToFill(QMenu *menu, QString path);
+	void examplesMenuFilled(QMenu *menu, QString path);
+	void scriptsMenuFilled(QMenu *menu, QString path);
 	void open();
 	void reload();
 	void openFromAction();
@@ -322,13 +333,9 @@ private:
 	QString getExamplePath(QString dir);
 	void createMenus();
 	void fillExampleMenu();
-    void fillExampleSubmenu(QDir dir, QMenu *m, int depth);
 	void fillFileMenu();
 	void fillFavoriteMenu();
-	void fillFavoriteSubMenu(QDir dir, QMenu *m, int depth);
 	void fillScriptsMenu();
-	void fillScriptsSubMenu(QDir dir, QMenu *m, int depth);
-	void fillEditScriptsSubMenu(QDir dir, QMenu *m, int depth);
 	void createToolBars();
     void createStatusBar();
 	void readSettings();
@@ -394,6 +401,10 @@ private:
 	QMenu *viewMenu;
 	QMenu *favoriteMenu;
 	QMenu *scriptsMenu;
+	QMenu *m_editScriptsMenu;
+	DirectoryMenu *m_favoriteDirMenu;
+	DirectoryMenu *m_scriptsDirMenu;
+	DirectoryMenu *m_editScriptsDirMenu;
 	QMenu *helpMenu;
 //	QToolBar *fileToolBar;
 //	QToolBar *editToolBar;
@@ -438,6 +449,7 @@ private:
     QAction *checkSyntaxAct;
 	QAction *runTermAct;
 	QAction *pauseAct;
+	QAction *hotUpdateAct;
 	QAction *stopAct;
 	QAction *stopAllAct;
 	QAction *recAct;
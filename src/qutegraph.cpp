@@ -1546,11 +1546,9 @@ void QuteTableWidget::reset() {
         m_maxy = 1.0;
         m_miny = -1.0;
     }
-#if QT_VERSION >= QT_VERSION_CHECK(5,14,0)
-    m_path.clear();
-#else
-    m_path = QPainterPath(); // not sure if it works
-#endif
+    m_poly.clear();
+    m_polyRect = QRect();
+    m_version = 0;
 }
 
 
@@ -1636,11 +1634,14 @@ void QuteTableWidget::paintEvent(QPaintEvent *event) {
     painter.setBrush(Qt::NoBrush);
     blockSignals(true);
     mutex.lock();
+    if(m_polyRect != this->rect()) {
+        this->updatePath();
+    }
     if(m_showGrid) {
         this->paintGrid(&painter);
     }
     painter.setPen(QPen(m_color, 0));
-    painter.drawPath(m_path);
+    painter.drawPolyline(m_poly);
     mutex.unlock();
     blockSignals(false);
 }
@@ -1656,69 +1657,83 @@ void QuteTableWidget::setRange(double maxy) {
 }
 
 void QuteTableWidget::updatePath() {
-    if(!m_running || m_tabnum <= 0) {
+    // Needs to be called with the lock
+    if(!m_running || m_tabnum <= 0 || m_ud == nullptr) {
         return;
     }
 
-    MYFLT *data;
-    int tabsize = csoundGetTable(m_ud->csound, &data, m_tabnum);
-    if(tabsize == 0 || data == nullptr) {
+    // The data is read in place from the table, only the indices which
+    // changed since the last update are recalculated
+    TableView view;
+    if(!m_ud->tableWatch.view(m_tabnum, m_version, &view)) {
         QDEBUG << "Table not found" << m_tabnum;
         return;
     }
-
-    m_tabsize = tabsize;
+    MYFLT *data = view.data;
+    int tabsize = view.size;
     int margin = m_margin;
 
     auto rect = this->rect();
     auto width = rect.width() - margin*2;
     auto height = rect.height() - margin*2;
-
-
-    double xscale = width / (double)tabsize;
-    double y0 = rect.y() + margin;
-    double x0 = rect.x() + margin;
+    if(width <= 0 || height <= 0) {
+        return;
+    }
 
     int step = tabsize / width;
     if(step == 0)
         step = 1;
 
-    double maxy = m_maxy;
-    double miny = m_miny;
+    bool full = tabsize != m_tabsize || step != m_step || rect != m_polyRect || m_poly.isEmpty();
+    if(!full && view.dirtyStart >= view.dirtyEnd) {
+        return;
+    }
+    int start = full ? 0 : view.dirtyStart;
+    int end = full ? tabsize : view.dirtyEnd;
+    // Align to the decimation grid
+    start = (start / step) * step;
 
     if(m_autorange) {
+        // The range only grows, so the changed part is all we need to look at
         double newmaxy = m_maxy;
         double newminy = m_miny;
-        for(int i=0; i < tabsize; i += step) {
+        for(int i=start; i < end; i += step) {
             double y = data[i];
             if(y > newmaxy)
                 newmaxy = y;
             else if (y < newminy)
                 newminy = y;
         }
-        maxy = m_maxy = ceil(newmaxy);
-        miny = m_miny = floor(newminy);
+        newmaxy = ceil(newmaxy);
+        newminy = floor(newminy);
+        if(newmaxy != m_maxy || newminy != m_miny) {
+            m_maxy = newmaxy;
+            m_miny = newminy;
+            full = true;
+            start = 0;
+            end = tabsize;
+        }
     }
 
-#if QT_VERSION >= QT_VERSION_CHECK(5,14,0)
-    m_path.clear();
-#else
-    m_path = QPainterPath(); // not sure if it works
-#endif
-    QPolygonF poly;
-    double yscale = -height / (maxy-miny);
+    m_tabsize = tabsize;
+    m_step = step;
+    m_polyRect = rect;
+    m_version = view.version;
 
-    double ydata = data[0];
-    poly.append(QPoint(x0, (ydata-miny)*yscale+y0+height));
+    double xscale = width / (double)tabsize;
+    double y0 = rect.y() + margin;
+    double x0 = rect.x() + margin;
+    double maxy = m_maxy;
+    double miny = m_miny;
+    double yscale = -height / (maxy-miny);
 
-    for(int i=1; i < tabsize; i+=step) {
-        ydata = data[i];
-        double x2 = i*xscale + x0;
-        double y2 = (ydata - miny) * yscale + (y0+height);
-        // path->lineTo(x2, y2);
-        poly.append(QPointF(x2, y2));
+    int numPoints = (tabsize + step - 1) / step;
+    if(full || m_poly.size() != numPoints) {
+        m_poly.resize(numPoints);
+    }
+    for(int i=start; i < end; i+=step) {
+        m_poly[i / step] = QPointF(i*xscale + x0, (data[i] - miny) * yscale + (y0+height));
     }
-    m_path.addPolygon(poly);
 }
 
 void QuteTableWidget::updateData(int tabnum) {
@@ -1732,6 +1747,8 @@ void QuteTableWidget::updateData(int tabnum) {
             m_miny = 0;
         }
         m_tabnum = tabnum;
+        m_poly.clear();
+        m_version = 0;
     }
     this->updatePath();
     this->update();
@@ -1920,9 +1937,7 @@ void QuteTable::setValue(double value) {
             return;
         }
         // update data, don't change table number
-        m_valueChanged = true;
-        // auto w = static_cast<QuteTableWidget*>(m_widget);
-        // w->updateData(m_tabnum);
+        markTableDirty(0, -1);
         return;
     }
     else if(m_value == value) {
@@ -1937,11 +1952,21 @@ void QuteTable::setValue(double value) {
     }
 };
 
+void QuteTable::markTableDirty(int start, int end) {
+    if(m_tabnum <= 0) {
+        return;
+    }
+    if(m_csoundUserData != nullptr) {
+        m_csoundUserData->tableWatch.markDirty(m_tabnum, start, end);
+    }
+    m_valueChanged = true;
+}
+
 void QuteTable::setValue(QString s) {
     auto parts = s.splitRef(' ', SKIP_EMPTY_PARTS);
     if(parts.size() == 0) {
-        qWarning() << "TablePLot: Message not understood, expected @set <tabnum> "
-                    "or @update";
+        qWarning() << "TablePLot: Message not understood, expected @set <tabnum>, "
+                    "@update or @update <start> <end>";
         return;
     }
     if(parts[0] == "@set") {
@@ -1952,7 +1977,12 @@ void QuteTable::setValue(QString s) {
         int tabnum = parts[1].toInt();
         setTableNumber(tabnum);
     } else if (parts[0] == "@update" && m_tabnum > 0) {
-        setValue(-1);
+        if(parts.size() == 3) {
+            // @update <start> <end>: only this range of the table was written
+            markTableDirty(parts[1].toInt(), parts[2].toInt());
+        } else {
+            setValue(-1);
+        }
     } else
         qWarning() << "Message not supported:" << s;
 }
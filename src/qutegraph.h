@@ -223,6 +223,8 @@ public:
         , m_maxy(1.0)
         , m_miny(-1.0)
         , m_autorange(true)
+        , m_step(1)
+        , m_version(0)
         , m_showGrid(true)
         , gridFont(QFont("Sans", 8))
         , gridFontMetrics(QFont("Sans", 8))
@@ -260,8 +262,11 @@ private:
     double m_maxy;
     double m_miny;
     bool m_autorange;
-    QPainterPath m_path;
-    // QPainterPath *m_path;
+    // One point every m_step table indices, updated only where the table changed
+    QPolygonF m_poly;
+    QRect m_polyRect;
+    int m_step;
+    int m_version;   // TableWatch version m_poly was built from
     QMutex mutex;
     bool m_showGrid;
     QFont gridFont;
@@ -297,6 +302,7 @@ public slots:
 
 private:
     int m_tabnum;
+    void markTableDirty(int start, int end); // end=-1: whole table
 
 protected:
     // virtual void mousePressEvent(QMouseEvent *event);
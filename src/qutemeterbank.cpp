@@ -0,0 +1,380 @@
+#include "qutemeterbank.h"
+
+#include <cmath>
+
+MeterBankWidget::MeterBankWidget(QWidget *parent) :
+    QWidget(parent),
+    m_color(Qt::green),
+    m_bgcolor(QColor(30, 30, 30)),
+    m_holdColor(Qt::white),
+    m_clipColor(Qt::red),
+    m_clipOffColor(QColor(60, 60, 60)),
+    m_dbRange(60.0),
+    m_holdMs(1500)
+{
+    // Every pixel is painted in paintEvent, so Qt doesn't need to erase first
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    m_clock.start();
+}
+
+void MeterBankWidget::setCount(int count)
+{
+    count = qBound(1, count, QCS_METERBANK_MAX_METERS);
+    if (count != m_meters.size()) {
+        m_meters.resize(count);
+        resetMeters();
+    }
+}
+
+void MeterBankWidget::setColors(QColor color, QColor bgcolor, QColor holdColor, QColor clipColor)
+{
+    m_color = color;
+    m_bgcolor = bgcolor;
+    m_holdColor = holdColor;
+    m_clipColor = clipColor;
+    m_clipOffColor = bgcolor.lighter(200);
+    update();
+}
+
+void MeterBankWidget::setDbRange(double dbRange)
+{
+    m_dbRange = dbRange;
+    for (int i = 0; i < m_meters.size(); i++) {
+        m_meters[i].bar = toPixels(m_meters[i].value);
+        m_meters[i].hold = m_holdMs > 0 ? toPixels(m_meters[i].holdValue) : 0;
+    }
+    update();
+}
+
+void MeterBankWidget::resetMeters()
+{
+    for (int i = 0; i < m_meters.size(); i++) {
+        Meter &meter = m_meters[i];
+        meter.value = 0.0;
+        meter.holdValue = 0.0;
+        meter.holdExpires = 0;
+        meter.bar = 0;
+        meter.hold = 0;
+        meter.clip = false;
+    }
+    update();
+}
+
+int MeterBankWidget::toPixels(double value)
+{
+    int height = qMax(this->height() - QCS_METERBANK_CLIP_HEIGHT, 0);
+    double pos;
+    if (m_dbRange > 0.0) {
+        pos = value > 0.0 ? 1.0 + 20.0 * log10(value) / m_dbRange : 0.0;
+    } else {
+        pos = value;
+    }
+    return (int) (qBound(0.0, pos, 1.0) * height + 0.5);
+}
+
+QRect MeterBankWidget::columnRect(int index)
+{
+    // Columns share the width evenly with a one pixel gap between them
+    int count = m_meters.size();
+    int x0 = index * width() / count;
+    int x1 = (index + 1) * width() / count;
+    return QRect(x0, 0, qMax(x1 - x0 - 1, 1), height());
+}
+
+void MeterBankWidget::updateColumn(int index, int top, int bottom)
+{
+    // top and bottom are heights from the bottom edge, in pixels
+    QRect column = columnRect(index);
+    int y = height() - top - 2;  // The hold line is 2 pixels high
+    update(QRect(column.x(), y, column.width(), top - bottom + 3));
+}
+
+void MeterBankWidget::setValues(const double *values, int count)
+{
+    count = qMin(count, m_meters.size());
+    const qint64 now = m_clock.elapsed();
+    for (int i = 0; i < count; i++) {
+        Meter &meter = m_meters[i];
+        double value = values[i];
+        meter.value = value;
+        if (value >= meter.holdValue || now >= meter.holdExpires) {
+            meter.holdValue = value;
+            meter.holdExpires = now + m_holdMs;
+        }
+        int bar = toPixels(value);
+        int hold = m_holdMs > 0 ? toPixels(meter.holdValue) : 0;
+        if (bar != meter.bar || hold != meter.hold) {
+            int top = qMax(qMax(bar, meter.bar), qMax(hold, meter.hold));
+            int bottom = qMin(qMin(bar, meter.bar), qMin(hold, meter.hold));
+            meter.bar = bar;
+            meter.hold = hold;
+            updateColumn(i, top, bottom);
+        }
+        if (value >= 1.0 && !meter.clip) {
+            meter.clip = true;
+            QRect column = columnRect(i);
+            update(QRect(column.x(), 0, column.width(), QCS_METERBANK_CLIP_HEIGHT));
+        }
+    }
+}
+
+void MeterBankWidget::paintEvent(QPaintEvent *event)
+{
+    QPainter painter(this);
+    const QRect dirty = event->rect();
+    painter.fillRect(dirty, m_bgcolor);
+    int count = m_meters.size();
+    if (count == 0 || width() == 0) {
+        return;
+    }
+    // Only visit the columns that overlap the dirty rectangle
+    int first = qMax(dirty.left() * count / width() - 1, 0);
+    int last = qMin(dirty.right() * count / width() + 1, count - 1);
+    const int h = height();
+    for (int i = first; i <= last; i++) {
+        const Meter &meter = m_meters[i];
+        QRect column = columnRect(i);
+        if (!column.intersects(dirty)) {
+            continue;
+        }
+        painter.fillRect(column.x(), 0, column.width(), QCS_METERBANK_CLIP_HEIGHT - 1,
+                         meter.clip ? m_clipColor : m_clipOffColor);
+        if (meter.bar > 0) {
+            painter.fillRect(column.x(), h - meter.bar, column.width(), meter.bar, m_color);
+        }
+        if (meter.hold > 0) {
+            painter.fillRect(column.x(), h - meter.hold, column.width(), 2, m_holdColor);
+        }
+    }
+}
+
+void MeterBankWidget::resizeEvent(QResizeEvent *event)
+{
+    QWidget::resizeEvent(event);
+    for (int i = 0; i < m_meters.size(); i++) {
+        m_meters[i].bar = toPixels(m_meters[i].value);
+        m_meters[i].hold = m_holdMs > 0 ? toPixels(m_meters[i].holdValue) : 0;
+    }
+}
+
+void MeterBankWidget::mousePressEvent(QMouseEvent *event)
+{
+    for (int i = 0; i < m_meters.size(); i++) {
+        m_meters[i].clip = false;
+    }
+    update(0, 0, width(), QCS_METERBANK_CLIP_HEIGHT);
+    QWidget::mousePressEvent(event);
+}
+
+// -------------------------
+
+QuteMeterBank::QuteMeterBank(QWidget *parent) : QuteWidget(parent)
+{
+    m_widget = new MeterBankWidget(this);
+    m_widget->setContextMenuPolicy(Qt::NoContextMenu);
+    m_widget->setMouseTracking(true); // Necessary to pass mouse tracking to widget panel for _MouseX channels
+    canFocus(false);
+    m_useLevels = false;
+    m_kind = OutputLevels::Peak;
+    m_firstChannel = 1;
+    m_resolvedFor = nullptr;
+
+    setProperty("QCS_meters", 8);
+    setProperty("QCS_firstChannel", 1);
+    setProperty("QCS_dbRange", 60.0);
+    setProperty("QCS_holdTime", 1.5);
+    setProperty("QCS_color", QColor(Qt::green));
+    setProperty("QCS_bgcolor", QColor(30, 30, 30));
+    setProperty("QCS_randomizable", false);
+}
+
+QuteMeterBank::~QuteMeterBank()
+{
+}
+
+void QuteMeterBank::applyInternalProperties()
+{
+    QuteWidget::applyInternalProperties();
+    auto w = static_cast<MeterBankWidget*>(m_widget);
+    w->setCount(property("QCS_meters").toInt());
+    w->setColors(property("QCS_color").value<QColor>(),
+                 property("QCS_bgcolor").value<QColor>(),
+                 Qt::white, Qt::red);
+    w->setHoldTime(property("QCS_holdTime").toDouble());
+    w->setDbRange(property("QCS_dbRange").toDouble());
+    m_firstChannel = qMax(property("QCS_firstChannel").toInt(), 1);
+    m_useLevels = OutputLevels::parseKindName(m_channel.toLatin1().constData(), &m_kind);
+    m_values.resize(w->count());
+    m_channelPtrs.clear();
+    m_resolvedFor = nullptr;
+}
+
+void QuteMeterBank::setCsoundUserData(CsoundUserData *ud)
+{
+    if (ud == nullptr) {
+        qDebug() << "CsoundUserData is null";
+        return;
+    }
+    m_csoundUserData = ud;
+    connect(ud->csEngine, SIGNAL(stopSignal()), this, SLOT(onStop()), Qt::UniqueConnection);
+}
+
+void QuteMeterBank::resolveChannels(CSOUND *csound)
+{
+    // Looked up once per run, after that every refresh is a plain read
+    m_channelPtrs.clear();
+    for (int i = 0; i < m_values.size(); i++) {
+        MYFLT *pvalue = nullptr;
+        QByteArray name = (m_channel + QString::number(m_firstChannel + i)).toLatin1();
+        if (csoundGetChannelPtr(csound, &pvalue, name.constData(),
+                                CSOUND_CONTROL_CHANNEL | CSOUND_OUTPUT_CHANNEL) != CSOUND_SUCCESS) {
+            pvalue = nullptr;
+        }
+        m_channelPtrs << pvalue;
+    }
+    m_resolvedFor = csound;
+}
+
+void QuteMeterBank::updateMeters(const OutputLevels *levels)
+{
+    if (m_channel.isEmpty() || m_values.isEmpty()) {
+        return;
+    }
+    if (m_useLevels) {
+        if (levels == nullptr || !levels->isEnabled()) {
+            return;
+        }
+        for (int i = 0; i < m_values.size(); i++) {
+            m_values[i] = levels->value(m_kind, m_firstChannel - 1 + i);
+        }
+    } else {
+        CsoundUserData *ud = m_csoundUserData;
+        if (ud == nullptr || ud->csound == nullptr || ud->csEngine == nullptr
+                || !ud->csEngine->isRunning()) {
+            return;
+        }
+        if (m_resolvedFor != ud->csound) {
+            resolveChannels(ud->csound);
+        }
+        for (int i = 0; i < m_values.size(); i++) {
+            m_values[i] = m_channelPtrs[i] != nullptr ? *m_channelPtrs[i] : 0.0;
+        }
+    }
+    static_cast<MeterBankWidget*>(m_widget)->setValues(m_values.constData(), m_values.size());
+}
+
+void QuteMeterBank::onStop()
+{
+    m_channelPtrs.clear();
+    m_resolvedFor = nullptr;
+    static_cast<MeterBankWidget*>(m_widget)->resetMeters();
+}
+
+void QuteMeterBank::createPropertiesDialog()
+{
+    QuteWidget::createPropertiesDialog();
+    dialog->setWindowTitle("Meter Bank");
+    nameLineEdit->setToolTip(tr("_OutPeak, _OutRms or _OutTruePeak to show the output levels, "
+                                "otherwise meter N reads the channel named <channel>N"));
+
+    QLabel *label = new QLabel(dialog);
+    label->setText(tr("Meters"));
+    layout->addWidget(label, 4, 0, Qt::AlignRight|Qt::AlignVCenter);
+    metersSpinBox = new QSpinBox(dialog);
+    metersSpinBox->setRange(1, QCS_METERBANK_MAX_METERS);
+    metersSpinBox->setValue(property("QCS_meters").toInt());
+    layout->addWidget(metersSpinBox, 4, 1, Qt::AlignLeft|Qt::AlignVCenter);
+
+    label = new QLabel(dialog);
+    label->setText(tr("First channel"));
+    layout->addWidget(label, 4, 2, Qt::AlignRight|Qt::AlignVCenter);
+    firstChannelSpinBox = new QSpinBox(dialog);
+    firstChannelSpinBox->setRange(1, QCS_MAX_LEVEL_CHANNELS);
+    firstChannelSpinBox->setValue(property("QCS_firstChannel").toInt());
+    layout->addWidget(firstChannelSpinBox, 4, 3, Qt::AlignLeft|Qt::AlignVCenter);
+
+    label = new QLabel(dialog);
+    label->setText(tr("dB range"));
+    layout->addWidget(label, 5, 0, Qt::AlignRight|Qt::AlignVCenter);
+    dbRangeSpinBox = new QDoubleSpinBox(dialog);
+    dbRangeSpinBox->setRange(0.0, 200.0);
+    dbRangeSpinBox->setToolTip(tr("Range of the scale in dB. 0 uses a linear scale"));
+    dbRangeSpinBox->setValue(property("QCS_dbRange").toDouble());
+    layout->addWidget(dbRangeSpinBox, 5, 1, Qt::AlignLeft|Qt::AlignVCenter);
+
+    label = new QLabel(dialog);
+    label->setText(tr("Peak hold (s)"));
+    layout->addWidget(label, 5, 2, Qt::AlignRight|Qt::AlignVCenter);
+    holdTimeSpinBox = new QDoubleSpinBox(dialog);
+    holdTimeSpinBox->setRange(0.0, 60.0);
+    holdTimeSpinBox->setSingleStep(0.5);
+    holdTimeSpinBox->setToolTip(tr("0 hides the peak hold line"));
+    holdTimeSpinBox->setValue(property("QCS_holdTime").toDouble());
+    layout->addWidget(holdTimeSpinBox, 5, 3, Qt::AlignLeft|Qt::AlignVCenter);
+
+    label = new QLabel(dialog);
+    label->setText(tr("Color"));
+    layout->addWidget(label, 6, 0, Qt::AlignRight|Qt::AlignVCenter);
+    colorButton = new SelectColorButton(dialog);
+    colorButton->setColor(property("QCS_color").value<QColor>());
+    layout->addWidget(colorButton, 6, 1, Qt::AlignLeft|Qt::AlignVCenter);
+
+    label = new QLabel(dialog);
+    label->setText(tr("Background"));
+    layout->addWidget(label, 6, 2, Qt::AlignRight|Qt::AlignVCenter);
+    bgColorButton = new SelectColorButton(dialog);
+    bgColorButton->setColor(property("QCS_bgcolor").value<QColor>());
+    layout->addWidget(bgColorButton, 6, 3, Qt::AlignLeft|Qt::AlignVCenter);
+}
+
+void QuteMeterBank::applyProperties()
+{
+#ifdef  USE_WIDGET_MUTEX
+    widgetLock.lockForWrite();
+#endif
+    setProperty("QCS_meters", metersSpinBox->value());
+    setProperty("QCS_firstChannel", firstChannelSpinBox->value());
+    setProperty("QCS_dbRange", dbRangeSpinBox->value());
+    setProperty("QCS_holdTime", holdTimeSpinBox->value());
+    setProperty("QCS_color", colorButton->getColor());
+    setProperty("QCS_bgcolor", bgColorButton->getColor());
+#ifdef  USE_WIDGET_MUTEX
+    widgetLock.unlock();
+#endif
+    QuteWidget::applyProperties();
+}
+
+QString QuteMeterBank::getWidgetXmlText()
+{
+    xmlText = "";
+    QXmlStreamWriter s(&xmlText);
+    createXmlWriter(s);
+
+#ifdef  USE_WIDGET_MUTEX
+    widgetLock.lockForRead();
+#endif
+    s.writeTextElement("meters", QString::number(property("QCS_meters").toInt()));
+    s.writeTextElement("firstChannel", QString::number(property("QCS_firstChannel").toInt()));
+    s.writeTextElement("dbRange", QString::number(property("QCS_dbRange").toDouble(), 'f', 2));
+    s.writeTextElement("holdTime", QString::number(property("QCS_holdTime").toDouble(), 'f', 2));
+
+    QColor color = property("QCS_color").value<QColor>();
+    s.writeStartElement("color");
+    s.writeTextElement("r", QString::number(color.red()));
+    s.writeTextElement("g", QString::number(color.green()));
+    s.writeTextElement("b", QString::number(color.blue()));
+    s.writeEndElement();
+
+    QColor bgcolor = property("QCS_bgcolor").value<QColor>();
+    s.writeStartElement("bgcolor");
+    s.writeTextElement("r", QString::number(bgcolor.red()));
+    s.writeTextElement("g", QString::number(bgcolor.green()));
+    s.writeTextElement("b", QString::number(bgcolor.blue()));
+    s.writeEndElement();
+
+    s.writeEndElement();
+#ifdef  USE_WIDGET_MUTEX
+    widgetLock.unlock();
+#endif
+    return xmlText;
+}
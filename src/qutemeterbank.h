@@ -0,0 +1,105 @@
+#ifndef QUTEMETERBANK_H
+#define QUTEMETERBANK_H
+
+#include <QElapsedTimer>
+
+#include "qutewidget.h"
+#include "outputlevels.h"
+#include "selectcolorbutton.h"
+
+// Height in pixels of the clip indicator above each bar
+#define QCS_METERBANK_CLIP_HEIGHT 5
+#define QCS_METERBANK_MAX_METERS 256
+
+// A row of vertical level meters drawn by a single widget. The values for
+// the whole bank are pushed once per refresh, peak hold and clip state are
+// computed there, and only the part of each bar whose pixels changed is
+// scheduled for repaint.
+class MeterBankWidget : public QWidget
+{
+    Q_OBJECT
+
+public:
+    MeterBankWidget(QWidget *parent = nullptr);
+    void setCount(int count);
+    int count() { return m_meters.size(); }
+    void setColors(QColor color, QColor bgcolor, QColor holdColor, QColor clipColor);
+    void setDbRange(double dbRange);  // 0 for a linear scale
+    void setHoldTime(double seconds) { m_holdMs = (qint64) (seconds * 1000); }
+    void setValues(const double *values, int count);  // Linear, 1.0 is full scale
+    void resetMeters();
+
+protected:
+    virtual void paintEvent(QPaintEvent *event) override;
+    virtual void resizeEvent(QResizeEvent *event) override;
+    virtual void mousePressEvent(QMouseEvent *event) override;  // Clears the clip indicators
+
+private:
+    struct Meter {
+        double value;
+        double holdValue;
+        qint64 holdExpires;
+        int bar;   // Bar height in pixels
+        int hold;  // Height of the peak hold line in pixels, 0 if not shown
+        bool clip;
+    };
+
+    int toPixels(double value);
+    QRect columnRect(int index);
+    void updateColumn(int index, int top, int bottom);
+
+    QVector<Meter> m_meters;
+    QColor m_color;
+    QColor m_bgcolor;
+    QColor m_holdColor;
+    QColor m_clipColor;
+    QColor m_clipOffColor;
+    double m_dbRange;
+    qint64 m_holdMs;
+    QElapsedTimer m_clock;
+};
+
+class QuteMeterBank : public QuteWidget
+{
+    Q_OBJECT
+
+public:
+    QuteMeterBank(QWidget *parent);
+    ~QuteMeterBank();
+    virtual QString getWidgetLine() { return QString(""); }
+    virtual QString getWidgetXmlText();
+    virtual QString getWidgetType() { return QString("BSBMeterBank"); }
+    virtual void applyInternalProperties();
+    virtual void setCsoundUserData(CsoundUserData *ud);
+    // Called by the layout once per refresh
+    void updateMeters(const OutputLevels *levels);
+
+public slots:
+    void onStop();
+
+protected:
+    virtual void createPropertiesDialog();
+    virtual void applyProperties();
+
+    QSpinBox *metersSpinBox;
+    QSpinBox *firstChannelSpinBox;
+    QDoubleSpinBox *dbRangeSpinBox;
+    QDoubleSpinBox *holdTimeSpinBox;
+    SelectColorButton *colorButton;
+    SelectColorButton *bgColorButton;
+
+private:
+    void resolveChannels(CSOUND *csound);
+
+    // If the channel is _OutPeak, _OutRms or _OutTruePeak meters show the
+    // engine's output levels, otherwise they read the control channels
+    // <channel>N, with N starting from the first channel property
+    bool m_useLevels;
+    OutputLevels::Kind m_kind;
+    int m_firstChannel;
+    CSOUND *m_resolvedFor;
+    QVector<MYFLT *> m_channelPtrs;
+    QVector<double> m_values;
+};
+
+#endif // QUTEMETERBANK_H
@@ -22,10 +22,73 @@
 
 #include "qutescope.h"
 #include <cmath>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define QCS_SCOPE_SSE2
+#endif
 #include "types.h"  //necessary for the userdata struct
 #include "qutecsound.h"  //necessary for the userdata struct
 
 
+//
+// Read access to the samples shown by a display: the output ring buffer, or
+// the audio tap chosen as the scope source. The output buffer stays locked
+// while this object exists, taps are read without locking.
+//
+class ScopeSource
+{
+public:
+	ScopeSource(CsoundUserData *ud, AudioTap *tap)
+	{
+		m_buffer = nullptr;
+		m_list = nullptr;
+		m_data = nullptr;
+		if (tap != nullptr) {
+			m_data = tap->data();
+			m_size = tap->size();
+			m_writePos = tap->writePos();
+			m_numChnls = tap->channels();
+		}
+		else {
+			m_buffer = &ud->audioOutputBuffer;
+			m_buffer->lock();
+			m_list = &m_buffer->buffer;
+			m_size = m_list->size();
+			m_writePos = m_buffer->currentPos;
+			m_numChnls = ud->numChnls;
+		}
+	}
+	~ScopeSource()
+	{
+		if (m_buffer != nullptr) {
+			m_buffer->unlock();
+		}
+	}
+	MYFLT operator[](long index) const
+	{
+		return m_data != nullptr ? m_data[index] : m_list->at(index);
+	}
+	long size() const { return m_size; }
+	long writePos() const { return m_writePos; }
+	int numChnls() const { return m_numChnls; }
+	void setReadPos(long pos)
+	{
+		// Only the output buffer keeps a read position
+		if (m_buffer != nullptr) {
+			m_buffer->currentReadPos = pos;
+		}
+	}
+
+private:
+	RingBuffer *m_buffer;
+	const QList<MYFLT> *m_list;
+	const MYFLT *m_data;
+	long m_size;
+	long m_writePos;
+	int m_numChnls;
+};
+
+
 QuteScope::QuteScope(QWidget *parent) : QuteWidget(parent)
 {
 	QGraphicsScene *m_scene = new QGraphicsScene(this);
@@ -76,10 +139,15 @@ QuteScope::QuteScope(QWidget *parent) : QuteWidget(parent)
 	setProperty("QCS_dispy", 1.0);
 	setProperty("QCS_mode", "lin");
     setProperty("QCS_triggermode", "NoTrigger");
+	setProperty("QCS_persistence", 0.85);
+	setProperty("QCS_source", "");
 }
 
 QuteScope::~QuteScope()
 {
+	if (m_params->ud != nullptr) {
+		m_params->ud->audioTaps.unsubscribe(m_params->tap);
+	}
 	delete m_poincareData;
 	delete m_lissajouData;
 	delete m_scopeData;
@@ -137,6 +205,8 @@ QString QuteScope::getWidgetXmlText()
 	s.writeTextElement("dispy", QString::number(property("QCS_dispy").toDouble(), 'f', 8));
     s.writeTextElement("mode",  QString::number(property("QCS_mode").toDouble(), 'f', 8));
     s.writeTextElement("triggermode", property("QCS_triggermode").toString());
+	s.writeTextElement("persistence", QString::number(property("QCS_persistence").toDouble(), 'f', 8));
+	s.writeTextElement("source", property("QCS_source").toString());
 	s.writeEndElement();
 #ifdef  USE_WIDGET_MUTEX
 	widgetLock.unlock();
@@ -173,7 +243,37 @@ void QuteScope::setValue(double value)
 
 void QuteScope::setUd(CsoundUserData *ud)
 {
+	if (ud == m_params->ud) {
+		return;
+	}
+	if (m_params->ud != nullptr) {
+		m_params->ud->audioTaps.unsubscribe(m_params->tap);
+		m_params->tap = nullptr;
+	}
 	m_params->ud = ud;
+	updateTap();
+}
+
+void QuteScope::updateTap()
+{
+	// An empty source shows the output, anything else is an audio tap
+	QString source = property("QCS_source").toString();
+	AudioTap *tap = m_params->tap;
+	if (tap != nullptr && tap->name() == source) {
+		return;
+	}
+	CsoundUserData *ud = m_params->ud;
+	if (ud == nullptr) {
+		return;
+	}
+	ud->audioTaps.unsubscribe(tap);
+	m_params->tap = source.isEmpty() ? nullptr : ud->audioTaps.subscribe(source);
+	if (!source.isEmpty() && m_params->tap == nullptr) {
+		ud->csEngine->queueMessage(tr("Scope: all %1 audio taps are in use, showing the output instead of %2.\n")
+								   .arg(QCS_MAX_AUDIO_TAPS).arg(source));
+	}
+	m_dataDisplay->hide();  // Restart the display from the new source
+	m_dataDisplay->show();
 }
 
 void QuteScope::updateLabel()
@@ -188,7 +288,8 @@ void QuteScope::updateLabel()
 	else {
 		chan =  QString::number((int) m_value );
 	}
-	m_label->setText(tr("Scope ch:") + chan);
+	QString source = property("QCS_source").toString();
+	m_label->setText(tr("Scope ch:") + chan + (source.isEmpty() ? QString() : " " + source));
 }
 
 
@@ -198,6 +299,9 @@ void QuteScope::applyInternalProperties()
 	setType(property("QCS_type").toString());
 	setValue(property("QCS_value").toDouble());
     m_params->triggerMode = triggerNameToMode(property("QCS_triggermode").toString());
+	m_params->persistence = property("QCS_persistence").toDouble();
+	updateTap();
+	updateLabel();
 }
 
 void QuteScope::createPropertiesDialog()
@@ -256,6 +360,24 @@ void QuteScope::createPropertiesDialog()
     triggerBox->addItem("Trigger Up", "TriggerUp");
     triggerBox->setCurrentIndex(triggerBox->findData(property("QCS_triggermode").toString()));
     layout->addWidget(triggerBox, 9, 1, Qt::AlignLeft|Qt::AlignVCenter);
+
+	label = new QLabel("Persistence");
+	layout->addWidget(label, 9, 2, Qt::AlignRight|Qt::AlignVCenter);
+	persistenceBox = new QDoubleSpinBox(dialog);
+	persistenceBox->setRange(0, 0.99);
+	persistenceBox->setSingleStep(0.05);
+	persistenceBox->setToolTip(tr("Brightness kept from one frame to the next in Lissajou "
+								  "and Poincare displays. 0 shows only the latest samples"));
+	persistenceBox->setValue(property("QCS_persistence").toDouble());
+	layout->addWidget(persistenceBox, 9, 3, Qt::AlignLeft|Qt::AlignVCenter);
+
+	label = new QLabel("Source");
+	layout->addWidget(label, 10, 0, Qt::AlignRight|Qt::AlignVCenter);
+	sourceEdit = new QLineEdit(dialog);
+	sourceEdit->setToolTip(tr("Leave empty to show the output. _In shows the input, "
+							  "any other name an a-rate channel written with chnset"));
+	sourceEdit->setText(property("QCS_source").toString());
+	layout->addWidget(sourceEdit, 10, 1, 1, 3, Qt::AlignLeft|Qt::AlignVCenter);
 #ifdef  USE_WIDGET_MUTEX
 	widgetLock.unlock();
 #endif
@@ -273,6 +395,9 @@ void QuteScope::applyProperties()
     auto triggerModeStr = triggerBox->currentData().toString();
     setProperty("QCS_triggermode", triggerModeStr);
     m_params->triggerMode = triggerNameToMode(triggerModeStr);
+	setProperty("QCS_persistence", persistenceBox->value());
+	m_params->persistence = persistenceBox->value();
+	setProperty("QCS_source", sourceEdit->text().trimmed());
 #ifdef  USE_WIDGET_MUTEX
 	widgetLock.unlock();
 #endif
@@ -301,38 +426,87 @@ void QuteScope::updateData()
                               static_cast<ScopeWidget *>(m_widget)->freeze);
 }
 
-ScopeItem::ScopeItem(int width, int height)
+PersistenceItem::PersistenceItem(int width, int height)
 {
-	m_width = width;
-	m_height = height;
+	m_pixels = nullptr;
+	m_stride = 0;
+	m_decay = 0;
+	setColor(Qt::green);
+	setSize(width, height);
 }
 
-void ScopeItem::paint(QPainter *p,
-                      const QStyleOptionGraphicsItem */*option*/,
-                      QWidget */*widget*/)
+void PersistenceItem::paint(QPainter *p,
+                            const QStyleOptionGraphicsItem */*option*/,
+                            QWidget */*widget*/)
 {
-	p->setPen(m_pen);
-	p->drawPoints(m_polygon);
+	p->drawImage(QPointF(-m_width/2, -m_height/2), m_image);
 }
 
-void ScopeItem::setPen(const QPen & pen)
+void PersistenceItem::setColor(const QColor & color)
 {
-	m_pen = pen;
+	m_color = qPremultiply(color.rgba());
 }
 
-void ScopeItem::setPolygon(const QPolygonF & polygon)
+void PersistenceItem::setDecay(double decay)
 {
-	m_polygon = polygon;
-	update(boundingRect());
+	m_decay = qBound(0, (int)(decay * 256), 255);
 }
 
-void ScopeItem::setSize(int width, int height)
+void PersistenceItem::setSize(int width, int height)
 {
-	m_width = width;
-	m_height = height;
+	m_width = width > 0 ? width : 1;
+	m_height = height > 0 ? height : 1;
+	m_image = QImage(m_width, m_height, QImage::Format_ARGB32_Premultiplied);
+	m_image.fill(Qt::transparent);
+	m_pixels = reinterpret_cast<quint32 *>(m_image.bits());
+	m_stride = m_image.bytesPerLine() / sizeof(quint32);
 	prepareGeometryChange();
 }
 
+void PersistenceItem::fade()
+{
+	m_pixels = reinterpret_cast<quint32 *>(m_image.bits());
+	if (m_decay == 0) {
+		m_image.fill(Qt::transparent);
+		return;
+	}
+	// All four channels are scaled by the same factor, so pixels stay
+	// valid premultiplied values
+	uchar *bytes = m_image.bits();
+	int numBytes = m_image.bytesPerLine() * m_image.height();
+	int i = 0;
+#ifdef QCS_SCOPE_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i factor = _mm_set1_epi16((short) m_decay);
+	for (; i + 16 <= numBytes; i += 16) {
+		__m128i px = _mm_loadu_si128(reinterpret_cast<__m128i *>(bytes + i));
+		__m128i lo = _mm_unpacklo_epi8(px, zero);
+		__m128i hi = _mm_unpackhi_epi8(px, zero);
+		lo = _mm_srli_epi16(_mm_mullo_epi16(lo, factor), 8);
+		hi = _mm_srli_epi16(_mm_mullo_epi16(hi, factor), 8);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(bytes + i), _mm_packus_epi16(lo, hi));
+	}
+#endif
+	for (; i < numBytes; i++) {
+		bytes[i] = (uchar) ((bytes[i] * m_decay) >> 8);
+	}
+}
+
+void PersistenceItem::plot(int x, int y)
+{
+	x += m_width/2;
+	y += m_height/2;
+	if ((unsigned) x < (unsigned) m_width && (unsigned) y < (unsigned) m_height) {
+		m_pixels[y * m_stride + x] = m_color;
+	}
+}
+
+void PersistenceItem::clear()
+{
+	m_image.fill(Qt::transparent);
+	update(boundingRect());
+}
+
 ScopeData::ScopeData(ScopeParams *params) : DataDisplay(params)
 {
 	curveData.resize(m_params->width + 2);
@@ -359,12 +533,7 @@ void ScopeData::updateData(int channel, double zoomx, double zoomy, bool freeze)
 	if (freeze)
 		return;
 	double value;
-	int numChnls = ud->numChnls;
 	MYFLT newValue;
-    if (channel == 0 || channel > numChnls ) {
-        return;
-	}
-	channel = (channel < 0 ? -1: channel - 1);
 #ifdef  USE_WIDGET_MUTEX
     //FIXME is this locking needed, or should a separate locking mechanism be implemented?
     QReadWriteLock *mutex = m_params->mutex;
@@ -372,12 +541,18 @@ void ScopeData::updateData(int channel, double zoomx, double zoomy, bool freeze)
 #endif
     // FIXME how to make sure the buffer is read before it is flushed when recorded?
     // Have another buffer?
-	RingBuffer *buffer = &ud->audioOutputBuffer;
-	buffer->lock();
-	QList<MYFLT> list = buffer->buffer;
-	buffer->unlock();
+	ScopeSource list(ud, m_params->tap);
+	int numChnls = list.numChnls();
+	// Nothing to show until the tap has resolved
+    if (numChnls <= 0 || list.size() <= 0 || channel == 0 || channel > numChnls ) {
+#ifdef  USE_WIDGET_MUTEX
+		mutex->unlock();
+#endif
+        return;
+	}
+	channel = (channel < 0 ? -1: channel - 1);
 	long listSize = list.size();
-    long offset = buffer->currentPos;
+    long offset = list.writePos();
     long dataToRead = width;
     // search for trig
     long trigOffset = 0;
@@ -401,7 +576,7 @@ void ScopeData::updateData(int channel, double zoomx, double zoomy, bool freeze)
                 int baseidx = (int)((offset + (int)(i*numChnls*zoomx)) % listSize);
                 double value = 0;
                 for(int chan = 0; chan < numChnls; chan++) {
-                    double newValue = list[baseidx+chan];
+                    double newValue = list[(baseidx+chan) % listSize];
                     if(fabs(newValue) > fabs(value))
                         value = newValue;
                 }
@@ -413,7 +588,7 @@ void ScopeData::updateData(int channel, double zoomx, double zoomy, bool freeze)
             }
 
         }
-        offset += trigOffset;
+        offset = (offset + trigOffset + listSize) % listSize;
     }
     double factor = numChnls * zoomx;
     int halfheight = height/2;
@@ -463,7 +638,7 @@ void ScopeData::updateData(int channel, double zoomx, double zoomy, bool freeze)
 	}
     */
     // buffer->currentReadPos += width;
-    buffer->currentReadPos = (offset + dataToRead) % buffer->size;
+    list.setReadPos((offset + dataToRead) % listSize);
 	m_params->widget->setSceneRect(0, -height/2, width, height );
 	curveData.last() = QPoint(width-4, 0);
 	curveData.first() = QPoint(0, 0);
@@ -485,26 +660,22 @@ void ScopeData::hide()
 
 LissajouData::LissajouData(ScopeParams *params) : DataDisplay(params)
 {
-	curveData.resize(m_params->width);
-	curve = new ScopeItem(m_params->width, m_params->height);
-    auto pen = QPen(Qt::green);
-    pen.setCosmetic(true);
-    curve->setPen(pen);
+	curve = new PersistenceItem(m_params->width, m_params->height);
+	curve->setColor(QColor("#40FF40"));
 	curve->hide();
+	lastReadPos = -1;
 	m_params->scene->addItem(curve);
 }
 
 void LissajouData::resize()
 {
-	// We take 8 times the display width points for each pass
-	// to have a smooth animation
-	curveData.resize(m_params->width * 8);
 	curve->setSize(m_params->width, m_params->height);
 }
 
 void LissajouData::updateData(int channel, double zoomx, double zoomy, bool freeze)
 {
-	// The decimation factor (zoom) is not used here
+	// Every frame written since the last pass is plotted, the decimation
+	// factor (zoom) is not used here
 	CsoundUserData *ud = m_params->ud;
 	int width = m_params->width;
 	int height = m_params->height;
@@ -512,33 +683,43 @@ void LissajouData::updateData(int channel, double zoomx, double zoomy, bool free
 		return;
 	if (freeze)
 		return;
-	double x, y;
-	int numChnls = ud->numChnls;
+#ifdef  USE_WIDGET_MUTEX
+	QReadWriteLock *mutex = m_params->mutex;
+	mutex->lockForWrite();
+#endif
+	ScopeSource list(ud, m_params->tap);
+	int numChnls = list.numChnls();
 	// We take two consecutives channels, the first one for abscissas and
 	// the second one for ordinates
-    if (channel == 0 || channel >= numChnls || numChnls < 2) {
+    if (channel == 0 || channel >= numChnls || numChnls < 2 || list.size() <= 0) {
+#ifdef  USE_WIDGET_MUTEX
+		mutex->unlock();
+#endif
         return;
 	}
 	channel = (channel < 0 ? 0 : channel - 1);
-#ifdef  USE_WIDGET_MUTEX
-	QReadWriteLock *mutex = m_params->mutex;
-	mutex->lockForWrite();
-#endif
-	RingBuffer *buffer = &ud->audioOutputBuffer;
-	buffer->lock();
-	QList<MYFLT> list = buffer->buffer;
-	buffer->unlock();
+	double scalex = width*zoomx/4;
+	double scaley = height*zoomy/4;
+	curve->setDecay(m_params->persistence);
+	curve->fade();
 	long listSize = list.size();
-	long offset = buffer->currentPos;
-	for (int i = 0; i < curveData.size(); i++) {
-		int bufferIndex = (int)((i*numChnls) + offset + channel) % listSize;
-		x = (double)list[bufferIndex];
-        bufferIndex = (bufferIndex + 1) % listSize;
-        y = (double) -list[bufferIndex];
-		curveData[i] = QPoint(x*width*zoomx/4, y*height*zoomy/4);
+	long writePos = list.writePos();
+	long available = (writePos - lastReadPos + listSize) % listSize;
+	if (lastReadPos < 0 || lastReadPos >= listSize) {
+		available = listSize - numChnls;
+	}
+	long numFrames = available / numChnls;
+	long bufferIndex = (writePos - numFrames*numChnls + listSize) % listSize;
+	for (long i = 0; i < numFrames; i++) {
+		long index = (bufferIndex + channel) % listSize;
+		double x = (double) list[index];
+		double y = (double) -list[(index + 1) % listSize];
+		curve->plot((int) (x*scalex), (int) (y*scaley));
+		bufferIndex = (bufferIndex + numChnls) % listSize;
 	}
+	lastReadPos = writePos;
 	m_params->widget->setSceneRect(-width/2, -height/2, width, height );
-	curve->setPolygon(curveData);
+	curve->update(curve->boundingRect());
 #ifdef  USE_WIDGET_MUTEX
 	mutex->unlock();
 #endif
@@ -546,6 +727,8 @@ void LissajouData::updateData(int channel, double zoomx, double zoomy, bool free
 
 void LissajouData::show()
 {
+	curve->clear();
+	lastReadPos = -1;
 	curve->show();
 }
 
@@ -556,24 +739,21 @@ void LissajouData::hide()
 
 PoincareData::PoincareData(ScopeParams *params) : DataDisplay(params)
 {
-	curveData.resize(m_params->width);
-	curve = new ScopeItem(m_params->width, m_params->height);
-    curve->setPen(QPen(Qt::green, 0));
+	curve = new PersistenceItem(m_params->width, m_params->height);
+	curve->setColor(Qt::green);
 	curve->hide();
-	lastValue = 0.0;
+	lastReadPos = -1;
 	m_params->scene->addItem(curve);
 }
 
 void PoincareData::resize()
 {
-	// We take 8 times the display width points for each pass
-	// to have a smooth animation
-	curveData.resize(m_params->width * 8);
 	curve->setSize(m_params->width, m_params->height);
 }
 
 void PoincareData::updateData(int channel, double zoomx, double zoomy, bool freeze)
 {
+	// Each sample is plotted against the one zoomx frames before it
 	CsoundUserData *ud = m_params->ud;
 	int width = m_params->width;
 	int height = m_params->height;
@@ -581,30 +761,42 @@ void PoincareData::updateData(int channel, double zoomx, double zoomy, bool free
 		return;
 	if (freeze)
 		return;
-	double value;
-	int numChnls = ud->numChnls;
-    if (channel == 0 || channel > numChnls) {
-        return;
-	}
-	channel = (channel < 0 ? 0 :  channel - 1);
 #ifdef  USE_WIDGET_MUTEX
 	QReadWriteLock *mutex = m_params->mutex;
 	mutex->lockForWrite();
 #endif
-	RingBuffer *buffer = &ud->audioOutputBuffer;
-	buffer->lock();
-	QList<MYFLT> list = buffer->buffer;
-	buffer->unlock();
+	ScopeSource list(ud, m_params->tap);
+	int numChnls = list.numChnls();
+    if (numChnls <= 0 || list.size() <= 0 || channel == 0 || channel > numChnls) {
+#ifdef  USE_WIDGET_MUTEX
+		mutex->unlock();
+#endif
+        return;
+	}
+	channel = (channel < 0 ? 0 :  channel - 1);
+	double scalex = width*zoomx/2;
+	double scaley = height*zoomy/2;
+	curve->setDecay(m_params->persistence);
+	curve->fade();
 	long listSize = list.size();
-	long offset = buffer->currentPos;
-	for (int i = 0; i < curveData.size(); i++) {
-		int bufferIndex = (int)((i*zoomx*numChnls) + offset + channel) % listSize;
-		value = (double)list[bufferIndex];
-		curveData[i] = QPoint(lastValue*width*zoomx/2, -value*height*zoomy/2);
-		lastValue = value;
+	long writePos = list.writePos();
+	long delay = ((long) zoomx > 0 ? (long) zoomx : 1) * numChnls;
+	long available = (writePos - lastReadPos + listSize) % listSize;
+	if (lastReadPos < 0 || lastReadPos >= listSize) {
+		available = listSize - delay;
+	}
+	long numFrames = qMin(available, listSize - delay) / numChnls;
+	long bufferIndex = (writePos - numFrames*numChnls + listSize) % listSize;
+	for (long i = 0; i < numFrames; i++) {
+		long index = (bufferIndex + channel) % listSize;
+		double x = (double) list[(index - delay + listSize) % listSize];
+		double y = (double) list[index];
+		curve->plot((int) (x*scalex), (int) (-y*scaley));
+		bufferIndex = (bufferIndex + numChnls) % listSize;
 	}
+	lastReadPos = writePos;
 	m_params->widget->setSceneRect(-width/2, -height/2, width, height );
-	curve->setPolygon(curveData);
+	curve->update(curve->boundingRect());
 #ifdef  USE_WIDGET_MUTEX
 	mutex->unlock();
 #endif
@@ -612,6 +804,8 @@ void PoincareData::updateData(int channel, double zoomx, double zoomy, bool free
 
 void PoincareData::show()
 {
+	curve->clear();
+	lastReadPos = -1;
 	curve->show();
 }
 
@@ -619,4 +813,3 @@ void PoincareData::hide()
 {
 	curve->hide();
 }
-
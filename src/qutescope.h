@@ -77,6 +77,8 @@ protected:
     QComboBox *triggerBox;
 	QDoubleSpinBox *zoomxBox;
 	QDoubleSpinBox *zoomyBox;
+	QDoubleSpinBox *persistenceBox;
+	QLineEdit *sourceEdit;
 	ScopeParams *m_params;
 	DataDisplay *m_dataDisplay;
 	ScopeData *m_scopeData;
@@ -89,6 +91,7 @@ protected:
 
 private:
 	void updateLabel();
+	void updateTap();
 
 public slots:
 	void updateData();
@@ -145,6 +148,8 @@ public:
 		this->width = width;
 		this->height = height;
         this->triggerMode = TriggerMode::NoTrigger;
+		this->persistence = 0.85;
+		this->tap = nullptr;
 	}
 	void setWidth(int width)
 	{
@@ -162,30 +167,41 @@ public:
 	int width;
 	int height;
     TriggerMode triggerMode;
+	double persistence;  // Decay of the raster displays (Lissajou and Poincare)
+	AudioTap *tap;  // Source other than the output, nullptr for the output
 };
 
 
 //
-// A custom QGraphicsItem to display sets of points
+// A custom QGraphicsItem which accumulates points into an image. On every
+// frame what was drawn before is faded, like the phosphor of an analog scope,
+// so the cost per frame is one pass over the image plus one pixel write per
+// point, whatever the number of points.
 //
-class ScopeItem : public QGraphicsItem
+class PersistenceItem : public QGraphicsItem
 {
 public:
-	ScopeItem(int width, int height);
+	PersistenceItem(int width, int height);
 	QRectF boundingRect() const
 	{
 		return QRectF(-m_width/2, -m_height/2, m_width, m_height);
 	}
 	void paint(QPainter *p, const QStyleOptionGraphicsItem *option, QWidget *widget);
-	void setPen(const QPen & pen);
-	void setPolygon(const QPolygonF & polygon);
+	void setColor(const QColor & color);
+	void setDecay(double decay);  // Brightness kept from one frame to the next, 0 to 1
 	void setSize(int width, int height);
+	void fade();
+	void plot(int x, int y);  // Coordinates relative to the center
+	void clear();
 
 protected:
 	int m_width;
 	int m_height;
-	QPen m_pen;
-	QPolygonF m_polygon;
+	QImage m_image;
+	quint32 *m_pixels;
+	int m_stride;  // In pixels
+	quint32 m_color;  // Premultiplied ARGB
+	int m_decay;  // 8 bit fixed point
 };
 
 
@@ -245,8 +261,8 @@ public:
 	virtual void hide();
 
 protected:
-	QPolygonF curveData;
-	ScopeItem *curve;
+	PersistenceItem *curve;
+	long lastReadPos;
 };
 
 
@@ -264,9 +280,8 @@ public:
 	virtual void hide();
 
 protected:
-	QPolygonF curveData;
-	ScopeItem *curve;
-	double lastValue;  // holds the last ordinate value to become abcsissa value of the next pass
+	PersistenceItem *curve;
+	long lastReadPos;
 };
 
 #endif
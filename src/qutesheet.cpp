@@ -148,6 +148,41 @@ bool QuteSheet::setText(QString new_data,
     return true;
 }
 
+QVector<double> QuteSheet::column(int column, int first, int count)
+{
+	if (m_sheet == 0) {
+		return QVector<double>();
+	}
+	return m_sheet->columnNumbers(column, first, count);
+}
+
+void QuteSheet::setColumn(int column, QVector<double> values, int first)
+{
+	if (m_sheet != 0) {
+		m_sheet->setColumnNumbers(column, values, first);
+	}
+}
+
+QList<int> QuteSheet::selectionRange()
+{
+	QList<int> range;
+	if (m_sheet != 0) {
+		QItemSelection selection = m_sheet->selectionModel()->selection();
+		int top = m_sheet->sheetModel()->rowCount(), left = m_sheet->sheetModel()->columnCount();
+		int bottom = -1, right = -1;
+		for (int i = 0; i < selection.size(); i++) {
+			top = qMin(top, selection[i].top());
+			left = qMin(left, selection[i].left());
+			bottom = qMax(bottom, selection[i].bottom());
+			right = qMax(right, selection[i].right());
+		}
+		if (bottom >= 0) {
+			range << top << left << bottom - top + 1 << right - left + 1;
+		}
+	}
+	return range;
+}
+
 QList<QList <QVariant> > QuteSheet::sort(QList<QList <QVariant> > vectors, int p_field)
 {
     (void) p_field;
@@ -76,6 +76,12 @@ public slots:
 				 int new_numRows = -1,
 				 int new_numCols = -1);
 
+	// Columns as lists of numbers, without going through text. Cells that
+	// are not numbers read as nan, and writing nan leaves a cell unchanged
+	QVector<double> column(int column, int first = 0, int count = -1);
+	void setColumn(int column, QVector<double> values, int first = 0);
+	QList<int> selectionRange();  // First row, first column, rows and columns
+
 	// Helper functions
 	QList<QList <QVariant> > sort(QList<QList <QVariant> > vectors, int p_field = 2);
 	QList<QList <QVariant > > transpose(QList<QList <QVariant > > mtx);
@@ -34,7 +34,7 @@
 
 enum QuteWidgetType { UNKNOWN=0, SPINBOX=1, LINEEDIT, CHECKBOX, SLIDER, KNOB, SCROLLNUMBER,
                       BUTTON, DROPDOWN, CONTROLLER, GRAPH, SCOPE, CONSOLE,
-                      TABLEDISPLAY };
+                      TABLEDISPLAY, METERBANK };
 
 class QuteWidget : public QWidget
 {
@@ -0,0 +1,300 @@
+#include "scorestreamer.h"
+#include "transportclock.h"
+
+#include <QObject>
+#include <QRegExp>
+#include <QStringList>
+#include <QThread>
+#include <QtConcurrent>
+#include <QtNumeric>
+
+#include <csPerfThread.hpp>
+
+#include <algorithm>
+
+ScoreStreamer::ScoreStreamer() :
+	m_perfThread(nullptr),
+	m_clock(nullptr),
+	m_stop(false),
+	m_lines(0),
+	m_last(0.0),
+	m_end(0.0)
+{
+}
+
+ScoreStreamer::~ScoreStreamer()
+{
+	stop();
+}
+
+void ScoreStreamer::start(const QString &score, CsoundPerformanceThread *perfThread,
+						  const TransportClock *clock)
+{
+	stop();
+	m_score = score;
+	m_perfThread = perfThread;
+	m_clock = clock;
+	m_stop = false;
+	m_window.clear();
+	m_window.reserve(QCS_SCORE_STREAM_WINDOW);
+	m_lines = 0;
+	m_last = 0.0;
+	m_end = 0.0;
+	m_future = QtConcurrent::run(this, &ScoreStreamer::run);
+}
+
+void ScoreStreamer::stop()
+{
+	m_stop = true;
+	m_future.waitForFinished();
+	m_score.clear();
+	m_window.clear();
+}
+
+bool ScoreStreamer::extractScore(QString *csd, QString *score, QString *reason)
+{
+	int start = csd->indexOf("<CsScore>");
+	int end = csd->indexOf("</CsScore>");
+	if (start < 0 || end < start) {
+		return false;  // No score, or one with a bin attribute
+	}
+	start += 9;
+	QString text = stripBlockComments(csd->mid(start, end - start));
+	if (text.trimmed().isEmpty()) {
+		return false;
+	}
+	QString problem = unsupported(text);
+	if (!problem.isEmpty()) {
+		if (reason != 0) {
+			*reason = problem;
+		}
+		return false;
+	}
+	*score = text;
+	csd->replace(start, end - start, "\nf0 z\n");
+	return true;
+}
+
+QString ScoreStreamer::stripBlockComments(const QString &score)
+{
+	QString text;
+	text.reserve(score.size());
+	int position = 0;
+	forever {
+		int open = score.indexOf("/*", position);
+		if (open < 0) {
+			text += score.midRef(position);
+			return text;
+		}
+		text += score.midRef(position, open - position);
+		int close = score.indexOf("*/", open + 2);
+		if (close < 0) {
+			return text;
+		}
+		// Keeps the lines it spans, so a comment still ends a statement
+		text += QString(score.midRef(open, close - open).count('\n'), '\n');
+		position = close + 2;
+	}
+}
+
+QString ScoreStreamer::unsupported(const QString &score)
+{
+	// Only what parseLine() places in time: i and f statements with every
+	// p-field written out
+	QRegExp fields("\"[^\"]*\"|[^\\s\"]+");
+	const QStringList lines = score.split('\n');
+	// Starts of the last QCS_SCORE_STREAM_WINDOW timed lines, by line count.
+	// run() can only sort a line among those, so one that starts before a
+	// line further back would be sent late
+	std::vector<double> starts;
+	qint64 timed = 0;
+	double latest = -1.0;  // Latest start further back than the window
+	for (int n = 0; n < lines.size(); n++) {
+		QString line = lines[n];
+		int comment = line.indexOf(';');
+		if (comment >= 0) {
+			line.truncate(comment);
+		}
+		line = line.trimmed();
+		if (line.isEmpty()) {
+			continue;
+		}
+		if (line[0] == 'e') {
+			break;  // The rest is not played
+		}
+		if (line.contains('$') || line[0] == '#') {
+			return QObject::tr("line %1 uses macros").arg(n + 1);
+		}
+		if (line[0] != 'i' && line[0] != 'f') {
+			return QObject::tr("line %1 has a '%2' statement").arg(n + 1).arg(line[0]);
+		}
+		int position = 1;
+		int index = 0;
+		bool hasStart = false;
+		double start = 0.0;
+		while ((position = fields.indexIn(line, position)) >= 0) {
+			const QString field = fields.cap(0);
+			position += field.size();
+			if (++index == 2) {
+				start = qMax(field.toDouble(&hasStart), 0.0);  // As in parseLine()
+			}
+			if (field[0] == '"') {
+				continue;
+			}
+			if (field == "." || field == "+" || field == "!" || field == "<" || field == ">"
+					|| field == "~" || field.startsWith('^') || field.startsWith('[')
+					|| field.startsWith('@') || field.startsWith("np") || field.startsWith("pp")) {
+				return QObject::tr("line %1 has a '%2' p-field").arg(n + 1).arg(field);
+			}
+		}
+		if (!hasStart) {
+			continue;
+		}
+		if (starts.empty()) {
+			starts.assign(QCS_SCORE_STREAM_WINDOW, 0.0);
+		}
+		double &slot = starts[timed % QCS_SCORE_STREAM_WINDOW];
+		if (timed >= QCS_SCORE_STREAM_WINDOW) {
+			latest = qMax(latest, slot);
+		}
+		if (start < latest) {
+			return QObject::tr("line %1 starts before an event more than %2 events above it")
+					.arg(n + 1).arg(QCS_SCORE_STREAM_WINDOW);
+		}
+		slot = start;
+		timed++;
+	}
+	return QString();
+}
+
+bool ScoreStreamer::later(const Event &a, const Event &b)
+{
+	return a.time != b.time ? a.time > b.time : a.order > b.order;
+}
+
+void ScoreStreamer::run()
+{
+	int position = 0;
+	const int size = m_score.size();
+	while (position < size && !m_stop) {
+		int next = m_score.indexOf('\n', position);
+		if (next < 0) {
+			next = size;
+		}
+		QString line = m_score.mid(position, next - position);
+		position = next + 1;
+		int comment = line.indexOf(';');
+		if (comment >= 0) {
+			line.truncate(comment);
+		}
+		line = line.trimmed();
+		if (line.isEmpty()) {
+			continue;
+		}
+		if (line[0] == 'e') {
+			break;
+		}
+		Event event;
+		if (!parseLine(line, &event)) {
+			continue;
+		}
+		m_window.push_back(event);
+		std::push_heap(m_window.begin(), m_window.end(), later);
+		if (m_window.size() >= QCS_SCORE_STREAM_WINDOW) {
+			std::pop_heap(m_window.begin(), m_window.end(), later);
+			if (!waitFor(m_window.back().time)) {
+				return;
+			}
+			send(m_window.back());
+			m_window.pop_back();
+		}
+	}
+	while (!m_window.empty() && !m_stop) {
+		std::pop_heap(m_window.begin(), m_window.end(), later);
+		if (!waitFor(m_window.back().time)) {
+			return;
+		}
+		send(m_window.back());
+		m_window.pop_back();
+	}
+	// Ends the performance as the compiled score would have, unless a note
+	// is held
+	if (!m_stop && qIsFinite(m_end) && waitFor(m_end)) {
+		double now = m_clock->position() / m_clock->sampleRate();
+		m_perfThread->InputMessage(QString("e %1").arg(qMax(m_end - now, 0.0), 0, 'f', 6)
+								   .toLatin1().constData());
+	}
+}
+
+bool ScoreStreamer::parseLine(const QString &line, Event *event)
+{
+	static const QRegExp fields("^([a-zA-Z])\\s*(\\S+)\\s+(\\S+)(.*)$");
+	event->order = m_lines++;
+	event->event = ScheduledEvent::fromLine(line);
+	double start = 0.0, duration = 0.0;
+	bool timed = false;
+	if (event->event.line.isEmpty()) {
+		start = event->event.pfields[1];
+		duration = event->event.pfields.size() > 2 ? event->event.pfields[2] : 0.0;
+		timed = true;
+	}
+	else {
+		QRegExp match(fields);
+		if (match.indexIn(line) == 0) {
+			start = match.cap(3).toDouble(&timed);
+			QStringList rest = match.cap(4).split(QRegExp("\\s+"), SKIP_EMPTY_PARTS);
+			if (!rest.isEmpty()) {
+				duration = rest[0].toDouble();
+			}
+		}
+		if (timed) {
+			event->event.head = (match.cap(1) + " " + match.cap(2)).toLatin1();
+			event->event.tail = match.cap(4).trimmed().toLatin1();
+			event->event.line.clear();
+		}
+	}
+	if (!timed) {
+		// Sent as it is, in its place among the lines around it
+		event->time = m_last;
+		return true;
+	}
+	event->time = qMax(start, 0.0);
+	m_last = event->time;
+	if (event->event.type == 'i' && duration < 0) {
+		m_end = qInf();  // Held until turned off
+	}
+	else {
+		m_end = qMax(m_end, event->time + qMax(duration, 0.0));
+	}
+	return true;
+}
+
+bool ScoreStreamer::waitFor(double time)
+{
+	while (!m_stop) {
+		double wait = time - QCS_SCORE_STREAM_LOOKAHEAD - m_clock->position() / m_clock->sampleRate();
+		if (wait <= 0) {
+			return true;
+		}
+		QThread::msleep(qBound(1, int(wait * 1000), 50));
+	}
+	return false;
+}
+
+void ScoreStreamer::send(const Event &event)
+{
+	const ScheduledEvent &e = event.event;
+	if (!e.line.isEmpty()) {
+		m_perfThread->InputMessage(e.line.constData());
+	}
+	else if (e.head.isEmpty()) {
+		// p2 is the time in the score, the performance thread makes it relative
+		m_perfThread->ScoreEvent(1, e.type, e.pfields.size(), e.pfields.constData());
+	}
+	else {
+		double now = m_clock->position() / m_clock->sampleRate();
+		QByteArray line = e.head + " " + QByteArray::number(qMax(event.time - now, 0.0), 'f', 6)
+				+ " " + e.tail;
+		m_perfThread->InputMessage(line.constData());
+	}
+}
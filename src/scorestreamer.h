@@ -0,0 +1,73 @@
+#ifndef SCORESTREAMER_H
+#define SCORESTREAMER_H
+
+#include <QFuture>
+#include <QString>
+
+#include <atomic>
+#include <vector>
+
+#include "eventscheduler.h"
+
+class CsoundPerformanceThread;
+class TransportClock;
+
+// Events parsed ahead of the performance, the reordering window of a
+// streamed score
+#define QCS_SCORE_STREAM_WINDOW 8192
+// Seconds of score sent to Csound before they are due
+#define QCS_SCORE_STREAM_LOOKAHEAD 1.0
+
+// Plays the score of a csd while it runs instead of having Csound compile
+// it up front, for generated scores of millions of events. A pool thread
+// reads the score text line by line and sends each event through the
+// performance thread when the engine gets within QCS_SCORE_STREAM_LOOKAHEAD
+// of its start, with p2 as an absolute time. Only QCS_SCORE_STREAM_WINDOW
+// parsed events are held at a time, in a heap by start time, so scores
+// that are in order within that window come out sorted. Scores that are
+// not, such as ones written voice by voice, are left to Csound to sort.
+// Numeric i and f lines are sent as binary events, other i and f lines
+// with a number for p2 as text. An e ends the performance after the last
+// note. Scores with anything else (t, s, r, loops, macros, carried,
+// relative or ramped p-fields ...) are not streamed; extractScore()
+// leaves them for Csound to compile.
+class ScoreStreamer
+{
+public:
+	ScoreStreamer();
+	~ScoreStreamer();
+	void start(const QString &score, CsoundPerformanceThread *perfThread,
+			   const TransportClock *clock);
+	void stop();  // Waits for the pool thread
+	// Replaces the <CsScore> section of csd with a score that keeps Csound
+	// running, and puts its text without block comments in score. False if
+	// csd has no score that can be streamed, with what stops it in reason
+	// if the score is not empty
+	static bool extractScore(QString *csd, QString *score, QString *reason = 0);
+
+private:
+	struct Event {
+		double time;
+		qint64 order;  // Line order, for events starting together
+		ScheduledEvent event;  // Text events get p2 written when sent
+	};
+	static bool later(const Event &a, const Event &b);
+	static QString stripBlockComments(const QString &score);
+	static QString unsupported(const QString &score);  // Empty if it can be streamed
+	void run();
+	bool parseLine(const QString &line, Event *event);
+	bool waitFor(double time);  // False if stopped
+	void send(const Event &event);
+
+	QString m_score;
+	CsoundPerformanceThread *m_perfThread;
+	const TransportClock *m_clock;
+	std::atomic<bool> m_stop;
+	QFuture<void> m_future;
+	std::vector<Event> m_window;  // Heap, owned by the pool thread
+	qint64 m_lines;
+	double m_last;  // Start of the last timed line
+	double m_end;  // End of the last note
+};
+
+#endif // SCORESTREAMER_H
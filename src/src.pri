@@ -24,28 +24,36 @@ FORMS = "src/about.ui" \
     src/html5guidisplay.ui
 
 HEADERS = "src/about.h" \
+    "src/audiotaps.h" \
+    "src/completionindex.h" \
     "src/configdialog.h" \
     "src/configlists.h" \
     "src/console.h" \
     "src/csoundengine.h" \
     "src/csoundoptions.h" \
     "src/curve.h" \
+    "src/directorymenu.h" \
     "src/dockhelp.h" \
+    "src/documentmodel.h" \
     "src/documentpage.h" \
     "src/documentview.h" \
     "src/dotgenerator.h" \
+    "src/eventscheduler.h" \
     "src/eventsheet.h" \
+    "src/eventsheetmodel.h" \
     "src/findreplace.h" \
     "src/framewidget.h" \
     "src/graphicwindow.h" \
     "src/highlighter.h" \
     "src/inspector.h" \
     "src/keyboardshortcuts.h" \
+    "src/liveevaluator.h" \
     "src/liveeventcontrol.h" \
     "src/liveeventframe.h" \
     "src/node.h" \
     "src/opentryparser.h" \
     "src/options.h" \
+    "src/outputlevels.h" \
     "src/qutebutton.h" \
     "src/qutecheckbox.h" \
     "src/qutecombobox.h" \
@@ -55,12 +63,16 @@ HEADERS = "src/about.h" \
     "src/qutegraph.h" \
     "src/quteknob.h" \
     "src/qutemeter.h" \
+    "src/qutemeterbank.h" \
     "src/qutescope.h" \
     "src/quteslider.h" \
     "src/qutespinbox.h" \
     "src/qutetext.h" \
     "src/qutewidget.h" \
+    "src/startuptrace.h" \
+    "src/tablewatch.h" \
     "src/texteditor.h" \
+    "src/transportclock.h" \
     "src/types.h" \
     "src/utilitiesdialog.h" \
     "src/widgetlayout.h" \
@@ -74,6 +86,7 @@ HEADERS = "src/about.h" \
     "src/pluginspage.h" \
     "src/additionalfilespage.h" \
     "src/scoreeditor.h" \
+    "src/scorestreamer.h" \
     "src/filebeditor.h" \
     $$PWD/risset.h \
     $$PWD/selectcolorbutton.h \
@@ -85,29 +98,37 @@ HEADERS = "src/about.h" \
     #$$PWD/CsoundHtmlOnlyWrapper.h
 
 SOURCES = "src/about.cpp" \
+    "src/audiotaps.cpp" \
+    "src/completionindex.cpp" \
     "src/configdialog.cpp" \
     "src/configlists.cpp" \
     "src/console.cpp" \
     "src/csoundengine.cpp" \
     "src/csoundoptions.cpp" \
     "src/curve.cpp" \
+    "src/directorymenu.cpp" \
     "src/dockhelp.cpp" \
+    "src/documentmodel.cpp" \
     "src/documentpage.cpp" \
     "src/documentview.cpp" \
     "src/dotgenerator.cpp" \
+    "src/eventscheduler.cpp" \
     "src/eventsheet.cpp" \
+    "src/eventsheetmodel.cpp" \
     "src/findreplace.cpp" \
     "src/framewidget.cpp" \
     "src/graphicwindow.cpp" \
     "src/highlighter.cpp" \
     "src/inspector.cpp" \
     "src/keyboardshortcuts.cpp" \
+    "src/liveevaluator.cpp" \
     "src/liveeventcontrol.cpp" \
     "src/liveeventframe.cpp" \
     "src/main.cpp" \
     "src/node.cpp" \
     "src/opentryparser.cpp" \
     "src/options.cpp" \
+    "src/outputlevels.cpp" \
     "src/qutebutton.cpp" \
     "src/qutecheckbox.cpp" \
     "src/qutecombobox.cpp" \
@@ -117,12 +138,16 @@ SOURCES = "src/about.cpp" \
     "src/qutegraph.cpp" \
     "src/quteknob.cpp" \
     "src/qutemeter.cpp" \
+    "src/qutemeterbank.cpp" \
     "src/qutescope.cpp" \
     "src/quteslider.cpp" \
     "src/qutespinbox.cpp" \
     "src/qutetext.cpp" \
     "src/qutewidget.cpp" \
+    "src/startuptrace.cpp" \
+    "src/tablewatch.cpp" \
     "src/texteditor.cpp" \
+    "src/transportclock.cpp" \
     "src/utilitiesdialog.cpp" \
     "src/widgetlayout.cpp" \
     "src/widgetpanel.cpp" \
@@ -135,6 +160,7 @@ SOURCES = "src/about.cpp" \
     "src/pluginspage.cpp" \
     "src/additionalfilespage.cpp" \
     "src/scoreeditor.cpp" \
+    "src/scorestreamer.cpp" \
     "src/filebeditor.cpp" \
     $$PWD/risset.cpp \
     $$PWD/selectcolorbutton.cpp \
@@ -0,0 +1,38 @@
+#include "startuptrace.h"
+
+#include <QElapsedTimer>
+#include <QTextStream>
+
+static QElapsedTimer startupTimer;
+static qint64 lastMarkNs = 0;
+static bool traceEnabled = false;
+
+void StartupTrace::start()
+{
+    startupTimer.start();
+    lastMarkNs = 0;
+}
+
+void StartupTrace::setEnabled(bool enabled)
+{
+    traceEnabled = enabled;
+}
+
+bool StartupTrace::isEnabled()
+{
+    return traceEnabled;
+}
+
+void StartupTrace::mark(const char *phase)
+{
+    if (!traceEnabled || !startupTimer.isValid()) {
+        return;
+    }
+    qint64 now = startupTimer.nsecsElapsed();
+    QTextStream out(stdout);
+    out << QString("startup: %1 %2 ms (%3 ms total)")
+           .arg(QString::fromLatin1(phase), -18)
+           .arg((now - lastMarkNs) / 1.0e6, 8, 'f', 1)
+           .arg(now / 1.0e6, 0, 'f', 1) << endl;
+    lastMarkNs = now;
+}
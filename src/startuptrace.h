@@ -0,0 +1,16 @@
+#ifndef STARTUPTRACE_H
+#define STARTUPTRACE_H
+
+// Times the phases of startup, printed when CsoundQt is started with
+// --startup-trace. Each mark prints the time since the previous mark and
+// since start(), so cold start regressions can be measured.
+class StartupTrace
+{
+public:
+    static void start();  // At the top of main()
+    static void setEnabled(bool enabled);
+    static bool isEnabled();
+    static void mark(const char *phase);
+};
+
+#endif // STARTUPTRACE_H
@@ -0,0 +1,112 @@
+#include "tablewatch.h"
+
+TableWatch::TableWatch() :
+    m_csound(nullptr),
+    m_serial(0)
+{
+}
+
+void TableWatch::setCsound(CSOUND *csound)
+{
+    QMutexLocker locker(&m_mutex);
+    m_csound = csound;
+    m_tables.clear();
+}
+
+TableWatch::Entry *TableWatch::resolve(int tabnum)
+{
+    if (m_csound == nullptr || tabnum <= 0) {
+        return nullptr;
+    }
+    // Looked up every time: ftgen and ftfree can move or free a table at
+    // any point of the performance
+    MYFLT *data = nullptr;
+    int size = csoundGetTable(m_csound, &data, tabnum);
+    auto it = m_tables.find(tabnum);
+    if (size <= 0 || data == nullptr) {
+        if (it != m_tables.end()) {
+            m_tables.erase(it);
+        }
+        return nullptr;
+    }
+    if (it != m_tables.end()) {
+        Entry *entry = &it.value();
+        if (entry->data != data || entry->size != size) {
+            // A new table, readers start over
+            entry->data = data;
+            entry->size = size;
+            entry->version = ++m_serial;
+            entry->floor = entry->version;
+            entry->head = 0;
+            entry->count = 0;
+        }
+        return entry;
+    }
+    Entry entry;
+    entry.data = data;
+    entry.size = size;
+    entry.version = ++m_serial;
+    entry.floor = entry.version;
+    entry.head = 0;
+    entry.count = 0;
+    return &m_tables.insert(tabnum, entry).value();
+}
+
+bool TableWatch::view(int tabnum, int sinceVersion, TableView *out)
+{
+    QMutexLocker locker(&m_mutex);
+    Entry *entry = resolve(tabnum);
+    if (entry == nullptr) {
+        return false;
+    }
+    out->data = entry->data;
+    out->size = entry->size;
+    out->version = entry->version;
+    if (sinceVersion >= entry->version) {
+        out->dirtyStart = out->dirtyEnd = 0;
+        return true;
+    }
+    if (sinceVersion < entry->floor) { // Too old, we can't tell what changed
+        out->dirtyStart = 0;
+        out->dirtyEnd = entry->size;
+        return true;
+    }
+    int start = entry->size;
+    int end = 0;
+    for (int i = 0; i < entry->count; i++) {
+        const DirtyRange &range = entry->history[i];
+        if (range.version > sinceVersion) {
+            start = qMin(start, range.start);
+            end = qMax(end, range.end);
+        }
+    }
+    out->dirtyStart = qMin(start, end);
+    out->dirtyEnd = qMin(end, entry->size);
+    return true;
+}
+
+void TableWatch::markDirty(int tabnum, int start, int end)
+{
+    QMutexLocker locker(&m_mutex);
+    Entry *entry = resolve(tabnum);
+    if (entry == nullptr) {
+        return;
+    }
+    if (end < 0) {
+        start = 0;
+        end = entry->size;
+    }
+    start = qBound(0, start, entry->size);
+    end = qBound(start, end, entry->size);
+    entry->version = ++m_serial;
+    DirtyRange &slot = entry->history[entry->head];
+    if (entry->count == QCS_TABLEWATCH_HISTORY) {
+        entry->floor = slot.version;
+    } else {
+        entry->count++;
+    }
+    slot.version = entry->version;
+    slot.start = start;
+    slot.end = end;
+    entry->head = (entry->head + 1) % QCS_TABLEWATCH_HISTORY;
+}
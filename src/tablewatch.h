@@ -0,0 +1,67 @@
+#ifndef TABLEWATCH_H
+#define TABLEWATCH_H
+
+#include <QHash>
+#include <QMutex>
+
+#include "types.h"
+
+// Number of dirty ranges remembered per table. Readers that fall further
+// behind than this get the whole table marked as dirty.
+#define QCS_TABLEWATCH_HISTORY 8
+
+// A snapshot of a watched table. data points directly into Csound's table
+// memory and is only valid while the engine that owns it is running.
+struct TableView {
+    MYFLT *data;
+    int size;
+    int version;
+    // Range changed since the version the reader passed in [start, end)
+    int dirtyStart;
+    int dirtyEnd;
+};
+
+// Maps table numbers to the memory returned by csoundGetTable so table
+// plots (QuteTable) can render straight from it instead of copying the
+// table on every update. Graph widgets still draw f-tables from the copy
+// in their Curve, as the graph callback hands over memory they could keep
+// past its lifetime. The pointer is looked up again on every call, and a
+// table that moved or changed size counts as changed everywhere. Whoever
+// knows a table has been written (the "@update" message of a table plot)
+// marks the changed range dirty, which bumps the table's version. Readers
+// remember the last version they drew and only redo the part that changed
+// since.
+class TableWatch
+{
+public:
+    TableWatch();
+
+    void setCsound(CSOUND *csound);  // nullptr drops every mapping (engine stopped)
+    bool view(int tabnum, int sinceVersion, TableView *out);
+    void markDirty(int tabnum, int start = 0, int end = -1);
+
+private:
+    struct DirtyRange {
+        int version;
+        int start;
+        int end;
+    };
+    struct Entry {
+        MYFLT *data;
+        int size;
+        int version;
+        int floor;  // Oldest version the history can still answer for
+        int head;
+        int count;
+        DirtyRange history[QCS_TABLEWATCH_HISTORY];
+    };
+
+    Entry *resolve(int tabnum);  // must be called with the lock held
+
+    CSOUND *m_csound;
+    int m_serial;  // Versions are unique across tables and runs
+    QHash<int, Entry> m_tables;
+    QMutex m_mutex;
+};
+
+#endif // TABLEWATCH_H
@@ -0,0 +1,288 @@
+#include "transportclock.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static const char *CHANNEL_NAMES[TransportClock::ChannelCount] = {
+	"_TransportPlaying",
+	"_TransportTempo",
+	"_TransportBeat",
+	"_TransportBar",
+	"_TransportBarBeat"
+};
+
+TransportClock::TransportClock() :
+	m_position(0),
+	m_sampleRate(44100),
+	m_state(nullptr)
+{
+	for (int i = 0; i < QCS_TRANSPORT_READERS; i++) {
+		m_readers[i].store(nullptr, std::memory_order_relaxed);
+	}
+	State *state = new State;
+	TempoChange change = {0.0, QCS_DEFAULT_TEMPO, 0.0};
+	state->tempoMap.append(change);
+	state->beatsPerBar = QCS_DEFAULT_BEATS_PER_BAR;
+	state->playing = true;
+	state->origin = 0;
+	state->stoppedBeat = 0.0;
+	state->generation = 0;
+	publish(state);
+}
+
+TransportClock::~TransportClock()
+{
+	qDeleteAll(m_retired);
+	delete current();
+}
+
+TransportClock::Reader::Reader(const TransportClock &clock)
+{
+	forever {
+		for (int i = 0; i < QCS_TRANSPORT_READERS; i++) {
+			const State *state = clock.m_state.load(std::memory_order_seq_cst);
+			const State *expected = nullptr;
+			if (clock.m_readers[i].compare_exchange_strong(expected, state)) {
+				// The state may have been replaced, and freed, before the slot
+				// held it. Once the slot holds the one that is current, it stays
+				const State *now;
+				while ((now = clock.m_state.load(std::memory_order_seq_cst)) != state) {
+					state = now;
+					clock.m_readers[i].store(state, std::memory_order_seq_cst);
+				}
+				m_slot = &clock.m_readers[i];
+				m_state = state;
+				return;
+			}
+		}
+	}
+}
+
+void TransportClock::reset(double sampleRate)
+{
+	m_sampleRate = sampleRate > 0 ? sampleRate : 44100;
+	m_position.store(0, std::memory_order_release);
+	State *state = newState();
+	state->playing = true;
+	state->origin = 0;
+	state->stoppedBeat = 0.0;
+	state->generation++;
+	publish(state);
+}
+
+void TransportClock::setPosition(qint64 samples)
+{
+	m_position.store(samples, std::memory_order_release);
+}
+
+void TransportClock::start()
+{
+	if (isPlaying()) {
+		return;
+	}
+	State *state = newState();
+	state->origin = position() - llround(secondsAt(state, state->stoppedBeat) * m_sampleRate);
+	state->playing = true;
+	state->generation++;
+	publish(state);
+}
+
+void TransportClock::stop()
+{
+	if (!isPlaying()) {
+		return;
+	}
+	State *state = newState();
+	state->stoppedBeat = beatAt(state, position());
+	state->playing = false;
+	state->generation++;
+	publish(state);
+}
+
+void TransportClock::locate(double beat)
+{
+	State *state = newState();
+	beat = qMax(beat, 0.0);
+	if (state->playing) {
+		state->origin = position() - llround(secondsAt(state, beat) * m_sampleRate);
+	}
+	else {
+		state->stoppedBeat = beat;
+	}
+	state->generation++;
+	publish(state);
+}
+
+void TransportClock::setTempo(double tempo, double beat)
+{
+	if (tempo <= 0) {
+		return;
+	}
+	State *state = newState();
+	if (beat < 0) {
+		beat = beatAt(state, position());
+	}
+	TempoChange change;
+	change.beat = qMax(beat, 0.0);
+	change.tempo = tempo;
+	change.seconds = secondsAt(state, change.beat);  // Before the map changes
+	QVector<TempoChange> &map = state->tempoMap;
+	// Changes at or after beat are replaced, so changes at the same beat
+	// merge, and one that keeps the tempo in effect adds nothing
+	while (map.size() > 1 && map.last().beat >= change.beat) {
+		map.removeLast();
+	}
+	if (map.last().beat >= change.beat) {
+		map.last() = change;  // The change at beat 0
+	}
+	else if (map.last().tempo != tempo) {
+		map.append(change);
+	}
+	else if (map.size() == current()->tempoMap.size()) {
+		delete state;  // Already at tempo from beat on
+		return;
+	}
+	publish(state);
+}
+
+void TransportClock::setBeatsPerBar(int beats)
+{
+	if (beats < 1 || beats == beatsPerBar()) {
+		return;
+	}
+	State *state = newState();
+	state->beatsPerBar = beats;
+	publish(state);
+}
+
+double TransportClock::tempoAt(double beat) const
+{
+	Reader state(*this);
+	return changeAtBeat(state.get(), beat).tempo;
+}
+
+double TransportClock::beatAt(qint64 sample) const
+{
+	Reader state(*this);
+	return beatAt(state.get(), sample);
+}
+
+qint64 TransportClock::sampleAt(double beat) const
+{
+	Reader state(*this);
+	return sampleAt(state.get(), beat);
+}
+
+qint64 TransportClock::nextBeat(qint64 sample, double quantum) const
+{
+	Reader state(*this);
+	const State *s = state.get();
+	if (!s->playing) {
+		return -1;
+	}
+	if (quantum <= 0) {
+		return sample;
+	}
+	// Beats are placed from their index, so rounding never accumulates
+	double index = floor(beatAt(s, sample) / quantum);
+	qint64 beatSample = sampleAt(s, index * quantum);
+	if (beatSample < sample) {
+		beatSample = sampleAt(s, (index + 1) * quantum);
+	}
+	return beatSample;
+}
+
+void TransportClock::channelValues(qint64 sample, double values[ChannelCount]) const
+{
+	Reader state(*this);
+	const State *s = state.get();
+	const double beat = beatAt(s, sample);
+	const double bar = floor(beat / s->beatsPerBar);
+	values[PlayingChannel] = s->playing ? 1.0 : 0.0;
+	values[TempoChannel] = changeAtBeat(s, beat).tempo;
+	values[BeatChannel] = beat;
+	values[BarChannel] = bar + 1;
+	values[BarBeatChannel] = beat - bar * s->beatsPerBar + 1;
+}
+
+const char *TransportClock::channelName(Channel channel)
+{
+	return CHANNEL_NAMES[channel];
+}
+
+int TransportClock::channelForName(const char *name)
+{
+	if (strncmp(name, "_Transport", 10) != 0) {
+		return -1;
+	}
+	for (int i = 0; i < ChannelCount; i++) {
+		if (strcmp(name, CHANNEL_NAMES[i]) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+TransportClock::State *TransportClock::newState() const
+{
+	return new State(*current());
+}
+
+void TransportClock::publish(State *state)
+{
+	const State *old = m_state.exchange(state, std::memory_order_seq_cst);
+	if (old != nullptr) {
+		m_retired.append(old);
+	}
+	for (int i = m_retired.size() - 1; i >= 0; i--) {
+		bool held = false;
+		for (int r = 0; r < QCS_TRANSPORT_READERS && !held; r++) {
+			held = m_readers[r].load(std::memory_order_seq_cst) == m_retired[i];
+		}
+		if (!held) {
+			delete m_retired.takeAt(i);
+		}
+	}
+}
+
+double TransportClock::beatAt(const State *state, qint64 sample) const
+{
+	if (!state->playing) {
+		return state->stoppedBeat;
+	}
+	return beatAtSeconds(state, (sample - state->origin) / m_sampleRate);
+}
+
+qint64 TransportClock::sampleAt(const State *state, double beat) const
+{
+	if (!state->playing) {
+		return -1;
+	}
+	return state->origin + llround(secondsAt(state, beat) * m_sampleRate);
+}
+
+const TransportClock::TempoChange &TransportClock::changeAtBeat(const State *state, double beat)
+{
+	const QVector<TempoChange> &map = state->tempoMap;
+	QVector<TempoChange>::const_iterator it =
+			std::upper_bound(map.constBegin(), map.constEnd(), beat,
+							 [](double b, const TempoChange &change) { return b < change.beat; });
+	return it == map.constBegin() ? map.first() : *(it - 1);
+}
+
+double TransportClock::secondsAt(const State *state, double beat)
+{
+	const TempoChange &change = changeAtBeat(state, beat);
+	return change.seconds + (beat - change.beat) * 60.0 / change.tempo;
+}
+
+double TransportClock::beatAtSeconds(const State *state, double seconds)
+{
+	const QVector<TempoChange> &map = state->tempoMap;
+	QVector<TempoChange>::const_iterator it =
+			std::upper_bound(map.constBegin(), map.constEnd(), seconds,
+							 [](double s, const TempoChange &change) { return s < change.seconds; });
+	const TempoChange &change = it == map.constBegin() ? map.first() : *(it - 1);
+	return change.beat + (seconds - change.seconds) * change.tempo / 60.0;
+}
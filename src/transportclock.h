@@ -0,0 +1,118 @@
+#ifndef TRANSPORTCLOCK_H
+#define TRANSPORTCLOCK_H
+
+#include <atomic>
+
+#include <QList>
+#include <QVector>
+#include <QtGlobal>
+
+#define QCS_DEFAULT_TEMPO 60.0
+#define QCS_DEFAULT_BEATS_PER_BAR 4
+// Threads that can read the transport at the same time
+#define QCS_TRANSPORT_READERS 8
+
+// Position of the running engine in samples, set before every control
+// pass, and the musical transport laid over it: a tempo map by beat, a
+// meter, and a play state that can be started, stopped and located.
+// Everything that plays in time (loops, delayed live events, quantized
+// code and scripts) places its events against this clock instead of a
+// wall clock timer, so what is timed from it stays locked to the audio
+// and to each other. The transport is also published to Csound on the
+// reserved channels of Channel.
+// The transport is changed from the GUI thread and read from any thread
+// without locks: each change publishes a new State. A reader marks the
+// state it uses in one of a few reader slots, and a replaced state is
+// freed by a later change once no slot holds it.
+class TransportClock
+{
+public:
+	enum Channel {
+		PlayingChannel = 0,  // _TransportPlaying, 1 while playing
+		TempoChannel,        // _TransportTempo, bpm
+		BeatChannel,         // _TransportBeat, beats from the start
+		BarChannel,          // _TransportBar, from 1
+		BarBeatChannel,      // _TransportBarBeat, beat in the bar from 1
+		ChannelCount
+	};
+
+	TransportClock();
+	~TransportClock();
+	// Call before performance starts. The transport plays from beat 0 and
+	// keeps its tempo map and meter
+	void reset(double sampleRate);
+	void setPosition(qint64 samples);  // Called from csThread
+	qint64 position() const { return m_position.load(std::memory_order_acquire); }
+	double sampleRate() const { return m_sampleRate; }
+	double samplesPerBeat(double tempo) const { return m_sampleRate * 60.0 / tempo; }
+
+	// GUI thread
+	void start();
+	void stop();
+	void locate(double beat);
+	// tempo from beat on, replacing the changes after it. From the current
+	// beat if beat is negative
+	void setTempo(double tempo, double beat = -1);
+	void setBeatsPerBar(int beats);
+
+	bool isPlaying() const { return Reader(*this)->playing; }
+	int beatsPerBar() const { return Reader(*this)->beatsPerBar; }
+	double tempoAt(double beat) const;
+	double beatAt(qint64 sample) const;  // Transport beat at an engine sample
+	qint64 sampleAt(double beat) const;  // -1 while stopped
+	// The first sample at or after sample on a multiple of quantum beats,
+	// -1 while stopped
+	qint64 nextBeat(qint64 sample, double quantum = 1.0) const;
+	// Changes with every start, stop and locate, for loops to realign
+	quint32 generation() const { return Reader(*this)->generation; }
+	// Every channel at sample, from the same state
+	void channelValues(qint64 sample, double values[ChannelCount]) const;
+	static const char *channelName(Channel channel);
+	static int channelForName(const char *name);  // -1 if not a transport channel
+
+private:
+	struct TempoChange {
+		double beat;
+		double tempo;
+		double seconds;  // Transport time at beat
+	};
+	struct State {
+		QVector<TempoChange> tempoMap;  // By beat, the first at beat 0
+		int beatsPerBar;
+		bool playing;
+		qint64 origin;  // Engine sample of beat 0 while playing
+		double stoppedBeat;
+		quint32 generation;
+	};
+	// Holds the current state in a reader slot while it is in scope
+	class Reader
+	{
+	public:
+		explicit Reader(const TransportClock &clock);
+		~Reader() { m_slot->store(nullptr, std::memory_order_release); }
+		const State *operator->() const { return m_state; }
+		const State *get() const { return m_state; }
+	private:
+		std::atomic<const State *> *m_slot;
+		const State *m_state;
+	};
+	// The writer's view, which only it can free
+	const State *current() const { return m_state.load(std::memory_order_relaxed); }
+	State *newState() const;  // Copy of the current state
+	void publish(State *state);  // Frees the states no reader holds
+	double beatAt(const State *state, qint64 sample) const;
+	qint64 sampleAt(const State *state, double beat) const;
+	static const TempoChange &changeAtBeat(const State *state, double beat);
+	static double secondsAt(const State *state, double beat);
+	static double beatAtSeconds(const State *state, double seconds);
+
+	std::atomic<qint64> m_position;
+	double m_sampleRate;
+	std::atomic<const State *> m_state;
+	mutable std::atomic<const State *> m_readers[QCS_TRANSPORT_READERS];
+	QList<const State *> m_retired;  // Replaced and not freed yet, GUI thread only
+
+	Q_DISABLE_COPY(TransportClock)
+};
+
+#endif // TRANSPORTCLOCK_H
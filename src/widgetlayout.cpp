@@ -37,6 +37,7 @@
 #include "quteconsole.h"
 #include "qutegraph.h"
 #include "qutescope.h"
+#include "qutemeterbank.h"
 #include "qutedummy.h"
 #include "framewidget.h"
 
@@ -48,6 +49,7 @@ WidgetLayout::WidgetLayout(QWidget* parent) : QWidget(parent)
     selectionFrame = new QRubberBand(QRubberBand::Rectangle, this);
     selectionFrame->hide();
     m_trackMouse = true;
+    m_outputLevels = nullptr;
     m_editMode = false;
     m_enableEdit = true;
     m_xmlFormat = true;
@@ -119,6 +121,9 @@ WidgetLayout::WidgetLayout(QWidget* parent) : QWidget(parent)
     createTableDisplayAct = new QAction(tr("Table Plot"), this);
     connect(createTableDisplayAct, SIGNAL(triggered()), this, SLOT(createNewTableDisplay()));
 
+    createMeterBankAct = new QAction(tr("Meter Bank"), this);
+    connect(createMeterBankAct, SIGNAL(triggered()), this, SLOT(createNewMeterBank()));
+
     propertiesAct = new QAction(tr("Properties"),this);
     connect(propertiesAct, SIGNAL(triggered()), this, SLOT(propertiesDialog()));
 
@@ -224,6 +229,7 @@ WidgetLayout::WidgetLayout(QWidget* parent) : QWidget(parent)
     m_widgetNameToType["BSBScope"] = QuteWidgetType::SCOPE;
     m_widgetNameToType["BSBConsole"] = QuteWidgetType::CONSOLE;
     m_widgetNameToType["BSBTableDisplay"] = QuteWidgetType::TABLEDISPLAY;
+    m_widgetNameToType["BSBMeterBank"] = QuteWidgetType::METERBANK;
 }
 
 WidgetLayout::~WidgetLayout()
@@ -750,6 +756,8 @@ int WidgetLayout::newXmlWidget(QDomNode mainnode, bool offset, bool newId)
         widget = static_cast<QuteWidget *>(w);
         connect(widget, SIGNAL(queueEventSignal(QString)),
                 this, SLOT(queueEvent(QString)));
+        connect(widget, SIGNAL(queueTemplateSignal(EventTemplate)),
+                this, SLOT(queueEvent(EventTemplate)));
         connect(widget, SIGNAL(newValue(QPair<QString,QString>)),
                 this, SLOT(newValue(QPair<QString,QString>)));
         connect(widget, SIGNAL(newValue(QPair<QString,double>)),
@@ -798,6 +806,12 @@ int WidgetLayout::newXmlWidget(QDomNode mainnode, bool offset, bool newId)
         widget = static_cast<QuteWidget *>(w);
         emit requestCsoundUserData(w);
     }
+    else if (type == "BSBMeterBank") {
+        auto w = new QuteMeterBank(this);
+        widget = static_cast<QuteWidget *>(w);
+        meterBankWidgets.append(w);
+        emit requestCsoundUserData(w);
+    }
     else {
         qDebug() << type << " not implemented";
         //    QuteDummy *w = new QuteDummy(this);
@@ -1541,6 +1555,24 @@ void WidgetLayout::refreshWidgets()
                 }
             }
         }
+        if (m_outputLevels != nullptr && m_outputLevels->isEnabled()) {
+            OutputLevels::Kind kind;
+            int channel;
+            QString ch1name = m_widgets[i]->getChannelName();
+            if (ch1name.startsWith("_Out")
+                    && OutputLevels::parseChannelName(ch1name.toLatin1().constData(), &kind, &channel)) {
+                m_widgets[i]->setValue(m_outputLevels->value(kind, channel));
+            }
+            QString ch2name = m_widgets[i]->getChannel2Name();
+            if (ch2name.startsWith("_Out")
+                    && OutputLevels::parseChannelName(ch2name.toLatin1().constData(), &kind, &channel)) {
+                m_widgets[i]->setValue2(m_outputLevels->value(kind, channel));
+            }
+        }
+    }
+    // Meter banks pull all their values at once and repaint in a single pass
+    for (int i = 0; i < meterBankWidgets.size(); i++) {
+        meterBankWidgets[i]->updateMeters(m_outputLevels);
     }
 }
 
@@ -1679,6 +1711,7 @@ void WidgetLayout::addCreateWidgetActionsToMenu(QMenu &menu) {
     menu.addAction(createGraphAct);
     menu.addAction(createScopeAct);
     menu.addAction(createTableDisplayAct);
+    menu.addAction(createMeterBankAct);
 }
 
 void WidgetLayout::createContextMenu(QContextMenuEvent *event)
@@ -2174,6 +2207,28 @@ QString WidgetLayout::createNewTableDisplay(int x, int y, QString channel)
     return uuid;
 }
 
+QString WidgetLayout::createNewMeterBank(int x, int y, QString channel)
+{
+    QString uuid;
+    bool dialog;
+    int posx = x >= 0 ? x : currentPosition.x();
+    int posy = y >= 0 ? y : currentPosition.y();
+    deselectAll();
+    if (channel.isEmpty()) {
+        channel = "_OutPeak";
+        dialog = true;
+    } else {
+        dialog = false;
+    }
+    uuid = createMeterBank(posx, posy, 160, 120, channel);
+    widgetChanged();
+    if (dialog && getOpenProperties()) {
+        m_widgets.last()->openProperties();
+    }
+    markHistory();
+    return uuid;
+}
+
 QString WidgetLayout::createNewScope(int x, int y, QString channel)
 {
     QString uuid;
@@ -2222,6 +2277,7 @@ void WidgetLayout::clearWidgetLayout()
     consoleWidgets.clear();
     graphWidgets.clear();
     scopeWidgets.clear();
+    meterBankWidgets.clear();
     widgetsMutex.unlock();
 }
 
@@ -3155,6 +3211,7 @@ QString WidgetLayout::createButton(int x, int y, int width, int height, QString
         widget->setProperty("QCS_eventLine", quoteParts[6]);
     }
     connect(widget, SIGNAL(queueEventSignal(QString)), this, SLOT(queueEvent(QString)));
+    connect(widget, SIGNAL(queueTemplateSignal(EventTemplate)), this, SLOT(queueEvent(EventTemplate)));
     connect(widget, SIGNAL(newValue(QPair<QString,QString>)),
             this, SLOT(newValue(QPair<QString,QString>)));
     connect(widget, SIGNAL(newValue(QPair<QString,double>)), this, SLOT(newValue(QPair<QString,double>)));
@@ -3406,6 +3463,22 @@ QString WidgetLayout::createTableDisplay(int x, int y, int width, int height, QS
     return widget->getUuid();
 }
 
+QString WidgetLayout::createMeterBank(int x, int y, int width, int height, QString channel) {
+
+    QuteMeterBank *widget = new QuteMeterBank(this);
+    widget->setProperty("QCS_x", x);
+    widget->setProperty("QCS_y", y);
+    widget->setProperty("QCS_width", width);
+    widget->setProperty("QCS_height", height);
+    widget->setProperty("QCS_objectName", channel);
+
+    emit requestCsoundUserData(widget);
+    meterBankWidgets.append(widget);
+    registerWidget(widget);
+    widget->applyInternalProperties();
+    return widget->getUuid();
+}
+
 void WidgetLayout::setBackground(bool bg, QColor bgColor)
 {
     QWidget *w;
@@ -3985,6 +4058,9 @@ void WidgetLayout::deleteWidget(QuteWidget *widget)
     index = scopeWidgets.indexOf(dynamic_cast<QuteScope *>(widget));
     if (index >= 0)
         scopeWidgets.remove(index);
+    index = meterBankWidgets.indexOf(dynamic_cast<QuteMeterBank *>(widget));
+    if (index >= 0)
+        meterBankWidgets.remove(index);
     m_activeWidgets = m_widgets.size();  // Allow all widgets again
     widgetsMutex.unlock();
     widgetChanged(widget);
@@ -4154,6 +4230,15 @@ void WidgetLayout::queueEvent(QString eventLine)
     emit queueEventSignal(eventLine);
 }
 
+void WidgetLayout::queueEvent(const EventTemplate &eventTemplate)
+{
+    QVector<double> values(eventTemplate.channels.size());
+    for (int i = 0; i < values.size(); i++) {
+        values[i] = getValueForChannel(eventTemplate.channels[i]);
+    }
+    emit queueScheduledEventSignal(eventTemplate.fill(values));
+}
+
 void WidgetLayout::duplicate()
 {
     if(!m_editMode)
@@ -30,11 +30,13 @@
 
 #include "qutewidget.h"
 #include "curve.h"
+#include "outputlevels.h"
 #include "widgetpreset.h"
 
 class QuteConsole;
 class QuteGraph;
 class QuteScope;
+class QuteMeterBank;
 class QuteButton;
 class FrameWidget;
 class QuteTable;
@@ -88,6 +90,7 @@ public:
 	int getMouseRelY();
 	int getMouseBut1();
 	int getMouseBut2();
+	void setOutputLevels(OutputLevels *levels) { m_outputLevels = levels; }
 	void setWidgetProperty(QString widgetid, QString property, QVariant value);
 	QVariant getWidgetProperty(QString widgetid, QString property);
 	void flush();
@@ -179,6 +182,7 @@ public:
 	QAction *createGraphAct;
 	QAction *createScopeAct;
     QAction *createTableDisplayAct;
+    QAction *createMeterBankAct;
 
 	// Alignment Actions
 	QAction *alignLeftAct;
@@ -226,6 +230,7 @@ public slots:
 	QString createNewGraph(int x = -1, int y = -1, QString channel = QString());
 	QString createNewScope(int x = -1, int y = -1, QString channel = QString());
     QString createNewTableDisplay(int x= -1, int y= -1, QString channel = QString());
+    QString createNewMeterBank(int x= -1, int y= -1, QString channel = QString());
 
 	void clearWidgets();
 	void clearWidgetLayout();
@@ -299,6 +304,7 @@ public slots:
 	void newValue(QPair<QString, QString> channelValue);
 	void processNewValues();
 	void queueEvent(QString eventLine);
+	void queueEvent(const EventTemplate &eventTemplate);  // Slots take widget values
 
     void processUpdateCurve(Curve *curve);
 	// Messages
@@ -338,6 +344,7 @@ private:
 	bool m_repeatKeys;
 	bool m_xmlFormat;
 	bool m_trackMouse;
+	OutputLevels *m_outputLevels; // Engine metering for _Out* channels, owned by the engine
 	bool m_openProperties; // Open widget properties when creating widgets
 	bool m_enableEdit; // Enable editing and properties dialog
 	bool m_tooltips;  // Show widget tooltips
@@ -377,6 +384,7 @@ private:
 	QVector<QuteConsole *> consoleWidgets;
 	QVector<QuteGraph *> graphWidgets;
 	QVector<QuteScope *> scopeWidgets;
+	QVector<QuteMeterBank *> meterBankWidgets;
 	int m_activeWidgets; // Keeps a number of widgets that can be currently accessed by value callbacks (e.g. set to 0 during paste). This is done to avoid locking the callbacks, which are called from a realtime thread
 
 	int parseXmlNode(QDomNode node);
@@ -395,6 +403,7 @@ private:
 	QString createScope(int x, int y, int width, int height, QString widgetLine);
 	QString createDummy(int x, int y, int width, int height, QString widgetLine);
     QString createTableDisplay(int x, int y, int width, int height, QString widgetLine);
+    QString createMeterBank(int x, int y, int width, int height, QString channel);
 
 
 	void setBackground(bool bg, QColor bgColor);
@@ -431,6 +440,7 @@ signals:
 	void registerButton(QuteButton *button);
     void requestCsoundUserData(QuteWidget *widget);
     void queueEventSignal(QString eventLine);
+    void queueScheduledEventSignal(const ScheduledEvent &event);
 	void widgetSelectedSignal(QuteWidget *widget);
 	void widgetUnselectedSignal(QuteWidget *widget);
 	void showMidiLearn(QuteWidget *);